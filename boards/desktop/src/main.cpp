@@ -8,6 +8,7 @@
 #include "services/engine_manager.hpp"
 #include "services/log_manager.hpp"
 #include "services/preset_manager.hpp"
+#include "services/sample_cache.hpp"
 #include "services/state_manager.hpp"
 #include "services/clock_manager.hpp"
 #include "services/ui_manager.hpp"
@@ -35,6 +36,7 @@ int main(int argc, char* argv[])
       PresetManager::create_default,
       std::make_unique<RTAudioAudioManager>,
       ClockManager::create_default,
+      SampleCache::create_default,
       std::make_unique<GLFWUIManager>,
       PrOTTO1SerialController::make_or_emulator,
       EngineManager::create_default
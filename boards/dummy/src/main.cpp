@@ -8,6 +8,7 @@
 #include "services/engine_manager.hpp"
 #include "services/log_manager.hpp"
 #include "services/preset_manager.hpp"
+#include "services/sample_cache.hpp"
 #include "services/state_manager.hpp"
 #include "services/ui_manager.hpp"
 
@@ -38,6 +39,7 @@ int main(int argc, char* argv[])
                     PresetManager::create_default,
                     std::make_unique<AudioManager>,
                     ClockManager::create_default,
+                    SampleCache::create_default,
                     std::make_unique<DummyUIManager>,
                     std::make_unique<DummyController>,
                     EngineManager::create_default};
@@ -305,7 +305,7 @@ namespace otto::service::audio {
     float* outRData = (float*) jack_port_get_buffer(ports.outR, nframes);
     float* inData = (float*) jack_port_get_buffer(ports.input, nframes);
 
-    int ref_count = 0;
+    std::atomic_int ref_count = 0;
     auto in_buf = AudioBufferHandle(inData, nframes, ref_count);
     auto out_data =
       engines::process({in_buf,
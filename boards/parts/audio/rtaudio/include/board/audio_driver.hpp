@@ -1,12 +1,15 @@
 #pragma once
 
 #include <atomic>
+#include <cstdint>
 #include <optional>
 #include <string>
 #include <vector>
 
 #include "core/audio/midi.hpp"
+#include "core/audio/midi_input.hpp"
 #include "core/audio/processor.hpp"
+#include "core/audio/reblocker.hpp"
 #include "util/locked.hpp"
 
 #include <RtAudio.h>
@@ -18,6 +21,8 @@ namespace otto::services {
 
   struct RTAudioAudioManager final : AudioManager {
     RTAudioAudioManager();
+    /// Writes the profiler statistics to the `--profile-csv` file, if given
+    ~RTAudioAudioManager();
 
     template<typename Parser>
     void add_args(Parser& cli);
@@ -32,14 +37,47 @@ namespace otto::services {
   protected:
     int process(float* out_buf, float* in_buf, int nframes, double stream_time, RtAudioStreamStatus stream_status);
 
+    /// Process one block of `_buffer_size` frames through the engines
+    ///
+    /// \param in Mono input, or `nullptr` if input is disabled
+    void process_block(float* out_l, float* out_r, const float* in) noexcept;
+
     void init_audio();
     void init_midi();
 
+    /// Convert an RtMidi timestamp to a steady clock time in nanoseconds
+    ///
+    /// Called from the midi thread for each message, in order.
+    std::int64_t midi_timestamp(double delta_time) noexcept;
+
     RtAudio client;
     // optional is used to delay construction to the init phaase, where errros can be handled
     std::optional<RtMidiIn> midi_in = std::nullopt;
     std::optional<RtMidiOut> midi_out = std::nullopt;
     bool enable_input = true;
+    /// The stream is opened with `RTAUDIO_NONINTERLEAVED` if possible, so the engines can render directly into
+    /// the output buffer. Otherwise the output is rendered into `interleave_buf_` and interleaved from there.
+    bool interleaved_ = false;
+    /// Number of frames processed at most per call to {@ref Reblocker::process}, in blocks
+    static constexpr int max_chunk_blocks = 4;
+    std::optional<core::audio::Reblocker> reblocker_ = std::nullopt;
+    std::vector<float> interleave_buf_;
+    bool reported_reblocking_ = false;
+
+    int midi_stage_ = profiler().add_stage("midi");
+    int output_stage_ = profiler().add_stage("output");
+    /// File to write the profiler statistics to on exit. Empty to not write them
+    std::string profile_csv_;
+
+    /// Messages from the RtMidi callback to the audio thread
+    core::midi::MidiInputQueue midi_input_;
+    bool reported_midi_overflow_ = false;
+    /// Start of the last process call, in nanoseconds on the steady clock
+    std::int64_t last_buffer_start_ = 0;
+    /// Sum of the RtMidi timestamps, which are relative to the previous message
+    double midi_time_ = 0;
+    /// Steady clock time in seconds when `midi_time_` was 0
+    std::optional<double> midi_epoch_ = std::nullopt;
 
     int device_in_ = client.getDefaultInputDevice();
     int device_out_ = client.getDefaultOutputDevice();
@@ -51,6 +89,10 @@ namespace otto::services {
   {
     cli |= lyra::opt(device_in_, "input device")["--audio-in"]("The input device number");
     cli |= lyra::opt(device_out_, "output device")["--audio-out"]("The output device number");
+    cli |= lyra::opt(profile_csv_, "file")["--profile-csv"]("Write audio stage timings to this file on exit");
+    cli |= lyra::opt(realtime_config().cpu, "cpu")["--audio-cpu"]("Pin the audio thread to this cpu");
+    cli |= lyra::opt(realtime_config().lock_memory)["--mlock"](
+      "Lock the process memory into RAM. Needs CAP_IPC_LOCK or a large enough memlock limit");
   }
 #endif
 
@@ -1,12 +1,16 @@
 #include "board/audio_driver.hpp"
 
+#include <algorithm>
 #include <chrono>
+#include <cstdint>
+#include <fstream>
 #include <string>
 #include <vector>
 
 #include <fmt/format.h>
 
 #include "util/algorithm.hpp"
+#include "util/simd.hpp"
 
 #include "core/audio/processor.hpp"
 
@@ -21,6 +25,7 @@ namespace otto::services {
 
   RTAudioAudioManager::RTAudioAudioManager()
   {
+    realtime_config().enabled = true;
     init_audio();
     try {
       init_midi();
@@ -30,6 +35,22 @@ namespace otto::services {
     }
   }
 
+  RTAudioAudioManager::~RTAudioAudioManager()
+  {
+    if (client.isStreamOpen()) client.closeStream();
+    // midi_input_ is destroyed before midi_in
+    if (midi_in) midi_in->cancelCallback();
+    auto midi_stats = midi_input_.statistics();
+    if (midi_stats.dropped + midi_stats.overflowed > 0) {
+      LOGW("Midi input: {} messages received, {} unsupported messages dropped, {} lost to overflow",
+           midi_stats.received, midi_stats.dropped, midi_stats.overflowed);
+    }
+    if (profile_csv_.empty()) return;
+    std::ofstream file{profile_csv_};
+    profiler().write_csv(file);
+    LOGI("Wrote audio profile to {}", profile_csv_);
+  }
+
   void RTAudioAudioManager::log_devices()
   {
     LOGI("Avaliable RtAudio devices:");
@@ -67,6 +88,7 @@ namespace otto::services {
 
     RtAudio::StreamOptions options;
     options.flags = RTAUDIO_SCHEDULE_REALTIME;
+    if (!interleaved_) options.flags |= RTAUDIO_NONINTERLEAVED;
     options.numberOfBuffers = 1;
     options.streamName = "OTTO";
     unsigned buf_siz = _buffer_size;
@@ -81,6 +103,8 @@ namespace otto::services {
         this, &options);
       _buffer_size = buf_siz;
       buffer_pool().set_buffer_size(buf_siz);
+      reblocker_.emplace(buf_siz, max_chunk_blocks * buf_siz);
+      if (interleaved_) interleave_buf_.resize(2 * max_chunk_blocks * buf_siz);
       client.startStream();
       gam::sampleRate(samplerate());
     } catch (RtAudioError& e) {
@@ -89,6 +113,11 @@ namespace otto::services {
         // try again without an input
         enable_input = false;
         init_audio();
+      } else if (!interleaved_) {
+        LOGW("Could not open a non-interleaved stream. Trying again with interleaved output");
+        interleaved_ = true;
+        enable_input = true;
+        init_audio();
       } else {
         throw;
       }
@@ -116,18 +145,30 @@ namespace otto::services {
       }
     }
 
+    // Sysex does not fit in the input queue, and active sensing is not used. Clock messages are kept
+    midi_in->ignoreTypes(true, false, true);
     midi_in->setCallback(
       [](double timeStamp, std::vector<unsigned char>* message, void* userData) {
         auto& self = *static_cast<RTAudioAudioManager*>(userData);
-        try {
-          self.send_midi_event(core::midi::from_bytes(*message));
-        } catch (util::exception& e) {
-          LOGE("Error parsing midi: {}", e.what());
-        }
+        self.midi_input_.push(*message, self.midi_timestamp(timeStamp));
       },
       this);
   }
 
+  std::int64_t RTAudioAudioManager::midi_timestamp(double delta_time) noexcept
+  {
+    using namespace std::chrono;
+    double now = duration<double>(steady_clock::now().time_since_epoch()).count();
+    midi_time_ += delta_time;
+    // RtMidi only tells us the time since the previous message, so the message times are anchored to the
+    // steady clock on the first message, and again whenever they drift more than a buffer away from it.
+    double max_drift = double(_buffer_size) / _samplerate;
+    if (!midi_epoch_ || *midi_epoch_ + midi_time_ > now || now - (*midi_epoch_ + midi_time_) > max_drift) {
+      midi_epoch_ = now - midi_time_;
+    }
+    return std::int64_t((*midi_epoch_ + midi_time_) * 1e9);
+  }
+
   using clock = std::chrono::high_resolution_clock;
 
   int RTAudioAudioManager::process(float* out_data,
@@ -136,62 +177,116 @@ namespace otto::services {
                                    double stream_time,
                                    RtAudioStreamStatus stream_status)
   {
-    pre_process_tasks();
     auto running = this->running() && Application::current().running();
-    if (!running) {
+    if (!running || !reblocker_) {
+      pre_process_tasks();
+      std::fill_n(out_data, 2 * nframes, 0.f);
       return 0;
     }
 
-    if ((unsigned) nframes != _buffer_size) {
-      LOGE("RTAudio requested {} frames. expected {}", nframes, _buffer_size);
-      return 0;
+    if ((unsigned) nframes != _buffer_size && !reported_reblocking_) {
+      LOGW("RTAudio requested {} frames, expected {}. The audio will be re-blocked", nframes, _buffer_size);
+      reported_reblocking_ = true;
     }
 
     if (stream_status != 0) {
       LOGE("RTAudioStreamStatus == {:x}", stream_status);
+      if (stream_status & RTAUDIO_OUTPUT_UNDERFLOW) profiler().report_xrun();
     }
 
     clock::time_point t0 = clock::now();
 
-    midi_bufs.swap();
-
-    int ref_count = 0;
-    auto in_buf = enable_input ? core::audio::AudioBufferHandle(in_data, nframes, ref_count)
-                               : Application::current().audio_manager->buffer_pool().allocate_clear();
-    // steal the inner midi buffer
-    auto out = Application::current().engine_manager->process(
-      {in_buf, {std::move(midi_bufs.inner())}, core::clock::ClockRange{}});
-
-    core::audio::validate_audio(out.audio[0]);
-    core::audio::validate_audio(out.audio[1]);
+    const int max_chunk = max_chunk_blocks * _buffer_size;
+    auto block = [this](float* out_l, float* out_r, const float* in) { process_block(out_l, out_r, in); };
+    for (int done = 0; done < nframes;) {
+      int n = std::min(nframes - done, max_chunk);
+      const float* in = enable_input ? in_data + done : nullptr;
+      if (interleaved_) {
+        float* left = interleave_buf_.data();
+        float* right = interleave_buf_.data() + max_chunk;
+        reblocker_->process(left, right, in, n, block);
+        auto scope = profiler().scope(output_stage_);
+        util::simd::interleave(left, right, out_data + 2 * done, n);
+      } else {
+        reblocker_->process(out_data + done, out_data + nframes + done, in, n, block);
+      }
+      done += n;
+    }
+    profiler().end_block();
 
-    // process_audio_output(out);
+    clock::time_point t1 = clock::now();
 
-    LOGE_IF(out.nframes != nframes, "Frames went missing!");
+    _cpu_time.add(std::chrono::nanoseconds(t1 - t0).count() / (1e9 / float(_samplerate) * nframes));
 
-    // Separate channels
-    for (int i = 0; i < nframes; i++) {
-      out_data[i * 2] = out.audio[0][i];
-      out_data[i * 2 + 1] = out.audio[1][i];
-    }
+    return 0;
+  }
 
-    if (midi_out) {
-      for (auto& ev : out.midi) {
-        util::match(ev, [this](auto& ev) {
-          auto bytes = ev.to_bytes();
-          midi_out->sendMessage(bytes.data(), bytes.size());
-        });
+  void RTAudioAudioManager::process_block(float* out_l, float* out_r, const float* in) noexcept
+  {
+    pre_process_tasks();
+    const int nframes = _buffer_size;
+
+    {
+      auto scope = profiler().scope(midi_stage_);
+      midi_bufs.swap();
+      auto buffer_start =
+        std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch())
+          .count();
+      // Events are played in this buffer, at the offset they had into the previous one. This gives a
+      // constant latency of one buffer, instead of quantizing events to the buffer boundaries.
+      midi_input_.drain(last_buffer_start_, _samplerate, nframes,
+                        [this](core::midi::MidiMessage msg) { midi_bufs.inner().push(msg); });
+      last_buffer_start_ = buffer_start;
+      if (!reported_midi_overflow_ && midi_input_.statistics().overflowed > 0) {
+        LOGW("The midi input queue overflowed. Midi messages are being lost");
+        reported_midi_overflow_ = true;
       }
     }
 
-    // return the midi buffer
-    midi_bufs.inner() = out.midi.move_vector_out();
+    auto is_aligned = [](const float* ptr) {
+      return reinterpret_cast<std::uintptr_t>(ptr) % util::simd::vfloat::alignment == 0;
+    };
+
+    std::atomic_int ref_count = 0;
+    auto& pool = Application::current().audio_manager->buffer_pool();
+    // The graph never writes to its external input, so the device buffer is used directly when the aligned
+    // SIMD loads of the nodes can read it. The input of a re-blocked callback generally is not aligned.
+    auto in_buf = [&] {
+      if (in == nullptr) return pool.allocate_clear();
+      if (is_aligned(in)) return core::audio::AudioBufferHandle(const_cast<float*>(in), nframes, ref_count);
+      auto res = pool.allocate();
+      std::copy_n(in, nframes, res.begin());
+      return res;
+    }();
+    core::audio::ProcessData<1> external_in = {in_buf, midi_bufs.inner(), core::clock::ClockRange{}};
+    std::array<core::audio::AudioBufferHandle, 2> out_bufs = {
+      core::audio::AudioBufferHandle(out_l, nframes, ref_count),
+      core::audio::AudioBufferHandle(out_r, nframes, ref_count),
+    };
+    auto out = [&] {
+      if (is_aligned(out_l) && is_aligned(out_r)) {
+        // Render the last stage of the graph directly into the output
+        return Application::current().engine_manager->process_into(std::move(external_in), out_bufs);
+      }
+      auto res = Application::current().engine_manager->process(std::move(external_in));
+      auto scope = profiler().scope(output_stage_);
+      std::copy_n(res.audio[0].begin(), nframes, out_l);
+      std::copy_n(res.audio[1].begin(), nframes, out_r);
+      return res;
+    }();
 
-    clock::time_point t1 = clock::now();
+    core::audio::validate_audio(out.audio[0]);
+    core::audio::validate_audio(out.audio[1]);
 
-    _cpu_time.add(std::chrono::nanoseconds(t1 - t0).count() / (1e9 / float(_samplerate) * nframes));
+    LOGE_IF(out.nframes != nframes, "Frames went missing!");
 
-    return 0;
+    auto scope = profiler().scope(midi_stage_);
+    if (midi_out) {
+      for (auto& msg : out.midi) {
+        auto bytes = out.midi.bytes(msg);
+        midi_out->sendMessage(bytes.data(), bytes.size());
+      }
+    }
   }
 } // namespace otto::services
 
@@ -0,0 +1,292 @@
+/// \file
+/// Headless offline renderer
+///
+/// Plays a standard MIDI file through the engines, with the engine state loaded from a state json file, and
+/// writes the result to a WAV file as fast as possible. Useful for throughput measurements, and for golden
+/// audio regression tests on machines without a sound card.
+///
+/// ```sh
+/// otto_exec --midi song.mid --state data/state.json --out song.wav [--threads 4]
+/// ```
+
+#include <chrono>
+#include <cmath>
+#include <fstream>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <AudioFile.h>
+#include <Gamma/Domain.h>
+#include <lyra/lyra.hpp>
+
+#include "core/audio/midi_buffer.hpp"
+#include "core/audio/midi_file.hpp"
+
+#include "services/audio_manager.hpp"
+#include "services/clock_manager.hpp"
+#include "services/controller.hpp"
+#include "services/engine_manager.hpp"
+#include "services/log_manager.hpp"
+#include "services/preset_manager.hpp"
+#include "services/sample_cache.hpp"
+#include "services/state_manager.hpp"
+#include "services/ui_manager.hpp"
+
+#include "util/jsonfile.hpp"
+
+using namespace otto;
+using namespace otto::services;
+
+int handle_exception(const char* e);
+int handle_exception(std::exception& e);
+int handle_exception();
+
+struct Options {
+  std::string midi_file;
+  std::string state_file;
+  std::string out_file = "render.wav";
+  int samplerate = 48000;
+  int buffer_size = 256;
+  int bit_depth = 24;
+  /// Seconds to keep rendering after the last MIDI event, for release tails and effects
+  double tail = 2;
+  int threads = 1;
+  std::string profile_csv;
+};
+
+/// Loads the state from a given file, and never writes it back
+struct RenderStateManager final : StateManager {
+  RenderStateManager(std::string path) : path_(std::move(path))
+  {
+    Application::current().events.post_init.connect([this] { load(); });
+  }
+
+  void load() override
+  {
+    if (!path_.empty()) {
+      util::JsonFile file{path_};
+      file.read();
+      data_ = file.data();
+    }
+    if (!data_.is_object()) data_ = nlohmann::json::object();
+
+    for (const auto& [name, client] : _clients) {
+      try {
+        client.load(data_[name]);
+      } catch (std::exception& e) {
+        LOGE("Exception while loading state for {}: {}", name, e.what());
+      }
+    }
+    _loaded = true;
+  }
+
+  void save() override {}
+
+  void attach(std::string name, Loader load, Saver save) override
+  {
+    _clients.insert_or_replace(name, Client{name, load, std::move(save)});
+    if (_loaded) load(data_[name]);
+  }
+
+  void detach(std::string name) override
+  {
+    _clients.erase_all(name);
+  }
+
+private:
+  std::string path_;
+  nlohmann::json data_ = nlohmann::json::object();
+};
+
+/// Drives the engines directly, without an audio device
+struct OfflineAudioManager final : AudioManager {
+  OfflineAudioManager(const Options& opts)
+  {
+    _samplerate = opts.samplerate;
+    _buffer_size = opts.buffer_size;
+    buffer_pool().set_buffer_size(opts.buffer_size);
+    gam::sampleRate(opts.samplerate);
+    // Flush denormals like the audio thread of a device does, but there are no deadlines to lock memory for
+    realtime_config().enabled = true;
+    realtime_config().lock_memory = false;
+  }
+
+  /// The number of frames {@ref render} produces for `midi`
+  static long length(const core::midi::MidiFile& midi, const Options& opts)
+  {
+    return std::ceil((midi.duration + opts.tail) * opts.samplerate);
+  }
+
+  /// Render the whole file. Returns the left and right channels.
+  std::array<std::vector<float>, 2> render(const core::midi::MidiFile& midi, const Options& opts)
+  {
+    const long total = length(midi, opts);
+    const int bs = buffer_size();
+    std::array<std::vector<float>, 2> res;
+    for (auto& ch : res) ch.reserve(total + bs);
+
+    auto next = midi.messages.begin();
+    core::midi::MidiBuffer events;
+    for (long start = 0; start < total; start += bs) {
+      pre_process_tasks();
+      events.clear();
+      for (; next != midi.messages.end() && long(next->time * opts.samplerate) < start + bs; ++next) {
+        long frame = std::max(0L, long(next->time * opts.samplerate) - start);
+        events.push(next->bytes, frame);
+      }
+      auto in = buffer_pool().allocate_clear();
+      core::audio::ProcessData<1> data = {in, events, core::clock::ClockRange{}};
+      auto out = Application::current().engine_manager->process(std::move(data));
+      for (int c = 0; c < 2; c++) res[c].insert(res[c].end(), out.audio[c].begin(), out.audio[c].end());
+      profiler().end_block();
+      buffer_pool().maintain();
+    }
+    for (auto& ch : res) ch.resize(total);
+    return res;
+  }
+};
+
+struct DummyUIManager final : UIManager {
+  DummyUIManager() = default;
+
+  void main_ui_loop() override {}
+};
+
+struct DummyController final : Controller {
+  void set_color(LED, LEDColor) override{};
+  void flush_leds() override {}
+  void clear_leds() override {}
+};
+
+/// Render one session. Returns the process exit code.
+int render_session(int argc, char* argv[], const Options& opts, const std::string& out_file)
+{
+  try {
+    auto midi = opts.midi_file.empty() ? core::midi::MidiFile() : core::midi::MidiFile::read(opts.midi_file);
+
+    Application app{[&] { return std::make_unique<LogManager>(argc, argv); },
+                    [&] { return std::make_unique<RenderStateManager>(opts.state_file); },
+                    PresetManager::create_default,
+                    [&] { return std::make_unique<OfflineAudioManager>(opts); },
+                    ClockManager::create_default,
+                    SampleCache::create_default,
+                    std::make_unique<DummyUIManager>,
+                    std::make_unique<DummyController>,
+                    EngineManager::create_default};
+
+    app.engine_manager->start();
+    app.audio_manager->start();
+
+    auto t0 = std::chrono::steady_clock::now();
+    auto audio = static_cast<OfflineAudioManager&>(*app.audio_manager).render(midi, opts);
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - t0;
+
+    auto frames = audio[0].size();
+    LOGI("Rendered {} frames in {:.3f}s: {:.0f} frames/sec, {:.1f}x realtime", frames, elapsed.count(),
+         frames / elapsed.count(), frames / elapsed.count() / opts.samplerate);
+
+    AudioFile<float> file;
+    file.setSampleRate(opts.samplerate);
+    file.setBitDepth(opts.bit_depth);
+    file.samples = {std::move(audio[0]), std::move(audio[1])};
+    if (!file.save(out_file)) {
+      LOGE("Could not write {}", out_file);
+      return 1;
+    }
+
+    if (!opts.profile_csv.empty()) {
+      std::ofstream csv{opts.profile_csv};
+      app.audio_manager->profiler().write_csv(csv);
+    }
+    app.exit(Application::ErrorCode::none);
+  } catch (const char* e) {
+    return handle_exception(e);
+  } catch (std::exception& e) {
+    return handle_exception(e);
+  } catch (...) {
+    return handle_exception();
+  }
+  return 0;
+}
+
+/// Render `opts.threads` sessions in parallel.
+///
+/// The services are process wide singletons, so each session is rendered in its own process.
+int render_parallel(int argc, char* argv[], const Options& opts)
+{
+  auto stem = opts.out_file.substr(0, opts.out_file.rfind(".wav"));
+  auto t0 = std::chrono::steady_clock::now();
+  std::vector<pid_t> children;
+  for (int i = 0; i < opts.threads; i++) {
+    pid_t pid = fork();
+    if (pid == 0) _exit(render_session(argc, argv, opts, fmt::format("{}.{}.wav", stem, i)));
+    if (pid < 0) {
+      std::perror("fork");
+      break;
+    }
+    children.push_back(pid);
+  }
+  int result = 0;
+  for (auto pid : children) {
+    int status = 0;
+    waitpid(pid, &status, 0);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) result = 1;
+  }
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - t0;
+
+  auto midi = opts.midi_file.empty() ? core::midi::MidiFile() : core::midi::MidiFile::read(opts.midi_file);
+  double frames = double(OfflineAudioManager::length(midi, opts)) * children.size();
+  fmt::print("Rendered {} sessions in {:.3f}s: {:.0f} frames/sec in total, {:.1f}x realtime\n", children.size(),
+             elapsed.count(), frames / elapsed.count(), frames / elapsed.count() / opts.samplerate);
+  return result;
+}
+
+int main(int argc, char* argv[])
+{
+  Options opts;
+  bool show_help = false;
+  auto cli = lyra::cli_parser() | lyra::help(show_help);
+  cli |= lyra::opt(opts.midi_file, "file")["--midi"]("Standard MIDI file to play");
+  cli |= lyra::opt(opts.state_file, "file")["--state"]("State json to load the engines from");
+  cli |= lyra::opt(opts.out_file, "file")["-o"]["--out"]("WAV file to write");
+  cli |= lyra::opt(opts.samplerate, "hz")["--samplerate"]("Sample rate");
+  cli |= lyra::opt(opts.buffer_size, "frames")["--buffer-size"]("Frames per processed block");
+  cli |= lyra::opt(opts.bit_depth, "bits")["--bit-depth"]("WAV bit depth: 8, 16 or 24");
+  cli |= lyra::opt(opts.tail, "seconds")["--tail"]("Time to render after the last MIDI event");
+  cli |= lyra::opt(opts.threads, "n")["--threads"]("Render this many sessions in parallel, to <out>.<n>.wav");
+  cli |= lyra::opt(opts.profile_csv, "file")["--profile-csv"]("Write audio stage timings to this file");
+
+  auto parsed = cli.parse({argc, argv});
+  if (!parsed) {
+    std::cerr << parsed.errorMessage() << "\n" << cli << "\n";
+    return 1;
+  }
+  if (show_help) {
+    std::cout << cli << "\n";
+    return 0;
+  }
+
+  if (opts.threads > 1) return render_parallel(argc, argv, opts);
+  return render_session(argc, argv, opts, opts.out_file);
+}
+
+int handle_exception(const char* e)
+{
+  LOGE(e);
+  LOGE("Exception thrown, exitting!");
+  return 1;
+}
+
+int handle_exception(std::exception& e)
+{
+  LOGE(e.what());
+  LOGE("Exception thrown, exitting!");
+  return 1;
+}
+
+int handle_exception()
+{
+  LOGE("Unknown exception thrown, exitting!");
+  return 1;
+}
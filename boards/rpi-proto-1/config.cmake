@@ -2,3 +2,8 @@ otto_include_board(parts/ui/egl)
 otto_include_board(parts/audio/rtaudio)
 otto_include_board(parts/controller/toot-mcu-fifo)
 set(CMAKE_LINKER_FLAGS_RELEASE "${CMAKE_LINKER_FLAGS_RELEASE} -ffast-math -funsafe-math-optimizations -mfpu=neon-vfpv4")
+# The linker flags above do not reach the compiler. Without these, __ARM_NEON is not defined, and
+# util/simd.hpp falls back to the scalar backend. aarch64 always has NEON, and rejects -mfpu.
+if (CMAKE_SYSTEM_PROCESSOR MATCHES "^arm")
+  target_compile_options(otto PUBLIC -mfpu=neon-vfpv4 -mfloat-abi=hard)
+endif()
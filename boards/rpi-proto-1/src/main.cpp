@@ -1,11 +1,14 @@
 #include <csignal>
 
+#include <lyra/lyra.hpp>
+
 #include "core/audio/midi.hpp"
 
 #include "services/audio_manager.hpp"
 #include "services/engine_manager.hpp"
 #include "services/log_manager.hpp"
 #include "services/preset_manager.hpp"
+#include "services/sample_cache.hpp"
 #include "services/state_manager.hpp"
 #include "services/ui_manager.hpp"
 #include "services/clock_manager.hpp"
@@ -31,11 +34,17 @@ int main(int argc, char* argv[])
       PresetManager::create_default,
       std::make_unique<RTAudioAudioManager>,
       ClockManager::create_default,
+      SampleCache::create_default,
       std::make_unique<EGLUIManager>,
       McuFifoController::make_or_dummy,
       EngineManager::create_default
     };
 
+    auto cli = lyra::cli_parser();
+    RTAudioAudioManager::current().add_args(cli);
+
+    cli.parse({argc, argv});
+
     Controller::current().register_key_handler(Key::settings, [] (auto) {
       if (Controller::current().is_pressed(Key::shift)) {
         Application::current().exit(Application::ErrorCode::user_exit);
@@ -0,0 +1,210 @@
+#include "audio_buffer_pool.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <new>
+
+#include "util/realtime.hpp"
+
+namespace otto::core::audio {
+
+  namespace {
+    constexpr std::uint64_t index_mask = 0xFFFFFFFF;
+
+    /// Atomically set `a` to `max(a, val)`
+    void fetch_max(std::atomic_int& a, int val) noexcept
+    {
+      int cur = a.load(std::memory_order_relaxed);
+      while (cur < val && !a.compare_exchange_weak(cur, val, std::memory_order_relaxed))
+        ;
+    }
+
+    /// The number of floats between the starts of two buffers, so every buffer is aligned
+    std::size_t aligned_stride(std::size_t buffer_size) noexcept
+    {
+      constexpr auto floats = AudioBufferPool::alignment / sizeof(float);
+      return (buffer_size + floats - 1) / floats * floats;
+    }
+  } // namespace
+
+  AudioBufferPool::AudioBufferPool(std::size_t buffer_size, int capacity)
+    : buffer_size_(buffer_size),
+      stride_(aligned_stride(buffer_size))
+  {
+    reserve(capacity);
+    std::lock_guard lock(grow_lock_);
+    fill_reserve_locked();
+  }
+
+  AudioBufferPool::~AudioBufferPool() noexcept = default;
+
+  AudioBufferHandle AudioBufferPool::allocate() noexcept
+  {
+    int index = pop_free(free_head_);
+    if (index < 0) {
+      // Last resort. maintain() should normally have grown the pool long before this happens. The buffer joins the
+      // free list when it is released, and maintain() replaces it in the reserve.
+      index = pop_free(reserve_head_);
+      if (index < 0) {
+        LOGF("No free audio buffers found, and the emergency reserve of {} buffers is used up", emergency_reserve);
+        std::terminate();
+      }
+      reserve_count_.fetch_sub(1, std::memory_order_relaxed);
+      capacity_.fetch_add(1, std::memory_order_release);
+      emergency_allocations_.fetch_add(1, std::memory_order_relaxed);
+    }
+    fetch_max(peak_in_use_, in_use_.fetch_add(1, std::memory_order_relaxed) + 1);
+    block_allocations_.fetch_add(1, std::memory_order_relaxed);
+    auto& slot = slots_[index];
+    return {slot.data, buffer_size_, slot.reference_count, this, index};
+  }
+
+  void AudioBufferPool::free_buffer(int index) noexcept
+  {
+    in_use_.fetch_sub(1, std::memory_order_relaxed);
+    push_free(free_head_, index);
+  }
+
+  void AudioBufferPool::push_free(std::atomic<std::uint64_t>& list, int index) noexcept
+  {
+    auto head = list.load(std::memory_order_relaxed);
+    std::uint64_t next;
+    do {
+      slots_[index].next_free.store(int(head & index_mask) - 1, std::memory_order_relaxed);
+      next = ((head >> 32) + 1) << 32 | std::uint64_t(index + 1);
+    } while (!list.compare_exchange_weak(head, next, std::memory_order_release, std::memory_order_relaxed));
+  }
+
+  int AudioBufferPool::pop_free(std::atomic<std::uint64_t>& list) noexcept
+  {
+    auto head = list.load(std::memory_order_acquire);
+    while (true) {
+      int index = int(head & index_mask) - 1;
+      if (index < 0) return -1;
+      int next_free = slots_[index].next_free.load(std::memory_order_relaxed);
+      auto next = ((head >> 32) + 1) << 32 | std::uint64_t(next_free + 1);
+      if (list.compare_exchange_weak(head, next, std::memory_order_acquire)) return index;
+    }
+  }
+
+  int AudioBufferPool::grow_locked(int count, std::atomic<std::uint64_t>& list, std::atomic_int& counter)
+  {
+    int first = slots_used_;
+    count = std::min(count, max_capacity - first);
+    if (count <= 0) return 0;
+    auto floats = std::size_t(count) * stride_;
+    auto* chunk = static_cast<float*>(::operator new[](floats * sizeof(float), std::align_val_t(alignment)));
+    // Writing every page maps it now, instead of on the audio thread when the buffer is first used
+    std::fill_n(chunk, floats, 0.f);
+    chunks_.push_back({std::unique_ptr<float, AlignedDelete>(chunk), floats * sizeof(float)});
+    if (lock_memory_) {
+      if (int err = util::lock_range(chunk, floats * sizeof(float)); err != 0) {
+        LOGW("Could not lock {} new audio buffers into memory: {}", count, std::strerror(err));
+      }
+    }
+    for (int i = first; i < first + count; i++) {
+      slots_[i].data = chunk + (i - first) * stride_;
+      slots_[i].reference_count = 0;
+    }
+    slots_used_ = first + count;
+    // Push in reverse, so the lowest indices are handed out first
+    for (int i = first + count - 1; i >= first; i--) push_free(list, i);
+    counter.fetch_add(count, std::memory_order_release);
+    return count;
+  }
+
+  void AudioBufferPool::fill_reserve_locked()
+  {
+    int missing = emergency_reserve - reserve_count_.load(std::memory_order_relaxed);
+    if (missing > 0) grow_locked(missing, reserve_head_, reserve_count_);
+  }
+
+  void AudioBufferPool::reserve(int new_capacity)
+  {
+    if (new_capacity > max_capacity - emergency_reserve) {
+      LOGW("Requested {} audio buffers, but the pool can hold at most {}", new_capacity,
+           max_capacity - emergency_reserve);
+      new_capacity = max_capacity - emergency_reserve;
+    }
+    std::lock_guard lock(grow_lock_);
+    grow_locked(new_capacity - capacity(), free_head_, capacity_);
+  }
+
+  void AudioBufferPool::maintain()
+  {
+    if (int used = emergency_reserve - reserve_count_.load(std::memory_order_relaxed); used > 0) {
+      LOGW("The audio buffer pool ran out, and {} buffers were taken from the emergency reserve", used);
+      std::lock_guard lock(grow_lock_);
+      fill_reserve_locked();
+    }
+    int peak = peak_in_use_.load(std::memory_order_relaxed);
+    int cap = capacity();
+    if (peak + growth_headroom <= cap || cap >= max_capacity - emergency_reserve) return;
+    int target = std::min(std::max(cap * 2, peak + growth_headroom), max_capacity - emergency_reserve);
+    LOGI("Growing the audio buffer pool from {} to {} buffers. Peak usage was {}", cap, target, peak);
+    reserve(target);
+  }
+
+  int AudioBufferPool::lock_memory()
+  {
+    std::lock_guard lock(grow_lock_);
+    lock_memory_ = true;
+    int res = 0;
+    for (auto& chunk : chunks_) {
+      if (int err = util::lock_range(chunk.data.get(), chunk.bytes); err != 0 && res == 0) res = err;
+    }
+    return res;
+  }
+
+  void AudioBufferPool::set_buffer_size(std::size_t bs) noexcept
+  {
+    std::lock_guard lock(grow_lock_);
+    if (in_use() != 0) {
+      LOGE("Changing the audio buffer size while {} buffers are in use", in_use());
+    }
+    int cap = capacity();
+    buffer_size_ = bs;
+    stride_ = aligned_stride(bs);
+    free_head_ = 0;
+    capacity_ = 0;
+    reserve_head_ = 0;
+    reserve_count_ = 0;
+    slots_used_ = 0;
+    chunks_.clear();
+    grow_locked(cap, free_head_, capacity_);
+    fill_reserve_locked();
+  }
+
+  void AudioBufferPool::end_block() noexcept
+  {
+    int allocs = block_allocations_.exchange(0, std::memory_order_relaxed);
+    allocations_last_block_.store(allocs, std::memory_order_relaxed);
+    fetch_max(peak_allocations_per_block_, allocs);
+#ifndef NDEBUG
+    if (int n = in_use(); n != 0 && !leak_reported_) {
+      // Only reported once, to not flood the log from the audio thread
+      LOGE("{} audio buffers are still in use after the block. Buffers should not be held across blocks", n);
+      leak_reported_ = true;
+    }
+#endif
+  }
+
+  AudioBufferPool::Statistics AudioBufferPool::statistics() const noexcept
+  {
+    Statistics res;
+    res.capacity = capacity();
+    res.in_use = in_use();
+    res.peak_in_use = peak_in_use_.load(std::memory_order_relaxed);
+    res.allocations_last_block = allocations_last_block_.load(std::memory_order_relaxed);
+    res.peak_allocations_per_block = peak_allocations_per_block_.load(std::memory_order_relaxed);
+    res.emergency_allocations = emergency_allocations_.load(std::memory_order_relaxed);
+    res.reserve_left = reserve_count_.load(std::memory_order_relaxed);
+    return res;
+  }
+
+  void AudioBufferPool::AlignedDelete::operator()(float* ptr) const noexcept
+  {
+    ::operator delete[](ptr, std::align_val_t(alignment));
+  }
+
+} // namespace otto::core::audio
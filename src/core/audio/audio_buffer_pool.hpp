@@ -1,7 +1,12 @@
 #pragma once
 
+#include <atomic>
+#include <cstdint>
 #include <exception>
 #include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
 #include <gsl/span>
 
 #include "util/audio.hpp"
@@ -19,41 +24,52 @@ namespace otto::core::audio {
     static constexpr auto value = N;
   };
 
+  struct AudioBufferPool;
+
   /// A handle to an audio buffer
+  ///
+  /// Handles are reference counted. When the last handle to a buffer from an {@ref AudioBufferPool} is
+  /// destroyed or released, the buffer is returned to the pool. Handles can also refer to buffers outside a pool,
+  /// in which case the reference count is only kept for bookkeeping.
+  ///
+  /// The reference count is atomic, so handles to the same buffer can be copied and destroyed on different threads.
   struct AudioBufferHandle {
     using iterator = float*;
     using pointer = float*;
     using const_iterator = const float*;
 
-    AudioBufferHandle(float* data, std::size_t length, int& reference_count) noexcept
-      : _data(data), _length(length), _reference_count(&reference_count)
-    {
-      (*_reference_count)++;
-    }
+    /// Refer to a buffer that is not owned by a pool
+    AudioBufferHandle(float* data, std::size_t length, std::atomic_int& reference_count) noexcept
+      : AudioBufferHandle(data, length, reference_count, nullptr, -1)
+    {}
 
     ~AudioBufferHandle() noexcept
     {
-      if (_reference_count) (*_reference_count)--;
+      release();
     }
 
     AudioBufferHandle(AudioBufferHandle&& rhs) noexcept
-      : _data(rhs._data), _length(rhs._length), _reference_count(rhs._reference_count)
+      : _data(rhs._data), _length(rhs._length), _reference_count(rhs._reference_count), _pool(rhs._pool), _index(rhs._index)
     {
       rhs._data = nullptr;
       rhs._reference_count = nullptr;
     }
 
     AudioBufferHandle(const AudioBufferHandle& rhs) noexcept
-      : _data(rhs._data), _length(rhs._length), _reference_count(rhs._reference_count)
+      : _data(rhs._data), _length(rhs._length), _reference_count(rhs._reference_count), _pool(rhs._pool), _index(rhs._index)
     {
-      (*_reference_count)++;
+      if (_reference_count) _reference_count->fetch_add(1, std::memory_order_relaxed);
     }
 
     AudioBufferHandle& operator=(AudioBufferHandle&& rhs) noexcept
     {
+      if (this == &rhs) return *this;
+      release();
       _data = rhs._data;
       _length = rhs._length;
       _reference_count = rhs._reference_count;
+      _pool = rhs._pool;
+      _index = rhs._index;
       rhs._data = nullptr;
       rhs._reference_count = nullptr;
       return *this;
@@ -61,16 +77,21 @@ namespace otto::core::audio {
 
     AudioBufferHandle& operator=(const AudioBufferHandle& rhs) noexcept
     {
+      if (this == &rhs) return *this;
+      // Take the new reference first, in case both refer to the same buffer
+      if (rhs._reference_count) rhs._reference_count->fetch_add(1, std::memory_order_relaxed);
+      release();
       _data = rhs._data;
       _length = rhs._length;
       _reference_count = rhs._reference_count;
-      (*_reference_count)++;
+      _pool = rhs._pool;
+      _index = rhs._index;
       return *this;
     }
 
     int reference_count() const
     {
-      return *_reference_count;
+      return _reference_count ? _reference_count->load() : 0;
     }
 
     float* data() const
@@ -110,12 +131,10 @@ namespace otto::core::audio {
       return _data[i];
     }
 
-    void release()
-    {
-      (*_reference_count)--;
-      _reference_count = nullptr;
-      _data = nullptr;
-    }
+    /// Drop this reference to the buffer. The handle is empty afterwards.
+    ///
+    /// If this was the last reference to a pool buffer, the buffer is returned to the pool.
+    void release() noexcept;
 
     void clear()
     {
@@ -132,7 +151,7 @@ namespace otto::core::audio {
     AudioBufferHandle slice(int idx, int length = -1)
     {
       length = length < 0 ? _length - idx : length;
-      return {_data + idx, std::size_t(length), *_reference_count};
+      return {_data + idx, std::size_t(length), *_reference_count, _pool, _index};
     }
 
     float* data()
@@ -146,37 +165,70 @@ namespace otto::core::audio {
     }
 
   private:
+    friend AudioBufferPool;
+
+    AudioBufferHandle(float* data,
+                      std::size_t length,
+                      std::atomic_int& reference_count,
+                      AudioBufferPool* pool,
+                      int index) noexcept
+      : _data(data), _length(length), _reference_count(&reference_count), _pool(pool), _index(index)
+    {
+      _reference_count->fetch_add(1, std::memory_order_relaxed);
+    }
+
     float* _data;
     std::size_t _length;
-    int* _reference_count;
+    std::atomic_int* _reference_count;
+    AudioBufferPool* _pool;
+    int _index;
   };
 
+  /// A pool of audio buffers
+  ///
+  /// Allocation pops a buffer off a lock-free free list, and the last {@ref AudioBufferHandle} to a buffer pushes
+  /// it back, so both are O(1), and buffers can be allocated from multiple threads at once, e.g. by engines
+  /// processed in parallel. All buffers are aligned to {@ref alignment} bytes, for SIMD loads and stores.
+  ///
+  /// The pool is grown off the audio thread by {@ref maintain()}, when the peak number of buffers in use gets
+  /// close to the capacity. If the pool still runs out, buffers are taken from a small preallocated reserve,
+  /// which is counted in {@ref Statistics::emergency_allocations}, and refilled by the next {@ref maintain()}.
+  /// The audio thread never allocates memory or takes a lock.
   struct AudioBufferPool {
-    static constexpr int number_of_buffers = 8;
-    AudioBufferPool(std::size_t buffer_size) : buffer_size(buffer_size)
-    {
-      // For now this is hardcoded, which is nice, cause we notice if we suddenly are using too many
-      // buffers
-      reserve(number_of_buffers);
-    }
-
-    AudioBufferHandle allocate() noexcept
-    {
-      for (std::size_t i = 0; i < reference_counts.size(); i++) {
-        if (reference_counts[i] < 1) {
-          if (i > _max_val) {
-            LOGI("Using {} buffers", i + 1);
-            _max_val = i;
-          }
-          reference_counts[i] = 0;
-          int index = i * buffer_size;
-          return {data.get() + index, buffer_size, reference_counts[i]};
-        }
-      }
-      // TODO: handle this reasonably
-      LOGF("No free audio buffers found. This shouldn't happen");
-      std::terminate();
-    }
+    /// The default initial capacity
+    static constexpr int number_of_buffers = 16;
+    /// The capacity can never grow beyond this, including the emergency reserve
+    static constexpr int max_capacity = 256;
+    /// The number of buffers kept aside for when the pool runs out before {@ref maintain()} has grown it
+    static constexpr int emergency_reserve = 4;
+    /// Alignment of each buffer in bytes
+    static constexpr std::size_t alignment = 64;
+    /// {@ref maintain()} grows the pool when fewer than this many buffers were free at the peak
+    static constexpr int growth_headroom = 4;
+
+    /// Buffer usage counters, e.g. for the debug ui
+    struct Statistics {
+      int capacity = 0;
+      int in_use = 0;
+      /// The largest number of buffers that have been in use at once
+      int peak_in_use = 0;
+      /// Allocations during the last block, see {@ref end_block()}
+      int allocations_last_block = 0;
+      int peak_allocations_per_block = 0;
+      /// The number of times the pool ran out of buffers, and one was taken from the emergency reserve
+      int emergency_allocations = 0;
+      /// Buffers left in the emergency reserve
+      int reserve_left = 0;
+    };
+
+    AudioBufferPool(std::size_t buffer_size, int capacity = number_of_buffers);
+    ~AudioBufferPool() noexcept;
+
+    AudioBufferPool(const AudioBufferPool&) = delete;
+    AudioBufferPool& operator=(const AudioBufferPool&) = delete;
+
+    /// Allocate a buffer. The contents are unspecified.
+    AudioBufferHandle allocate() noexcept;
 
     AudioBufferHandle allocate_clear()
     {
@@ -197,24 +249,126 @@ namespace otto::core::audio {
       return util::generate_array<NN>([this](int) { return allocate_clear(); });
     }
 
-    void set_buffer_size(std::size_t bs) noexcept
+    /// Change the size of the buffers
+    ///
+    /// Reallocates all buffers, so no buffers may be in use, and this must not be called on the audio thread.
+    void set_buffer_size(std::size_t bs) noexcept;
+
+    std::size_t buffer_size() const noexcept
     {
-      buffer_size = bs;
-      reserve(number_of_buffers);
+      return buffer_size_;
     }
 
-  private:
-    void reserve(std::size_t n) noexcept
+    /// The number of buffers in the pool, not counting the emergency reserve
+    int capacity() const noexcept
     {
-      data = std::make_unique<float[]>(n * buffer_size);
-      _avaliable_buffers = n;
-      reference_counts.resize(_avaliable_buffers, 0);
+      return capacity_.load(std::memory_order_acquire);
     }
 
-    std::size_t buffer_size;
-    std::vector<int> reference_counts;
-    std::size_t _avaliable_buffers = 0;
-    std::unique_ptr<float[]> data;
-    std::size_t _max_val = -1;
+    /// The number of buffers currently allocated
+    int in_use() const noexcept
+    {
+      return in_use_.load(std::memory_order_relaxed);
+    }
+
+    /// Grow the pool to at least `capacity` buffers
+    ///
+    /// Allocates memory, so it should not be called on the audio thread.
+    void reserve(int capacity);
+
+    /// Grow the pool if the peak usage is within {@ref growth_headroom} of the capacity, and refill the emergency
+    /// reserve
+    ///
+    /// Call this regularly from a thread other than the audio thread.
+    void maintain();
+
+    /// Lock the buffers into memory with `mlock`, and every buffer the pool gets from now on, including the
+    /// buffers of the emergency reserve
+    ///
+    /// Must not be called on the audio thread.
+    ///
+    /// \returns 0, or the `errno` of the first failure
+    int lock_memory();
+
+    /// Mark the end of an audio block
+    ///
+    /// Updates the per block statistics. In debug builds, this also reports buffers that are still in use, since
+    /// no buffers should be held across blocks.
+    ///
+    /// Audio thread only.
+    void end_block() noexcept;
+
+    Statistics statistics() const noexcept;
+
+  private:
+    friend AudioBufferHandle;
+
+    struct Slot {
+      std::atomic_int reference_count = 0;
+      /// Index of the next buffer in the free list, or -1
+      std::atomic_int next_free = -1;
+      float* data = nullptr;
+    };
+
+    /// Return a buffer to the free list
+    void free_buffer(int index) noexcept;
+    void push_free(std::atomic<std::uint64_t>& list, int index) noexcept;
+    /// \returns -1 if the list is empty
+    int pop_free(std::atomic<std::uint64_t>& list) noexcept;
+    /// Add `count` new buffers to `list`, and to `counter`. Requires `grow_lock_`
+    ///
+    /// \returns The number of buffers added, which is less than `count` when {@ref max_capacity} is reached
+    int grow_locked(int count, std::atomic<std::uint64_t>& list, std::atomic_int& counter);
+    /// Top up the emergency reserve. Requires `grow_lock_`
+    void fill_reserve_locked();
+
+    struct AlignedDelete {
+      void operator()(float* ptr) const noexcept;
+    };
+
+    struct Chunk {
+      std::unique_ptr<float, AlignedDelete> data;
+      std::size_t bytes = 0;
+    };
+
+    std::size_t buffer_size_;
+    /// The distance between buffers in floats, rounded up to keep them aligned
+    std::size_t stride_;
+    std::array<Slot, max_capacity> slots_;
+    /// `tag << 32 | (index + 1)` of the first free buffer. The tag is incremented on each change, so a buffer
+    /// that is popped and pushed back while another thread is popping it can not corrupt the list.
+    std::atomic<std::uint64_t> free_head_ = 0;
+    std::atomic_int capacity_ = 0;
+    /// The emergency reserve, in the same format as `free_head_`. Buffers taken from it are returned to the free
+    /// list, and counted in `capacity_` from then on.
+    std::atomic<std::uint64_t> reserve_head_ = 0;
+    std::atomic_int reserve_count_ = 0;
+    /// The number of slots that have a buffer. Requires `grow_lock_`
+    int slots_used_ = 0;
+    std::atomic_int in_use_ = 0;
+    std::atomic_int peak_in_use_ = 0;
+    std::atomic_int block_allocations_ = 0;
+    std::atomic_int allocations_last_block_ = 0;
+    std::atomic_int peak_allocations_per_block_ = 0;
+    std::atomic_int emergency_allocations_ = 0;
+    bool leak_reported_ = false;
+
+    std::mutex grow_lock_;
+    std::vector<Chunk> chunks_;
+    /// Lock new chunks into memory. Requires `grow_lock_`
+    bool lock_memory_ = false;
   };
-}
+
+  // IMPLEMENTATION //
+
+  inline void AudioBufferHandle::release() noexcept
+  {
+    if (_reference_count != nullptr && _reference_count->fetch_sub(1, std::memory_order_acq_rel) == 1 &&
+        _pool != nullptr) {
+      _pool->free_buffer(_index);
+    }
+    _reference_count = nullptr;
+    _data = nullptr;
+  }
+
+} // namespace otto::core::audio
@@ -0,0 +1,311 @@
+#include "graph.hpp"
+
+#include <algorithm>
+
+#include "services/log_manager.hpp"
+
+namespace otto::core::audio {
+
+  // AudioGraph //
+
+  ProcessData<2> AudioGraph::process(ProcessData<1> external_in,
+                                     AudioBufferPool& pool,
+                                     util::realtime_worker_pool* workers,
+                                     const std::array<AudioBufferHandle, 2>* output) noexcept
+  {
+    const int nframes = external_in.nframes;
+    slots_.clear();
+    for (int i = 0; i < slot_count_; i++) {
+      if (output != nullptr && i == output_slots_[0]) {
+        slots_.emplace_back((*output)[0]);
+      } else if (output != nullptr && i == output_slots_[1]) {
+        slots_.emplace_back((*output)[1]);
+      } else {
+        slots_.emplace_back(pool.allocate());
+      }
+      slots_.back() = slots_.back().slice(0, nframes);
+    }
+    auto buffer = [&](int slot) -> const AudioBufferHandle& {
+      return slot == external_slot ? external_in.audio : slots_[slot];
+    };
+
+    ProcessData<0> data = external_in.midi_only();
+    auto run_node = [&](Node& node) {
+      Buffers in;
+      Buffers out;
+      for (int slot : node.in_slots) in.emplace_back(buffer(slot));
+      for (int slot : node.out_slots) out.emplace_back(buffer(slot));
+      AudioProfiler::Scope scope(profiler_, profiler_ ? node.profiler_stage : -1);
+      node.process(in, out, data);
+    };
+    for (auto [begin, count] : stages_) {
+      if (workers != nullptr && count > 1) {
+        workers->run(count, [&, begin = begin](int i) noexcept { run_node(nodes_[begin + i]); });
+      } else {
+        for (int i = begin; i < begin + count; i++) run_node(nodes_[i]);
+      }
+    }
+
+    ProcessData<2> res = {std::array<AudioBufferHandle, 2>{buffer(output_slots_[0]), buffer(output_slots_[1])},
+                          data.midi, data.clock};
+    slots_.clear();
+    return res;
+  }
+
+  std::vector<std::string> AudioGraph::node_order() const
+  {
+    std::vector<std::string> res;
+    res.reserve(nodes_.size());
+    for (auto& node : nodes_) res.push_back(node.name);
+    return res;
+  }
+
+  void AudioGraph::set_profiler(AudioProfiler& profiler)
+  {
+    for (auto& node : nodes_) node.profiler_stage = profiler.add_stage(node.name);
+    profiler_ = &profiler;
+  }
+
+  // AudioGraphBuilder //
+
+  AudioGraphBuilder::Bus AudioGraphBuilder::bus(std::string name, int channels)
+  {
+    busses_.push_back({std::move(name), channels});
+    return {int(busses_.size()) - 1, channels};
+  }
+
+  void AudioGraphBuilder::node(std::string name,
+                               std::vector<Bus> inputs,
+                               std::vector<Bus> outputs,
+                               AudioGraph::ProcessFunc process,
+                               NodeOptions options)
+  {
+    nodes_.push_back({std::move(name), std::move(inputs), std::move(outputs), std::move(process), options});
+  }
+
+  void AudioGraphBuilder::node(std::string name,
+                               std::vector<Bus> inputs,
+                               std::vector<Bus> outputs,
+                               AudioGraph::ProcessFunc process)
+  {
+    node(std::move(name), std::move(inputs), std::move(outputs), std::move(process), NodeOptions());
+  }
+
+  void AudioGraphBuilder::output(Bus bus) noexcept
+  {
+    output_ = bus.index;
+  }
+
+  std::unique_ptr<AudioGraph> AudioGraphBuilder::compile(int buffer_budget, Schedule schedule) const
+  {
+    const int node_count = nodes_.size();
+    const int bus_count = busses_.size();
+    constexpr int external_node = -2;
+    constexpr int no_node = -1;
+
+    if (output_ < 0 || busses_[output_].channels != 2) {
+      throw exception(ErrorCode::invalid_output, "The graph output must be a stereo bus");
+    }
+
+    // Find the node writing to each bus
+    std::vector<int> producer(bus_count, no_node);
+    producer[0] = external_node;
+    for (int n = 0; n < node_count; n++) {
+      auto& node = nodes_[n];
+      auto channels = [](auto& bs) {
+        int res = 0;
+        for (auto& b : bs) res += b.channels;
+        return res;
+      };
+      if (channels(node.inputs) > AudioGraph::max_channels || channels(node.outputs) > AudioGraph::max_channels) {
+        throw exception(ErrorCode::too_many_channels, "Node '{}' has too many channels", node.name);
+      }
+      for (auto& b : node.outputs) {
+        if (producer[b.index] != no_node) {
+          throw exception(ErrorCode::multiple_producers, "Bus '{}' is written by more than one node",
+                          busses_[b.index].name);
+        }
+        producer[b.index] = n;
+      }
+    }
+    for (auto& node : nodes_) {
+      for (auto& b : node.inputs) {
+        if (producer[b.index] == no_node) {
+          throw exception(ErrorCode::no_producer, "Bus '{}' is read by '{}', but no node writes to it",
+                          busses_[b.index].name, node.name);
+        }
+      }
+    }
+    if (producer[output_] == no_node) {
+      throw exception(ErrorCode::no_producer, "The output bus '{}' is not written by any node", busses_[output_].name);
+    }
+
+    // Topological sort. Out of the nodes that are ready, the first one declared goes first.
+    std::vector<int> waiting_for(node_count, 0);
+    for (int n = 0; n < node_count; n++) {
+      for (auto& b : nodes_[n].inputs) {
+        if (producer[b.index] >= 0) waiting_for[n]++;
+      }
+    }
+    std::vector<int> order;
+    std::vector<bool> done(node_count, false);
+    order.reserve(node_count);
+    while (int(order.size()) < node_count) {
+      int n = 0;
+      while (n < node_count && (done[n] || waiting_for[n] > 0)) n++;
+      if (n == node_count) {
+        throw exception(ErrorCode::cycle, "The audio graph contains a cycle");
+      }
+      done[n] = true;
+      order.push_back(n);
+      for (int m = 0; m < node_count; m++) {
+        for (auto& b : nodes_[m].inputs) {
+          if (producer[b.index] == n) waiting_for[m]--;
+        }
+      }
+    }
+
+    // Group the nodes into stages. The nodes in a stage do not depend on each other, so a parallel schedule can
+    // run them at the same time. A serial schedule has a single node in each stage.
+    std::vector<int> stage_of(node_count, 0);
+    for (int i = 0; i < node_count; i++) {
+      int n = order[i];
+      if (schedule == Schedule::serial) {
+        stage_of[n] = i;
+        continue;
+      }
+      for (auto& b : nodes_[n].inputs) {
+        if (producer[b.index] >= 0) stage_of[n] = std::max(stage_of[n], stage_of[producer[b.index]] + 1);
+      }
+    }
+    std::stable_sort(order.begin(), order.end(), [&](int a, int b) { return stage_of[a] < stage_of[b]; });
+    const int stage_count = node_count == 0 ? 0 : stage_of[order.back()] + 1;
+
+    // Liveness. A bus is alive from the stage writing it, until the last stage reading it.
+    std::vector<int> last_use(bus_count, -1);
+    for (int n : order) {
+      for (auto& b : nodes_[n].inputs) last_use[b.index] = std::max(last_use[b.index], stage_of[n]);
+    }
+    last_use[output_] = stage_count;
+    // The number of nodes reading each bus in its last stage
+    std::vector<int> last_readers(bus_count, 0);
+    for (int n : order) {
+      auto& inputs = nodes_[n].inputs;
+      for (auto b = inputs.begin(); b != inputs.end(); ++b) {
+        bool first = std::none_of(inputs.begin(), b, [&](auto& b2) { return b2.index == b->index; });
+        if (first && last_use[b->index] == stage_of[n]) last_readers[b->index]++;
+      }
+    }
+
+    // Assign buffers to bus channels. Always reuse the lowest free buffer. Buffers freed in a stage are only
+    // reused in later stages, except by in place nodes that are the only reader of a bus.
+    std::vector<std::vector<int>> bus_slots(bus_count);
+    bus_slots[0] = {AudioGraph::external_slot};
+    std::vector<bool> released(bus_count, false);
+    std::vector<int> free_slots;
+    int slot_count = 0;
+    int max_scratch = 0;
+    auto take_lowest = [](std::vector<int>& slots) {
+      std::sort(slots.begin(), slots.end(), std::greater<>());
+      int res = slots.back();
+      slots.pop_back();
+      return res;
+    };
+
+    auto graph = std::unique_ptr<AudioGraph>(new AudioGraph());
+    for (int i = 0; i < node_count;) {
+      const int stage = stage_of[order[i]];
+      const int stage_begin = i;
+      std::vector<int> released_after;
+      int stage_scratch = 0;
+      for (; i < node_count && stage_of[order[i]] == stage; i++) {
+        auto& decl = nodes_[order[i]];
+        std::vector<int> own_slots;
+        for (auto& b : decl.inputs) {
+          if (b.index == 0 || last_use[b.index] != stage || released[b.index]) continue;
+          released[b.index] = true;
+          auto& dst = decl.options.in_place && last_readers[b.index] == 1 ? own_slots : released_after;
+          dst.insert(dst.end(), bus_slots[b.index].begin(), bus_slots[b.index].end());
+        }
+        for (auto& b : decl.outputs) {
+          for (int c = 0; c < b.channels; c++) {
+            if (!own_slots.empty()) {
+              bus_slots[b.index].push_back(take_lowest(own_slots));
+            } else if (!free_slots.empty()) {
+              bus_slots[b.index].push_back(take_lowest(free_slots));
+            } else {
+              bus_slots[b.index].push_back(slot_count++);
+            }
+          }
+          // Outputs nobody reads
+          if (last_use[b.index] < stage) {
+            released_after.insert(released_after.end(), bus_slots[b.index].begin(), bus_slots[b.index].end());
+          }
+        }
+        released_after.insert(released_after.end(), own_slots.begin(), own_slots.end());
+        stage_scratch += decl.options.scratch_buffers;
+
+        AudioGraph::Node node;
+        node.name = decl.name;
+        node.process = decl.process;
+        for (auto& b : decl.inputs) {
+          node.in_slots.insert(node.in_slots.end(), bus_slots[b.index].begin(), bus_slots[b.index].end());
+        }
+        for (auto& b : decl.outputs) {
+          node.out_slots.insert(node.out_slots.end(), bus_slots[b.index].begin(), bus_slots[b.index].end());
+        }
+        graph->nodes_.push_back(std::move(node));
+      }
+      free_slots.insert(free_slots.end(), released_after.begin(), released_after.end());
+      max_scratch = std::max(max_scratch, stage_scratch);
+      graph->stages_.push_back({stage_begin, i - stage_begin});
+    }
+
+    graph->slot_count_ = slot_count;
+    graph->peak_buffer_usage_ = slot_count + max_scratch;
+    graph->output_slots_ = {bus_slots[output_][0], bus_slots[output_][1]};
+
+    if (graph->peak_buffer_usage_ > buffer_budget) {
+      throw exception(ErrorCode::too_many_buffers, "The audio graph needs {} buffers, but only {} are avaliable",
+                      graph->peak_buffer_usage_, buffer_budget);
+    }
+    DLOGI("Compiled audio graph with {} nodes and {} busses into {} stages and {} buffers", node_count,
+          bus_count - 1, stage_count, slot_count);
+    return graph;
+  }
+
+  // SwappableAudioGraph //
+
+  SwappableAudioGraph::~SwappableAudioGraph() noexcept
+  {
+    collect_retired();
+    delete pending_.load();
+    delete current_;
+  }
+
+  void SwappableAudioGraph::publish(std::unique_ptr<AudioGraph> graph)
+  {
+    std::lock_guard lock(publish_lock_);
+    collect_retired();
+    // If the audio thread never picked up the previous graph, it is ours to destroy
+    delete pending_.exchange(graph.release(), std::memory_order_acq_rel);
+  }
+
+  AudioGraph* SwappableAudioGraph::acquire() noexcept
+  {
+    // Only swap if there is room to retire the current graph, so it is never destroyed on this thread.
+    if (pending_.load(std::memory_order_relaxed) != nullptr && retired_.size() < retired_.capacity) {
+      if (auto* graph = pending_.exchange(nullptr, std::memory_order_acq_rel); graph != nullptr) {
+        if (current_ != nullptr) retired_.try_push(current_);
+        current_ = graph;
+      }
+    }
+    return current_;
+  }
+
+  void SwappableAudioGraph::collect_retired() noexcept
+  {
+    retired_.consume_all([](AudioGraph* graph) { delete graph; });
+  }
+
+} // namespace otto::core::audio
@@ -0,0 +1,268 @@
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "core/audio/processor.hpp"
+#include "core/audio/profiler.hpp"
+
+#include "util/exception.hpp"
+#include "util/local_vector.hpp"
+#include "util/realtime_worker_pool.hpp"
+#include "util/spsc_queue.hpp"
+
+namespace otto::core::audio {
+
+  struct AudioGraphBuilder;
+
+  /// A compiled audio routing graph
+  ///
+  /// Nodes are audio processors, and the edges between them are mono or stereo busses. The graph is built
+  /// declaratively using an {@ref AudioGraphBuilder}, which sorts the nodes topologically and plans which
+  /// audio buffer each bus channel is stored in. Busses that are never alive at the same time share a
+  /// buffer, so the graph only holds {@ref slot_count()} buffers from the {@ref AudioBufferPool} while it
+  /// processes, regardless of how many busses it has.
+  ///
+  /// A compiled graph is immutable, apart from the scratch state used by {@ref process}. To change the
+  /// routing, build a new graph and publish it through a {@ref SwappableAudioGraph}.
+  struct AudioGraph {
+    /// The maximum number of input or output channels of a single node
+    static constexpr int max_channels = 8;
+
+    /// The audio buffers passed to a node. One entry per channel of each of its input/output busses, in the
+    /// order they were declared.
+    using Buffers = util::local_vector<AudioBufferHandle, max_channels>;
+
+    /// The function called to process a node.
+    ///
+    /// Output buffers are not cleared before the call, so the node must write all of their frames.
+    /// For nodes declared `in_place`, output buffers may alias input buffers.
+    ///
+    /// With a parallel schedule, nodes in the same stage run concurrently on different threads, and share
+    /// `data`, which they must not modify.
+    using ProcessFunc = std::function<void(Buffers& in, Buffers& out, ProcessData<0>& data)>;
+
+    /// Process a block of audio through the graph
+    ///
+    /// \param external_in The graph input bus, and the midi and clock of this block.
+    /// \param pool The pool to get the {@ref slot_count()} bus buffers from. They are held for the duration
+    ///             of this call, except for the two channels of the output bus, which are returned.
+    /// \param workers The worker pool to run the nodes of each stage in parallel on.
+    ///                If `nullptr`, all nodes are processed on the calling thread.
+    /// \param output If set, the output bus is rendered directly into these buffers, instead of pool buffers,
+    ///               and the returned handles refer to them. They must hold at least `nframes` frames, and be
+    ///               aligned to {@ref util::simd::vfloat::alignment}, since nodes may use aligned SIMD loads
+    ///               and stores on any of their buffers. Earlier busses may share storage with the output bus,
+    ///               so their contents are unspecified until the call returns.
+    ProcessData<2> process(ProcessData<1> external_in,
+                           AudioBufferPool& pool,
+                           util::realtime_worker_pool* workers = nullptr,
+                           const std::array<AudioBufferHandle, 2>* output = nullptr) noexcept;
+
+    /// The number of pool buffers used to store the busses
+    int slot_count() const noexcept
+    {
+      return slot_count_;
+    }
+
+    /// The number of pool buffers in use at the most demanding stage,
+    /// including the scratch buffers its nodes allocate themselves.
+    int peak_buffer_usage() const noexcept
+    {
+      return peak_buffer_usage_;
+    }
+
+    /// The number of stages. Nodes in the same stage can be processed in parallel
+    int stage_count() const noexcept
+    {
+      return stages_.size();
+    }
+
+    /// The node names, in processing order
+    std::vector<std::string> node_order() const;
+
+    /// Time each node in a stage of `profiler`, named after the node
+    ///
+    /// Call before the graph is published. Not for the audio thread.
+    void set_profiler(AudioProfiler& profiler);
+
+  private:
+    friend AudioGraphBuilder;
+
+    /// Slot index used for the external input bus
+    static constexpr int external_slot = -1;
+
+    struct Node {
+      std::string name;
+      std::vector<int> in_slots;
+      std::vector<int> out_slots;
+      ProcessFunc process;
+      int profiler_stage = -1;
+    };
+
+    AudioGraph() = default;
+
+    struct Stage {
+      int begin;
+      int count;
+    };
+
+    std::vector<Node> nodes_;
+    std::vector<Stage> stages_;
+    std::array<int, 2> output_slots_ = {external_slot, external_slot};
+    int slot_count_ = 0;
+    int peak_buffer_usage_ = 0;
+    AudioProfiler* profiler_ = nullptr;
+    /// The buffers for this block. Only used during {@ref process}.
+    util::local_vector<AudioBufferHandle, AudioBufferPool::number_of_buffers> slots_;
+  };
+
+  /// Builds and compiles an {@ref AudioGraph}
+  ///
+  /// ```cpp
+  /// AudioGraphBuilder b;
+  /// auto dry = b.bus("dry", 1);
+  /// auto out = b.bus("out", 2);
+  /// b.node("synth", {}, {dry}, [&](auto& in, auto& out, auto& data) { ... });
+  /// b.node("fx", {dry}, {out}, [&](auto& in, auto& out, auto& data) { ... });
+  /// b.output(out);
+  /// auto graph = b.compile(AudioBufferPool::number_of_buffers - 1);
+  /// ```
+  struct AudioGraphBuilder {
+    /// Error codes. Thrown with exceptions from {@ref compile}
+    enum struct ErrorCode {
+      /// The graph contains a cycle
+      cycle,
+      /// A bus is read, but no node writes to it
+      no_producer,
+      /// A bus is written by more than one node
+      multiple_producers,
+      /// The output bus is not set, or is not stereo
+      invalid_output,
+      /// A node has more than {@ref AudioGraph::max_channels} input or output channels
+      too_many_channels,
+      /// The graph needs more buffers than the budget allows
+      too_many_buffers,
+    };
+
+    /// AudioGraphBuilder exceptions. Contain an ErrorCode
+    using exception = util::as_exception<ErrorCode>;
+
+    /// A reference to a bus
+    struct Bus {
+      int index;
+      int channels;
+    };
+
+    /// How the nodes are scheduled
+    enum struct Schedule {
+      /// One node at a time
+      serial,
+      /// Independent nodes may run at the same time. This can need more buffers than a serial schedule, since
+      /// buffers can not be reused between nodes running in parallel.
+      parallel,
+    };
+
+    /// Options for a node
+    struct NodeOptions {
+      /// The node reads all of its input before writing any of its output, or processes frame by frame,
+      /// reading all inputs of a frame before writing any output of it, so its outputs may share buffers
+      /// with inputs it is the last reader of. Any output may alias any such input.
+      bool in_place = false;
+      /// The number of buffers the node allocates from the pool while processing
+      int scratch_buffers = 0;
+    };
+
+    /// The external input bus. Mono.
+    Bus input() const noexcept
+    {
+      return {0, 1};
+    }
+
+    /// Declare a bus
+    ///
+    /// \param channels 1 for mono, 2 for stereo
+    Bus bus(std::string name, int channels);
+
+    /// Declare a node
+    ///
+    /// Nodes are processed in an order where each node runs after the nodes writing to its inputs.
+    /// Other than that, nodes run in the order they were declared.
+    void node(std::string name,
+              std::vector<Bus> inputs,
+              std::vector<Bus> outputs,
+              AudioGraph::ProcessFunc process,
+              NodeOptions options);
+
+    /// Declare a node with the default {@ref NodeOptions}
+    void node(std::string name, std::vector<Bus> inputs, std::vector<Bus> outputs, AudioGraph::ProcessFunc process);
+
+    /// Set the stereo bus to return from {@ref AudioGraph::process}
+    void output(Bus bus) noexcept;
+
+    /// Sort the nodes and plan the buffers
+    ///
+    /// \param buffer_budget The number of pool buffers the graph may use at most.
+    /// \throws exception if the graph is invalid, or needs more than `buffer_budget` buffers
+    std::unique_ptr<AudioGraph> compile(int buffer_budget, Schedule schedule = Schedule::serial) const;
+
+  private:
+    struct BusDecl {
+      std::string name;
+      int channels;
+    };
+
+    struct NodeDecl {
+      std::string name;
+      std::vector<Bus> inputs;
+      std::vector<Bus> outputs;
+      AudioGraph::ProcessFunc process;
+      NodeOptions options;
+    };
+
+    std::vector<BusDecl> busses_ = {{"input", 1}};
+    std::vector<NodeDecl> nodes_;
+    int output_ = -1;
+  };
+
+  /// Holds the graph used by the audio thread, and lets other threads replace it
+  ///
+  /// A new graph is picked up by the audio thread at the start of the next block. The graph it replaces is
+  /// destroyed off the audio thread, the next time a graph is published.
+  struct SwappableAudioGraph {
+    SwappableAudioGraph() = default;
+    SwappableAudioGraph(const SwappableAudioGraph&) = delete;
+    SwappableAudioGraph& operator=(const SwappableAudioGraph&) = delete;
+
+    /// Destroys all graphs. The audio thread must not be processing.
+    ~SwappableAudioGraph() noexcept;
+
+    /// Replace the graph
+    ///
+    /// May be called from any thread except the audio thread.
+    void publish(std::unique_ptr<AudioGraph> graph);
+
+    /// Get the graph to process this block with
+    ///
+    /// Audio thread only. Call once at the start of each block.
+    ///
+    /// \returns `nullptr` if no graph has been published
+    AudioGraph* acquire() noexcept;
+
+  private:
+    /// Destroy the graphs the audio thread is done with. Requires `publish_lock_`
+    void collect_retired() noexcept;
+
+    std::mutex publish_lock_;
+    std::atomic<AudioGraph*> pending_ = nullptr;
+    /// Only accessed from the audio thread
+    AudioGraph* current_ = nullptr;
+    /// Replaced graphs, pushed by the audio thread
+    util::spsc_queue<AudioGraph*, 16> retired_;
+  };
+
+} // namespace otto::core::audio
@@ -172,6 +172,12 @@ namespace otto::core::midi {
 
   using AnyMidiEvent = std::variant<MidiEvent, NoteOnEvent, NoteOffEvent, ControlChangeEvent, PitchBendEvent>;
 
+  /// Get the time of an event, as a frame offset into the buffer it is processed in
+  inline int event_time(const AnyMidiEvent& evt) noexcept
+  {
+    return std::visit([](const MidiEvent& e) { return e.time; }, evt);
+  }
+
   inline AnyMidiEvent from_bytes(gsl::span<unsigned char> bytes, int time = 0)
   {
     if (bytes.size() < 3) throw util::exception("Midi event size must be >= 3 bytes");
@@ -0,0 +1,166 @@
+#include "midi_buffer.hpp"
+
+#include <algorithm>
+
+namespace otto::core::midi {
+
+  // MidiMessage //
+
+  MessageType MidiMessage::type() const noexcept
+  {
+    if (status < 0x80) return MessageType::Invalid;
+    switch (status & 0xF0) {
+      case 0x80: return MessageType::NoteOff;
+      case 0x90: return data2 == 0 ? MessageType::NoteOff : MessageType::NoteOn;
+      case 0xA0: return MessageType::PolyPressure;
+      case 0xB0: return MessageType::ControlChange;
+      case 0xC0: return MessageType::ProgramChange;
+      case 0xD0: return MessageType::ChannelPressure;
+      case 0xE0: return MessageType::PitchBend;
+      default: break;
+    }
+    switch (status) {
+      case 0xF0: return MessageType::SysEx;
+      case 0xF1: return MessageType::TimeCode;
+      case 0xF2: return MessageType::SongPosition;
+      case 0xF3: return MessageType::SongSelect;
+      case 0xF6: return MessageType::TuneRequest;
+      case 0xF8: return MessageType::Clock;
+      case 0xFA: return MessageType::Start;
+      case 0xFB: return MessageType::Continue;
+      case 0xFC: return MessageType::Stop;
+      case 0xFE: return MessageType::ActiveSensing;
+      case 0xFF: return MessageType::Reset;
+      default: return MessageType::Invalid;
+    }
+  }
+
+  AnyMidiEvent MidiMessage::to_event() const noexcept
+  {
+    auto time = int(frame);
+    auto chan = MidiEvent::byte(channel());
+    switch (type()) {
+      case MessageType::NoteOn: {
+        NoteOnEvent res = {key(), 1, chan, time};
+        res.velocity = data2;
+        return res;
+      }
+      case MessageType::NoteOff: {
+        NoteOffEvent res = {key(), 1, chan, time};
+        res.velocity = data2;
+        return res;
+      }
+      case MessageType::ControlChange: {
+        ControlChangeEvent res = {controller(), value()};
+        res.type = MidiEvent::Type::ControlChange;
+        res.channel = chan;
+        res.time = time;
+        return res;
+      }
+      case MessageType::PitchBend: {
+        PitchBendEvent res = {value14()};
+        res.type = MidiEvent::Type::PitchBend;
+        res.channel = chan;
+        res.time = time;
+        return res;
+      }
+      default: return MidiEvent{MidiEvent::Type(status >> 4), channel(), time};
+    }
+  }
+
+  MidiMessage MidiMessage::from_event(const AnyMidiEvent& event) noexcept
+  {
+    return util::match(
+      event,
+      [](const NoteEvent& e) {
+        return MidiMessage{std::uint8_t((int(e.type) << 4) | e.channel), e.key, e.velocity, 0, std::uint32_t(e.time)};
+      },
+      [](const ControlChangeEvent& e) {
+        return MidiMessage{std::uint8_t((int(e.type) << 4) | e.channel), std::uint8_t(e.controler),
+                           std::uint8_t(e.value), 0, std::uint32_t(e.time)};
+      },
+      [](const PitchBendEvent& e) {
+        return MidiMessage{std::uint8_t((int(e.type) << 4) | e.channel), std::uint8_t(e.value & 0x7F),
+                           std::uint8_t((e.value >> 7) & 0x7F), 0, std::uint32_t(e.time)};
+      },
+      [](const MidiEvent& e) {
+        return MidiMessage{std::uint8_t((int(e.type) << 4) | e.channel), 0, 0, 0, std::uint32_t(e.time)};
+      });
+  }
+
+  MidiMessage MidiMessage::from_bytes(gsl::span<const std::uint8_t> bytes, std::uint32_t frame) noexcept
+  {
+    if (bytes.empty()) return {};
+    int size = message_size(bytes[0]);
+    if (size == 0 || int(bytes.size()) != size) return {};
+    MidiMessage res;
+    res.status = bytes[0];
+    if (size > 1) res.data1 = bytes[1];
+    if (size > 2) res.data2 = bytes[2];
+    res.frame = frame;
+    return res;
+  }
+
+  // MidiBuffer //
+
+  bool MidiBuffer::push(MidiMessage msg) noexcept
+  {
+    if (msg.status == 0xF0) return false;
+    if (size_ == capacity) {
+      dropped_++;
+      return false;
+    }
+    messages_[size_++] = msg;
+    return true;
+  }
+
+  bool MidiBuffer::push(const AnyMidiEvent& event) noexcept
+  {
+    return push(MidiMessage::from_event(event));
+  }
+
+  bool MidiBuffer::push(gsl::span<const std::uint8_t> bytes, std::uint32_t frame) noexcept
+  {
+    if (bytes.empty()) return false;
+    if (bytes[0] != 0xF0) {
+      auto msg = MidiMessage::from_bytes(bytes, frame);
+      return msg.status != 0 && push(msg);
+    }
+    if (bytes.size() < 2 || bytes[bytes.size() - 1] != 0xF7) return false;
+    if (size_ == capacity || sysex_count_ == max_sysex_messages || sysex_size_ + bytes.size() > sysex_capacity) {
+      dropped_++;
+      return false;
+    }
+    std::copy(bytes.begin(), bytes.end(), sysex_data_.begin() + sysex_size_);
+    sysex_ranges_[sysex_count_] = {std::uint16_t(sysex_size_), std::uint16_t(bytes.size())};
+    sysex_size_ += bytes.size();
+    messages_[size_++] = {0xF0, std::uint8_t(sysex_count_ & 0xFF), std::uint8_t(sysex_count_ >> 8), 0, frame};
+    sysex_count_++;
+    return true;
+  }
+
+  gsl::span<const std::uint8_t> MidiBuffer::bytes(const MidiMessage& msg) const noexcept
+  {
+    if (msg.status != 0xF0) return {&msg.status, &msg.status + msg.size()};
+    auto range = sysex_ranges_[msg.data1 | (msg.data2 << 8)];
+    auto* first = sysex_data_.data() + range.offset;
+    return {first, first + range.size};
+  }
+
+  void MidiBuffer::clear() noexcept
+  {
+    size_ = 0;
+    sysex_size_ = 0;
+    sysex_count_ = 0;
+  }
+
+  // MidiParser //
+
+  void MidiParser::reset() noexcept
+  {
+    running_status_ = 0;
+    pending_size_ = 0;
+    in_sysex_ = false;
+  }
+
+} // namespace otto::core::midi
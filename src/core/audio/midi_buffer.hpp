@@ -0,0 +1,405 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+#include <gsl/span>
+
+#include "core/audio/midi.hpp"
+
+namespace otto::core::midi {
+
+  /// The kind of a {@ref MidiMessage}, from its status byte
+  enum struct MessageType : std::uint8_t {
+    /// A data byte or an undefined status
+    Invalid,
+    NoteOff,
+    NoteOn,
+    PolyPressure,
+    ControlChange,
+    ProgramChange,
+    ChannelPressure,
+    PitchBend,
+    SysEx,
+    TimeCode,
+    SongPosition,
+    SongSelect,
+    TuneRequest,
+    Clock,
+    Start,
+    Continue,
+    Stop,
+    ActiveSensing,
+    Reset,
+  };
+
+  /// The length of a message with this status byte, including the status byte itself
+  ///
+  /// \returns 0 for sysex, which has no fixed length, and for data bytes and undefined system common statuses
+  constexpr int message_size(std::uint8_t status) noexcept
+  {
+    if (status < 0x80) return 0;
+    if (status < 0xF0) return (status & 0xF0) == 0xC0 || (status & 0xF0) == 0xD0 ? 2 : 3;
+    switch (status) {
+      case 0xF1: [[fallthrough]];
+      case 0xF3: return 2;
+      case 0xF2: return 3;
+      case 0xF6: return 1;
+      default: return status >= 0xF8 ? 1 : 0;
+    }
+  }
+
+  /// A midi message packed into 8 bytes, with its frame offset into the block
+  ///
+  /// The status and data bytes are stored as they are sent on the wire, and the accessors below give a typed
+  /// view of them. Which accessors make sense depends on the {@ref type()}. Sysex messages do not fit, so they
+  /// are kept in the {@ref MidiBuffer} the message is in, and `data1` and `data2` hold their index there.
+  struct MidiMessage {
+    std::uint8_t status = 0;
+    std::uint8_t data1 = 0;
+    std::uint8_t data2 = 0;
+    /// Unused. Keeps `frame` aligned
+    std::uint8_t reserved = 0;
+    /// Offset into the block
+    std::uint32_t frame = 0;
+
+    /// The type of the message. Note on with velocity 0 is a note off, as per the midi specification.
+    MessageType type() const noexcept;
+
+    /// Number of bytes of the message on the wire, or 0 for sysex
+    int size() const noexcept
+    {
+      return message_size(status);
+    }
+
+    /// Channel messages are the ones from note off to pitch bend
+    bool is_channel_message() const noexcept
+    {
+      return status >= 0x80 && status < 0xF0;
+    }
+
+    /// Realtime messages like clock can be sent at any time, even in the middle of other messages
+    bool is_realtime() const noexcept
+    {
+      return status >= 0xF8;
+    }
+
+    /// The channel of a channel message, 0 to 15
+    int channel() const noexcept
+    {
+      return status & 0x0F;
+    }
+
+    /// The key of a note or poly pressure message
+    int key() const noexcept
+    {
+      return data1;
+    }
+
+    /// The velocity of a note message
+    int velocity() const noexcept
+    {
+      return data2;
+    }
+
+    /// The controller number of a control change
+    int controller() const noexcept
+    {
+      return data1;
+    }
+
+    /// The value of a control change
+    int value() const noexcept
+    {
+      return data2;
+    }
+
+    /// The program of a program change
+    int program() const noexcept
+    {
+      return data1;
+    }
+
+    /// The pressure of a poly or channel pressure message
+    int pressure() const noexcept
+    {
+      return (status & 0xF0) == 0xA0 ? data2 : data1;
+    }
+
+    /// The 14 bit value of a pitch bend or song position message. 8192 is the center of a pitch bend.
+    int value14() const noexcept
+    {
+      return data1 | (data2 << 7);
+    }
+
+    /// Convert to the variant event type used by {@ref VoiceManager::handle_midi} and other older code
+    ///
+    /// Types that have no event of their own are converted to a plain {@ref MidiEvent}.
+    AnyMidiEvent to_event() const noexcept;
+
+    /// Pack an event
+    static MidiMessage from_event(const AnyMidiEvent& event) noexcept;
+
+    /// Pack a channel or system message that is not sysex
+    ///
+    /// \returns a message with status 0 if the bytes are not a complete message
+    static MidiMessage from_bytes(gsl::span<const std::uint8_t> bytes, std::uint32_t frame = 0) noexcept;
+
+    bool operator==(const MidiMessage& rhs) const noexcept
+    {
+      return status == rhs.status && data1 == rhs.data1 && data2 == rhs.data2 && frame == rhs.frame;
+    }
+
+    bool operator!=(const MidiMessage& rhs) const noexcept
+    {
+      return !(*this == rhs);
+    }
+  };
+
+  static_assert(sizeof(MidiMessage) == 8);
+
+  /// The midi messages of one block
+  ///
+  /// Fixed capacity, so filling it never allocates. Messages, and the bytes of sysex messages, are stored
+  /// contiguously, so iterating over a dense stream of clock or CC messages stays in a few cache lines.
+  /// Messages pushed to a full buffer are dropped and counted in {@ref dropped()}.
+  struct MidiBuffer {
+    /// Messages per block
+    static constexpr std::size_t capacity = 1024;
+    /// Bytes of sysex per block
+    static constexpr std::size_t sysex_capacity = 4096;
+    /// Sysex messages per block
+    static constexpr std::size_t max_sysex_messages = 64;
+
+    using iterator = const MidiMessage*;
+
+    /// Add a message
+    ///
+    /// \returns `false` if the buffer is full, or `msg` is a sysex message
+    bool push(MidiMessage msg) noexcept;
+
+    /// Pack and add an event. See {@ref MidiMessage::from_event}
+    bool push(const AnyMidiEvent& event) noexcept;
+
+    /// Add a complete message, including sysex messages from `0xF0` to `0xF7`
+    ///
+    /// \returns `false` if the buffer is full, or `bytes` is not a complete message
+    bool push(gsl::span<const std::uint8_t> bytes, std::uint32_t frame) noexcept;
+
+    /// The bytes of a message in this buffer, as they are sent on the wire
+    gsl::span<const std::uint8_t> bytes(const MidiMessage& msg) const noexcept;
+
+    /// Remove all messages. Does not reset {@ref dropped()}
+    void clear() noexcept;
+
+    std::size_t size() const noexcept
+    {
+      return size_;
+    }
+
+    bool empty() const noexcept
+    {
+      return size_ == 0;
+    }
+
+    iterator begin() const noexcept
+    {
+      return messages_.data();
+    }
+
+    iterator end() const noexcept
+    {
+      return messages_.data() + size_;
+    }
+
+    const MidiMessage& operator[](std::size_t i) const noexcept
+    {
+      return messages_[i];
+    }
+
+    /// Number of messages that did not fit, since construction
+    std::uint64_t dropped() const noexcept
+    {
+      return dropped_;
+    }
+
+  private:
+    struct SysexRange {
+      std::uint16_t offset;
+      std::uint16_t size;
+    };
+
+    std::array<MidiMessage, capacity> messages_;
+    std::size_t size_ = 0;
+    std::array<std::uint8_t, sysex_capacity> sysex_data_;
+    std::size_t sysex_size_ = 0;
+    std::array<SysexRange, max_sysex_messages> sysex_ranges_;
+    std::size_t sysex_count_ = 0;
+    std::uint64_t dropped_ = 0;
+  };
+
+  /// Refers to the {@ref MidiBuffer} of a block
+  ///
+  /// This is what {@ref audio::ProcessData} holds, so all copies of the process data refer to the same
+  /// messages. A default constructed reference refers to no buffer. It is empty, and pushing to it fails.
+  struct MidiBufferRef {
+    MidiBufferRef() noexcept = default;
+    MidiBufferRef(MidiBuffer& buffer) noexcept : buffer_(&buffer) {}
+
+    template<typename T>
+    bool push(T&& msg) noexcept
+    {
+      return buffer_ != nullptr && buffer_->push(std::forward<T>(msg));
+    }
+
+    bool push(gsl::span<const std::uint8_t> bytes, std::uint32_t frame) noexcept
+    {
+      return buffer_ != nullptr && buffer_->push(bytes, frame);
+    }
+
+    gsl::span<const std::uint8_t> bytes(const MidiMessage& msg) const noexcept
+    {
+      return buffer_->bytes(msg);
+    }
+
+    std::size_t size() const noexcept
+    {
+      return buffer_ != nullptr ? buffer_->size() : 0;
+    }
+
+    bool empty() const noexcept
+    {
+      return size() == 0;
+    }
+
+    MidiBuffer::iterator begin() const noexcept
+    {
+      return buffer_ != nullptr ? buffer_->begin() : nullptr;
+    }
+
+    MidiBuffer::iterator end() const noexcept
+    {
+      return buffer_ != nullptr ? buffer_->end() : nullptr;
+    }
+
+    /// The buffer, or `nullptr`
+    MidiBuffer* get() const noexcept
+    {
+      return buffer_;
+    }
+
+  private:
+    MidiBuffer* buffer_ = nullptr;
+  };
+
+  /// Splits a stream of midi bytes into messages
+  ///
+  /// Handles running status, realtime messages in the middle of other messages, and sysex messages that arrive
+  /// in several chunks. Bytes that do not belong to any message are skipped, and counted in {@ref dropped()},
+  /// along with sysex messages longer than {@ref max_sysex_size}. Never allocates.
+  struct MidiParser {
+    static constexpr std::size_t max_sysex_size = 512;
+
+    /// Feed a chunk of bytes, and call `on_message(gsl::span<const std::uint8_t>)` with each message
+    /// it completes, in order.
+    ///
+    /// Sysex messages are passed with their `0xF0` and `0xF7` bytes.
+    template<typename F>
+    void parse(gsl::span<const std::uint8_t> bytes, F&& on_message);
+
+    /// Forget any partial message and the running status
+    void reset() noexcept;
+
+    /// Number of bytes and sysex messages that were skipped
+    std::uint64_t dropped() const noexcept
+    {
+      return dropped_;
+    }
+
+  private:
+    std::uint8_t running_status_ = 0;
+    std::array<std::uint8_t, 3> pending_ = {};
+    int pending_size_ = 0;
+    int expected_size_ = 0;
+    bool in_sysex_ = false;
+    bool sysex_overflow_ = false;
+    std::array<std::uint8_t, max_sysex_size> sysex_;
+    std::size_t sysex_size_ = 0;
+    std::uint64_t dropped_ = 0;
+  };
+
+  // IMPLEMENTATION //
+
+  template<typename F>
+  void MidiParser::parse(gsl::span<const std::uint8_t> bytes, F&& on_message)
+  {
+    auto end_sysex = [&](bool complete) {
+      if (complete && !sysex_overflow_) {
+        on_message(gsl::span<const std::uint8_t>(sysex_.data(), sysex_size_));
+      } else {
+        dropped_++;
+      }
+      in_sysex_ = false;
+    };
+    for (std::uint8_t b : bytes) {
+      if (b >= 0xF8) {
+        // Realtime messages do not affect the running status or the message they interrupt
+        if (message_size(b) == 1 && MidiMessage{b}.type() != MessageType::Invalid) {
+          on_message(gsl::span<const std::uint8_t>(&b, 1));
+        } else {
+          dropped_++;
+        }
+        continue;
+      }
+      if (in_sysex_) {
+        if (b < 0x80) {
+          if (sysex_size_ < max_sysex_size - 1) {
+            sysex_[sysex_size_++] = b;
+          } else {
+            sysex_overflow_ = true;
+          }
+          continue;
+        }
+        // Any status byte ends the sysex. Only 0xF7 ends it successfully
+        if (b == 0xF7) sysex_[sysex_size_++] = b;
+        end_sysex(b == 0xF7);
+        if (b == 0xF7) continue;
+      }
+      if (b == 0xF0) {
+        in_sysex_ = true;
+        sysex_overflow_ = false;
+        sysex_[0] = b;
+        sysex_size_ = 1;
+        running_status_ = 0;
+        pending_size_ = 0;
+        continue;
+      }
+      if (b >= 0x80) {
+        // System common messages cancel the running status
+        running_status_ = b < 0xF0 ? b : 0;
+        expected_size_ = message_size(b);
+        pending_size_ = 0;
+        if (expected_size_ == 0) {
+          dropped_++;
+          continue;
+        }
+        pending_[pending_size_++] = b;
+      } else if (pending_size_ == 0) {
+        if (running_status_ == 0) {
+          dropped_++;
+          continue;
+        }
+        pending_[pending_size_++] = running_status_;
+        expected_size_ = message_size(running_status_);
+        pending_[pending_size_++] = b;
+      } else {
+        pending_[pending_size_++] = b;
+      }
+      if (pending_size_ == expected_size_) {
+        on_message(gsl::span<const std::uint8_t>(pending_.data(), pending_size_));
+        pending_size_ = 0;
+      }
+    }
+  }
+
+} // namespace otto::core::midi
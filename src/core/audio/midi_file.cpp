@@ -0,0 +1,194 @@
+#include "midi_file.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+
+namespace otto::core::midi {
+
+  namespace {
+    using ErrorCode = MidiFile::ErrorCode;
+    using exception = MidiFile::exception;
+
+    /// Big endian reader with bounds checks
+    struct Reader {
+      gsl::span<const std::uint8_t> data;
+      std::size_t pos = 0;
+
+      bool at_end() const noexcept
+      {
+        return pos >= data.size();
+      }
+
+      void require(std::size_t n) const
+      {
+        if (pos + n > data.size()) throw exception(ErrorCode::truncated, "MIDI file ends unexpectedly");
+      }
+
+      std::uint8_t u8()
+      {
+        require(1);
+        return data[pos++];
+      }
+
+      std::uint32_t be(int bytes)
+      {
+        require(bytes);
+        std::uint32_t res = 0;
+        for (int i = 0; i < bytes; i++) res = res << 8 | data[pos++];
+        return res;
+      }
+
+      /// Variable length quantity
+      std::uint32_t vlq()
+      {
+        std::uint32_t res = 0;
+        for (int i = 0; i < 4; i++) {
+          auto b = u8();
+          res = res << 7 | (b & 0x7F);
+          if ((b & 0x80) == 0) break;
+        }
+        return res;
+      }
+
+      void skip(std::size_t n)
+      {
+        require(n);
+        pos += n;
+      }
+    };
+
+    struct TickMessage {
+      std::uint64_t tick;
+      std::array<std::uint8_t, 3> bytes;
+    };
+
+    struct TempoChange {
+      std::uint64_t tick;
+      /// Microseconds per quarter note
+      std::uint32_t tempo;
+    };
+
+    /// The number of data bytes following a channel status byte
+    int data_bytes(std::uint8_t status) noexcept
+    {
+      auto type = status >> 4;
+      return (type == 0xC || type == 0xD) ? 1 : 2;
+    }
+
+    /// Read one track. Returns the tick of its last event
+    std::uint64_t read_track(Reader r, std::vector<TickMessage>& messages, std::vector<TempoChange>& tempi)
+    {
+      std::uint64_t tick = 0;
+      std::uint8_t running_status = 0;
+      while (!r.at_end()) {
+        tick += r.vlq();
+        std::uint8_t status = r.u8();
+        if (status == 0xFF) {
+          auto type = r.u8();
+          auto len = r.vlq();
+          if (type == 0x51 && len == 3) {
+            tempi.push_back({tick, r.be(3)});
+          } else {
+            r.skip(len);
+          }
+          if (type == 0x2F) break;
+          continue;
+        }
+        if (status == 0xF0 || status == 0xF7) {
+          r.skip(r.vlq());
+          // Sysex cancels running status
+          running_status = 0;
+          continue;
+        }
+        std::array<std::uint8_t, 3> bytes = {0, 0, 0};
+        int i = 0;
+        if (status & 0x80) {
+          running_status = status;
+        } else {
+          if (running_status == 0) {
+            throw exception(ErrorCode::missing_status, "MIDI data byte {:#x} without a status", status);
+          }
+          // The byte we read was the first data byte
+          bytes[1] = status;
+          i = 1;
+        }
+        bytes[0] = running_status;
+        for (int n = data_bytes(running_status); i < n; i++) bytes[i + 1] = r.u8();
+        if (data_bytes(running_status) == 2) messages.push_back({tick, bytes});
+      }
+      return tick;
+    }
+  } // namespace
+
+  MidiFile MidiFile::parse(gsl::span<const std::uint8_t> data)
+  {
+    Reader r{data};
+    if (data.size() < 14 || r.be(4) != 0x4D546864 /* MThd */) {
+      throw exception(ErrorCode::invalid_header, "Not a MIDI file");
+    }
+    auto header_len = r.be(4);
+    if (header_len < 6) throw exception(ErrorCode::invalid_header, "MIDI header too short");
+    auto format = r.be(2);
+    auto track_count = r.be(2);
+    auto division = r.be(2);
+    r.skip(header_len - 6);
+    if (format > 1) throw exception(ErrorCode::unsupported_format, "MIDI file format {} is not supported", format);
+
+    std::vector<TickMessage> messages;
+    std::vector<TempoChange> tempi;
+    std::uint64_t last_tick = 0;
+    for (unsigned t = 0; t < track_count && !r.at_end(); t++) {
+      auto id = r.be(4);
+      auto len = r.be(4);
+      r.require(len);
+      if (id == 0x4D54726B /* MTrk */) {
+        last_tick = std::max(last_tick, read_track(Reader{data.subspan(r.pos, len)}, messages, tempi));
+      }
+      r.skip(len);
+    }
+
+    // Events at the same tick keep their track order
+    std::stable_sort(messages.begin(), messages.end(), [](auto& a, auto& b) { return a.tick < b.tick; });
+    std::stable_sort(tempi.begin(), tempi.end(), [](auto& a, auto& b) { return a.tick < b.tick; });
+
+    // Seconds per tick, at the current tempo
+    auto tick_length = [division](std::uint32_t tempo) {
+      if (division & 0x8000) {
+        // SMPTE: negative frames per second in the high byte, ticks per frame in the low byte
+        int fps = -std::int8_t(division >> 8);
+        return 1.0 / (fps * (division & 0xFF));
+      }
+      return tempo * 1e-6 / division;
+    };
+
+    // Walk the tempo map alongside the messages
+    auto tempo_iter = tempi.begin();
+    std::uint64_t segment_tick = 0;
+    double segment_time = 0;
+    double seconds_per_tick = tick_length(500000);
+    auto time_of = [&](std::uint64_t tick) {
+      for (; tempo_iter != tempi.end() && tempo_iter->tick <= tick; ++tempo_iter) {
+        segment_time += (tempo_iter->tick - segment_tick) * seconds_per_tick;
+        segment_tick = tempo_iter->tick;
+        seconds_per_tick = tick_length(tempo_iter->tempo);
+      }
+      return segment_time + (tick - segment_tick) * seconds_per_tick;
+    };
+
+    MidiFile res;
+    res.messages.reserve(messages.size());
+    for (auto& m : messages) res.messages.push_back({time_of(m.tick), m.bytes});
+    res.duration = time_of(last_tick);
+    return res;
+  }
+
+  MidiFile MidiFile::read(const filesystem::path& path)
+  {
+    std::ifstream file{path.c_str(), std::ios::binary};
+    if (!file) throw exception(ErrorCode::file_error, "Could not open {}", path.c_str());
+    std::vector<std::uint8_t> data{std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>()};
+    return parse(data);
+  }
+
+} // namespace otto::core::midi
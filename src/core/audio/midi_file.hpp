@@ -0,0 +1,60 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+#include <gsl/span>
+
+#include "util/exception.hpp"
+#include "util/filesystem.hpp"
+
+namespace otto::core::midi {
+
+  /// A Standard MIDI File, flattened to a list of timed channel messages
+  ///
+  /// Formats 0 and 1 are supported. Tracks are merged, and tick times are converted to seconds using the tempo
+  /// map. Only three byte channel messages (note on/off, polyphonic aftertouch, control change and pitch bend)
+  /// are kept. Other messages, sysex and meta events are skipped.
+  struct MidiFile {
+    /// Error codes. Thrown with exceptions from {@ref parse} and {@ref read}
+    enum struct ErrorCode {
+      /// The file could not be opened
+      file_error,
+      /// The file does not start with a valid `MThd` chunk
+      invalid_header,
+      /// A chunk or event runs past the end of the file
+      truncated,
+      /// Format 2 files, which contain independent sequences, are not supported
+      unsupported_format,
+      /// A data byte was found with no running status to apply it to
+      missing_status,
+    };
+
+    /// MidiFile exceptions. Contain an ErrorCode
+    using exception = util::as_exception<ErrorCode>;
+
+    struct Message {
+      /// Seconds since the start of the file
+      double time;
+      std::array<std::uint8_t, 3> bytes;
+    };
+
+    /// Parse a file from memory
+    ///
+    /// \throws exception if the file is invalid
+    static MidiFile parse(gsl::span<const std::uint8_t> data);
+
+    /// Read and parse a file
+    ///
+    /// \throws exception if the file can not be read or is invalid
+    static MidiFile read(const filesystem::path& path);
+
+    /// The channel messages of all tracks, ordered by time
+    std::vector<Message> messages;
+
+    /// The time of the last event in the file, including meta events like end of track
+    double duration = 0;
+  };
+
+} // namespace otto::core::midi
@@ -0,0 +1,38 @@
+#include "midi_input.hpp"
+
+namespace otto::core::midi {
+
+  bool MidiInputQueue::push(gsl::span<const std::uint8_t> message, std::int64_t time) noexcept
+  {
+    auto parser_dropped = parser_.dropped();
+    bool sysex = false;
+    bool pushed_all = true;
+    parser_.parse(message, [&](gsl::span<const std::uint8_t> bytes) {
+      if (bytes[0] == 0xF0) {
+        sysex = true;
+        return;
+      }
+      if (queue_.try_push({time, MidiMessage::from_bytes(bytes)})) {
+        received_.fetch_add(1, std::memory_order_relaxed);
+      } else {
+        pushed_all = false;
+      }
+    });
+    if (sysex || parser_.dropped() != parser_dropped) {
+      dropped_.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    }
+    return pushed_all;
+  }
+
+  auto MidiInputQueue::statistics() const noexcept -> Statistics
+  {
+    return {
+      received_.load(std::memory_order_relaxed),
+      dropped_.load(std::memory_order_relaxed),
+      queue_.overflow_count(),
+      queue_.high_water_mark(),
+    };
+  }
+
+} // namespace otto::core::midi
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+
+#include <gsl/span>
+
+#include "core/audio/midi_buffer.hpp"
+#include "util/spsc_queue.hpp"
+
+namespace otto::core::midi {
+
+  /// A message from a midi input, with the time it was received
+  struct TimedMidiMessage {
+    /// Steady clock time, in nanoseconds
+    std::int64_t time = 0;
+    MidiMessage message;
+  };
+
+  /// Convert a steady clock time to a frame offset into a block
+  ///
+  /// \param window_start The steady clock time of frame 0, in nanoseconds
+  /// \returns the offset, clamped to the block
+  inline int time_to_frame(std::int64_t time, std::int64_t window_start, int samplerate, int nframes) noexcept
+  {
+    auto frame = (time - window_start) * samplerate / 1'000'000'000;
+    return int(std::clamp<std::int64_t>(frame, 0, nframes - 1));
+  }
+
+  /// Passes midi messages from the thread of a midi input to the audio thread
+  ///
+  /// A bounded, lock-free single-producer/single-consumer ring of {@ref TimedMidiMessage}s. Pushing never locks
+  /// or allocates, so it is safe from driver callbacks, and the audio thread drains it at the start of each
+  /// block, converting the timestamps to frame offsets.
+  ///
+  /// The pushed bytes go through a {@ref MidiParser}, so drivers that split messages, or use running status,
+  /// are handled. Sysex messages do not fit in the ring. They, and bytes the parser skips, are dropped on push
+  /// and counted in {@ref Statistics::dropped}. Messages pushed while the ring is full are lost, and counted in
+  /// {@ref Statistics::overflowed}.
+  struct MidiInputQueue {
+    static constexpr std::size_t capacity = 1024;
+
+    struct Statistics {
+      /// Messages that were pushed successfully
+      std::uint64_t received = 0;
+      /// Pushes that contained sysex or invalid bytes
+      std::uint64_t dropped = 0;
+      /// Messages that were lost because the ring was full
+      std::uint64_t overflowed = 0;
+      /// The most messages that have been waiting at once
+      std::size_t high_water_mark = 0;
+    };
+
+    /// Push raw midi bytes, received at steady clock time `time` in nanoseconds.
+    ///
+    /// Usually one complete message, but any chunk of the byte stream is accepted. Producer only. Bytes must
+    /// be pushed in the order they were received.
+    ///
+    /// \returns `false` if anything was dropped or the ring was full
+    bool push(gsl::span<const std::uint8_t> message, std::int64_t time) noexcept;
+
+    /// Pop all waiting messages, and call `f(MidiMessage)` with each of them, in order.
+    ///
+    /// The message frames are offsets from `window_start`, see {@ref time_to_frame}. They never decrease,
+    /// even if the timestamps do.
+    ///
+    /// Consumer only.
+    ///
+    /// \returns the number of messages
+    template<typename F>
+    std::size_t drain(std::int64_t window_start, int samplerate, int nframes, F&& f) noexcept
+    {
+      int last_frame = 0;
+      return queue_.consume_all([&](TimedMidiMessage& msg) {
+        last_frame = std::max(last_frame, time_to_frame(msg.time, window_start, samplerate, nframes));
+        msg.message.frame = last_frame;
+        f(msg.message);
+      });
+    }
+
+    /// Snapshot of the counters. Can be called from any thread
+    Statistics statistics() const noexcept;
+
+  private:
+    util::spsc_queue<TimedMidiMessage, capacity> queue_;
+    /// Producer only
+    MidiParser parser_;
+    std::atomic<std::uint64_t> received_ = 0;
+    std::atomic<std::uint64_t> dropped_ = 0;
+  };
+
+} // namespace otto::core::midi
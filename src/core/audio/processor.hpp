@@ -20,10 +20,11 @@
 #include <exception>
 #include <functional>
 #include <gsl/span>
+#include <type_traits>
 
 #include "core/audio/audio_buffer_pool.hpp"
 #include "core/audio/clock.hpp"
-#include "core/audio/midi.hpp"
+#include "core/audio/midi_buffer.hpp"
 
 #include "util/audio.hpp"
 
@@ -35,12 +36,12 @@ namespace otto::core::audio {
     static constexpr int channels = N;
 
     std::array<AudioBufferHandle, channels> audio;
-    midi::shared_vector<midi::AnyMidiEvent> midi;
+    midi::MidiBufferRef midi;
     clock::ClockRange clock;
     long nframes;
 
     ProcessData(std::array<AudioBufferHandle, channels> audio,
-                midi::shared_vector<midi::AnyMidiEvent> midi = {},
+                midi::MidiBufferRef midi = {},
                 clock::ClockRange clock = {}) noexcept;
 
     ProcessData<0> midi_only();
@@ -71,12 +72,12 @@ namespace otto::core::audio {
   struct ProcessData<0> {
     static constexpr int channels = 0;
 
-    midi::shared_vector<midi::AnyMidiEvent> midi;
+    midi::MidiBufferRef midi;
     clock::ClockRange clock;
     long nframes;
 
-    ProcessData(midi::shared_vector<midi::AnyMidiEvent> midi, clock::ClockRange clock, long nframes) noexcept;
-    ProcessData(midi::shared_vector<midi::AnyMidiEvent> midi, long nframes) noexcept : ProcessData(midi, {}, nframes) {}
+    ProcessData(midi::MidiBufferRef midi, clock::ClockRange clock, long nframes) noexcept;
+    ProcessData(midi::MidiBufferRef midi, long nframes) noexcept : ProcessData(midi, {}, nframes) {}
 
     template<std::size_t NN>
     ProcessData<NN> with(const std::array<AudioBufferHandle, NN>& buf);
@@ -91,16 +92,16 @@ namespace otto::core::audio {
     static constexpr int channels = 1;
 
     AudioBufferHandle audio;
-    midi::shared_vector<midi::AnyMidiEvent> midi;
+    midi::MidiBufferRef midi;
     clock::ClockRange clock;
     long nframes;
 
     ProcessData(AudioBufferHandle audio,
-                midi::shared_vector<midi::AnyMidiEvent> midi = {},
+                midi::MidiBufferRef midi = {},
                 clock::ClockRange clock = {}) noexcept;
 
     ProcessData(std::array<AudioBufferHandle, channels> audio,
-                midi::shared_vector<midi::AnyMidiEvent> midi = {},
+                midi::MidiBufferRef midi = {},
                 clock::ClockRange clock = {}) noexcept
       : ProcessData(audio[0], midi, clock)
     {}
@@ -126,6 +127,21 @@ namespace otto::core::audio {
 
   void validate_audio(AudioBufferHandle& audio);
 
+  /// Split a block at the frames where its midi events occur.
+  ///
+  /// Calls `on_event` for each midi message in `data`, and `on_block(int idx, int length)` for each run of
+  /// frames between them, in order. This lets processors apply events at their exact frame, instead of at the
+  /// start of the buffer.
+  ///
+  /// If `on_event` can be called with a `const midi::MidiMessage&`, it gets the packed message. Otherwise it is
+  /// called with the message converted to a `const midi::AnyMidiEvent&`.
+  ///
+  /// Messages are expected to be sorted by their `frame`. Messages are never reordered: A message with a frame
+  /// before the previous message is applied at the same frame as the previous one, and frames outside the
+  /// block are clamped to it.
+  template<int N, typename EventHandler, typename BlockHandler>
+  void split_at_midi_events(ProcessData<N>& data, EventHandler&& on_event, BlockHandler&& on_block);
+
 } // namespace otto::core::audio
 
 #include "processor.inl"
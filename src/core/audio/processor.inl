@@ -25,7 +25,7 @@ namespace otto::core::audio {
 
   template<int N>
   ProcessData<N>::ProcessData(std::array<AudioBufferHandle, channels> audio,
-                              midi::shared_vector<midi::AnyMidiEvent> midi,
+                              midi::MidiBufferRef midi,
                               clock::ClockRange clock) noexcept
     : audio(audio), midi(midi), clock(clock), nframes(audio[0].size())
   {
@@ -41,7 +41,7 @@ namespace otto::core::audio {
   template<int N>
   ProcessData<N> ProcessData<N>::audio_only()
   {
-    return {audio, {}, clock, nframes};
+    return {audio, {}, clock};
   }
 
   template<int N>
@@ -70,7 +70,7 @@ namespace otto::core::audio {
     auto res = *this;
     length = length < 0 ? nframes - idx : length;
     res.nframes = length;
-    res.audio = audio.slice(idx, length);
+    res.audio = util::generate_array<N>([&](int n) { return audio[n].slice(idx, length); });
     return res;
   }
 
@@ -82,7 +82,7 @@ namespace otto::core::audio {
 
   // ProcessData<0> //
 
-  inline ProcessData<0>::ProcessData(midi::shared_vector<midi::AnyMidiEvent> midi,
+  inline ProcessData<0>::ProcessData(midi::MidiBufferRef midi,
                                      clock::ClockRange clock,
                                      long nframes) noexcept
     : midi(midi), clock(clock), nframes(nframes)
@@ -107,7 +107,7 @@ namespace otto::core::audio {
   // ProcessDaata<1> //
 
   inline ProcessData<1>::ProcessData(AudioBufferHandle audio,
-                                     midi::shared_vector<midi::AnyMidiEvent> midi,
+                                     midi::MidiBufferRef midi,
                                      clock::ClockRange clock) noexcept
     : audio(audio), midi(midi), clock(clock), nframes(audio.size())
   {
@@ -156,4 +156,23 @@ namespace otto::core::audio {
     return {audio.data()};
   }
 
+  template<int N, typename EventHandler, typename BlockHandler>
+  void split_at_midi_events(ProcessData<N>& data, EventHandler&& on_event, BlockHandler&& on_block)
+  {
+    int pos = 0;
+    for (auto& msg : data.midi) {
+      int time = std::clamp<long>(msg.frame, pos, std::max<long>(data.nframes - 1, 0));
+      if (time > pos) {
+        on_block(pos, time - pos);
+        pos = time;
+      }
+      if constexpr (std::is_invocable_v<EventHandler, const midi::MidiMessage&>) {
+        on_event(msg);
+      } else {
+        on_event(msg.to_event());
+      }
+    }
+    if (pos < data.nframes) on_block(pos, data.nframes - pos);
+  }
+
 } // namespace otto::core::audio
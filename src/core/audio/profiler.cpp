@@ -0,0 +1,191 @@
+#include "profiler.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#include <fmt/format.h>
+
+namespace otto::core::audio {
+
+  AudioProfiler::AudioProfiler() = default;
+
+  int AudioProfiler::add_stage(const std::string& name)
+  {
+    std::lock_guard lock(names_lock_);
+    int count = stage_count_.load();
+    auto found = std::find(names_.begin(), names_.begin() + count, name);
+    if (found != names_.begin() + count) return found - names_.begin();
+    if (count == max_stages) return -1;
+    names_[count] = name;
+    stage_count_.store(count + 1);
+    return count;
+  }
+
+  void AudioProfiler::record(int stage, clock::duration duration) noexcept
+  {
+    if (stage < 0) return;
+    auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count();
+    auto& bt = stages_[stage].block_time;
+    // Only one thread records a stage at a time, so this doesn't need to be a single atomic operation
+    bt.store(std::max<std::int64_t>(bt.load(std::memory_order_relaxed), 0) + ns, std::memory_order_relaxed);
+  }
+
+  void AudioProfiler::begin_block() noexcept
+  {
+    if (block_open_) end_block();
+    if (reset_requested_.exchange(false, std::memory_order_acquire)) clear();
+    block_open_ = true;
+  }
+
+  void AudioProfiler::end_block() noexcept
+  {
+    if (!block_open_) return;
+    block_open_ = false;
+    std::int64_t slowest_time = -1;
+    int count = stage_count_.load(std::memory_order_acquire);
+    for (int i = 0; i < count; i++) {
+      auto& stage = stages_[i];
+      auto t = stage.block_time.exchange(-1, std::memory_order_relaxed);
+      if (t < 0) continue;
+      auto& bucket = stage.histogram[bucket_of(t)];
+      // Only the audio thread writes these, so a load and a store is enough
+      bucket.store(bucket.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+      if (std::uint64_t(t) > stage.max.load(std::memory_order_relaxed)) stage.max.store(t, std::memory_order_relaxed);
+      if (t > slowest_time) {
+        slowest_time = t;
+        last_slowest_ = i;
+      }
+    }
+  }
+
+  void AudioProfiler::report_xrun() noexcept
+  {
+    end_block();
+    xruns_.fetch_add(1, std::memory_order_relaxed);
+    if (last_slowest_ >= 0) stages_[last_slowest_].xruns.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  void AudioProfiler::record_resource_usage(std::uint64_t page_faults, std::uint64_t involuntary_switches) noexcept
+  {
+    auto now = clock::now();
+    if (!resource_baseline_) {
+      resource_baseline_ = {now, page_faults, involuntary_switches};
+      resource_window_ = *resource_baseline_;
+      resource_window_full_ = false;
+      return;
+    }
+    page_faults_.store(page_faults - resource_baseline_->page_faults, std::memory_order_relaxed);
+    involuntary_switches_.store(involuntary_switches - resource_baseline_->involuntary_switches,
+                                std::memory_order_relaxed);
+
+    constexpr auto minute = std::chrono::minutes(1);
+    auto elapsed = now - resource_window_.time;
+    // Until the first minute is over, the rate is extrapolated from the partial window
+    if (elapsed < minute && resource_window_full_) return;
+    double minutes = std::chrono::duration<double, std::ratio<60>>(elapsed).count();
+    if (minutes <= 0) return;
+    page_faults_per_minute_.store((page_faults - resource_window_.page_faults) / minutes, std::memory_order_relaxed);
+    involuntary_switches_per_minute_.store((involuntary_switches - resource_window_.involuntary_switches) / minutes,
+                                           std::memory_order_relaxed);
+    if (elapsed >= minute) {
+      resource_window_ = {now, page_faults, involuntary_switches};
+      resource_window_full_ = true;
+    }
+  }
+
+  AudioProfiler::ResourceStatistics AudioProfiler::resource_statistics() const noexcept
+  {
+    ResourceStatistics res;
+    res.page_faults_per_minute = page_faults_per_minute_.load(std::memory_order_relaxed);
+    res.involuntary_switches_per_minute = involuntary_switches_per_minute_.load(std::memory_order_relaxed);
+    res.page_faults = page_faults_.load(std::memory_order_relaxed);
+    res.involuntary_switches = involuntary_switches_.load(std::memory_order_relaxed);
+    return res;
+  }
+
+  void AudioProfiler::reset() noexcept
+  {
+    reset_requested_.store(true, std::memory_order_release);
+  }
+
+  void AudioProfiler::clear() noexcept
+  {
+    for (auto& stage : stages_) {
+      for (auto& b : stage.histogram) b.store(0, std::memory_order_relaxed);
+      stage.max.store(0, std::memory_order_relaxed);
+      stage.xruns.store(0, std::memory_order_relaxed);
+    }
+    xruns_.store(0, std::memory_order_relaxed);
+    last_slowest_ = -1;
+    resource_baseline_.reset();
+    page_faults_per_minute_.store(0, std::memory_order_relaxed);
+    involuntary_switches_per_minute_.store(0, std::memory_order_relaxed);
+    page_faults_.store(0, std::memory_order_relaxed);
+    involuntary_switches_.store(0, std::memory_order_relaxed);
+  }
+
+  std::vector<AudioProfiler::StageStatistics> AudioProfiler::statistics() const
+  {
+    std::vector<StageStatistics> res;
+    std::lock_guard lock(names_lock_);
+    int count = stage_count_.load(std::memory_order_acquire);
+    res.reserve(count);
+    for (int i = 0; i < count; i++) {
+      auto& stage = stages_[i];
+      StageStatistics stats;
+      stats.name = names_[i];
+      stats.max = stage.max.load(std::memory_order_relaxed);
+      stats.xruns = stage.xruns.load(std::memory_order_relaxed);
+      std::array<std::uint32_t, bucket_count> hist;
+      std::uint64_t total = 0;
+      for (int b = 0; b < bucket_count; b++) {
+        hist[b] = stage.histogram[b].load(std::memory_order_relaxed);
+        total += hist[b];
+      }
+      stats.blocks = total;
+      auto percentile = [&](double p) -> std::uint64_t {
+        // Nearest rank
+        auto rank = std::max<std::uint64_t>(std::ceil(p * total), 1);
+        std::uint64_t seen = 0;
+        for (int b = 0; b < bucket_count; b++) {
+          seen += hist[b];
+          if (seen >= rank) return std::min(bucket_max(b), stats.max);
+        }
+        return stats.max;
+      };
+      if (total > 0) {
+        stats.p50 = percentile(0.5);
+        stats.p99 = percentile(0.99);
+      }
+      res.push_back(std::move(stats));
+    }
+    return res;
+  }
+
+  void AudioProfiler::write_csv(std::ostream& os) const
+  {
+    os << "stage,blocks,p50_us,p99_us,max_us,xruns\n";
+    for (auto& s : statistics()) {
+      os << fmt::format("\"{}\",{},{:.1f},{:.1f},{:.1f},{}\n", s.name, s.blocks, s.p50 / 1000.0, s.p99 / 1000.0,
+                        s.max / 1000.0, s.xruns);
+    }
+  }
+
+  int AudioProfiler::bucket_of(std::uint64_t ns) noexcept
+  {
+    if (ns < buckets_per_octave) return ns;
+    ns = std::min<std::uint64_t>(ns, 0xFFFFFFFF);
+    int msb = 63 - __builtin_clzll(ns);
+    // The two bits below the most significant one select the bucket within the octave
+    return msb * buckets_per_octave + ((ns >> (msb - 2)) & 3);
+  }
+
+  std::uint64_t AudioProfiler::bucket_max(int bucket) noexcept
+  {
+    if (bucket < buckets_per_octave) return bucket;
+    int msb = bucket / buckets_per_octave;
+    int sub = bucket % buckets_per_octave;
+    return (std::uint64_t(buckets_per_octave + sub + 1) << (msb - 2)) - 1;
+  }
+
+} // namespace otto::core::audio
@@ -0,0 +1,196 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace otto::core::audio {
+
+  /// Records how long each stage of the audio processing takes, per block
+  ///
+  /// Stages are registered by name off the audio thread, and timed on the audio thread with {@ref Scope}.
+  /// The timings of each block go into a logarithmic histogram per stage, which the ui thread can read
+  /// percentiles from at any time. Recording never locks or allocates.
+  ///
+  /// When the audio driver reports an xrun, it is attributed to the stage that took the longest in the
+  /// block before it.
+  ///
+  /// The audio manager also records the page faults and involuntary context switches of the audio thread, which
+  /// should both stay at zero once the realtime setup is done.
+  ///
+  /// ```cpp
+  /// // Setup
+  /// int stage = profiler.add_stage("synth");
+  /// // Audio thread
+  /// profiler.begin_block();
+  /// {
+  ///   auto scope = profiler.scope(stage);
+  ///   ...
+  /// }
+  /// profiler.end_block();
+  /// ```
+  struct AudioProfiler {
+    using clock = std::chrono::steady_clock;
+
+    /// The maximum number of stages
+    static constexpr int max_stages = 32;
+
+    /// Times a stage until destroyed
+    struct Scope {
+      Scope(AudioProfiler* profiler, int stage) noexcept
+        : profiler_(profiler), stage_(stage), start_(stage < 0 ? clock::time_point() : clock::now())
+      {}
+      Scope(const Scope&) = delete;
+      Scope& operator=(const Scope&) = delete;
+      ~Scope() noexcept
+      {
+        if (stage_ >= 0) profiler_->record(stage_, clock::now() - start_);
+      }
+
+    private:
+      AudioProfiler* profiler_;
+      int stage_;
+      clock::time_point start_;
+    };
+
+    /// Percentiles of the time a stage took per block
+    struct StageStatistics {
+      std::string name;
+      /// The number of blocks the stage ran in
+      std::uint64_t blocks = 0;
+      /// Nanoseconds. Accurate to within 25%.
+      std::uint64_t p50 = 0;
+      std::uint64_t p99 = 0;
+      /// Nanoseconds. Exact.
+      std::uint64_t max = 0;
+      /// The number of xruns this stage was the slowest stage of the block before
+      std::uint64_t xruns = 0;
+    };
+
+    /// Page faults and involuntary context switches of the audio thread, see {@ref record_resource_usage}
+    struct ResourceStatistics {
+      /// In the last full minute, or extrapolated from the time since recording started if less than a minute
+      double page_faults_per_minute = 0;
+      double involuntary_switches_per_minute = 0;
+      /// Since recording started
+      std::uint64_t page_faults = 0;
+      std::uint64_t involuntary_switches = 0;
+    };
+
+    AudioProfiler();
+
+    /// Register a stage, or get the existing stage with the same name
+    ///
+    /// Not for the audio thread.
+    ///
+    /// \returns The stage index, or -1 if there are already {@ref max_stages} stages. Recording to stage -1 does
+    ///          nothing.
+    int add_stage(const std::string& name);
+
+    /// Start timing a stage. The time is recorded when the returned scope is destroyed.
+    [[nodiscard]] Scope scope(int stage) noexcept
+    {
+      return {this, stage};
+    }
+
+    /// Add `duration` to the time of `stage` in the current block
+    ///
+    /// Each stage may be recorded from one thread at a time, but different stages may be recorded from
+    /// different threads at once.
+    void record(int stage, clock::duration duration) noexcept;
+
+    /// Start a new block. Ends the previous block if {@ref end_block} was not called.
+    ///
+    /// Audio thread only.
+    void begin_block() noexcept;
+
+    /// Record the times of the current block into the histograms
+    ///
+    /// Audio thread only.
+    void end_block() noexcept;
+
+    /// Attribute an xrun to the slowest stage of the last block
+    ///
+    /// Audio thread only. Call it before the next block is started.
+    void report_xrun() noexcept;
+
+    /// The number of xruns reported in total
+    std::uint64_t xruns() const noexcept
+    {
+      return xruns_.load(std::memory_order_relaxed);
+    }
+
+    /// Record the total page faults and involuntary context switches of the audio thread so far
+    ///
+    /// The first call sets the baseline. Call it about once a second, from the audio thread only.
+    void record_resource_usage(std::uint64_t page_faults, std::uint64_t involuntary_switches) noexcept;
+
+    /// The rates of page faults and context switches from {@ref record_resource_usage}
+    ///
+    /// Can be called from any thread.
+    ResourceStatistics resource_statistics() const noexcept;
+
+    /// Clear all histograms, xrun counts and resource usage at the start of the next block
+    void reset() noexcept;
+
+    /// Get the statistics of all stages
+    ///
+    /// Can be called from any thread. The statistics are read while they are being updated, so they may be off
+    /// by a block.
+    std::vector<StageStatistics> statistics() const;
+
+    /// Write the statistics as CSV, with one row per stage. Times are in microseconds.
+    void write_csv(std::ostream& os) const;
+
+  private:
+    /// Four buckets per power of two, for durations up to 2^32 ns
+    static constexpr int buckets_per_octave = 4;
+    static constexpr int bucket_count = 32 * buckets_per_octave;
+
+    static int bucket_of(std::uint64_t ns) noexcept;
+    /// The largest duration that falls in `bucket`
+    static std::uint64_t bucket_max(int bucket) noexcept;
+
+    struct Stage {
+      /// Nanoseconds in the current block, or -1 if the stage has not run this block
+      std::atomic<std::int64_t> block_time = -1;
+      std::array<std::atomic<std::uint32_t>, bucket_count> histogram = {};
+      std::atomic<std::uint64_t> max = 0;
+      std::atomic<std::uint64_t> xruns = 0;
+    };
+
+    void clear() noexcept;
+
+    std::array<Stage, max_stages> stages_;
+    std::atomic_int stage_count_ = 0;
+    mutable std::mutex names_lock_;
+    std::array<std::string, max_stages> names_;
+
+    /// Resource usage counters at the start of recording and of the current minute
+    struct ResourceSample {
+      clock::time_point time;
+      std::uint64_t page_faults = 0;
+      std::uint64_t involuntary_switches = 0;
+    };
+    std::optional<ResourceSample> resource_baseline_;
+    ResourceSample resource_window_;
+    bool resource_window_full_ = false;
+    std::atomic<double> page_faults_per_minute_ = 0;
+    std::atomic<double> involuntary_switches_per_minute_ = 0;
+    std::atomic<std::uint64_t> page_faults_ = 0;
+    std::atomic<std::uint64_t> involuntary_switches_ = 0;
+
+    bool block_open_ = false;
+    /// The slowest stage of the last finished block
+    int last_slowest_ = -1;
+    std::atomic<std::uint64_t> xruns_ = 0;
+    std::atomic_bool reset_requested_ = false;
+  };
+
+} // namespace otto::core::audio
@@ -0,0 +1,38 @@
+#include "reblocker.hpp"
+
+namespace otto::core::audio {
+
+  Reblocker::Reblocker(int block_size, int max_frames)
+    : block_size_(block_size),
+      out_(2 * block_size),
+      // At the start of a call, the ring holds one block minus the frames left in `out_`
+      in_ring_(block_size + max_frames),
+      in_block_(block_size)
+  {}
+
+  void Reblocker::push_input(const float* in, int n) noexcept
+  {
+    const auto cap = in_ring_.size();
+    for (int i = 0; i < n;) {
+      auto w = in_write_ % cap;
+      int k = std::min<std::size_t>(n - i, cap - w);
+      std::copy_n(in + i, k, in_ring_.data() + w);
+      in_write_ += k;
+      i += k;
+    }
+  }
+
+  const float* Reblocker::pop_input() noexcept
+  {
+    const auto cap = in_ring_.size();
+    for (int i = 0; i < block_size_;) {
+      auto r = in_read_ % cap;
+      int k = std::min<std::size_t>(block_size_ - i, cap - r);
+      std::copy_n(in_ring_.data() + r, k, in_block_.data() + i);
+      in_read_ += k;
+      i += k;
+    }
+    return in_block_.data();
+  }
+
+} // namespace otto::core::audio
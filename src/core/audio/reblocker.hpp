@@ -0,0 +1,100 @@
+#pragma once
+
+#include <algorithm>
+#include <vector>
+
+namespace otto::core::audio {
+
+  /// Adapts audio callbacks of varying length to a fixed processing block size
+  ///
+  /// Some audio backends occasionally call back with a different number of frames than requested. The engines
+  /// are always processed in blocks of `block_size` frames, and any surplus output is kept for the next
+  /// callback. Whole blocks that fit in a callback are rendered directly into its buffers, so a callback of
+  /// exactly `block_size` frames costs nothing extra.
+  ///
+  /// Output is never delayed. Input can only be kept aligned with the output by delaying it one block, so the
+  /// first callback whose length is not a multiple of `block_size` switches the input to a one block delay,
+  /// which is kept from then on.
+  struct Reblocker {
+    /// \param block_size The number of frames to process at a time
+    /// \param max_frames The maximum number of frames per call to {@ref process}
+    Reblocker(int block_size, int max_frames);
+
+    /// Render `nframes` frames of stereo output, processing whole blocks as needed
+    ///
+    /// \param in Mono input, or `nullptr`
+    /// \param process_block Called as `process_block(float* out_l, float* out_r, const float* in)` to render one
+    ///                      block of `block_size` frames. `in` is `nullptr` if there is no input.
+    /// \requires `nframes <= max_frames`
+    template<typename F>
+    void process(float* out_l, float* out_r, const float* in, int nframes, F&& process_block);
+
+    int block_size() const noexcept
+    {
+      return block_size_;
+    }
+
+    /// Whether the input is delayed by a block
+    bool input_delayed() const noexcept
+    {
+      return input_delayed_;
+    }
+
+  private:
+    void push_input(const float* in, int n) noexcept;
+    /// Pop a block of input into `in_block_`
+    const float* pop_input() noexcept;
+
+    int block_size_;
+    /// Planar left and right output of the last block, of which `out_size_` frames are left from `out_read_`
+    std::vector<float> out_;
+    int out_read_ = 0;
+    int out_size_ = 0;
+
+    bool input_delayed_ = false;
+    std::vector<float> in_ring_;
+    std::size_t in_read_ = 0;
+    std::size_t in_write_ = 0;
+    std::vector<float> in_block_;
+  };
+
+  // IMPLEMENTATION //
+
+  template<typename F>
+  void Reblocker::process(float* out_l, float* out_r, const float* in, int nframes, F&& process_block)
+  {
+    if (in != nullptr) {
+      if (!input_delayed_ && nframes % block_size_ != 0) {
+        input_delayed_ = true;
+        in_read_ = in_write_ = 0;
+        std::fill_n(in_ring_.begin(), block_size_, 0.f);
+        in_write_ = block_size_;
+      }
+      if (input_delayed_) push_input(in, nframes);
+    }
+    auto block_input = [&](int pos) -> const float* {
+      if (in == nullptr) return nullptr;
+      return input_delayed_ ? pop_input() : in + pos;
+    };
+
+    int pos = 0;
+    while (pos < nframes) {
+      if (out_size_ > 0) {
+        int n = std::min(out_size_, nframes - pos);
+        std::copy_n(out_.data() + out_read_, n, out_l + pos);
+        std::copy_n(out_.data() + block_size_ + out_read_, n, out_r + pos);
+        out_read_ += n;
+        out_size_ -= n;
+        pos += n;
+      } else if (nframes - pos >= block_size_) {
+        process_block(out_l + pos, out_r + pos, block_input(pos));
+        pos += block_size_;
+      } else {
+        process_block(out_.data(), out_.data() + block_size_, block_input(pos));
+        out_read_ = 0;
+        out_size_ = block_size_;
+      }
+    }
+  }
+
+} // namespace otto::core::audio
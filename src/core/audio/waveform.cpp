@@ -1,97 +1,331 @@
 #include "waveform.hpp"
 
-#include "util/iterator.hpp"
-#include "util/algorithm.hpp"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <thread>
 
-#include <Gamma/Analysis.h>
+#include "util/futex.hpp"
+#include "util/simd.hpp"
 
 namespace otto::core::audio {
 
-  Waveform::Waveform(gsl::span<float> data, int min_points)
-    : input_data_(data),
-      max_res_(std::floor(std::log(data.size() / min_points))),
-      points_(data.size() * (2 - std::pow(2, -max_res_)))
+  namespace {
+    using util::simd::vfloat;
+
+    struct CacheHeader {
+      std::array<char, 4> magic = {'O', 'T', 'P', 'K'};
+      std::uint32_t version = 1;
+      std::uint32_t base_bin = Waveform::base_bin;
+      std::uint32_t levels = 0;
+      std::uint32_t frames = 0;
+      std::uint32_t reserved = 0;
+      /// The size and modification time of the file. If they match, the file is not hashed
+      std::uint64_t file_size = 0;
+      std::int64_t mtime = 0;
+      std::uint64_t hash = 0;
+
+      bool same_layout(const CacheHeader& rhs) const noexcept
+      {
+        return magic == rhs.magic && version == rhs.version && base_bin == rhs.base_bin && levels == rhs.levels &&
+               frames == rhs.frames;
+      }
+    };
+
+    fs::path cache_path(const fs::path& file)
+    {
+      auto res = file;
+      res += ".peaks";
+      return res;
+    }
+
+    /// FNV-1a, taken a word at a time instead of a byte at a time, which is plenty to tell files apart
+    ///
+    /// Gives up when `stop` is set, and then returns the hash of the part that was read
+    std::uint64_t hash_file(const fs::path& file, const std::atomic<bool>& stop)
+    {
+      std::ifstream in(file.c_str(), std::ios::binary);
+      std::uint64_t hash = 0xcbf29ce484222325;
+      std::vector<std::uint64_t> buffer(1 << 17);
+      while (in && !stop) {
+        in.read(reinterpret_cast<char*>(buffer.data()), buffer.size() * sizeof(std::uint64_t));
+        std::size_t bytes = in.gcount();
+        std::size_t words = (bytes + sizeof(std::uint64_t) - 1) / sizeof(std::uint64_t);
+        std::memset(reinterpret_cast<char*>(buffer.data()) + bytes, 0, words * sizeof(std::uint64_t) - bytes);
+        for (std::size_t i = 0; i < words; i++) {
+          hash ^= buffer[i];
+          hash *= 0x100000001b3;
+        }
+      }
+      return hash;
+    }
+
+    Peak merge(Peak a, Peak b) noexcept
+    {
+      return {std::min(a.min, b.min), std::max(a.max, b.max)};
+    }
+
+    /// The peak of `n` frames, {@ref vfloat::size} at a time. `frames` does not need to be aligned
+    Peak peak_of(const float* frames, int n) noexcept
+    {
+      if (n <= 0) return {};
+      Peak res = {frames[0], frames[0]};
+      int i = 0;
+      for (; i < n && reinterpret_cast<std::uintptr_t>(frames + i) % vfloat::alignment != 0; i++) {
+        res = merge(res, {frames[i], frames[i]});
+      }
+      if (n - i >= int(vfloat::size)) {
+        vfloat lo = vfloat::load(frames + i);
+        vfloat hi = lo;
+        for (i += vfloat::size; i + int(vfloat::size) <= n; i += vfloat::size) {
+          vfloat v = vfloat::load(frames + i);
+          lo = min(lo, v);
+          hi = max(hi, v);
+        }
+        alignas(vfloat::alignment) std::array<float, vfloat::size> los, his;
+        lo.store(los.data());
+        hi.store(his.data());
+        for (std::size_t l = 0; l < vfloat::size; l++) res = merge(res, {los[l], his[l]});
+      }
+      for (; i < n; i++) res = merge(res, {frames[i], frames[i]});
+      return res;
+    }
+  } // namespace
+
+  // Waveform::Worker //
+
+  struct Waveform::Worker {
+    static Worker& get()
+    {
+      static Worker instance;
+      return instance;
+    }
+
+    ~Worker()
+    {
+      {
+        std::lock_guard lock(mutex_);
+        stop_ = true;
+      }
+      cv_.notify_all();
+      if (thread_.joinable()) thread_.join();
+    }
+
+    void submit(Waveform& wf)
+    {
+      {
+        std::lock_guard lock(mutex_);
+        if (!thread_.joinable()) thread_ = std::thread([this] { run(); });
+        queue_.push_back(&wf);
+      }
+      cv_.notify_all();
+    }
+
+    /// Make sure `wf` is not being built, and will not be. Returns within a chunk, since `wf` is stopped
+    void cancel(Waveform& wf)
+    {
+      std::unique_lock lock(mutex_);
+      queue_.erase(std::remove(queue_.begin(), queue_.end(), &wf), queue_.end());
+      cv_.wait(lock, [&] { return building_ != &wf; });
+    }
+
+  private:
+    void run()
+    {
+      std::unique_lock lock(mutex_);
+      while (true) {
+        cv_.wait(lock, [&] { return stop_ || !queue_.empty(); });
+        if (stop_) return;
+        auto* wf = queue_.front();
+        queue_.pop_front();
+        building_ = wf;
+        lock.unlock();
+        wf->run();
+        lock.lock();
+        building_ = nullptr;
+        cv_.notify_all();
+      }
+    }
+
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::deque<Waveform*> queue_;
+    Waveform* building_ = nullptr;
+    bool stop_ = false;
+    std::thread thread_;
+  };
+
+  // Waveform //
+
+  Waveform::Waveform(gsl::span<float> data, int min_points) : input_data_(data), size_(data.size())
   {
-    DLOGI("Maximum resolution is = {}", max_res_);
-    DLOGI("File size: {}", input_data_.size());
-    for (int i = 0; i <= max_res_; i++) {
-      DLOGI("Generating res = {}", i);
-      generate_res(i);
+    allocate(min_points);
+    if (size_ > 0) Worker::get().submit(*this);
+  }
+
+  Waveform::Waveform(const fs::path& file, int min_points) : path_(file)
+  {
+    try {
+      file_ = std::make_unique<util::dsp::WavFile>(file);
+      size_ = file_->size();
+    } catch (util::dsp::WavFile::exception& e) {
+      LOGW("Could not open waveform: {}", e.what());
     }
-    DLOGI("Done generating");
+    allocate(min_points);
+    if (size_ > 0) Worker::get().submit(*this);
+  }
+
+  Waveform::~Waveform()
+  {
+    stop_ = true;
+    if (size_ > 0) Worker::get().cancel(*this);
   }
 
-  gsl::span<float> Waveform::at_resolution(int res)
+  int Waveform::size() const noexcept
   {
-    // int start = std::ceil(input_data_.size() * (1.f - std::pow(2.f, -float(res - 1.f))));
-    // int length = std::ceil(input_data_.size() * std::pow(2.f, -float(res)));
-    // return {points_.data() + start, length};
+    return size_;
+  }
 
-    // return {points_.data() + input_data_.size() * res, input_data_.size()};
-    //return {points_.data(), std::ceil(float(input_data_.size()) / float(bin_size))};
+  int Waveform::frames_ready() const noexcept
+  {
+    return frames_ready_.load(std::memory_order_acquire);
+  }
 
-    //NOTE: I have changed ceil to floor, to 
-    // Calculate start-point in points_.
-    // The result of the sum over: input_data_.size()*2^(-n), for n=0 to n=res
-    int start = std::ceil(input_data_.size() * (2 - std::pow(2.f, 1-float(res))));
-    // Calculate number of points at a certain resolution
-    int length = std::ceil(input_data_.size() * std::pow(2.f, -float(res)));
-    DLOGI("start: {}, length: {}", start, length);
-    return {points_.data() + start, length};
+  bool Waveform::ready() const noexcept
+  {
+    return frames_ready() == size_;
   }
 
-  void Waveform::generate_res(int res) {
-    // Get the span in which to put the points
-    auto data = at_resolution(res);
-    auto dst = data.begin();
+  void Waveform::wait() const noexcept
+  {
+    for (auto ready = frames_ready_.load(std::memory_order_acquire); int(ready) < size_;
+         ready = frames_ready_.load(std::memory_order_acquire)) {
+      util::futex_wait(frames_ready_, ready);
+    }
+  }
 
-    if (res == 0) {
-      // Res=0 is special.
-      util::transform(input_data_, dst, [](float f){return std::abs(f);} );
+  void Waveform::allocate(int min_points)
+  {
+    // At least one level, even when the whole waveform fits in fewer than `min_points` bins of it
+    int levels = 1;
+    while ((std::int64_t(base_bin) << levels) <= size_ / std::max(min_points, 1)) levels++;
+    for (int l = 0; l < levels; l++) {
+      int bin = base_bin << l;
+      levels_.emplace_back((size_ + bin - 1) / bin);
+    }
+    chunk_frames_ = base_bin << (levels - 1);
+  }
 
+  void Waveform::read(int first, gsl::span<float> out) const
+  {
+    if (file_ != nullptr) {
+      file_->read(first, out);
     } else {
-      // For all other resolutions, the source of data is the previous resolution
-      auto src_data = at_resolution(res - 1);
-      auto src = src_data.cbegin();
-      // Pick out every second point
-      *dst = *src;
-      while (src < src_data.cend()-2) {
-        dst++;
-        src += 2;
-        *dst = *src;
-      }
-      DLOGI("Done.");
-      // Low-pass filter the result.
-      // Do it forwards and backwards to get zero phase twists.
-      
-      for (auto &f : data) {
-        f = lpf(f);
-      }
-      lpf.zero();
-      for (auto f = data.rbegin(); f != data.rend(); ++f) {
-        *f = lpf(*f);
-      }
-      
+      std::copy_n(input_data_.begin() + first, out.size(), out.begin());
+    }
+  }
+
+  void Waveform::run()
+  {
+    if (file_ != nullptr && load_cache()) {
+      DLOGI("Loaded the peaks of {} from the cache", path_.string());
+      frames_ready_.store(size_, std::memory_order_release);
+      util::futex_wake_all(frames_ready_);
+      return;
+    }
+    std::vector<float> buffer;
+    for (int first = 0; first < size_ && !stop_; first += chunk_frames_) {
+      build_chunk(first, buffer);
+      frames_ready_.store(std::min(first + chunk_frames_, size_), std::memory_order_release);
+    }
+    util::futex_wake_all(frames_ready_);
+    // Saved as long as it was finished, unless the waveform is destroyed while the file is hashed
+    if (file_ != nullptr && ready()) save_cache();
+  }
 
+  void Waveform::build_chunk(int first, std::vector<float>& buffer)
+  {
+    const int n = std::min(chunk_frames_, size_ - first);
+    const float* frames = input_data_.data() + first;
+    if (file_ != nullptr) {
+      buffer.resize(n);
+      file_->read(first, buffer);
+      frames = buffer.data();
+    }
+    // Nearly all the work is in the finest level, which is reduced from the frames
+    for (int f = 0; f < n; f += base_bin) {
+      levels_[0][(first + f) / base_bin] = peak_of(frames + f, std::min(base_bin, n - f));
+    }
+    // Each coarser level is reduced from the one below, which has 1/256th as many values, so this is scalar
+    for (std::size_t l = 1; l < levels_.size(); l++) {
+      const auto& below = levels_[l - 1];
+      const int bin = base_bin << (l - 1);
+      const int last = (first + n + bin - 1) / bin;
+      // `first` is a multiple of the coarsest bin, so this starts on an even bin
+      for (int b = first / bin; b < last; b += 2) {
+        levels_[l][b / 2] = b + 1 < last ? merge(below[b], below[b + 1]) : below[b];
+      }
     }
-    
   }
 
-  int Waveform::res_for_duration(int dur, int nPoints) const
+  bool Waveform::load_cache()
   {
-    if (dur == 0) return 0;
-    // The max is to be safe against when dur < nPoints
-    return std::max(std::floor(std::log(dur / float(nPoints))),0.f);
+    std::ifstream in(cache_path(path_).c_str(), std::ios::binary);
+    if (!in) return false;
+    CacheHeader header;
+    in.read(reinterpret_cast<char*>(&header), sizeof(header));
+    CacheHeader expected;
+    expected.levels = levels_.size();
+    expected.frames = size_;
+    if (!in || !header.same_layout(expected)) return false;
 
-    // Highest integer n such that
-    //dur > nPoints * n
-    // Then
-    //res = n-1
-    // But 0 =< res
-    //return std::max(int(std::floor(dur / float(nPoints)) - 1), 0);
+    std::error_code ec;
+    auto file_size = fs::file_size(path_, ec);
+    auto mtime = fs::last_write_time(path_, ec).time_since_epoch().count();
+    // Copied or touched files can still have the same contents
+    if ((header.file_size != file_size || header.mtime != mtime) && header.hash != hash_file(path_, stop_)) {
+      return false;
+    }
 
+    for (auto& level : levels_) in.read(reinterpret_cast<char*>(level.data()), level.size() * sizeof(Peak));
+    return in && in.peek() == std::ifstream::traits_type::eof();
   }
 
+  void Waveform::save_cache() const
+  {
+    std::error_code ec;
+    CacheHeader header;
+    header.levels = levels_.size();
+    header.frames = size_;
+    header.file_size = fs::file_size(path_, ec);
+    header.mtime = fs::last_write_time(path_, ec).time_since_epoch().count();
+    header.hash = hash_file(path_, stop_);
+    if (stop_) return;
+
+    // Written next to the cache and moved over it, so a cache that is being written is never read
+    auto cache = cache_path(path_);
+    auto tmp = cache;
+    tmp += ".tmp";
+    {
+      std::ofstream out(tmp.c_str(), std::ios::binary | std::ios::trunc);
+      out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+      for (auto& level : levels_) {
+        out.write(reinterpret_cast<const char*>(level.data()), level.size() * sizeof(Peak));
+      }
+      if (!out.good()) {
+        LOGW("Could not write the peak cache {}", cache.string());
+        fs::remove(tmp, ec);
+        return;
+      }
+    }
+    fs::rename(tmp, cache, ec);
+    if (ec) LOGW("Could not write the peak cache {}: {}", cache.string(), ec.message());
+  }
 
   WaveformView Waveform::view(int nPoints, int first, int last)
   {
@@ -100,69 +334,71 @@ namespace otto::core::audio {
 
   WaveformView& Waveform::view(WaveformView& v, int first, int last)
   {
-    if (points_.size() == 0) {
-      util::fill(v.points_, 0);
+    OTTO_ASSERT(last >= first);
+    const int npoints = v.points_.size();
+    std::fill(v.points_.begin(), v.points_.end(), Peak{});
+    first = std::clamp(first, 0, size_);
+    last = std::clamp(last, first, size_);
+    const double step = npoints > 0 ? double(last - first) / npoints : 0;
+    v.start_ = first;
+    v.step_ = step;
+    if (npoints == 0 || last == first) return v;
+
+    // The frames shown by point `i`. At least one, when there are more points than frames
+    auto frames_of = [&](int i) {
+      int a = first + int(i * step);
+      int b = std::max(a + 1, first + int((i + 1) * step));
+      return std::pair(a, b);
+    };
+
+    if (step < base_bin) {
+      // Close enough that the frames themselves are cheap to read
+      scratch_.resize(last - first);
+      read(first, scratch_);
+      for (int i = 0; i < npoints; i++) {
+        auto [a, b] = frames_of(i);
+        v.points_[i] = peak_of(scratch_.data() + a - first, b - a);
+      }
       return v;
     }
-    DLOGI("Calculating view");
-    // nPoints is the number of points we want, e.g. 260 or 300
-    auto nPoints = v.size();
-    v.points_.clear();
-
-    OTTO_ASSERT(last >= first);
 
-    int res = res_for_duration(last - first, nPoints);
-    auto data = at_resolution(res);
-
-    // nDataPoints is how many samples there are in the resolution
-    // we have been given. This might be every fourth sample in the original audiofile
-    auto nDataPoints = data.size();
-
-    v.start_ = float(first) / float(input_data_.size()) * nDataPoints;
-    v.step_ = (last - first) / float(input_data_.size()) * nDataPoints / float(nPoints);
-
-    DLOGI("Calculating view now: {}", res);
-    for (int i = 0; i < nPoints; i++) {
-      // float max = data[std::min(int(first + idx), last) / bin_size];
-      // for (int j = 1; j < v.step_; j++) {
-      //   max = std::max(data[std::min(int(first + idx), last) / bin_size], max);
-      // }
-      // v.points_.push_back(max);
-      //TODO: Benchmark difference between start, mean, max.
-      //float sum = data[std::min(int(first + idx), last)];
-      //for (int j = 1; j < v.step_; j++) {
-      //  sum += data[std::min(int(first + idx + j), last)];
-        //DLOGI("{}",j);
-      //}
-      //v.points_.push_back(sum / std::ceil(v.step_));
-      //idx += v.step_;
-
-      //For now, just take the first valid point in the resolution
-      int pos = std::floor(v.start_ + i * v.step_);
-      v.points_.push_back( data[pos] );
-
-    }
-    DLOGI("Returning view");
+    const int level = std::min<int>(std::log2(step / base_bin), levels_.size() - 1);
+    const int bin = base_bin << level;
+    const auto& peaks = levels_[level];
+    const int bins_ready = (frames_ready() + bin - 1) / bin;
+    for (int i = 0; i < npoints; i++) {
+      auto [a, b] = frames_of(i);
+      int last_bin = std::min((b + bin - 1) / bin, bins_ready);
+      if (a / bin >= last_bin) continue;
+      Peak p = peaks[a / bin];
+      for (int k = a / bin + 1; k < last_bin; k++) p = merge(p, peaks[k]);
+      v.points_[i] = p;
+    }
     return v;
   }
 
+  // WaveformView //
+
   WaveformView::WaveformView(Waveform& wf, int nPoints, int first, int last)
   {
-    points_.resize(nPoints, 0);
+    points_.resize(nPoints);
     wf.view(*this, first, last);
   }
 
-  auto WaveformView::point_for_time(int time) const -> std::pair<float, float> {
+  auto WaveformView::point_for_time(int time) const -> std::pair<float, Peak>
+  {
     auto idx = (time - start_) / step_;
     if (idx < 0) return {0, points_.front()};
     else if (idx >= points_.size()) return {size() - 1, points_.back()};
     return {idx, points_[idx]};
   }
 
-  auto WaveformView::iter_for_time(int time) const -> iterator {
+  auto WaveformView::iter_for_time(int time) const -> iterator
+  {
     auto idx = (time - start_) / step_;
     if (idx < 0) return begin();
     else if (idx >= points_.size()) return end() - 1;
     return begin() + idx;
   }
+
 } // namespace otto::core::audio
@@ -1,51 +1,114 @@
 #pragma once
 
-#include <gsl/span>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <utility>
 #include <vector>
-#include <Gamma/Filter.h>
+
+#include <gsl/span>
 
 #include "services/log_manager.hpp"
-#include "util/dyn-array.hpp"
+#include "util/dsp/sample_stream.hpp"
+#include "util/filesystem.hpp"
 
 namespace otto::core::audio {
 
+  /// The lowest and highest value in a range of frames
+  struct Peak {
+    float min = 0;
+    float max = 0;
+  };
+
   struct WaveformView;
 
-  /// Multi-resolution waveform data
+  /// Multi-resolution min/max peaks of a waveform
   ///
-  /// Max size is size of input data.
+  /// The peaks are kept for bins of {@ref base_bin} frames, and for every power of two above that, up to
+  /// the bin size that fits the whole waveform in `min_points` bins. Views closer than {@ref base_bin}
+  /// frames per point read the frames themselves.
+  ///
+  /// The peaks are built on a worker thread, from the start of the waveform to the end, so constructing a
+  /// waveform never blocks. Views show the frames that have been built so far, and silence after them. All
+  /// waveforms share one worker, which builds them one at a time, in the order they were constructed.
+  ///
+  /// The peaks of a file are cached next to it, in `<file>.peaks`. The cache is used as long as the file has
+  /// the same size and modification time, or, if those have changed, the same contents.
   struct Waveform {
+    /// The number of frames in the bins of the finest level
+    static constexpr int base_bin = 256;
+
     Waveform() = default;
+
+    /// The waveform of `data`, which must outlive it. Not cached
     Waveform(gsl::span<float> data, int min_points);
 
+    /// The waveform of a WAV file, mixed down to mono
+    ///
+    /// Files that can not be read give an empty waveform.
+    Waveform(const fs::path& file, int min_points);
+
+    ~Waveform();
+
+    Waveform(const Waveform&) = delete;
+    Waveform& operator=(const Waveform&) = delete;
+
     /// Get a view of the waveform
     WaveformView view(int nPoints, int first, int last);
 
     /// Update a view with a new area.
     WaveformView& view(WaveformView& v, int first, int last);
 
+    /// The number of frames
+    int size() const noexcept;
+
+    /// The number of frames from the start that the peaks have been built for
+    int frames_ready() const noexcept;
+
+    /// `true` when all the peaks have been built
+    bool ready() const noexcept;
+
+    /// Block until all the peaks have been built
+    void wait() const noexcept;
+
   private:
-    gsl::span<float> at_resolution(int res);
+    /// Allocate the levels for the current size
+    void allocate(int min_points);
 
-    int res_for_duration(int dur, int nPoints) const;
+    /// Read frames `[first, first + out.size())`
+    void read(int first, gsl::span<float> out) const;
 
-    void generate_res(int res);
+    /// The thread that builds the peaks of all waveforms
+    struct Worker;
 
-    gsl::span<float> input_data_;
-    /// res 0 is original resolution, 1 is 1/2, 2 is 1/4 etc.
-    int max_res_;
+    void run();
+    /// Build the peaks of the frames `[first, first + chunk_frames_)` on all levels
+    void build_chunk(int first, std::vector<float>& buffer);
 
-    // The structure of this becomes
-    // [ - - res=0 - - | - res=1 - | res=2 |.... ]
-    // Each new sector is half the size of the previous
-    util::dyn_array<float> points_ = {0};
+    bool load_cache();
+    void save_cache() const;
 
-    /// Frequency controls grainyness of waveform.
-    gam::OnePole<> lpf{8000};
+    gsl::span<float> input_data_;
+    std::unique_ptr<util::dsp::WavFile> file_;
+    fs::path path_;
+    int size_ = 0;
+
+    /// `levels_[i]` has a peak for every `base_bin << i` frames
+    std::vector<std::vector<Peak>> levels_;
+    /// The frames in a bin of the coarsest level. The worker publishes its progress in steps of this size
+    int chunk_frames_ = base_bin;
+
+    /// Written by the worker, after the peaks of these frames
+    mutable std::atomic<std::uint32_t> frames_ready_ = 0;
+    /// Set when the waveform is destroyed. The worker checks it between chunks, and while hashing the file
+    std::atomic<bool> stop_ = false;
+
+    /// Frames read for views closer than {@ref base_bin}
+    std::vector<float> scratch_;
   };
 
   struct WaveformView {
-    using iterator = std::vector<float>::const_iterator;
+    using iterator = std::vector<Peak>::const_iterator;
 
     auto begin() const noexcept
     {
@@ -66,18 +129,21 @@ namespace otto::core::audio {
       return points_.size();
     }
 
-    std::pair<float, float> point_for_time(int idx) const;
+    /// The index of the point that shows frame `time`, and that point
+    std::pair<float, Peak> point_for_time(int time) const;
 
-    iterator iter_for_time(int idx) const;
+    iterator iter_for_time(int time) const;
 
   private:
     WaveformView(Waveform&, int nPoints, int first, int last);
 
     friend Waveform;
 
-    std::vector<float> points_;
-    int start_;
-    float step_;
+    std::vector<Peak> points_;
+    /// The first frame
+    int start_ = 0;
+    /// Frames per point
+    float step_ = 1;
   };
 
 } // namespace otto::core::audio
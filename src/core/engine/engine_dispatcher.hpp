@@ -1,5 +1,11 @@
 #pragma once
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
 #include "core/engine/engine.hpp"
 #include "core/engine/nullengine.hpp"
 #include "util/flat_map.hpp"
@@ -16,6 +22,12 @@ namespace otto::core::engine {
   using PublishEngineNames = itc::PropTypes<struct publish_engine_names_tag, gsl::span<const util::string_ref>>;
 
   /// Owns engines of type `ET`, and dispatches to a selected one of them
+  ///
+  /// When a new engine is selected, it is constructed on a worker thread, so the audio thread never waits
+  /// for engine construction, and the UI thread never waits for the audio thread. When the new engine is
+  /// ready, the audio thread adopts it at the start of a block, and crossfades from the old engine over
+  /// {@ref crossfade_ms}. The old engine is then handed back to the worker thread, which destroys it, once the
+  /// UI shows the screen of the new engine, and the actions queued for the old one have been called.
   template<EngineType ET, typename... Engines>
   struct EngineDispatcher : input::InputHandler {
     using Sender = services::UISender<EngineSelectorScreen>;
@@ -32,9 +44,17 @@ namespace otto::core::engine {
       CurrentScreen::Prop<Sender> current_screen = {sender, 0, props::limits(0, 1)};
     };
 
+    /// Length of the equal-power crossfade between the old and new engine when switching
+    static constexpr int crossfade_ms = 20;
+
     EngineDispatcher() noexcept;
+    ~EngineDispatcher() noexcept;
 
     ui::ScreenAndInput selector_screen();
+
+    /// The most recently selected engine that is done constructing
+    ///
+    /// The audio thread may still be fading over to it. Must not be called from the audio thread
     ITypedEngine<ET>& current();
     ITypedEngine<ET>* operator->();
 
@@ -47,10 +67,60 @@ namespace otto::core::engine {
     bool keypress(input::Key) override;
 
   private:
-    std::atomic<bool> engine_is_constructed_ = true;
-    util::variant_w_base<ITypedEngine<ET>, Engines...> current_engine_ = std::in_place_index_t<0>();
+    using EngineVariant = util::variant_w_base<ITypedEngine<ET>, Engines...>;
+
+    /// Construct engine number `idx` on the heap
+    static EngineVariant* make_engine(int idx);
+
+    /// The loop of {@ref worker_}. Constructs the requested engines, and switches to them
+    void worker_loop();
+
+    /// Make `engine` current, wait for the audio thread to fade over to it, and destroy the old engine
+    ///
+    /// Called on {@ref worker_}
+    void switch_to(EngineVariant* engine);
+
+    /// Call `done()` at the start of every audio block until it returns `true`, or the dispatcher is being
+    /// destroyed
+    ///
+    /// \returns `false` if the dispatcher is being destroyed
+    template<typename F>
+    bool wait_for(F&& done);
+
+    /// How often the worker checks {@ref stop_} while it waits for other threads
+    static constexpr std::chrono::milliseconds stop_poll_interval{50};
+
+    /// Adopt the pending engine, if there is one, and the previous switch is done.
+    ///
+    /// Called by the audio thread at the start of a block
+    void adopt_pending() noexcept;
+
     std::unique_ptr<EngineSelectorScreen> screen_;
     Props props = {{*screen_}};
+
+    /// The engine returned by {@ref current()}
+    std::atomic<EngineVariant*> current_ = nullptr;
+    /// Constructed by the worker, and not yet adopted by the audio thread
+    std::atomic<EngineVariant*> pending_ = nullptr;
+    /// Faded out by the audio thread, and not yet destroyed by the worker
+    std::atomic<EngineVariant*> retired_ = nullptr;
+    /// The engine being switched away from, until the worker destroys it. Only accessed by the worker
+    EngineVariant* replaced_ = nullptr;
+
+    /// The engine being played. Only accessed by the audio thread while audio is running
+    EngineVariant* active_ = nullptr;
+    /// The engine being faded out, if any. Audio thread only
+    EngineVariant* fading_ = nullptr;
+    int fade_frame_ = 0;
+    int fade_frames_ = 1;
+
+    /// Guards {@ref requested_idx_}, and changes to {@ref stop_}
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    int requested_idx_ = 0;
+    std::atomic_bool stop_ = false;
+    /// Started on the first engine switch
+    std::thread worker_;
   };
 } // namespace otto::core::engine
 
@@ -1,10 +1,15 @@
 #pragma once
-#include <thread>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <memory>
 
 #include "engine_dispatcher.hpp"
 #include "services/audio_manager.hpp"
 #include "services/engine_manager.hpp"
 #include "services/preset_manager.hpp"
+#include "services/ui_manager.hpp"
+#include "util/futex.hpp"
 #include "util/meta.hpp"
 #include "util/string_conversions.hpp"
 
@@ -15,36 +20,172 @@ namespace otto::core::engine {
 
   ENGDISPTEMPLATE
   ENGDISP::EngineDispatcher() noexcept : screen_(std::make_unique<EngineSelectorScreen>()) {
+    active_ = make_engine(0);
+    current_ = active_;
     props.sender.push(PublishEngineNames::action::data(engine_names));
     props.selected_engine_idx.on_change().connect([this] (int idx) {
-      engine_is_constructed_ = false;
-      services::AudioManager::current().wait_one();
-      current_engine_.emplace_by_index(idx);
-      engine_is_constructed_ = true;
+      {
+        std::lock_guard lock(mutex_);
+        requested_idx_ = idx;
+      }
+      if (!worker_.joinable()) worker_ = std::thread([this] { worker_loop(); });
+      cv_.notify_one();
     });
   }
 
+  ENGDISPTEMPLATE
+  ENGDISP::~EngineDispatcher() noexcept
+  {
+    {
+      std::lock_guard lock(mutex_);
+      stop_ = true;
+    }
+    cv_.notify_all();
+    if (worker_.joinable()) worker_.join();
+    // Audio has stopped by now. An engine can be in several of these, if a switch was interrupted
+    std::array<EngineVariant*, 6> engines = {current_, pending_, retired_, active_, fading_, replaced_};
+    std::sort(engines.begin(), engines.end());
+    auto last = std::unique(engines.begin(), engines.end());
+    std::for_each(engines.begin(), last, [](EngineVariant* engine) { delete engine; });
+  }
+
+  ENGDISPTEMPLATE
+  auto ENGDISP::make_engine(int idx) -> EngineVariant*
+  {
+    // Translate idx to a compile time index, like variant_w_base::emplace_by_index
+    const auto impl = [&](auto c_I, auto&& impl) -> EngineVariant* {
+      constexpr int I = meta::_v<decltype(c_I)>;
+      if constexpr (I < 0) {
+        return nullptr;
+      } else {
+        if (I == idx) return new EngineVariant(std::in_place_index_t<I>());
+        return impl(meta::c<I - 1>(), impl);
+      }
+    };
+    return impl(meta::c<int(sizeof...(Engines)) - 1>(), impl);
+  }
+
+  ENGDISPTEMPLATE
+  void ENGDISP::worker_loop()
+  {
+    int idx = current_.load()->index();
+    std::unique_lock lock(mutex_);
+    while (true) {
+      cv_.wait(lock, [&] { return stop_ || requested_idx_ != idx; });
+      if (stop_) return;
+      // Only the latest selection is constructed, when scrolling past several engines
+      idx = requested_idx_;
+      lock.unlock();
+      switch_to(make_engine(idx));
+      lock.lock();
+    }
+  }
+
+  ENGDISPTEMPLATE
+  void ENGDISP::switch_to(EngineVariant* engine)
+  {
+    auto& audio = services::AudioManager::current();
+    replaced_ = current_.exchange(engine);
+    if (audio.running()) {
+      pending_.store(engine, std::memory_order_release);
+      // The audio thread hands back the old engine when it is done fading it out
+      if (!wait_for([&] { return retired_.load(std::memory_order_acquire) != nullptr; })) return;
+      retired_.store(nullptr, std::memory_order_relaxed);
+    } else {
+      active_ = engine;
+    }
+    // The UI may be showing a screen of the old engine, and actions for its screens may still be queued, so
+    // have the UI thread call them, and then show the screen of the new engine instead
+    auto ui_done = std::make_shared<std::atomic<std::uint32_t>>(0);
+    auto refresh = [ui_done] {
+      auto& ui = services::UIManager::current();
+      ui.display(ui.state.current_screen.get());
+      *ui_done = 1;
+      util::futex_wake_all(*ui_done);
+    };
+    if (!wait_for([&] { return services::UIManager::current().action_queue().push(refresh); })) return;
+    while (*ui_done == 0) {
+      if (stop_) return;
+      util::futex_wait_for(*ui_done, 0, stop_poll_interval);
+    }
+    // Actions for the old engine may also be queued for the audio thread. An empty call runs after all of them
+    while (!audio.run_at_next_block([] {}, stop_poll_interval)) {
+      if (stop_) return;
+    }
+    delete replaced_;
+    replaced_ = nullptr;
+  }
+
+  ENGDISPTEMPLATE
+  template<typename F>
+  bool ENGDISP::wait_for(F&& done)
+  {
+    auto& audio = services::AudioManager::current();
+    while (!stop_) {
+      if (done()) return true;
+      audio.wait_for_next_block(stop_poll_interval);
+    }
+    return false;
+  }
+
+  ENGDISPTEMPLATE
+  void ENGDISP::adopt_pending() noexcept
+  {
+    if (fading_ != nullptr || retired_.load(std::memory_order_acquire) != nullptr) return;
+    auto* engine = pending_.exchange(nullptr, std::memory_order_acq_rel);
+    if (engine == nullptr) return;
+    fading_ = active_;
+    active_ = engine;
+    fade_frame_ = 0;
+    fade_frames_ = std::max(1, services::AudioManager::current().samplerate() * crossfade_ms / 1000);
+  }
+
   ENGDISPTEMPLATE
   ITypedEngine<ET>& ENGDISP::current()
   {
-    return *current_engine_;
+    return **current_.load();
   }
 
   ENGDISPTEMPLATE
   ITypedEngine<ET>* ENGDISP::operator->()
   {
-    return &*current_engine_;
+    return &current();
   }
 
   ENGDISPTEMPLATE
   template<int N>
   auto ENGDISP::process(audio::ProcessData<N> data) noexcept
   {
-    if (engine_is_constructed_) {
-      return util::match(current_engine_, [&](auto& engine) { return engine.audio->process(data); });
+    adopt_pending();
+    auto process_engine = [](EngineVariant& variant, audio::ProcessData<N> d) {
+      return util::match(variant, [&](auto& engine) { return engine.audio->process(d); });
+    };
+    if (fading_ == nullptr) return process_engine(*active_, data);
+
+    // Both engines get the same input. They may process it in place, so the old engine gets a copy.
+    auto old_data = data;
+    if constexpr (N > 0) {
+      auto copies = services::AudioManager::current().buffer_pool().template allocate_multi<N>();
+      auto in = data.raw_audio_buffers();
+      for (int c = 0; c < N; c++) std::copy_n(in[c], data.nframes, copies[c].data());
+      old_data = data.with(copies);
+    }
+    auto res = process_engine(*active_, data);
+    auto old_res = process_engine(*fading_, old_data);
+    auto out = res.raw_audio_buffers();
+    auto old_out = old_res.raw_audio_buffers();
+    for (int i = 0; i < res.nframes; i++) {
+      float t = std::min(1.f, float(fade_frame_ + i) / fade_frames_);
+      float fade_in = std::sin(t * float(M_PI_2));
+      float fade_out = std::cos(t * float(M_PI_2));
+      for (std::size_t c = 0; c < out.size(); c++) out[c][i] = out[c][i] * fade_in + old_out[c][i] * fade_out;
+    }
+    fade_frame_ += res.nframes;
+    if (fade_frame_ >= fade_frames_) {
+      retired_.store(fading_, std::memory_order_release);
+      fading_ = nullptr;
     }
-    util::fill(data.audio, 0);
-    return data;
+    return res;
   }
 
   ENGDISPTEMPLATE
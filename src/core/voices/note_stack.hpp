@@ -0,0 +1,311 @@
+#pragma once
+
+#include <array>
+#include <bitset>
+#include <cstdint>
+
+#include "util/assert.hpp"
+
+namespace otto::core::voices {
+
+  /// A held note, and the voice playing it, if any
+  struct NoteStackEntry {
+    /// Which physical key is activating this note
+    int key = 0;
+    /// Which note this voice is playing.
+    int note = 0;
+    /// Detune value from note
+    float detune = 1;
+    /// Velocity
+    float velocity = 0;
+    /// Index of the voice that is playing this note, or -1
+    int voice = -1;
+
+    /// Whether a physical key is not holding this note down
+    ///
+    /// When using a sustain pedal, this will be set to true on note off
+    bool should_release = false;
+
+    bool has_voice() const noexcept
+    {
+      return voice >= 0;
+    }
+  };
+
+  /// The held notes, oldest first
+  ///
+  /// Entries live in a fixed array, and are linked into a list in the order they were pushed, so removing an entry
+  /// never moves the others. All entries of a key are pushed together, so they are always adjacent, and the newest
+  /// entry of each key is indexed. Removing a key is linear in the number of entries for that key only.
+  ///
+  /// The entries that have voices are always the newest ones: voices are stolen from the oldest entry with a
+  /// voice, and returned to the newest entry without one. So stealing and returning a voice are both constant time.
+  template<int Capacity>
+  struct NoteStack {
+    static_assert(Capacity < 0x7FFF);
+
+    static constexpr int capacity = Capacity;
+    static constexpr int number_of_keys = 128;
+
+    NoteStack() noexcept
+    {
+      clear();
+    }
+
+    void clear() noexcept
+    {
+      head_ = tail_ = first_voiced_ = -1;
+      size_ = 0;
+      for (int i = 0; i < Capacity; i++) links_[i] = {-1, std::int16_t(i + 1 < Capacity ? i + 1 : -1)};
+      free_ = 0;
+      key_last_.fill(-1);
+    }
+
+    int size() const noexcept
+    {
+      return size_;
+    }
+
+    bool empty() const noexcept
+    {
+      return size_ == 0;
+    }
+
+    /// Whether `n` more entries can be pushed
+    bool has_room(int n) const noexcept
+    {
+      return size_ + n <= Capacity;
+    }
+
+    NoteStackEntry& operator[](int index) noexcept
+    {
+      return entries_[index];
+    }
+
+    /// Index of the newest entry, or -1
+    int back() const noexcept
+    {
+      return tail_;
+    }
+
+    /// Index of the entry after `index`, or -1
+    int next(int index) const noexcept
+    {
+      return links_[index].next;
+    }
+
+    /// Push an entry. If the stack has entries with voices, `entry` must have a voice too.
+    ///
+    /// All entries of a key must be pushed without pushing other keys in between, and `entry.key` must be a
+    /// midi key, 0 to 127.
+    ///
+    /// \returns the index of the entry, or -1 if the stack is full
+    int push_back(const NoteStackEntry& entry) noexcept
+    {
+      if (free_ < 0) return -1;
+      OTTO_ASSERT(entry.key >= 0 && entry.key < number_of_keys);
+      OTTO_ASSERT(entry.has_voice() || first_voiced_ < 0);
+      int index = free_;
+      free_ = links_[index].next;
+      auto& e = entries_[index];
+      e = entry;
+      links_[index] = {std::int16_t(tail_), -1};
+      if (tail_ >= 0) links_[tail_].next = index;
+      if (head_ < 0) head_ = index;
+      tail_ = index;
+      if (e.has_voice() && first_voiced_ < 0) first_voiced_ = index;
+      key_last_[e.key] = index;
+      size_++;
+      return index;
+    }
+
+    /// Take the voice from the oldest entry that has one
+    ///
+    /// \returns the voice index, or -1 if no entries have voices
+    int steal_oldest() noexcept
+    {
+      if (first_voiced_ < 0) return -1;
+      auto& e = entries_[first_voiced_];
+      int voice = e.voice;
+      e.voice = -1;
+      first_voiced_ = links_[first_voiced_].next;
+      return voice;
+    }
+
+    /// Give `voice` to the newest entry that doesn't have one
+    ///
+    /// \returns the index of the entry, or -1 if all entries have voices
+    int return_voice(int voice) noexcept
+    {
+      int index = first_voiced_ >= 0 ? links_[first_voiced_].prev : tail_;
+      if (index < 0) return -1;
+      entries_[index].voice = voice;
+      first_voiced_ = index;
+      return index;
+    }
+
+    /// Mark all entries of `key` to be released
+    void mark_release(int key) noexcept
+    {
+      for_each_of_key(key, [](NoteStackEntry& e) { e.should_release = true; });
+    }
+
+    /// Remove all entries of `key`
+    ///
+    /// `removed(NoteStackEntry&)` is called for each removed entry that had a voice, newest first, after all of
+    /// them are unlinked. So returning the voice to another entry from `removed` never returns it to an entry of
+    /// the same key.
+    template<typename F>
+    void remove_key(int key, F&& removed) noexcept
+    {
+      int last = key_last_[key];
+      if (last < 0) return;
+      int first = last;
+      bool had_first_voiced = last == first_voiced_;
+      while (links_[first].prev >= 0 && entries_[links_[first].prev].key == key) {
+        first = links_[first].prev;
+        had_first_voiced |= first == first_voiced_;
+      }
+
+      // Unlink the whole group
+      int before = links_[first].prev;
+      int after = links_[last].next;
+      (before >= 0 ? links_[before].next : head_) = after;
+      (after >= 0 ? links_[after].prev : tail_) = before;
+      // All entries after the first one with a voice have voices too
+      if (had_first_voiced) first_voiced_ = after;
+      key_last_[key] = -1;
+
+      // The group's own links are still intact
+      int stop = before;
+      for (int i = last; i != stop;) {
+        auto& e = entries_[i];
+        int prev = links_[i].prev;
+        if (e.has_voice()) removed(e);
+        links_[i].next = free_;
+        free_ = i;
+        size_--;
+        i = prev;
+      }
+    }
+
+    /// Remove all keys that have entries marked with {@ref mark_release}
+    ///
+    /// `remove(key)` is called for each of them, oldest first, and must call {@ref remove_key}.
+    template<typename F>
+    void remove_released(F&& remove) noexcept
+    {
+      for (int i = head_; i >= 0;) {
+        auto& e = entries_[i];
+        if (!e.should_release) {
+          i = links_[i].next;
+          continue;
+        }
+        int key = e.key;
+        i = links_[key_last_[key]].next;
+        remove(key);
+      }
+    }
+
+  private:
+    template<typename F>
+    void for_each_of_key(int key, F&& f) noexcept
+    {
+      for (int i = key_last_[key]; i >= 0 && entries_[i].key == key; i = links_[i].prev) {
+        f(entries_[i]);
+      }
+    }
+
+    struct Link {
+      std::int16_t prev = -1;
+      std::int16_t next = -1;
+    };
+
+    std::array<NoteStackEntry, Capacity> entries_;
+    /// The order of the entries. Unused entries are linked through `next`, starting at `free_`
+    std::array<Link, Capacity> links_;
+    std::int16_t head_ = -1;
+    std::int16_t tail_ = -1;
+    std::int16_t free_ = 0;
+    int size_ = 0;
+    /// The oldest entry with a voice. All entries after it have voices too.
+    std::int16_t first_voiced_ = -1;
+    /// The newest entry of each key
+    std::array<std::int16_t, number_of_keys> key_last_;
+  };
+
+  /// The voices that are not triggered, in the order they were released
+  ///
+  /// A bitmask answers whether a voice is free, and an intrusive list keeps the order, so that the voice that was
+  /// released the longest time ago, and is most likely done with its release, is reused first.
+  template<int NumberOfVoices>
+  struct FreeVoices {
+    FreeVoices() noexcept
+    {
+      fill();
+    }
+
+    /// Make all voices free, in index order
+    void fill() noexcept
+    {
+      mask_.reset();
+      head_ = tail_ = -1;
+      for (int i = 0; i < NumberOfVoices; i++) push_back(i);
+    }
+
+    bool empty() const noexcept
+    {
+      return mask_.none();
+    }
+
+    int size() const noexcept
+    {
+      return mask_.count();
+    }
+
+    bool contains(int voice) const noexcept
+    {
+      return mask_.test(voice);
+    }
+
+    /// Add a voice at the back. Does nothing if it is already free
+    void push_back(int voice) noexcept
+    {
+      if (contains(voice)) return;
+      mask_.set(voice);
+      links_[voice] = {std::int16_t(tail_), -1};
+      (tail_ >= 0 ? links_[tail_].next : head_) = voice;
+      tail_ = voice;
+    }
+
+    /// Remove and return the voice that was released first, or -1 if there are none
+    int pop_front() noexcept
+    {
+      int voice = head_;
+      if (voice >= 0) remove(voice);
+      return voice;
+    }
+
+    /// Remove `voice`. Does nothing if it is not free
+    void remove(int voice) noexcept
+    {
+      if (!contains(voice)) return;
+      mask_.reset(voice);
+      auto [prev, next] = links_[voice];
+      (prev >= 0 ? links_[prev].next : head_) = next;
+      (next >= 0 ? links_[next].prev : tail_) = prev;
+    }
+
+  private:
+    struct Link {
+      std::int16_t prev = -1;
+      std::int16_t next = -1;
+    };
+
+    std::bitset<NumberOfVoices> mask_;
+    std::array<Link, NumberOfVoices> links_;
+    std::int16_t head_ = -1;
+    std::int16_t tail_ = -1;
+  };
+
+} // namespace otto::core::voices
@@ -9,6 +9,7 @@
 #include "core/audio/processor.hpp"
 #include "core/props/props.hpp"
 #include "core/ui/screen.hpp"
+#include "core/voices/note_stack.hpp"
 #include "itc/prop.hpp"
 #include "util/algorithm.hpp"
 #include "util/crtp.hpp"
@@ -83,6 +84,15 @@ namespace otto::core::voices {
     /// release stage
     bool is_triggered() noexcept;
 
+    /// Is this voice currently producing sound?
+    ///
+    /// Voices that are not sounding are skipped by the VoiceManager. Voices with an amp envelope
+    /// should implement this to return `true` until the envelope is done, typically
+    /// `is_triggered() || !env_.done()`.
+    ///
+    /// The default implementation always returns `true`.
+    bool is_sounding() noexcept;
+
     /// Calculate the next glide points, envelope etc..
     /// 
     /// @note Must be called before calling operator(). VoiceManager::operator() and ::process do this.
@@ -90,6 +100,9 @@ namespace otto::core::voices {
 
     void action(portamento_tag::action, float p) noexcept;
 
+    /// Render a block of audio into `data.audio`, and return it.
+    ///
+    /// The default implementation calls `operator()` for each frame.
     /// This should multiply by volume_. If you write you own, remember to do that!
     core::audio::ProcessData<1> process(core::audio::ProcessData<1>) noexcept;
 
@@ -153,10 +166,22 @@ namespace otto::core::voices {
 
 
     /// Process audio, applying Preprocessing, each voice and then postprocessing
+    ///
+    /// The block is split at the midi events in `data`, so each event is applied at its exact frame.
+    /// Each sounding voice renders the frames between two events, which are then summed into the returned
+    /// buffer. Voices that are not sounding are not rendered at all.
     audio::ProcessData<1> process(audio::ProcessData<1> data) noexcept;
 
+    /// The offset of the frames currently being rendered, from the start of the buffer passed to
+    /// {@ref process()}.
+    ///
+    /// Lets voices read from per-block buffers in their `process` call.
+    int block_offset() const noexcept;
+
     /// Process audio, applying Preprocessing, each voice and then postprocessing.
     /// Individual volume of voices are applied here.
+    ///
+    /// Voices that are not sounding are skipped.
     float operator()() noexcept;
 
     void handle_midi(const midi::AnyMidiEvent&) noexcept;
@@ -168,6 +193,9 @@ namespace otto::core::voices {
 
     Voice& last_triggered_voice() noexcept;
 
+    /// The number of voices that are currently sounding
+    int sounding_voice_count() noexcept;
+
     // -- PROPERTY SETTERS -- //
 
     void action(play_mode_tag::action, PlayMode) noexcept;
@@ -189,28 +217,7 @@ namespace otto::core::voices {
 
     PlayMode play_mode() noexcept;
 
-    struct NoteStackEntry {
-      /// Which physical key is activating this note
-      int key = 0;
-      /// Which note this voice is playing.
-      int note = 0;
-      /// Detune value from note
-      float detune = 0;
-      /// Velocity
-      float velocity = 0;
-      /// Reference to voice that is playing this note
-      Voice* voice = nullptr;
-
-      /// Whether a physical key is not holding this note down
-      ///
-      /// When using a sustain pedal, this will be set to false on note off
-      bool should_release = false;
-
-      bool has_voice() const noexcept
-      {
-        return voice != nullptr;
-      }
-    };
+    using NoteStackEntry = voices::NoteStackEntry;
 
     /// Voice allocators - Corresponds to different playmodes
     struct VoiceAllocatorBase {
@@ -222,7 +229,14 @@ namespace otto::core::voices {
       /// Midi off is common to all
       void handle_midi_off(const midi::NoteOffEvent&) noexcept;
 
-      Voice& get_voice(int key, int note) noexcept;
+      /// Get a voice to play `note`
+      ///
+      /// Prefers the free voice that last played `note`, then the free voice that was released first, and if no
+      /// voices are free, steals the voice of the oldest held note.
+      ///
+      /// \returns the index of the voice
+      int get_voice(int key, int note) noexcept;
+      /// Remove all note stack entries of `key`, and return their voices to held notes that lost theirs
       void stop_voice(int key) noexcept;
 
       /// Owner
@@ -263,6 +277,9 @@ namespace otto::core::voices {
 
       void handle_midi_on(const midi::NoteOnEvent&) noexcept override;
       void set_detune(float detune) noexcept;
+
+    private:
+      void calculate_detune_values(float detune) noexcept;
     };
 
     // -- PRIVATE FIELDS -- //
@@ -279,9 +296,9 @@ namespace otto::core::voices {
 
     void set_sustain(bool s) noexcept;
 
-    util::local_vector<float, 7> detune_values;
+    util::local_vector<float, voice_count_v> detune_values;
     util::local_vector<float, voice_count_v> rand_values;
-    // Random values. 100% random, organic and fresh. Works for up to 12 voices.
+    // Random values. 100% random, organic and fresh. Repeats after 12 voices.
     static inline std::array<float, 12> rand_max = {0.94, 0.999, 1.03, 1.06, 0.92, 1.01,
                                                     1.02, 0.98,  1.0,  1.09, 0.94, 1.05};
 
@@ -291,14 +308,17 @@ namespace otto::core::voices {
     float pitch_bend_ = 1;
     bool sustain_ = false;
 
+    int block_offset_ = 0;
+
     // The actual voices
     std::array<Voice, voice_count_v> voices_;
     // Contains the currently untriggered voices
-    util::local_vector<Voice*, voice_count_v> free_voices;
+    FreeVoices<voice_count_v> free_voices;
     // Contains informatins about the currently held keys/playing voices.
-    // One key pushes more than one entry in other playmodes than poly 
-    util::local_vector<NoteStackEntry, 12 * voice_count_v> note_stack;
-    
+    // One key pushes more than one entry in other playmodes than poly
+    NoteStack<12 * voice_count_v> note_stack;
+    // The voice that was last given each note by get_voice, or -1
+    std::array<std::int16_t, 128> note_voice_;
 
     util::variant_w_base<VoiceAllocatorBase, PolyAllocator, MonoAllocator, UnisonAllocator, IntervalAllocator>
       voice_allocator = {std::in_place_type<PolyAllocator>, *this};
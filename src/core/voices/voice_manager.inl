@@ -72,6 +72,12 @@ namespace otto::core::voices {
     return triggered_;
   }
 
+  template<typename D>
+  bool VoiceBase<D>::is_sounding() noexcept
+  {
+    return true;
+  }
+
   template<typename D>
   void VoiceBase<D>::trigger(int midi_note, float detune, float velocity, bool legato, bool jump) noexcept
   {
@@ -118,12 +124,11 @@ namespace otto::core::voices {
   template<typename D>
   core::audio::ProcessData<1> VoiceBase<D>::process(core::audio::ProcessData<1> data) noexcept
   {
-    auto buf = services::AudioManager::current().buffer_pool().allocate();
-    for (auto& f : buf) {
+    for (auto& f : data.audio) {
       next();
       f = this->derived()() * this->derived().volume();
     }
-    return data.with(buf);
+    return data;
   }
 
   // VOICE ALLOCATORS //
@@ -140,81 +145,63 @@ namespace otto::core::voices {
   void VoiceManager<V, N>::VoiceAllocatorBase::handle_midi_off(const otto::core::midi::NoteOffEvent& evt) noexcept
   {
     auto key = evt.key;
+    if (key < 0 || key >= vm.note_stack.number_of_keys) return;
     if (vm.sustain_) {
-      // TODO: Make sure ALL entries with this key are set to release, not just the first.
-      auto found = util::find_if(vm.note_stack, [&](auto& nvp) { return nvp.key == key; });
-      if (found != vm.note_stack.end()) {
-        found->should_release = true;
-      }
+      vm.note_stack.mark_release(key);
     } else {
       stop_voice(key);
     }
   }
 
   template<typename V, int N>
-  auto VoiceManager<V, N>::VoiceAllocatorBase::get_voice(int key, int note) noexcept -> Voice&
+  int VoiceManager<V, N>::VoiceAllocatorBase::get_voice(int key, int note) noexcept
   {
-    if (vm.free_voices.size() > 0) {
-      // Usual behaviour is to return the next free voice
-      auto fvit = vm.free_voices.begin();
-      // Finds the voice that last played the note if it exists
-      auto it = util::find_if(vm.voices_, [note](Voice& vp) { return vp.midi_note_ == note; });
-      // If there is/was a voice that is playing this note
-      if (it != vm.voices_.end()) {
-        // It's not currently playing; choose this voice
-        if (!it->is_triggered()) fvit = util::find(vm.free_voices, it);
-        // Otherwise, do nothing - That would mean the voice is playing, and we should not steal it.
+    if (!vm.free_voices.empty()) {
+      // Reuse the voice that last played this note, if it is not playing something else now
+      if (note >= 0 && note < vm.note_stack.number_of_keys) {
+        int last = vm.note_voice_[note];
+        if (last >= 0 && vm.voices_[last].midi_note_ == note && vm.free_voices.contains(last)) {
+          vm.free_voices.remove(last);
+          return last;
+        }
       }
-      auto& v = **fvit;
-      vm.free_voices.erase(fvit);
+      // Usual behaviour is to return the voice that has been free the longest
+      int v = vm.free_voices.pop_front();
+      if (note >= 0 && note < vm.note_stack.number_of_keys) vm.note_voice_[note] = v;
       return v;
-    } else {
-      // Steal oldest playing note
-      auto found = util::find_if(vm.note_stack, [](NoteStackEntry& nse) { return nse.has_voice(); });
-      if (found != vm.note_stack.end()) {
-        DLOGI("Stealing voice {} from key {}", (found->voice - vm.voices_.data()), found->note);
-        Voice& v = *found->voice;
-        v.release();
-        found->voice = nullptr;
-        return v;
-      } else {
-        DLOGI("No voice found. Using voice 0");
-        return vm.voices_[0];
-      }
     }
+    // Steal oldest playing note
+    int v = vm.note_stack.steal_oldest();
+    if (v >= 0) {
+      DLOGI("Stealing voice {} for key {}", v, key);
+      vm.voices_[v].release();
+      if (note >= 0 && note < vm.note_stack.number_of_keys) vm.note_voice_[note] = v;
+      return v;
+    }
+    DLOGI("No voice found. Using voice 0");
+    return 0;
   }
 
   template<typename V, int N>
   void VoiceManager<V, N>::VoiceAllocatorBase::stop_voice(int key) noexcept
   {
-    // find_if can work with reverse iterators, so we don't need a view.
-    auto free_voice = [this](Voice& v) {
-      auto found =
-        std::find_if(vm.note_stack.rbegin(), vm.note_stack.rend(), [](auto nse) { return !nse.has_voice(); });
-      if (found != vm.note_stack.rend()) {
-        found->voice = &v;
-        v.trigger(found->note, found->detune, found->velocity, vm.legato_, false);
-      } else {
-        v.release();
-        vm.free_voices.push_back(&v);
-      }
-    };
-
-    // Remove-erase in reverse since for all other modes than poly, the note_stack has the format
+    // For all other modes than poly, the note_stack has the format
     // [A1 A2 A3 B1 B2 B3 C1 C2 C3] for instance, where A, B, C are different held keys.
     // If only the C's have voices, when we lift that key, we want the voices to go to the B's
-    // while the number is kept the same (e.g. C2 -> B2)
-    auto reverse_note_stack = util::view::reverse(vm.note_stack);
-    auto it = std::remove_if(reverse_note_stack.begin(), reverse_note_stack.end(), [&](auto nse) {
-      if (nse.key == key) {
-        if (nse.has_voice()) {
-          free_voice(*nse.voice);
-        }
-        return true;
+    // while the number is kept the same (e.g. C2 -> B2). remove_key passes the entries newest first,
+    // and return_voice gives each voice to the newest entry without one, so this is what happens.
+    vm.note_stack.remove_key(key, [this](NoteStackEntry& removed) {
+      int v = removed.voice;
+      auto& voice = vm.voices_[v];
+      int idx = vm.note_stack.return_voice(v);
+      if (idx >= 0) {
+        auto& entry = vm.note_stack[idx];
+        voice.trigger(entry.note, entry.detune, entry.velocity, vm.legato_, false);
+      } else {
+        voice.release();
+        vm.free_voices.push_back(v);
       }
-      return false;
     });
-    vm.note_stack.erase(reverse_note_stack.end().base(), it.base());
   }
 
   // PLAYMODE ALLOCATORS //
@@ -236,10 +223,10 @@ namespace otto::core::voices {
     auto& vm = this->vm;
     auto key = evt.key;
     this->stop_voice(key);
-    Voice& voice = this->get_voice(key, key);
-    auto res =
-      vm.note_stack.push_back({.key = key, .note = key, .detune = 1, .velocity = evt.fvelocity(), .voice = &voice});
-    if (res) voice.trigger(key, vm.rand_values[(&voice - vm.voices_.data())], evt.fvelocity(), false, false);
+    if (!vm.note_stack.has_room(1)) return;
+    int v = this->get_voice(key, key);
+    vm.note_stack.push_back({.key = key, .note = key, .detune = 1, .velocity = evt.fvelocity(), .voice = v});
+    vm.voices_[v].trigger(key, vm.rand_values[v], evt.fvelocity(), false, false);
   }
 
   template<typename V, int N>
@@ -248,7 +235,7 @@ namespace otto::core::voices {
     auto& vm = this->vm;
     vm.rand_values.clear();
     for (int i = 0; i < voice_count_v; i++) {
-      vm.rand_values.push_back(vm.rand_max[i] * r - r + 1.f);
+      vm.rand_values.push_back(vm.rand_max[i % vm.rand_max.size()] * r - r + 1.f);
     }
   }
 
@@ -268,11 +255,12 @@ namespace otto::core::voices {
     auto key = evt.key;
 
     this->stop_voice(key);
+    if (!vm.note_stack.has_room(2)) return;
     for (int i = 0; i < 2; ++i) {
-      Voice& voice = this->get_voice(key, key + interval_ * i);
-      auto res = vm.note_stack.push_back(
-        {.key = key, .note = key + interval_ * i, .detune = 1, .velocity = evt.fvelocity(), .voice = &voice});
-      if (res) voice.trigger(key + interval_ * i, 1, evt.fvelocity(), false, false);
+      int note = key + interval_ * i;
+      int v = this->get_voice(key, note);
+      vm.note_stack.push_back({.key = key, .note = note, .detune = 1, .velocity = evt.fvelocity(), .voice = v});
+      vm.voices_[v].trigger(note, 1, evt.fvelocity(), false, false);
     }
   }
 
@@ -311,30 +299,27 @@ namespace otto::core::voices {
     auto& vm = this->vm;
     auto key = evt.key;
     this->stop_voice(key);
+    if (!vm.note_stack.has_room(num_voices_used)) return;
     /// If there is already a note playing that we must steal
-    if (vm.note_stack.size() > 0) {
+    if (!vm.note_stack.empty()) {
       for (int i = 0; i < num_voices_used; ++i) {
         int sv = i > 0; // Are we dispatching a subvoice?
-        // Find the correct voice to steal
-        // Every iteration in the loop, a new entry is added to the notestack.
-        auto& note = *(vm.note_stack.end() - num_voices_used);
-        DLOGI("Stealing voice {} from key {}", (note.voice - vm.voices_.data()), note.note);
-        Voice& v = *note.voice;
+        // Only the newest key has voices, so this steals them in order.
+        int v = vm.note_stack.steal_oldest();
+        DLOGI("Stealing voice {} for key {}", v, key);
         // v.release calls on_note_off. Don't do this if legato is engaged.
-        if (!vm.legato_) v.release();
-        note.voice = nullptr;
-        auto res = vm.note_stack.push_back(
-          {.key = key, .note = key - 12 * i, .detune = 1, .velocity = evt.fvelocity(), .voice = &v});
-        if (res) v.trigger(key - 12 * sv, 1, evt.fvelocity(), vm.legato_, false);
+        if (!vm.legato_) vm.voices_[v].release();
+        vm.note_stack.push_back(
+          {.key = key, .note = key - 12 * sv, .detune = 1, .velocity = evt.fvelocity(), .voice = v});
+        vm.voices_[v].trigger(key - 12 * sv, 1, evt.fvelocity(), vm.legato_, false);
       }
     } else {
-      for (int i = 0; i < num_voices_used; ++i) {
-        int sv = i > 0; // Are we dispatching a subvoice?
-        auto fvit = vm.free_voices.begin() + i;
-        auto& v = **fvit;
-        auto res = vm.note_stack.push_back(
-          {.key = key, .note = key - 12 * sv, .detune = 1, .velocity = evt.fvelocity(), .voice = &v});
-        if (res) v.trigger(key - 12 * sv, 1, evt.fvelocity(), false, vm.retrig_);
+      for (int v = 0; v < num_voices_used; ++v) {
+        int sv = v > 0; // Are we dispatching a subvoice?
+        vm.free_voices.remove(v);
+        vm.note_stack.push_back(
+          {.key = key, .note = key - 12 * sv, .detune = 1, .velocity = evt.fvelocity(), .voice = v});
+        vm.voices_[v].trigger(key - 12 * sv, 1, evt.fvelocity(), false, vm.retrig_);
       }
     }
   }
@@ -347,18 +332,27 @@ namespace otto::core::voices {
       auto& voice = this->vm.voices_[i];
       voice.volume(this->vm.normal_volume / (float) num_voices_used);
     }
+    calculate_detune_values(detune_);
   }
 
   template<typename V, int N>
-  void VoiceManager<V, N>::UnisonAllocator::set_detune(float detune) noexcept
+  void VoiceManager<V, N>::UnisonAllocator::calculate_detune_values(float detune) noexcept
   {
     auto& vm = this->vm;
     vm.detune_values.clear();
     vm.detune_values.push_back(1);
-    for (int i = 1; i < 3; i++) {
+    for (int i = 1; i <= num_voices_used / 2; i++) {
       vm.detune_values.push_back(1 + detune * 0.015f * i);
       vm.detune_values.push_back(1.f / (1.f + detune * 0.015f * (float) i));
     }
+  }
+
+  template<typename V, int N>
+  void VoiceManager<V, N>::UnisonAllocator::set_detune(float detune) noexcept
+  {
+    auto& vm = this->vm;
+    detune_ = detune;
+    calculate_detune_values(detune);
     for (auto&& [v, d] : util::zip(vm.voices(), vm.detune_values)) v.glide_ = midi::note_freq(v.midi_note_) * d;
   }
 
@@ -368,27 +362,24 @@ namespace otto::core::voices {
     auto& vm = this->vm;
     auto key = evt.key;
     this->stop_voice(key);
-    if (vm.note_stack.size() > 0) {
+    if (!vm.note_stack.has_room(num_voices_used)) return;
+    if (!vm.note_stack.empty()) {
       for (int i = 0; i < num_voices_used; i++) {
-        // Find the correct voice to steal
-        // Every iteration in the loop, a new entry is added to the notestack.
-        auto& note = *(vm.note_stack.end() - num_voices_used);
-        DLOGI("Stealing voice {} from key {}", (note.voice - vm.voices_.data()), note.note);
-        Voice& v = *note.voice;
+        // Only the newest key has voices, so this steals them in order.
+        int v = vm.note_stack.steal_oldest();
+        DLOGI("Stealing voice {} for key {}", v, key);
         // v.release calls on_note_off. Don't do this if legato is engaged.
-        if (!vm.legato_) v.release();
-        note.voice = nullptr;
-        auto res = vm.note_stack.push_back(
-          {.key = key, .note = key, .detune = vm.detune_values[i], .velocity = evt.fvelocity(), .voice = &v});
-        if (res) v.trigger(key, vm.detune_values[i], evt.fvelocity(), vm.legato_, false);
+        if (!vm.legato_) vm.voices_[v].release();
+        vm.note_stack.push_back(
+          {.key = key, .note = key, .detune = vm.detune_values[i], .velocity = evt.fvelocity(), .voice = v});
+        vm.voices_[v].trigger(key, vm.detune_values[i], evt.fvelocity(), vm.legato_, false);
       }
     } else {
-      for (int i = 0; i < num_voices_used; i++) {
-        auto vit = vm.free_voices.begin() + i;
-        auto& v = **vit;
-        auto res = vm.note_stack.push_back(
-          {.key = key, .note = key, .detune = vm.detune_values[i], .velocity = evt.fvelocity(), .voice = &v});
-        if (res) v.trigger(key, vm.detune_values[i], evt.fvelocity(), false, vm.retrig_);
+      for (int v = 0; v < num_voices_used; v++) {
+        vm.free_voices.remove(v);
+        vm.note_stack.push_back(
+          {.key = key, .note = key, .detune = vm.detune_values[v], .velocity = evt.fvelocity(), .voice = v});
+        vm.voices_[v].trigger(key, vm.detune_values[v], evt.fvelocity(), false, vm.retrig_);
       }
     }
   }
@@ -415,18 +406,6 @@ namespace otto::core::voices {
       // envelope_props.release.on_change().connect(
       //   [&voice](float release) { voice.env_.release(4 * release * release + 0.02); });
     }
-
-    // sustain_.on_change().connect([this](bool val) {
-    //   if (!val) {
-    //     auto copy = note_stack;
-    //     for (auto&& nvp : copy) {
-    //       if (nvp.should_release) {
-    //         voice_allocator->stop_voice(nvp.note);
-    //         DLOGI("Released note {}", nvp.note);
-    //       }
-    //     }
-    //   }
-    // });
   }
 
   template<typename V, int N>
@@ -434,6 +413,7 @@ namespace otto::core::voices {
   {
     float voice_sum = 0.f;
     for (auto& voice : voices_) {
+      if (!voice.is_sounding()) continue;
       voice.next();
       voice_sum += voice() * voice.volume();
     }
@@ -457,14 +437,25 @@ namespace otto::core::voices {
   template<typename V, int N>
   audio::ProcessData<1> VoiceManager<V, N>::process(audio::ProcessData<1> data) noexcept
   {
-    for (auto& event : data.midi) handle_midi(event);
-    auto buf = services::AudioManager::current().buffer_pool().allocate_clear();
-    for (auto& v : voices()) {
-      auto v_out = v.process(data.audio_only());
-      for (auto&& [vf, b] : util::zip(v_out.audio, buf)) {
-        b += vf;
-      }
-    }
+    auto& pool = services::AudioManager::current().buffer_pool();
+    auto buf = pool.allocate_clear().slice(0, data.nframes);
+    // All voices render into the same scratch buffer, which is then added to the sum
+    auto scratch = pool.allocate().slice(0, data.nframes);
+    // Voices do not get the midi events
+    audio::split_at_midi_events(
+      data, [&](const midi::AnyMidiEvent& event) { handle_midi(event); },
+      [&](int idx, int length) {
+        block_offset_ = idx;
+        auto out = buf.slice(idx, length);
+        for (auto& v : voices()) {
+          if (!v.is_sounding()) continue;
+          auto v_out = v.process(audio::ProcessData<1>(scratch.slice(idx, length), {}, data.clock));
+          for (auto&& [vf, b] : util::zip(v_out.audio, out)) {
+            b += vf;
+          }
+        }
+      });
+    block_offset_ = 0;
     return data.with(buf);
   }
 
@@ -473,7 +464,9 @@ namespace otto::core::voices {
   {
     util::match(
       event, //
-      [&](const midi::NoteOnEvent& evt) { voice_allocator->handle_midi_on(evt); },
+      [&](const midi::NoteOnEvent& evt) {
+        if (evt.key >= 0 && evt.key < note_stack.number_of_keys) voice_allocator->handle_midi_on(evt);
+      },
       [&](const midi::NoteOffEvent& evt) { voice_allocator->handle_midi_off(evt); },
       [&](const midi::ControlChangeEvent& evt) { handle_control_change(evt); },
       [&](const midi::PitchBendEvent& evt) { handle_pitch_bend(evt); }, //
@@ -490,9 +483,21 @@ namespace otto::core::voices {
   auto VoiceManager<V, N>::last_triggered_voice() noexcept -> Voice&
   {
     if (note_stack.empty()) return voices_[0];
-    auto v = note_stack.back().voice;
-    if (v == nullptr) return voices_[0];
-    return *v;
+    int v = note_stack[note_stack.back()].voice;
+    if (v < 0) return voices_[0];
+    return voices_[v];
+  }
+
+  template<typename V, int N>
+  int VoiceManager<V, N>::block_offset() const noexcept
+  {
+    return block_offset_;
+  }
+
+  template<typename V, int N>
+  int VoiceManager<V, N>::sounding_voice_count() noexcept
+  {
+    return util::count_if(voices_, [](Voice& v) { return v.is_sounding(); });
   }
 
   template<typename V, int N>
@@ -513,10 +518,8 @@ namespace otto::core::voices {
     }
     util::for_each(voices(), &Voice::release);
     note_stack.clear();
-    free_voices.clear();
-    for (auto&& voice : voices()) {
-      free_voices.push_back(&voice);
-    }
+    free_voices.fill();
+    note_voice_.fill(-1);
   }
 
   template<typename V, int N>
@@ -524,13 +527,10 @@ namespace otto::core::voices {
   {
     sustain_ = s;
     if (!s) {
-      auto copy = note_stack;
-      for (auto&& nvp : copy) {
-        if (nvp.should_release) {
-          voice_allocator->stop_voice(nvp.note);
-          DLOGI("Released note {}", nvp.note);
-        }
-      }
+      note_stack.remove_released([this](int key) {
+        voice_allocator->stop_voice(key);
+        DLOGI("Released key {}", key);
+      });
     }
   }
 
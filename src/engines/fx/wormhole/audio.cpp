@@ -1,11 +1,17 @@
 #include "audio.hpp"
 
+#include <algorithm>
+
 #include "services/audio_manager.hpp"
 
 namespace otto::engines::wormhole {
 
-  Audio::Audio() noexcept
+  Audio::Audio() noexcept : fdn_(services::AudioManager::current().samplerate())
   {
+    int ramp = services::AudioManager::current().buffer_size();
+    shimmer_amount.set_ramp_frames(ramp);
+    filter_freq = {3000, ramp, util::dsp::Smoothed<>::Ramp::exponential};
+
     // reverb.resize({1307, 1637, 1811, 1931}, {1051, 337, 113});
     reverb.resize(gam::JCREVERB);
 
@@ -13,6 +19,7 @@ namespace otto::engines::wormhole {
     shimmer_filter.freq(18000);
 
     pre_filter.type(gam::LOW_PASS);
+    pre_filter.freq(filter_freq.current());
 
     output_delay[0].maxDelay(211.f / gam::sampleRate());
     output_delay[1].maxDelay(179.f / gam::sampleRate());
@@ -20,33 +27,72 @@ namespace otto::engines::wormhole {
 
   void Audio::action(itc::prop_change<&Props::filter>, float flt) noexcept
   {
-    pre_filter.freq(3000 + flt * flt * 17000);
+    filter_freq.set(3000 + flt * flt * 17000);
   }
 
   void Audio::action(itc::prop_change<&Props::shimmer>, float sh) noexcept
   {
-    shimmer_amount = sh * 0.03;
+    shimmer_amount.set(sh * 0.03);
   }
 
   void Audio::action(itc::prop_change<&Props::length>, float len) noexcept
   {
     reverb.decay(3.f * len);
+    fdn_.decay(3.f * len);
   }
 
   void Audio::action(itc::prop_change<&Props::damping>, float damp) noexcept
   {
     reverb.damping(damp);
+    fdn_.damping(damp);
+  }
+
+  void Audio::action(itc::prop_change<&Props::classic>, bool c) noexcept
+  {
+    classic_ = c;
+    // The network starts from silence, instead of the tail it had when it was last used
+    if (!classic_) {
+      fdn_.clear();
+      shimmer_.fill(0);
+    }
   }
 
   audio::ProcessData<2> Audio::process(audio::ProcessData<1> data) noexcept
   {
     auto buf = services::AudioManager::current().buffer_pool().allocate_multi<2>();
-    for (auto&& [dat, bufL, bufR] : util::zip(data.audio, buf[0], buf[1])) {
-      auto frm = reverb(pre_filter(dat) + last_sample * shimmer_amount);
-      last_sample = dc_block(shimmer_filter(pitchshifter(frm)));
+    if (classic_) {
+      for (int i = 0; i < data.nframes; i++) {
+        // The filter coefficients are only recalculated once per control block
+        if (i % control_frames == 0 && filter_freq.is_ramping()) pre_filter.freq(filter_freq.skip(control_frames));
+        auto frm = reverb(pre_filter(data.audio[i]) + last_sample * shimmer_amount.next());
+        last_sample = dc_block(shimmer_filter(pitchshifter(frm)));
+
+        buf[0][i] = output_delay[0](frm);
+        buf[1][i] = output_delay[1](frm);
+      }
+      return data.with(buf);
+    }
 
-      bufL = output_delay[0](frm);
-      bufR = output_delay[1](frm);
+    for (int first = 0; first < data.nframes; first += shimmer_frames) {
+      const int n = std::min(shimmer_frames, data.nframes - first);
+      float* left = buf[0].data() + first;
+      float* right = buf[1].data() + first;
+      // The input is built in the left channel, which the network reads before it writes it
+      for (int i = 0; i < n; i++) {
+        if ((first + i) % control_frames == 0 && filter_freq.is_ramping()) {
+          pre_filter.freq(filter_freq.skip(control_frames));
+        }
+        left[i] = pre_filter(data.audio[first + i]) + shimmer_[i] * shimmer_amount.next();
+      }
+      fdn_.process(left, left, right, n);
+      // The pitch shifter is the most expensive part, so it only runs while there is shimmer to hear
+      if (shimmer_amount.current() > 0 || shimmer_amount.is_ramping()) {
+        for (int i = 0; i < n; i++) {
+          shimmer_[i] = dc_block(shimmer_filter(pitchshifter(0.5f * (left[i] + right[i]))));
+        }
+      } else {
+        std::fill_n(shimmer_.begin(), n, 0.f);
+      }
     }
     return data.with(buf);
   }
@@ -1,5 +1,7 @@
 #pragma once
 
+#include "util/dsp/fdn_reverb.hpp"
+#include "util/dsp/smoothed.hpp"
 #include "util/dsp/transpose.hpp"
 #include "wormhole.hpp"
 
@@ -15,10 +17,22 @@ namespace otto::engines::wormhole {
     void action(itc::prop_change<&Props::shimmer>, float s) noexcept;
     void action(itc::prop_change<&Props::length>, float l) noexcept;
     void action(itc::prop_change<&Props::damping>, float d) noexcept;
+    void action(itc::prop_change<&Props::classic>, bool c) noexcept;
 
   private:
+    /// Frames between updates of the filter frequency while it ramps
+    static constexpr int control_frames = 16;
+    /// Frames the feedback delay network processes at a time. The shimmer is fed back one of these later
+    static constexpr int shimmer_frames = 64;
+
+    bool classic_ = false;
+    util::dsp::FdnReverb fdn_;
+    /// The shimmer of the last {@ref shimmer_frames} frames of the feedback delay network
+    std::array<float, shimmer_frames> shimmer_ = {};
+
     float last_sample = 0;
-    float shimmer_amount = 0;
+    util::dsp::Smoothed<> shimmer_amount;
+    util::dsp::Smoothed<> filter_freq = {3000};
     gam::ReverbMS<> reverb;
     dsp::SimplePitchShift pitchshifter;
     std::array<gam::Delay<>, 2> output_delay;
@@ -23,6 +23,10 @@ namespace otto::engines::wormhole {
   {
     damping_ = d;
   }
+  void Screen::action(itc::prop_change<&Props::classic>, bool c) noexcept
+  {
+    classic_ = c;
+  }
 
   void Screen::draw(ui::vg::Canvas& ctx)
   {
@@ -257,6 +261,15 @@ namespace otto::engines::wormhole {
 
     ctx.restore();
 
+    // reverb character, toggled by clicking the green encoder
+    if (classic_) {
+      ctx.save();
+      ctx.font(Fonts::Norm, 25);
+      ctx.fillStyle(Colors::Green);
+      ctx.fillText("classic", 22.9, 210.0);
+      ctx.restore();
+    }
+
 
     // Green Dot at the end
     ctx.beginPath();
@@ -17,6 +17,8 @@ namespace otto::engines::wormhole {
     void action(itc::prop_change<&Props::length>, float l) noexcept;
     float damping_ = 0.f;
     void action(itc::prop_change<&Props::damping>, float d) noexcept;
+    bool classic_ = false;
+    void action(itc::prop_change<&Props::classic>, bool c) noexcept;
   };
 
 } // namespace otto::engines::wormhole
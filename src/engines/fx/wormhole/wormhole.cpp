@@ -19,6 +19,15 @@ namespace otto::engines::wormhole {
     }
   }
 
+  bool Wormhole::keypress(Key key)
+  {
+    switch (key) {
+      case Key::green_click: props.classic.set(!props.classic.get()); break;
+      default: return false;
+    }
+    return true;
+  }
+
   core::ui::ScreenAndInput Wormhole::screen()
   {
     return {*screen_, *this};
@@ -20,8 +20,10 @@ namespace otto::engines::wormhole {
     Sndr::Prop<struct shimmer_tag, float> shimmer = {sender, 0, limits(0, 1), step_size(0.01)};
     Sndr::Prop<struct length_tag, float> length = {sender, 0.5, limits(0, 1), step_size(0.01)};
     Sndr::Prop<struct damping_tag, float> damping = {sender, 0.4, limits(0, 0.99), step_size(0.01)};
+    /// Use the original, per-sample JC reverb instead of the feedback delay network
+    Sndr::Prop<struct classic_tag, bool> classic = {sender, false};
 
-    DECL_REFLECTION(Props, filter, shimmer, length, damping);
+    DECL_REFLECTION(Props, filter, shimmer, length, damping, classic);
   };
 
   struct Wormhole : core::engine::EffectEngine<Wormhole> {
@@ -29,6 +31,7 @@ namespace otto::engines::wormhole {
     Wormhole();
 
     void encoder(core::input::EncoderEvent e) override;
+    bool keypress(core::input::Key key) override;
 
     core::ui::ScreenAndInput screen() override;
 
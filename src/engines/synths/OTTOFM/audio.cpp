@@ -21,6 +21,11 @@ namespace otto::engines::ottofm {
     release_envelopes();
   }
 
+  bool Voice::is_sounding() noexcept
+  {
+    return is_triggered() || !env_.done();
+  }
+
   void Voice::reset_envelopes() noexcept
   {
     util::for_each(operators, [](auto& op) { op.reset(); });
@@ -38,33 +43,40 @@ namespace otto::engines::ottofm {
     util::for_each(operators, [this](auto& op) { op.freq(frequency()); });
   }
 
-  // Voice process. We apply voice volume and increment voice frequency with next() manually,
+  // We apply voice volume and increment voice frequency with next() manually,
   // since we are overwriting the default process method.
-  core::audio::ProcessData<1> Voice::process(core::audio::ProcessData<1> data) noexcept
+  template<int Alg>
+  void Voice::render(core::audio::AudioBufferHandle& out) noexcept
   {
-    auto callOps = [&] {
-      auto& [op0, op1, op2, op3] = operators;
-      float aux = 0;
-      switch (audio.algN_) {
-        case 0: return op0(op1(op2(op3(0))));
-        case 1: return op0(op1(op2(0) + op3(0)));
-        case 2: return op0(op1(op2(0)) + op3(0));
-        case 3: aux = op3(0); return op0(op1(aux) + op2(aux));
-        case 4: aux = op2(op3(0)); return (op0(aux) + op1(aux));
-        case 5: return (op0(0) + op1(op2(op3(0))));
-        case 6: return op0(op1(0) + op2(0) + op3(0));
-        case 7: return (op0(op1(0)) + op2(op3(0)));
-        case 8: aux = op3(0); return (op0(aux) + op1(aux) + op2(aux));
-        case 9: return (op0(0) + op1(0) + op2(op3(0)));
-        case 10: return (op0(0) + op1(0) + op2(0) + op3(0));
-        default: return 0.f;
-      }
-    };
-    for (auto& f : data.audio) {
+    auto& [op0, op1, op2, op3] = operators;
+    float* data = out.data();
+    int nframes = out.size();
+    for (int i = 0; i < nframes; i++) {
       next();
-      set_frequencies();
-      f = callOps() * volume() * env_();
+      if (i % control_rate_frames == 0) set_frequencies();
+      data[i] = fm_algorithm<Alg>(op0, op1, op2, op3) * volume() * env_();
     }
+  }
+
+  const std::array<Voice::Kernel, 11> Voice::kernels = {{
+    &Voice::render<0>,
+    &Voice::render<1>,
+    &Voice::render<2>,
+    &Voice::render<3>,
+    &Voice::render<4>,
+    &Voice::render<5>,
+    &Voice::render<6>,
+    &Voice::render<7>,
+    &Voice::render<8>,
+    &Voice::render<9>,
+    &Voice::render<10>,
+  }};
+
+  static_assert(std::tuple_size_v<decltype(algorithms)> == 11, "There must be a render kernel for each algorithm");
+
+  core::audio::ProcessData<1> Voice::process(core::audio::ProcessData<1> data) noexcept
+  {
+    (this->*kernel_)(data.audio);
     return data;
   }
 
@@ -75,8 +87,11 @@ namespace otto::engines::ottofm {
     util::indexed_for_each(voice_mgr_.last_triggered_voice().operators,
                            [&](auto i, auto& op) { shared_activity[i] = op.get_activity_level(); });
 
-    return voice_mgr_.process(data);
+    auto buf = services::AudioManager::current().buffer_pool().allocate().slice(0, data.nframes);
+    audio::split_at_midi_events(
+      data, [&](const midi::AnyMidiEvent& event) { voice_mgr_.handle_midi(event); },
+      [&](int idx, int length) { voice_bank_.process(buf.slice(idx, length), algorithm_); });
+    return data.with(buf);
   }
 
-
 } // namespace otto::engines::ottofm
@@ -8,9 +8,12 @@
 
 #include "core/voices/voice_manager.hpp"
 #include "ottofm.hpp"
+#include "util/simd.hpp"
 
 namespace otto::engines::ottofm {
 
+  struct VoiceBank;
+
   /// Custom version of the 'Sine' in Gamma. We need to call it with a phase offset
   /// instead of a frequency offset. (Phase modulation, not frequency modulation)
   /// Defines its own action handlers, which is why it is templated.
@@ -30,11 +33,22 @@ namespace otto::engines::ottofm {
     float operator()(float phaseMod = 0) noexcept
     {
       if (modulator_)
-        return env_() * sine(phaseMod) * outlevel_ * fm_amount_;
-      else {
-        previous_value_ = sine(phaseMod + feedback_ * previous_value_) * outlevel_;
-        return previous_value_;
-      }
+        return modulate(phaseMod);
+      else
+        return carry(phaseMod);
+    }
+
+    /// Generate the next sample as a modulator. Uses the operator envelope and the fm amount.
+    float modulate(float phaseMod = 0) noexcept
+    {
+      return env_() * sine(phaseMod) * outlevel_ * fm_amount_;
+    }
+
+    /// Generate the next sample as a carrier. Applies feedback, and relies on the voice envelope.
+    float carry(float phaseMod = 0) noexcept
+    {
+      previous_value_ = sine(phaseMod + feedback_ * previous_value_) * outlevel_;
+      return previous_value_;
     }
 
     /// Set frequency
@@ -124,6 +138,8 @@ namespace otto::engines::ottofm {
     }
 
   private:
+    friend VoiceBank;
+
     FMSine sine;
     gam::ADSR<> env_;
 
@@ -142,16 +158,55 @@ namespace otto::engines::ottofm {
     float previous_value_ = 0;
   };
 
+  /// Generate the next sample of algorithm `Alg` from the four operators
+  ///
+  /// Operators that feed into another are modulators, the rest are carriers.
+  /// This must match the modulator_flags in `algorithms`.
+  template<int Alg, typename Op0, typename Op1, typename Op2, typename Op3>
+  auto fm_algorithm(Op0& op0, Op1& op1, Op2& op2, Op3& op3) noexcept
+  {
+    if constexpr (Alg == 0) return op0.carry(op1.modulate(op2.modulate(op3.modulate())));
+    if constexpr (Alg == 1) return op0.carry(op1.modulate(op2.modulate() + op3.modulate()));
+    if constexpr (Alg == 2) return op0.carry(op1.modulate(op2.modulate()) + op3.modulate());
+    if constexpr (Alg == 3) {
+      auto aux = op3.modulate();
+      return op0.carry(op1.modulate(aux) + op2.modulate(aux));
+    }
+    if constexpr (Alg == 4) {
+      auto aux = op2.modulate(op3.modulate());
+      return op0.carry(aux) + op1.carry(aux);
+    }
+    if constexpr (Alg == 5) return op0.carry() + op1.carry(op2.modulate(op3.modulate()));
+    if constexpr (Alg == 6) return op0.carry(op1.modulate() + op2.modulate() + op3.modulate());
+    if constexpr (Alg == 7) return op0.carry(op1.modulate()) + op2.carry(op3.modulate());
+    if constexpr (Alg == 8) {
+      auto aux = op3.modulate();
+      return op0.carry(aux) + op1.carry(aux) + op2.carry(aux);
+    }
+    if constexpr (Alg == 9) return op0.carry() + op1.carry() + op2.carry(op3.modulate());
+    if constexpr (Alg == 10) return op0.carry() + op1.carry() + op2.carry() + op3.carry();
+  }
+
   struct Voice : voices::VoiceBase<Voice> {
     Voice(Audio& a) noexcept;
 
+    /// Renders a block with one algorithm
+    using Kernel = void (Voice::*)(core::audio::AudioBufferHandle&) noexcept;
+
+    /// Number of frames between each update of the operator frequencies
+    static constexpr int control_rate_frames = 16;
+
     // These voices only have process calls.
-    // This saves us from checking the current algorithm every sample.
+    // The kernel for the current algorithm is selected when the algorithm changes,
+    // which saves us from checking it every sample.
     core::audio::ProcessData<1> process(core::audio::ProcessData<1> data) noexcept;
 
     void on_note_on(float) noexcept;
     void on_note_off() noexcept;
 
+    /// The voice is sounding until the amp envelope is done
+    bool is_sounding() noexcept;
+
     void reset_envelopes() noexcept;
     void release_envelopes() noexcept;
 
@@ -179,6 +234,7 @@ namespace otto::engines::ottofm {
         op.modulator(algorithms[a].modulator_flags[i]);
         i++;
       });
+      kernel_ = kernels[a];
     }
 
     void action(voices::attack_tag::action, float a) noexcept
@@ -202,10 +258,71 @@ namespace otto::engines::ottofm {
     std::tuple<FMOperator<0>, FMOperator<1>, FMOperator<2>, FMOperator<3>> operators;
 
   private:
+    friend VoiceBank;
+
+    /// Render a block with algorithm `Alg`
+    template<int Alg>
+    void render(core::audio::AudioBufferHandle& out) noexcept;
+
+    /// The render kernels, indexed by algorithm
+    static const std::array<Kernel, 11> kernels;
+
+    Kernel kernel_ = kernels[0];
     gam::ADSR<> env_ = {0.1f, 0.1f, 0.7f, 2.0f, 1.f, -4.f};
     Audio& audio;
   };
 
+  /// Renders all voices at once, vectorized across voices
+  ///
+  /// The oscillator state of every voice and operator is kept in aligned structure-of-arrays, so one
+  /// SIMD instruction processes the same operator in 4 or 8 voices (see util/simd.hpp).
+  /// Note allocation, glide and envelopes are still handled by the {@ref Voice}s, and are read
+  /// into the bank for every control block.
+  struct VoiceBank {
+    static constexpr int voice_count = 6;
+    static constexpr int operator_count = 4;
+    /// Voices padded to a whole number of SIMD vectors
+    static constexpr int lanes = util::simd::padded_size(voice_count);
+
+    VoiceBank(std::array<Voice, voice_count>& voices) noexcept;
+
+    /// Render all sounding voices with algorithm `alg`, and write their sum to `out`
+    void process(core::audio::AudioBufferHandle out, int alg) noexcept;
+
+  private:
+    using Kernel = void (VoiceBank::*)(float* out, int nframes) noexcept;
+    using Lanes = std::array<float, lanes>;
+    static constexpr std::size_t alignment = util::simd::vfloat::alignment;
+
+    /// Render `nframes` frames with algorithm `Alg`
+    template<int Alg>
+    void render(float* out, int nframes) noexcept;
+
+    /// Advance the voices by `nframes`, which is at most one control block, and read their state
+    void prepare(int nframes, const Algorithm& alg) noexcept;
+
+    /// The render kernels, indexed by algorithm
+    static const std::array<Kernel, 11> kernels;
+
+    std::array<Voice, voice_count>& voices_;
+
+    // Oscillator state, indexed by [operator][voice]
+    alignas(alignment) std::array<Lanes, operator_count> phase_ = {};
+    alignas(alignment) std::array<Lanes, operator_count> increment_ = {};
+    alignas(alignment) std::array<Lanes, operator_count> outlevel_ = {};
+    alignas(alignment) std::array<Lanes, operator_count> feedback_ = {};
+    alignas(alignment) std::array<Lanes, operator_count> fm_amount_ = {};
+    alignas(alignment) std::array<Lanes, operator_count> previous_ = {};
+
+    // Per frame values for the current control block
+    /// Modulator envelopes, indexed by [operator][frame][voice]
+    alignas(alignment) std::array<std::array<Lanes, Voice::control_rate_frames>, operator_count> env_ = {};
+    /// Voice envelope times voice volume, indexed by [frame][voice]
+    alignas(alignment) std::array<Lanes, Voice::control_rate_frames> amp_ = {};
+    /// Output of each voice, indexed by [frame][voice]
+    alignas(alignment) std::array<Lanes, Voice::control_rate_frames> mix_ = {};
+  };
+
   struct Audio {
     Audio(std::array<itc::Shared<float>, 4> activity) : shared_activity(activity) {}
 
@@ -217,17 +334,24 @@ namespace otto::engines::ottofm {
       voice_mgr_.action(a, args...);
     }
 
-    // Only a process call, since this sums the process calls of the voices.
+    void action(itc::prop_change<&Props::algorithm_idx> a, int alg) noexcept
+    {
+      algorithm_ = alg;
+      voice_mgr_.action(a, alg);
+    }
+
+    // Only a process call. All voices are rendered at once by the voice bank.
     audio::ProcessData<1> process(audio::ProcessData<1>) noexcept;
 
     friend Voice;
 
-    int algN_ = 0;
     int cur_op_ = 0;
+    int algorithm_ = 0;
 
     std::array<itc::Shared<float>, 4> shared_activity;
 
     voices::VoiceManager<Voice, 6> voice_mgr_ = {*this};
+    VoiceBank voice_bank_ = {voice_mgr_.voices()};
   };
 
 } // namespace otto::engines::ottofm
@@ -0,0 +1,139 @@
+#include "audio.hpp"
+
+#include <Gamma/Domain.h>
+
+namespace otto::engines::ottofm {
+
+  using util::simd::vfloat;
+
+  namespace {
+    /// One operator in `vfloat::size` voices. Mirrors FMOperator::modulate and FMOperator::carry
+    struct LaneOperator {
+      vfloat phase;
+      vfloat increment;
+      vfloat outlevel;
+      vfloat feedback;
+      vfloat fm_amount;
+      vfloat previous;
+      vfloat env;
+
+      vfloat next_phase() noexcept
+      {
+        vfloat res = phase;
+        phase = util::simd::wrap_phase(phase + increment);
+        return res;
+      }
+
+      vfloat modulate(vfloat phase_mod = vfloat{0.f}) noexcept
+      {
+        return env * util::simd::sinP9(util::simd::wrap_phase(next_phase() + phase_mod)) * outlevel * fm_amount;
+      }
+
+      vfloat carry(vfloat phase_mod = vfloat{0.f}) noexcept
+      {
+        // Added in the same order as FMOperator::carry, so the voices and the bank round alike
+        auto wrapped = util::simd::wrap_phase(next_phase() + (phase_mod + feedback * previous));
+        previous = util::simd::sinP9(wrapped) * outlevel;
+        return previous;
+      }
+    };
+
+    /// Call `f(index, op)` for each operator of a voice
+    template<typename F>
+    void for_each_operator(Voice& voice, F&& f)
+    {
+      std::apply([&](auto&... ops) {
+        int k = 0;
+        (f(k++, ops), ...);
+      }, voice.operators);
+    }
+  } // namespace
+
+  VoiceBank::VoiceBank(std::array<Voice, voice_count>& voices) noexcept : voices_(voices) {}
+
+  void VoiceBank::process(core::audio::AudioBufferHandle out, int alg) noexcept
+  {
+    (this->*kernels[alg])(out.data(), out.size());
+  }
+
+  void VoiceBank::prepare(int nframes, const Algorithm& alg) noexcept
+  {
+    // The voices, and their envelopes, run at the samplerate of the Gamma domain, so the oscillators must too
+    float inv_samplerate = 1.f / gam::sampleRate();
+    for (int v = 0; v < voice_count; v++) {
+      Voice& voice = voices_[v];
+      if (!voice.is_sounding()) {
+        for (int f = 0; f < nframes; f++) amp_[f][v] = 0;
+        continue;
+      }
+      for (int f = 0; f < nframes; f++) {
+        voice.next();
+        if (f == 0) {
+          // The phase accumulators cover [-1, 1) per cycle, like FMOperator::FMSine
+          for_each_operator(voice, [&](int k, auto& op) {
+            increment_[k][v] = 2.f * (voice.frequency() * op.freq_ratio_ + op.detune_amount_) * inv_samplerate;
+            outlevel_[k][v] = op.outlevel_;
+            feedback_[k][v] = op.feedback_;
+            fm_amount_[k][v] = op.fm_amount_;
+          });
+        }
+        amp_[f][v] = voice.env_() * voice.volume();
+        for_each_operator(voice, [&](int k, auto& op) {
+          if (alg.modulator_flags[k]) env_[k][f][v] = op.env_();
+        });
+      }
+    }
+  }
+
+  template<int Alg>
+  void VoiceBank::render(float* out, int nframes) noexcept
+  {
+    for (int start = 0; start < nframes; start += Voice::control_rate_frames) {
+      int n = std::min<int>(Voice::control_rate_frames, nframes - start);
+      prepare(n, algorithms[Alg]);
+
+      for (int l = 0; l < lanes; l += vfloat::size) {
+        std::array<LaneOperator, operator_count> ops;
+        for (int k = 0; k < operator_count; k++) {
+          ops[k].phase = vfloat::load(&phase_[k][l]);
+          ops[k].increment = vfloat::load(&increment_[k][l]);
+          ops[k].outlevel = vfloat::load(&outlevel_[k][l]);
+          ops[k].feedback = vfloat::load(&feedback_[k][l]);
+          ops[k].fm_amount = vfloat::load(&fm_amount_[k][l]);
+          ops[k].previous = vfloat::load(&previous_[k][l]);
+        }
+        auto& [op0, op1, op2, op3] = ops;
+        for (int f = 0; f < n; f++) {
+          for (int k = 0; k < operator_count; k++) ops[k].env = vfloat::load(&env_[k][f][l]);
+          vfloat res = fm_algorithm<Alg>(op0, op1, op2, op3) * vfloat::load(&amp_[f][l]);
+          res.store(&mix_[f][l]);
+        }
+        for (int k = 0; k < operator_count; k++) {
+          ops[k].phase.store(&phase_[k][l]);
+          ops[k].previous.store(&previous_[k][l]);
+        }
+      }
+
+      for (int f = 0; f < n; f++) {
+        float sum = 0;
+        for (int l = 0; l < voice_count; l++) sum += mix_[f][l];
+        out[start + f] = sum;
+      }
+    }
+  }
+
+  const std::array<VoiceBank::Kernel, 11> VoiceBank::kernels = {{
+    &VoiceBank::render<0>,
+    &VoiceBank::render<1>,
+    &VoiceBank::render<2>,
+    &VoiceBank::render<3>,
+    &VoiceBank::render<4>,
+    &VoiceBank::render<5>,
+    &VoiceBank::render<6>,
+    &VoiceBank::render<7>,
+    &VoiceBank::render<8>,
+    &VoiceBank::render<9>,
+    &VoiceBank::render<10>,
+  }};
+
+} // namespace otto::engines::ottofm
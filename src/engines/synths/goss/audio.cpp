@@ -18,9 +18,9 @@ namespace otto::engines::goss {
     env_.release(4.f);
   }
 
-  float Voice::operator()() noexcept
+  float Voice::operator()(float pitch_modulation) noexcept
   {
-    float fundamental = frequency() * (1 + 0.012 * audio.leslie * audio.pitch_modulation_hi.cos()) * 0.5;
+    float fundamental = frequency() * pitch_modulation * 0.5;
     voice_player.freq(fundamental);
     percussion_player.freq(frequency());
     float s = voice_player() + (percussion_player() + noise() * 0.4) * perc_env();
@@ -28,6 +28,21 @@ namespace otto::engines::goss {
     return s_drive * env_();
   }
 
+  core::audio::ProcessData<1> Voice::process(core::audio::ProcessData<1> data) noexcept
+  {
+    float* pitch_modulation = audio.pitch_modulation_buf_ + audio.voice_mgr_.block_offset();
+    for (auto& f : data.audio) {
+      next();
+      f = (*this)(*pitch_modulation++) * volume();
+    }
+    return data;
+  }
+
+  bool Voice::is_sounding() noexcept
+  {
+    return is_triggered() || !env_.done();
+  }
+
   void Voice::on_note_on(float freq_target) noexcept
   {
     env_.resetSoft();
@@ -102,29 +117,33 @@ namespace otto::engines::goss {
     leslie_filter_lo.freq(leslie_speed_lo);
     leslie_amount_hi = leslie * 0.5;
     leslie_amount_lo = leslie * 0.5;
-    pitch_modulation_hi.freq(leslie * leslie_speed_hi);
+    // The LFO used to be advanced once per voice per sample, so its rate was tuned for all 6 voices
+    pitch_modulation_hi.freq(leslie * leslie_speed_hi * voice_mgr_.voice_count_v);
 
     rotation.freq(leslie_speed_hi / 4.f);
   }
 
-  float Audio::operator()() noexcept
+  audio::ProcessData<1> Audio::process(audio::ProcessData<1> data) noexcept
   {
-    // TODO: Once per buffer
-    *shared_rotation = rotation.nextPhase();
+    float rot = 0;
+    for (int i = 0; i < data.nframes; i++) rot = rotation.nextPhase();
+    *shared_rotation = rot;
 
-    // Gets summed sample from all voices
-    float voices = voice_mgr_();
-    // Leslie
-    float s_lo = voices * (1 + leslie_amount_lo * leslie_filter_lo.cos());
-    float s_hi = hpf(voices) * (1 + leslie_amount_hi * leslie_filter_hi.cos());
-    return s_lo + s_hi;
-  }
+    auto pitch_modulation = services::AudioManager::current().buffer_pool().allocate();
+    for (auto& pm : pitch_modulation) {
+      pm = 1 + 0.012 * leslie * pitch_modulation_hi.cos();
+    }
+    pitch_modulation_buf_ = pitch_modulation.data();
 
-  audio::ProcessData<1> Audio::process(audio::ProcessData<1> data) noexcept
-  {
-    for (auto& m : data.midi) voice_mgr_.handle_midi(m);
-    for (float& f : data.audio) {
-      f = (*this)();
+    // Gets summed block from all sounding voices
+    auto voices = voice_mgr_.process(data);
+    pitch_modulation_buf_ = nullptr;
+
+    // Leslie
+    for (auto&& [f, v] : util::zip(data.audio, voices.audio)) {
+      float s_lo = v * (1 + leslie_amount_lo * leslie_filter_lo.cos());
+      float s_hi = hpf(v) * (1 + leslie_amount_hi * leslie_filter_hi.cos());
+      f = s_lo + s_hi;
     }
     return data;
   }
@@ -16,11 +16,20 @@ namespace otto::engines::goss {
   struct Voice : voices::VoiceBase<Voice> {
     Voice(Audio& a) noexcept;
 
-    float operator()() noexcept;
+    /// Generate the next sample
+    ///
+    /// @param pitch_modulation The leslie pitch modulation factor for this sample
+    float operator()(float pitch_modulation) noexcept;
+
+    /// Render a block. Reads the pitch modulation for each frame from Audio.
+    core::audio::ProcessData<1> process(core::audio::ProcessData<1>) noexcept;
 
     void on_note_on(float) noexcept;
     void on_note_off() noexcept;
 
+    /// The voice is sounding until the amp envelope is done
+    bool is_sounding() noexcept;
+
     /// Use actions from base class
     using VoiceBase::action;
 
@@ -73,8 +82,6 @@ namespace otto::engines::goss {
       voice_mgr_.action(a, args...);
     }
 
-    float operator()() noexcept;
-
     audio::ProcessData<1> process(audio::ProcessData<1>) noexcept;
 
   private:
@@ -101,6 +108,9 @@ namespace otto::engines::goss {
     gam::LFO<> leslie_filter_hi;
     gam::LFO<> leslie_filter_lo;
     gam::LFO<> pitch_modulation_hi;
+    /// The pitch modulation factor for each frame of the block currently being rendered.
+    /// Computed once per block, so the LFO runs at the same rate no matter how many voices are sounding.
+    float* pitch_modulation_buf_ = nullptr;
 
     gam::AccumPhase<> rotation;
 
@@ -0,0 +1,96 @@
+#include "audio.hpp"
+
+#include "services/audio_manager.hpp"
+
+namespace otto::engines::stream_sampler {
+
+  Voice::Voice(Audio& a) noexcept : audio(a), stream_(a.streamer_.stream(a.next_stream_++))
+  {
+    env_.finish();
+  }
+
+  core::audio::ProcessData<1> Voice::process(core::audio::ProcessData<1> data) noexcept
+  {
+    stream_.read({data.audio.data(), data.nframes});
+    for (auto& f : data.audio) {
+      next();
+      f *= env_() * volume();
+    }
+    // Stop streaming once the release is over
+    if (!is_triggered() && env_.done()) stream_.stop();
+    return data;
+  }
+
+  bool Voice::is_sounding() noexcept
+  {
+    return (is_triggered() || !env_.done()) && !stream_.done();
+  }
+
+  void Voice::on_note_on(float freq_target) noexcept
+  {
+    if (audio.kits_.empty()) return;
+    auto& samples = audio.kits_[audio.kit_].samples;
+    int count = samples.size();
+    auto& sample = *samples[((midi_note() - 60) % count + count) % count];
+    samplerate_ratio_ = float(sample.samplerate()) / services::AudioManager::current().samplerate();
+    stream_.start(sample, audio.speed_ * samplerate_ratio_, audio.loop_);
+    env_.resetSoft();
+  }
+
+  void Voice::on_note_off() noexcept
+  {
+    env_.release();
+  }
+
+  void Voice::speed(float speed) noexcept
+  {
+    stream_.speed(speed * samplerate_ratio_);
+  }
+
+  // Audio
+
+  Audio::Audio(std::vector<Kit> kits)
+    : kits_(std::move(kits)), streamer_(voice_count, services::AudioManager::current().samplerate())
+  {}
+
+  std::vector<std::string> Audio::kit_names() const
+  {
+    std::vector<std::string> res;
+    for (auto& kit : kits_) res.push_back(kit.name);
+    return res;
+  }
+
+  std::vector<fs::path> Audio::kit_previews() const
+  {
+    std::vector<fs::path> res;
+    for (auto& kit : kits_) res.push_back(kit.samples.front()->path());
+    return res;
+  }
+
+  const util::dsp::SampleStreamer& Audio::streamer() const noexcept
+  {
+    return streamer_;
+  }
+
+  void Audio::action(itc::prop_change<&Props::kit>, int k) noexcept
+  {
+    kit_ = std::clamp(k, 0, std::max(0, int(kits_.size()) - 1));
+  }
+
+  void Audio::action(itc::prop_change<&Props::speed>, float s) noexcept
+  {
+    speed_ = s;
+    for (auto& voice : voice_mgr_.voices()) voice.speed(s);
+  }
+
+  void Audio::action(itc::prop_change<&Props::loop>, bool l) noexcept
+  {
+    loop_ = l;
+  }
+
+  audio::ProcessData<1> Audio::process(audio::ProcessData<1> data) noexcept
+  {
+    return voice_mgr_.process(data);
+  }
+
+} // namespace otto::engines::stream_sampler
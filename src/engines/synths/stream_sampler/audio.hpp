@@ -0,0 +1,92 @@
+#pragma once
+
+#include <Gamma/Envelope.h>
+
+#include "core/voices/voice_manager.hpp"
+#include "stream_sampler.hpp"
+
+namespace otto::engines::stream_sampler {
+
+  struct Voice : voices::VoiceBase<Voice> {
+    Voice(Audio& a) noexcept;
+
+    /// Render a block from the stream of this voice
+    core::audio::ProcessData<1> process(core::audio::ProcessData<1>) noexcept;
+
+    /// Start streaming the sample for the current key
+    void on_note_on(float) noexcept;
+    void on_note_off() noexcept;
+
+    /// The voice is sounding until the amp envelope is done, or the sample has ended
+    bool is_sounding() noexcept;
+
+    /// Set the playback speed, relative to the original pitch of the sample
+    void speed(float speed) noexcept;
+
+    /// Use actions from base class
+    using VoiceBase::action;
+
+    void action(voices::attack_tag::action, float a) noexcept
+    {
+      env_.attack(a * a * 8.f + 0.01f);
+    }
+    void action(voices::decay_tag::action, float d) noexcept
+    {
+      env_.decay(d * d * 4.f + 0.01f);
+    }
+    void action(voices::sustain_tag::action, float s) noexcept
+    {
+      env_.sustain(s);
+    }
+    void action(voices::release_tag::action, float r) noexcept
+    {
+      env_.release(r * r * 8.f + 0.01f);
+    }
+
+  private:
+    Audio& audio;
+    util::dsp::SampleStreamer::Stream& stream_;
+    /// The samplerate of the current sample, divided by the output samplerate
+    float samplerate_ratio_ = 1;
+    gam::ADSR<> env_ = {0.001f, 0.1f, 1.f, 0.2f, 1.f, -4.f};
+  };
+
+  struct Audio {
+    static constexpr int voice_count = 6;
+
+    Audio(std::vector<Kit> kits);
+
+    std::vector<std::string> kit_names() const;
+    /// The file of the first sample in each kit
+    std::vector<fs::path> kit_previews() const;
+    const util::dsp::SampleStreamer& streamer() const noexcept;
+
+    void action(itc::prop_change<&Props::kit>, int k) noexcept;
+    void action(itc::prop_change<&Props::speed>, float s) noexcept;
+    void action(itc::prop_change<&Props::loop>, bool l) noexcept;
+
+    template<typename Tag, typename... Args>
+    auto action(itc::Action<Tag, Args...> a, Args... args) noexcept
+      -> std::enable_if_t<itc::ActionReceiver::is<voices::VoiceManager<Voice, voice_count>, itc::Action<Tag, Args...>>>
+    {
+      voice_mgr_.action(a, args...);
+    }
+
+    audio::ProcessData<1> process(audio::ProcessData<1>) noexcept;
+
+  private:
+    friend Voice;
+
+    const std::vector<Kit> kits_;
+    util::dsp::SampleStreamer streamer_;
+    /// The stream the next voice to be constructed plays from
+    int next_stream_ = 0;
+
+    int kit_ = 0;
+    float speed_ = 1;
+    bool loop_ = false;
+
+    voices::VoiceManager<Voice, voice_count> voice_mgr_ = {*this};
+  };
+
+} // namespace otto::engines::stream_sampler
@@ -0,0 +1,105 @@
+#include "screen.hpp"
+
+#include "core/ui/vector_graphics.hpp"
+
+namespace otto::engines::stream_sampler {
+
+  using namespace ui;
+  using namespace ui::vg;
+
+  namespace {
+    constexpr int waveform_points = 140;
+  }
+
+  SamplerScreen::SamplerScreen(std::vector<std::string> kit_names,
+                               std::vector<fs::path> kit_previews,
+                               const util::dsp::SampleStreamer& streamer)
+    : kit_names_(std::move(kit_names)), kit_previews_(std::move(kit_previews)), streamer_(streamer)
+  {
+    load_preview(0);
+  }
+
+  void SamplerScreen::action(itc::prop_change<&Props::kit>, int k) noexcept
+  {
+    if (k != kit_) load_preview(k);
+    kit_ = k;
+  }
+
+  void SamplerScreen::load_preview(int k)
+  {
+    waveform_ = nullptr;
+    if (k < int(kit_previews_.size())) {
+      waveform_ = std::make_unique<core::audio::Waveform>(kit_previews_[k], waveform_points);
+    }
+  }
+
+  void SamplerScreen::action(itc::prop_change<&Props::speed>, float s) noexcept
+  {
+    speed_ = s;
+  }
+
+  void SamplerScreen::action(itc::prop_change<&Props::loop>, bool l) noexcept
+  {
+    loop_ = l;
+  }
+
+  void SamplerScreen::draw(ui::vg::Canvas& ctx)
+  {
+    constexpr float x_pad = 20;
+    constexpr float y_pad = 20;
+    constexpr float x_right = width - x_pad;
+    constexpr float y_bottom = height - y_pad;
+    constexpr float number_shift = 30;
+
+    // Text
+    ctx.font(Fonts::Norm, 25);
+    ctx.fillStyle(Colours::Blue);
+    ctx.textAlign(HorizontalAlign::Left, VerticalAlign::Middle);
+    ctx.fillText("kit", x_pad, y_pad);
+
+    ctx.fillStyle(Colours::Green);
+    ctx.textAlign(HorizontalAlign::Right, VerticalAlign::Middle);
+    ctx.fillText("speed", x_right, y_pad);
+
+    ctx.fillStyle(Colours::Yellow);
+    ctx.textAlign(HorizontalAlign::Left, VerticalAlign::Middle);
+    ctx.fillText("loop", x_pad, y_bottom - number_shift);
+
+    // Values
+    ctx.font(Fonts::Norm, 40);
+    ctx.fillStyle(Colours::Blue);
+    ctx.textAlign(HorizontalAlign::Left, VerticalAlign::Middle);
+    ctx.fillText(kit_ < int(kit_names_.size()) ? kit_names_[kit_] : "no samples", x_pad, y_pad + number_shift);
+
+    ctx.fillStyle(Colours::Green);
+    ctx.textAlign(HorizontalAlign::Right, VerticalAlign::Middle);
+    ctx.fillText(fmt::format("{:.2f}", speed_), x_right, y_pad + number_shift);
+
+    ctx.fillStyle(Colours::Yellow);
+    ctx.textAlign(HorizontalAlign::Left, VerticalAlign::Middle);
+    ctx.fillText(loop_ ? "on" : "off", x_pad, y_bottom);
+
+    // Waveform of the first sample, along the maxima and back along the minima
+    if (waveform_ != nullptr && waveform_->size() > 0) {
+      constexpr float y_mid = height / 2;
+      constexpr float y_scale = 40;
+      constexpr float x_step = (x_right - x_pad) / (waveform_points - 1);
+      auto view = waveform_->view(waveform_points, 0, waveform_->size());
+      ctx.beginPath();
+      ctx.moveTo(x_pad, y_mid - view[0].max * y_scale);
+      for (int i = 0; i < waveform_points; i++) ctx.lineTo(x_pad + i * x_step, y_mid - view[i].max * y_scale);
+      for (int i = waveform_points - 1; i >= 0; i--) ctx.lineTo(x_pad + i * x_step, y_mid - view[i].min * y_scale);
+      ctx.closePath();
+      ctx.fill(Colours::Gray60);
+    }
+
+    // The disk could not keep up. Shown until the engine is recreated
+    if (int underruns = streamer_.underruns(); underruns > 0) {
+      ctx.font(Fonts::Norm, 25);
+      ctx.fillStyle(Colours::Red);
+      ctx.textAlign(HorizontalAlign::Right, VerticalAlign::Middle);
+      ctx.fillText(fmt::format("{} dropouts", underruns), x_right, y_bottom);
+    }
+  }
+
+} // namespace otto::engines::stream_sampler
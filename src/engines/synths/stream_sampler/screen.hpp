@@ -0,0 +1,38 @@
+#pragma once
+
+#include <memory>
+
+#include "core/audio/waveform.hpp"
+#include "core/ui/screen.hpp"
+#include "stream_sampler.hpp"
+
+namespace otto::engines::stream_sampler {
+
+  struct SamplerScreen : ui::Screen {
+    SamplerScreen(std::vector<std::string> kit_names,
+                  std::vector<fs::path> kit_previews,
+                  const util::dsp::SampleStreamer& streamer);
+
+    void draw(nvg::Canvas& ctx) override;
+
+    void action(itc::prop_change<&Props::kit>, int k) noexcept;
+    void action(itc::prop_change<&Props::speed>, float s) noexcept;
+    void action(itc::prop_change<&Props::loop>, bool l) noexcept;
+
+  private:
+    /// Show the waveform of the first sample in kit `k`
+    void load_preview(int k);
+
+    const std::vector<std::string> kit_names_;
+    const std::vector<fs::path> kit_previews_;
+    /// Read for the underrun count
+    const util::dsp::SampleStreamer& streamer_;
+
+    int kit_ = 0;
+    float speed_ = 1;
+    bool loop_ = false;
+    /// Built in the background, and cached, so long samples show up right away the next time
+    std::unique_ptr<core::audio::Waveform> waveform_;
+  };
+
+} // namespace otto::engines::stream_sampler
@@ -0,0 +1,105 @@
+#include "stream_sampler.hpp"
+
+#include <algorithm>
+
+#include "audio.hpp"
+#include "screen.hpp"
+#include "services/application.hpp"
+#include "services/log_manager.hpp"
+#include "services/sample_cache.hpp"
+
+namespace otto::engines::stream_sampler {
+
+  using namespace core::input;
+
+  std::vector<Kit> load_kits(const fs::path& dir)
+  {
+    std::vector<fs::path> folders;
+    if (fs::exists(dir)) {
+      for (auto&& de : fs::directory_iterator(dir)) {
+        if (de.is_directory()) folders.push_back(de.path());
+      }
+    }
+    std::sort(folders.begin(), folders.end());
+
+    struct Loading {
+      fs::path path;
+      services::SampleCache::Handle cached;
+      std::unique_ptr<util::dsp::StreamedSample> streamed;
+    };
+
+    // Start loading all the cached samples before waiting for any of them
+    auto& cache = services::SampleCache::current();
+    std::vector<std::pair<std::string, std::vector<Loading>>> loading;
+    for (auto& folder : folders) {
+      std::vector<fs::path> files;
+      for (auto&& de : fs::directory_iterator(folder)) {
+        if (de.is_regular_file() && de.path().extension() == ".wav") files.push_back(de.path());
+      }
+      std::sort(files.begin(), files.end());
+
+      auto& kit = loading.emplace_back(folder.filename().string(), std::vector<Loading>{}).second;
+      for (auto& file : files) {
+        try {
+          util::dsp::WavFile wav(file);
+          if (wav.size() <= max_cached_seconds * wav.samplerate()) {
+            kit.push_back({file, cache.load(file), nullptr});
+          } else {
+            kit.push_back({file, {}, std::make_unique<util::dsp::StreamedSample>(file)});
+          }
+        } catch (util::dsp::WavFile::exception& e) {
+          LOGW("Could not open sample: {}", e.what());
+        }
+      }
+    }
+
+    std::vector<Kit> res;
+    for (auto& [name, samples] : loading) {
+      Kit kit = {name, {}};
+      for (auto& l : samples) {
+        if (l.streamed) {
+          kit.samples.push_back(std::move(l.streamed));
+        } else if (auto sample = l.cached.wait()) {
+          // Shares ownership of the whole cached sample
+          std::shared_ptr<const std::vector<float>> audio(sample, &sample->audio);
+          kit.samples.push_back(std::make_unique<util::dsp::StreamedSample>(l.path, audio, sample->samplerate));
+        }
+      }
+      if (!kit.samples.empty()) res.push_back(std::move(kit));
+    }
+    return res;
+  }
+
+  StreamSamplerEngine::StreamSamplerEngine()
+    : audio(std::make_unique<Audio>(load_kits(services::Application::current().data_dir / "samples"))),
+      screen_(std::make_unique<SamplerScreen>(audio->kit_names(), audio->kit_previews(), audio->streamer()))
+  {
+    props.kit.as<has_limits>().max = std::max(0, int(audio->kit_names().size()) - 1);
+  }
+
+  void StreamSamplerEngine::encoder(EncoderEvent e)
+  {
+    switch (e.encoder) {
+      case Encoder::blue: props.kit.step(e.steps); break;
+      case Encoder::green: props.speed.step(e.steps); break;
+      case Encoder::yellow: props.loop.step(e.steps); break;
+      default: break;
+    }
+  }
+
+  core::ui::ScreenAndInput StreamSamplerEngine::screen()
+  {
+    return {*screen_, *this};
+  }
+
+  core::ui::ScreenAndInput StreamSamplerEngine::envelope_screen()
+  {
+    return {env_screen_, props.envelope};
+  }
+
+  core::ui::ScreenAndInput StreamSamplerEngine::voices_screen()
+  {
+    return {voice_screen_, props.settings};
+  }
+
+} // namespace otto::engines::stream_sampler
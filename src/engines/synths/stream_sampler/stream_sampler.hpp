@@ -0,0 +1,83 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "core/engine/engine.hpp"
+#include "core/ui/screen.hpp"
+#include "core/voices/voice_manager.hpp"
+#include "core/voices/voices_ui.hpp"
+#include "itc/prop.hpp"
+#include "util/dsp/sample_stream.hpp"
+#include "util/reflection.hpp"
+
+namespace otto::engines::stream_sampler {
+
+  using namespace core;
+  using namespace core::engine;
+  using namespace props;
+
+  struct SamplerScreen;
+  struct Audio;
+  using Sender = EngineSender<Audio, SamplerScreen, voices::SettingsScreen, voices::EnvelopeScreen>;
+
+  /// A folder of samples
+  struct Kit {
+    std::string name;
+    std::vector<std::unique_ptr<util::dsp::StreamedSample>> samples;
+  };
+
+  /// Samples up to this long are decoded into memory by the {@ref services::SampleCache}, and shared with other
+  /// engines. Longer samples are streamed from disk.
+  constexpr int max_cached_seconds = 10;
+
+  /// Open the `.wav` files in each folder in `dir` as a kit, in order of their names
+  ///
+  /// Short samples are loaded through the {@ref services::SampleCache}, so they are only decoded again when
+  /// they have been evicted. Of longer samples, only the heads are read into memory. Files that can not be read
+  /// are skipped, and so are folders without any samples.
+  std::vector<Kit> load_kits(const fs::path& dir);
+
+  struct Props : voices::SynthPropsBase<Sender> {
+    /// Limited to the number of kits by the engine
+    Sender::Prop<struct kit_tag, int, wrap> kit = {sender, 0, limits(0, 0)};
+    Sender::Prop<struct speed_tag, float> speed = {sender, 1, limits(0.25, 4), step_size(0.01)};
+    /// Applies to the notes played after it is changed
+    Sender::Prop<struct loop_tag, bool> loop = {sender, false};
+
+    DECL_REFLECTION(Props, envelope, settings, kit, speed, loop);
+  };
+
+  /// Plays the kits in `data/samples`, streaming the samples from disk
+  ///
+  /// Each key plays a sample of the current kit, starting with the first one at middle C, and wrapping
+  /// around. Samples of any length can be played, since only their first frames are kept in memory.
+  struct StreamSamplerEngine : core::engine::SynthEngine<StreamSamplerEngine> {
+    static constexpr auto name = "Sampler";
+
+    StreamSamplerEngine();
+
+    void encoder(core::input::EncoderEvent e) override;
+
+    core::ui::ScreenAndInput screen() override;
+    core::ui::ScreenAndInput envelope_screen() override;
+    core::ui::ScreenAndInput voices_screen() override;
+
+    const std::unique_ptr<Audio> audio;
+
+    DECL_REFLECTION(StreamSamplerEngine, props);
+
+  private:
+    const std::unique_ptr<SamplerScreen> screen_;
+    voices::SettingsScreen voice_screen_;
+    voices::EnvelopeScreen env_screen_;
+
+    Sender sender_ = {*audio, *screen_, voice_screen_, env_screen_};
+    Props props{sender_};
+  };
+
+} // namespace otto::engines::stream_sampler
+
+#include "audio.hpp"
+#include "screen.hpp"
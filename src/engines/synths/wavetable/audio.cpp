@@ -0,0 +1,99 @@
+#include "audio.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#include "services/audio_manager.hpp"
+
+namespace otto::engines::wavetable {
+
+  using util::dsp::WavetablePyramid;
+
+  Voice::Voice(Audio& a) noexcept : audio(a)
+  {
+    env_.finish();
+  }
+
+  core::audio::ProcessData<1> Voice::process(core::audio::ProcessData<1> data) noexcept
+  {
+    auto& tables = *audio.tables_;
+    if (tables.size() == 0) {
+      std::fill(data.audio.begin(), data.audio.end(), 0.f);
+      return data;
+    }
+    const float inv_samplerate = 1.f / services::AudioManager::current().samplerate();
+    const int block_offset = audio.voice_mgr_.block_offset();
+    const int last = tables.size() - 1;
+
+    alignas(util::simd::vfloat::alignment) std::array<float, Audio::control_frames> wave;
+    std::array<float, Audio::control_frames> amp;
+    for (int start = 0; start < data.nframes; start += Audio::control_frames) {
+      const int n = std::min<int>(Audio::control_frames, data.nframes - start);
+      for (int f = 0; f < n; f++) {
+        next();
+        amp[f] = env_() * volume();
+      }
+
+      float increment = frequency() * audio.octave_factor_ * inv_samplerate;
+      int level = WavetablePyramid::level_for(increment);
+      // The morph only goes between two neighbouring tables, so the block is split where the position crosses
+      // into the next pair of tables
+      const float step = audio.position_step_;
+      float position = audio.block_position_ + step * (block_offset + start);
+      for (int done = 0; done < n;) {
+        int idx = std::clamp(int(std::floor(position)), 0, std::max(0, last - 1));
+        float frames = n - done;
+        if (step > 0 && idx + 1 < last) frames = std::ceil((idx + 1 - position) / step);
+        if (step < 0 && idx > 0) frames = std::floor((position - idx) / -step) + 1;
+        const int len = std::clamp(int(std::min(frames, float(n - done))), 1, n - done);
+        phase_ = util::dsp::render_wavetable(tables.table(idx, level), tables.table(std::min(idx + 1, last), level),
+                                             position - idx, step, phase_, increment, wave.data(), len);
+        for (int f = 0; f < len; f++) data.audio[start + done + f] = wave[f] * amp[done + f];
+        done += len;
+        position += step * len;
+      }
+    }
+    return data;
+  }
+
+  bool Voice::is_sounding() noexcept
+  {
+    return is_triggered() || !env_.done();
+  }
+
+  void Voice::on_note_on(float freq_target) noexcept
+  {
+    env_.resetSoft();
+  }
+
+  void Voice::on_note_off() noexcept
+  {
+    env_.release();
+  }
+
+  // Audio
+
+  Audio::Audio() noexcept
+  {
+    position_.set_ramp_frames(services::AudioManager::current().buffer_size());
+  }
+
+  void Audio::action(itc::prop_change<&Props::position>, float p) noexcept
+  {
+    position_.set(p);
+  }
+
+  void Audio::action(itc::prop_change<&Props::octave>, int o) noexcept
+  {
+    octave_factor_ = std::pow(2.f, o);
+  }
+
+  audio::ProcessData<1> Audio::process(audio::ProcessData<1> data) noexcept
+  {
+    const int last = std::max(0, tables_->size() - 1);
+    block_position_ = position_.current() * last;
+    position_step_ = (position_.skip(data.nframes) * last - block_position_) / data.nframes;
+    return voice_mgr_.process(data);
+  }
+
+} // namespace otto::engines::wavetable
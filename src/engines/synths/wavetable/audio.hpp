@@ -0,0 +1,89 @@
+#pragma once
+
+#include <Gamma/Envelope.h>
+
+#include "core/voices/voice_manager.hpp"
+#include "util/dsp/smoothed.hpp"
+#include "wavetable.hpp"
+
+namespace otto::engines::wavetable {
+
+  struct Voice : voices::VoiceBase<Voice> {
+    Voice(Audio& a) noexcept;
+
+    /// Render a block
+    ///
+    /// The tables are read {@ref Audio::control_frames} frames at a time with
+    /// {@ref util::dsp::render_wavetable}. The pitch, and so the level of the pyramid, is updated once per
+    /// control block, the envelope and volume every frame. A control block is split further where the morph
+    /// position crosses into the next pair of tables.
+    core::audio::ProcessData<1> process(core::audio::ProcessData<1>) noexcept;
+
+    void on_note_on(float) noexcept;
+    void on_note_off() noexcept;
+
+    /// The voice is sounding until the amp envelope is done
+    bool is_sounding() noexcept;
+
+    /// Use actions from base class
+    using VoiceBase::action;
+
+    void action(voices::attack_tag::action, float a) noexcept
+    {
+      env_.attack(a * a * 8.f + 0.01f);
+    }
+    void action(voices::decay_tag::action, float d) noexcept
+    {
+      env_.decay(d * d * 4.f + 0.01f);
+    }
+    void action(voices::sustain_tag::action, float s) noexcept
+    {
+      env_.sustain(s);
+    }
+    void action(voices::release_tag::action, float r) noexcept
+    {
+      env_.release(r * r * 8.f + 0.01f);
+    }
+
+  private:
+    Audio& audio;
+
+    /// In cycles, `[0, 1)`
+    float phase_ = 0;
+    gam::ADSR<> env_ = {0.1f, 0.1f, 0.7f, 2.0f, 1.f, -4.f};
+  };
+
+  struct Audio {
+    Audio() noexcept;
+
+    void action(itc::prop_change<&Props::position>, float p) noexcept;
+    void action(itc::prop_change<&Props::octave>, int o) noexcept;
+
+    template<typename Tag, typename... Args>
+    auto action(itc::Action<Tag, Args...> a, Args... args) noexcept
+      -> std::enable_if_t<itc::ActionReceiver::is<voices::VoiceManager<Voice, 6>, itc::Action<Tag, Args...>>>
+    {
+      voice_mgr_.action(a, args...);
+    }
+
+    audio::ProcessData<1> process(audio::ProcessData<1>) noexcept;
+
+  private:
+    friend Voice;
+
+    /// Frames per control block of the voices
+    static constexpr int control_frames = 16;
+
+    std::shared_ptr<const util::dsp::WavetablePyramid> tables_ = shared_wavetables();
+
+    util::dsp::Smoothed<> position_;
+    /// The position at the start of the current block, in waveforms, and how much it moves per frame.
+    /// The position is only advanced once per block, and all voices morph along the same ramp.
+    float block_position_ = 0;
+    float position_step_ = 0;
+    float octave_factor_ = 1;
+
+    voices::VoiceManager<Voice, 6> voice_mgr_ = {*this};
+  };
+
+} // namespace otto::engines::wavetable
@@ -0,0 +1,81 @@
+#include "screen.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#include "core/ui/vector_graphics.hpp"
+
+namespace otto::engines::wavetable {
+
+  using namespace ui;
+  using namespace ui::vg;
+  using util::dsp::WavetablePyramid;
+
+  void WavetableScreen::action(itc::prop_change<&Props::position>, float p) noexcept
+  {
+    position_ = p;
+  }
+
+  void WavetableScreen::action(itc::prop_change<&Props::octave>, int o) noexcept
+  {
+    octave_ = o;
+  }
+
+  void WavetableScreen::draw(ui::vg::Canvas& ctx)
+  {
+    constexpr float x_pad = 20;
+    constexpr float y_pad = 20;
+    constexpr float x_right = width - x_pad;
+    constexpr float number_shift = 30;
+    constexpr float wave_height = 50;
+    constexpr float wave_y = height / 2 + 20;
+    constexpr int points = 128;
+
+    // Waveform
+    if (tables_->size() > 0) {
+      int last = tables_->size() - 1;
+      float position = position_ * last;
+      int idx = std::clamp(int(position), 0, std::max(0, last - 1));
+      float morph = position - idx;
+      const float* a = tables_->table(idx, 0);
+      const float* b = tables_->table(std::min(idx + 1, last), 0);
+
+      ctx.beginPath();
+      for (int i = 0; i <= points; i++) {
+        int frame = i * WavetablePyramid::table_size / points;
+        float value = a[frame] + morph * (b[frame] - a[frame]);
+        float x = x_pad + (x_right - x_pad) * i / points;
+        if (i == 0)
+          ctx.moveTo(x, wave_y - value * wave_height);
+        else
+          ctx.lineTo(x, wave_y - value * wave_height);
+      }
+      ctx.lineWidth(4.0);
+      ctx.lineCap(LineCap::ROUND);
+      ctx.lineJoin(LineJoin::ROUND);
+      ctx.strokeStyle(Colours::Blue);
+      ctx.stroke();
+    }
+
+    // Text
+    ctx.font(Fonts::Norm, 25);
+    ctx.fillStyle(Colours::Blue);
+    ctx.textAlign(HorizontalAlign::Left, VerticalAlign::Middle);
+    ctx.fillText("position", x_pad, y_pad);
+
+    ctx.fillStyle(Colours::Green);
+    ctx.textAlign(HorizontalAlign::Right, VerticalAlign::Middle);
+    ctx.fillText("octave", x_right, y_pad);
+
+    // Numbers
+    ctx.font(Fonts::Norm, 40);
+    ctx.fillStyle(Colours::Blue);
+    ctx.textAlign(HorizontalAlign::Left, VerticalAlign::Middle);
+    ctx.fillText(fmt::format("{}", std::round(position_ * 100)), x_pad, y_pad + number_shift);
+
+    ctx.fillStyle(Colours::Green);
+    ctx.textAlign(HorizontalAlign::Right, VerticalAlign::Middle);
+    ctx.fillText(fmt::format("{:+}", octave_), x_right, y_pad + number_shift);
+  }
+
+} // namespace otto::engines::wavetable
@@ -0,0 +1,22 @@
+#pragma once
+
+#include "core/ui/screen.hpp"
+#include "wavetable.hpp"
+
+namespace otto::engines::wavetable {
+
+  /// Shows the waveform at the current position, morphed like the voices play it
+  struct WavetableScreen : ui::Screen {
+    void draw(nvg::Canvas& ctx) override;
+
+    void action(itc::prop_change<&Props::position>, float p) noexcept;
+    void action(itc::prop_change<&Props::octave>, int o) noexcept;
+
+  private:
+    std::shared_ptr<const util::dsp::WavetablePyramid> tables_ = shared_wavetables();
+
+    float position_ = 0;
+    int octave_ = 0;
+  };
+
+} // namespace otto::engines::wavetable
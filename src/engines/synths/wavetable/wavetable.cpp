@@ -0,0 +1,56 @@
+#include "wavetable.hpp"
+
+#include <mutex>
+
+#include "audio.hpp"
+#include "screen.hpp"
+#include "services/application.hpp"
+
+namespace otto::engines::wavetable {
+
+  using namespace core::input;
+
+  std::shared_ptr<const util::dsp::WavetablePyramid> shared_wavetables()
+  {
+    static std::mutex mutex;
+    static std::weak_ptr<const util::dsp::WavetablePyramid> loaded;
+    std::lock_guard lock(mutex);
+    auto res = loaded.lock();
+    if (!res) {
+      auto& data_dir = services::Application::current().data_dir;
+      res = std::make_shared<const util::dsp::WavetablePyramid>(
+        util::dsp::load_wavetables(data_dir / "wavetables", data_dir / "wavetables.cache"));
+      loaded = res;
+    }
+    return res;
+  }
+
+  WavetableEngine::WavetableEngine()
+    : audio(std::make_unique<Audio>()), screen_(std::make_unique<WavetableScreen>())
+  {}
+
+  void WavetableEngine::encoder(EncoderEvent e)
+  {
+    switch (e.encoder) {
+      case Encoder::blue: props.position.step(e.steps); break;
+      case Encoder::green: props.octave.step(e.steps); break;
+      default: break;
+    }
+  }
+
+  core::ui::ScreenAndInput WavetableEngine::screen()
+  {
+    return {*screen_, *this};
+  }
+
+  core::ui::ScreenAndInput WavetableEngine::envelope_screen()
+  {
+    return {env_screen_, props.envelope};
+  }
+
+  core::ui::ScreenAndInput WavetableEngine::voices_screen()
+  {
+    return {voice_screen_, props.settings};
+  }
+
+} // namespace otto::engines::wavetable
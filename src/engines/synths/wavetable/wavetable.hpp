@@ -0,0 +1,65 @@
+#pragma once
+
+#include <memory>
+
+#include "core/engine/engine.hpp"
+#include "core/ui/screen.hpp"
+#include "core/voices/voice_manager.hpp"
+#include "core/voices/voices_ui.hpp"
+#include "itc/prop.hpp"
+#include "util/dsp/wavetable.hpp"
+#include "util/reflection.hpp"
+
+namespace otto::engines::wavetable {
+
+  using namespace core;
+  using namespace core::engine;
+  using namespace props;
+
+  struct WavetableScreen;
+  struct Audio;
+  using Sender = EngineSender<Audio, WavetableScreen, voices::SettingsScreen, voices::EnvelopeScreen>;
+
+  struct Props : voices::SynthPropsBase<Sender> {
+    /// Where in the list of waveforms to play. Between two waveforms, they are morphed.
+    Sender::Prop<struct position_tag, float> position = {sender, 0, limits(0, 1), step_size(0.005)};
+    Sender::Prop<struct octave_tag, int> octave = {sender, 0, limits(-2, 2)};
+
+    DECL_REFLECTION(Props, envelope, settings, position, octave);
+  };
+
+  /// The waveforms in `data/wavetables`
+  ///
+  /// Loaded the first time an engine needs them, and shared by all the engines that use them after that.
+  /// The pyramids are immutable, so the audio and UI threads can read them without locking.
+  std::shared_ptr<const util::dsp::WavetablePyramid> shared_wavetables();
+
+  /// A synth that plays band-limited single cycle waveforms, and morphs between them
+  struct WavetableEngine : core::engine::SynthEngine<WavetableEngine> {
+    static constexpr auto name = "Wavetable";
+
+    WavetableEngine();
+
+    void encoder(core::input::EncoderEvent e) override;
+
+    core::ui::ScreenAndInput screen() override;
+    core::ui::ScreenAndInput envelope_screen() override;
+    core::ui::ScreenAndInput voices_screen() override;
+
+    const std::unique_ptr<Audio> audio;
+
+    DECL_REFLECTION(WavetableEngine, props);
+
+  private:
+    const std::unique_ptr<WavetableScreen> screen_;
+    voices::SettingsScreen voice_screen_;
+    voices::EnvelopeScreen env_screen_;
+
+    Sender sender_ = {*audio, *screen_, voice_screen_, env_screen_};
+    Props props{sender_};
+  };
+
+} // namespace otto::engines::wavetable
+
+#include "audio.hpp"
+#include "screen.hpp"
@@ -1,12 +1,13 @@
 #pragma once
 
-
-#include <deque>
-#include <queue>
+#include <atomic>
 #include <tuple>
+#include <type_traits>
 
 #include "action.hpp"
+#include "util/inplace_function.hpp"
 #include "util/spin_lock.hpp"
+#include "util/spsc_queue.hpp"
 #include "util/type_traits.hpp"
 #include "util/utility.hpp"
 
@@ -17,16 +18,38 @@ namespace otto::itc {
   /// Queue-owners can expose a reference to this to make sure the internal pop functions aren't
   /// callable from the outside.
   ///
-  /// @TODO Implement as a lock-free thread safe queue
-  /// @TODO Implement using a fixed size std::function alternative.
+  /// The queue is a bounded, lock-free ring buffer of fixed size callables, so pushing never
+  /// allocates, and the consumer never waits for a producer. Pushes to a full queue are dropped
+  /// and counted in {@ref overflow_count()}.
+  ///
+  /// The ring buffer itself is single-producer, but props are set from several non-realtime threads
+  /// (UI, controller, state loading), so producers are serialized by a spin lock. The consuming
+  /// thread never touches that lock.
   struct PushOnlyActionQueue {
-    using value_type = std::function<void()>;
+    /// Maximum number of actions that can be queued at once
+    static constexpr std::size_t capacity = 1024;
+    /// Maximum size of the captured state of a queued function
+    static constexpr std::size_t function_capacity = 48;
+
+    using value_type = util::inplace_function<void(), function_capacity>;
 
     int size() const noexcept
     {
       return queue_.size();
     }
 
+    /// The number of pushes that have been dropped because the queue was full
+    std::size_t overflow_count() const noexcept
+    {
+      return queue_.overflow_count();
+    }
+
+    /// The largest number of actions that have been queued at once
+    std::size_t high_water_mark() const noexcept
+    {
+      return queue_.high_water_mark();
+    }
+
     /// Push a call to `call_receiver` to the queue.
     template<typename AR, typename Tag, typename... Args>
     auto push(AR& ar, ActionData<Action<Tag, Args...>> action_data)
@@ -52,19 +75,52 @@ namespace otto::itc {
     ///
     /// This is completely separate from actions, and just allows you to run any old function on the other thread
     ///
+    /// @return `false` if the queue was full, and the function was dropped.
+    ///
     /// @TODO Consider, should this be removed from the interface?
-    void push(const value_type& v) noexcept
+    template<typename Callable>
+    bool push(Callable&& f) noexcept
     {
       lock_.lock();
-      queue_.push(v);
+      bool res = queue_.try_emplace(std::forward<Callable>(f));
       lock_.unlock();
+      return res;
     }
 
   protected:
     PushOnlyActionQueue() = default;
 
     util::spin_lock lock_;
-    std::queue<value_type, std::deque<value_type>> queue_;
+    util::spsc_queue<value_type, capacity> queue_;
+  };
+
+  namespace detail {
+    template<typename T, typename = void>
+    struct is_lock_free_atomic : std::false_type {};
+
+    template<typename T>
+    struct is_lock_free_atomic<T, std::enable_if_t<std::is_trivially_copyable_v<T>>>
+      : std::bool_constant<std::atomic<T>::is_always_lock_free> {};
+  } // namespace detail
+
+  /// The latest value of a single-argument action, for coalescing repeated pushes of it into one queued call
+  ///
+  /// See {@ref ActionSender::push_latest}. Each slot belongs to one queue. Copies start out empty, so a copied
+  /// prop does not share the slots of the original.
+  template<typename T>
+  struct LatestValueSlot {
+    static_assert(detail::is_lock_free_atomic<T>::value, "Only values that fit in a lock-free atomic can be coalesced");
+
+    LatestValueSlot() = default;
+    LatestValueSlot(const LatestValueSlot&) noexcept {}
+    LatestValueSlot& operator=(const LatestValueSlot&) noexcept
+    {
+      return *this;
+    }
+
+    std::atomic<T> value = {};
+    /// A call that will read `value` is in the queue
+    std::atomic_bool queued = false;
   };
 
   /// A queue one can push actionData/receiver pairs to to have the receiver called on another thread
@@ -72,30 +128,30 @@ namespace otto::itc {
     using value_type = PushOnlyActionQueue::value_type;
 
     /// Pop a function off the queue and return it
+    ///
+    /// Returns an empty function if the queue is empty
     value_type pop() noexcept
     {
-      lock_.lock();
-      auto res = queue_.front();
-      queue_.pop();
-      lock_.unlock();
-      return res;
+      auto res = queue_.try_pop();
+      if (!res) return {};
+      return std::move(*res);
     }
 
     /// Pop a function off the queue and call it
     void pop_call() noexcept
     {
-      pop()();
+      auto f = pop();
+      if (f) f();
     }
 
     /// Pop all functions off the queue and call them
-    void pop_call_all() noexcept
+    ///
+    /// Functions pushed while this is running are left for the next call.
+    ///
+    /// @return the number of functions called
+    std::size_t pop_call_all() noexcept
     {
-      lock_.lock();
-      while (queue_.size() > 0) {
-        queue_.front()();
-        queue_.pop();
-      }
-      lock_.unlock();
+      return queue_.consume_all([](value_type& f) { f(); });
     }
   };
 } // namespace otto::itc
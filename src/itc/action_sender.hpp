@@ -1,5 +1,7 @@
 #pragma once
 
+#include <gsl/span>
+
 #include "action_queue.hpp"
 
 namespace otto::itc {
@@ -16,6 +18,9 @@ namespace otto::itc {
     template<typename Val, typename Tag, typename... Mixins>
     using Prop = ActionProp<ActionSender<Receivers...>, Val, Tag, Mixins...>;
 
+    /// Number of {@ref LatestValueSlot}s used by {@ref push_latest}
+    static constexpr std::size_t queue_count = 1;
+
     /// Does not own the queue, and does not own the receivers.
     ActionSender(PushOnlyActionQueue& queue, Receivers&... r) : queue_(queue), receivers_(r...) {}
 
@@ -26,6 +31,29 @@ namespace otto::itc {
       (queue_.try_push(receiver<Receivers>(), action_data), ...);
     }
 
+    /// Push a new value of a single-argument action, coalesced with the pushes that have not been received yet
+    ///
+    /// The value is stored in `slots[0]`, and a call is only queued if there is none waiting already. When the
+    /// call runs, it passes the latest value to the receivers. However many times a prop is changed between
+    /// two runs of the queue, its receivers only get the last value, once, at the position of the first push.
+    template<typename Tag, typename Val>
+    void push_latest(gsl::span<LatestValueSlot<Val>> slots, ActionData<Action<Tag, Val>> action_data)
+    {
+      if constexpr ((ActionReceiver::is<Receivers, Action<Tag, Val>> || ...)) {
+        auto& slot = slots[0];
+        // The value must be stored before the flag is checked, and the call clears the flag before it loads
+        // the value, so a value stored after the load always queues a new call.
+        slot.value.store(std::get<0>(action_data.args));
+        if (slot.queued.exchange(true)) return;
+        bool pushed = queue_.push([&slot, receivers = receivers_] {
+          slot.queued.store(false);
+          auto data = Action<Tag, Val>::data(slot.value.load());
+          (try_call_receiver(std::get<Receivers&>(receivers), data), ...);
+        });
+        if (!pushed) slot.queued.store(false);
+      }
+    }
+
     /// Get a receiver of a specific type
     template<typename Receiver>
     auto receiver() noexcept -> std::enable_if_t<util::is_one_of_v<Receiver, Receivers...>, Receiver&>
@@ -43,6 +71,9 @@ namespace otto::itc {
     template<typename Val, typename Tag, typename... Mixins>
     using Prop = ActionProp<JoinedActionSender<ActionSenders...>, Val, Tag, Mixins...>;
 
+    /// Number of {@ref LatestValueSlot}s used by {@ref push_latest}. One for each queue of the joined senders
+    static constexpr std::size_t queue_count = (ActionSenders::queue_count + ... + 0);
+
     JoinedActionSender(ActionSenders... sndrs) : sndrs_{std::forward<ActionSenders>(sndrs)...} {}
 
     template<typename Tag, typename... Args>
@@ -51,6 +82,20 @@ namespace otto::itc {
       util::for_each(sndrs_, [&action_data](auto& sndr) { sndr.push(action_data); });
     }
 
+    /// Push a coalesced value to each of the joined senders. See {@ref ActionSender::push_latest}
+    ///
+    /// `slots` is split between the senders, in order.
+    template<typename Tag, typename Val>
+    void push_latest(gsl::span<LatestValueSlot<Val>> slots, ActionData<Action<Tag, Val>> action_data)
+    {
+      std::size_t offset = 0;
+      util::for_each(sndrs_, [&](auto& sndr) {
+        constexpr std::size_t count = std::decay_t<decltype(sndr)>::queue_count;
+        sndr.push_latest(slots.subspan(offset, count), action_data);
+        offset += count;
+      });
+    }
+
   private:
     std::tuple<ActionSenders...> sndrs_;
   };
@@ -66,6 +111,9 @@ namespace otto::itc {
     template<typename Val, typename Tag, typename... Mixins>
     using Prop = ActionProp<DirectActionSender<Receivers...>, Val, Tag, Mixins...>;
 
+    /// There is no queue, so {@ref push_latest} needs no slots
+    static constexpr std::size_t queue_count = 0;
+
     DirectActionSender(Receivers&... r) : receivers_(r...) {}
 
     /// Push an action to be received by all receivers that support it
@@ -75,6 +123,13 @@ namespace otto::itc {
       (try_call_receiver(receiver<Receivers>(), action_data), ...);
     }
 
+    /// Calls the receivers directly, there is nothing to coalesce
+    template<typename Tag, typename Val>
+    void push_latest(gsl::span<LatestValueSlot<Val>>, ActionData<Action<Tag, Val>> action_data)
+    {
+      push(action_data);
+    }
+
     /// Get a receiver of a specific type
     template<typename Receiver>
     auto receiver() noexcept -> std::enable_if_t<util::is_one_of_v<Receiver, Receivers...>, Receiver&>
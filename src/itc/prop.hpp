@@ -1,6 +1,11 @@
 #pragma once
 
+#include <array>
+
+#include <gsl/span>
+
 #include "action.hpp"
+#include "action_queue.hpp"
 #include "core/props/props.hpp"
 
 namespace otto::core::props::mixin {
@@ -17,12 +22,27 @@ namespace otto::core::props::mixin {
     }
   };
 
+  namespace detail {
+    /// The number of queues a sender can coalesce pushes to, or 0 if it does not have `push_latest`
+    template<typename Sender, typename = void>
+    struct queue_count : std::integral_constant<std::size_t, 0> {};
+
+    template<typename Sender>
+    struct queue_count<Sender, std::void_t<decltype(Sender::queue_count)>>
+      : std::integral_constant<std::size_t, Sender::queue_count> {};
+  } // namespace detail
+
   template<typename PropTag, typename Sender, typename ValueType, typename TagList>
   struct leaf<action<PropTag, Sender>, ValueType, TagList> {
     using action_mixin = action<PropTag, Sender>;
     OTTO_PROPS_MIXIN_DECLS(action_mixin);
     using change_action = itc::Action<PropTag, value_type>;
 
+    /// Changes are coalesced with {@ref itc::ActionSender::push_latest} when the sender and the value type
+    /// support it. Otherwise every change is queued.
+    static constexpr bool coalesce_changes =
+      detail::queue_count<Sender>::value > 0 && itc::detail::is_lock_free_atomic<value_type>::value;
+
     void init(Sender& sndr) noexcept
     {
       sender = &sndr;
@@ -42,11 +62,20 @@ namespace otto::core::props::mixin {
     void send_actions() const noexcept
     {
       OTTO_ASSERT(sender != nullptr);
-      sender->push(change_action::data(as_prop().get()));
+      if constexpr (coalesce_changes) {
+        sender->push_latest(gsl::span<itc::LatestValueSlot<value_type>>(latest_), change_action::data(as_prop().get()));
+      } else {
+        sender->push(change_action::data(as_prop().get()));
+      }
     }
 
   private:
     Sender* sender = nullptr;
+    /// One slot per queue of the sender, if changes are coalesced
+    mutable std::conditional_t<coalesce_changes,
+                               std::array<itc::LatestValueSlot<value_type>, detail::queue_count<Sender>::value>,
+                               std::array<char, 0>>
+      latest_;
   };
 
 } // namespace otto::core::props::mixin
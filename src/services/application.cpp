@@ -9,6 +9,7 @@
 #include "services/state_manager.hpp"
 #include "services/ui_manager.hpp"
 #include "services/clock_manager.hpp"
+#include "services/sample_cache.hpp"
 #include "services/controller.hpp"
 
 namespace otto::services {
@@ -18,6 +19,7 @@ namespace otto::services {
                            ServiceStorage<PresetManager>::Factory preset_fact,
                            ServiceStorage<AudioManager>::Factory audio_fact,
                            ServiceStorage<ClockManager>::Factory clock_fact,
+                           ServiceStorage<SampleCache>::Factory sample_cache_fact,
                            ServiceStorage<UIManager>::Factory ui_fact,
                            ServiceStorage<Controller>::Factory controller,
                            ServiceStorage<EngineManager>::Factory engine_fact)
@@ -26,6 +28,7 @@ namespace otto::services {
       preset_manager(std::move(preset_fact)),
       audio_manager(std::move(audio_fact)),
       clock_manager(std::move(clock_fact)),
+      sample_cache(std::move(sample_cache_fact)),
       ui_manager(std::move(ui_fact)),
       controller(std::move(controller)),
       engine_manager(std::move(engine_fact))
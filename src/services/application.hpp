@@ -17,6 +17,7 @@ namespace otto::services {
   struct UIManager;
   struct StateManager;
   struct ClockManager;
+  struct SampleCache;
   struct Controller;
 
   struct Application;
@@ -86,6 +87,7 @@ namespace otto::services {
                 ServiceStorage<PresetManager>::Factory preset_factory,
                 ServiceStorage<AudioManager>::Factory audio_factory,
                 ServiceStorage<ClockManager>::Factory clock_factory,
+                ServiceStorage<SampleCache>::Factory sample_cache_factory,
                 ServiceStorage<UIManager>::Factory ui_factory,
                 ServiceStorage<Controller>::Factory controller,
                 ServiceStorage<EngineManager>::Factory engine_factory);
@@ -110,6 +112,7 @@ namespace otto::services {
     ServiceStorage<PresetManager> preset_manager;
     ServiceStorage<AudioManager> audio_manager;
     ServiceStorage<ClockManager> clock_manager;
+    ServiceStorage<SampleCache> sample_cache;
     ServiceStorage<UIManager> ui_manager;
     ServiceStorage<Controller> controller;
     ServiceStorage<EngineManager> engine_manager;
@@ -1,7 +1,12 @@
 #include "audio_manager.hpp"
 
+#include <algorithm>
+#include <cstring>
+
 #include <Gamma/Domain.h>
 
+#include "util/realtime.hpp"
+
 namespace otto::services {
 
   AudioManager::AudioManager()
@@ -15,6 +20,16 @@ namespace otto::services {
     return _buffer_pool;
   }
 
+  core::audio::AudioProfiler& AudioManager::profiler() noexcept
+  {
+    return profiler_;
+  }
+
+  AudioManager::RealtimeConfig& AudioManager::realtime_config() noexcept
+  {
+    return realtime_config_;
+  }
+
   itc::PushOnlyActionQueue& AudioManager::action_queue() noexcept
   {
     return action_queue_;
@@ -22,6 +37,19 @@ namespace otto::services {
 
   void AudioManager::start() noexcept
   {
+    auto& cfg = realtime_config_;
+    if (cfg.enabled && cfg.lock_memory) {
+      // Faulting in the whole process takes a while, so it is done here instead of in the first audio callback
+      memory_lock_error_ = util::lock_memory();
+      if (memory_lock_error_ == 0) memory_lock_error_ = _buffer_pool.lock_memory();
+      if (memory_lock_error_ == 0) {
+        LOGI("Locked the process memory into RAM");
+      } else {
+        LOGW("Could not lock memory: {} (errno {}). Add CAP_IPC_LOCK or raise the memlock limit to avoid page "
+             "faults on the audio thread",
+             std::strerror(memory_lock_error_), memory_lock_error_);
+      }
+    }
     _running = true;
   }
 
@@ -30,17 +58,71 @@ namespace otto::services {
     return _running;
   }
 
-  void AudioManager::wait_one() const noexcept
+  bool AudioManager::wait_for_next_block(std::chrono::nanoseconds timeout) noexcept
+  {
+    auto number = _buffer_number.load();
+    block_waiters_++;
+    bool res = wait_while_equal(_buffer_number, number, timeout);
+    block_waiters_--;
+    return res;
+  }
+
+  bool AudioManager::wait_while_equal(std::atomic<std::uint32_t>& word,
+                                      std::uint32_t value,
+                                      std::chrono::nanoseconds timeout) noexcept
+  {
+    using clock = std::chrono::steady_clock;
+    // Most waits are over within a fraction of a buffer, which is shorter than a sleep and a wakeup
+    constexpr auto spin_time = std::chrono::microseconds(50);
+    auto start = clock::now();
+    while (clock::now() - start < std::min<std::chrono::nanoseconds>(spin_time, timeout)) {
+      if (word.load() != value) return true;
+      util::cpu_relax();
+    }
+    while (word.load() == value) {
+      auto left = timeout - (clock::now() - start);
+      if (left.count() <= 0) return false;
+      util::futex_wait_for(word, value, left);
+    }
+    return true;
+  }
+
+  bool AudioManager::wait_for_call(BlockCall& call, std::chrono::nanoseconds timeout) noexcept
+  {
+    using clock = std::chrono::steady_clock;
+    auto deadline = clock::now() + timeout;
+    while (true) {
+      // Read before the state, so a call finished in between wakes the wait below
+      auto seen = calls_done_.load();
+      auto state = call.state.load();
+      if (state == BlockCall::done) return true;
+      if (state == BlockCall::running) {
+        // The audio thread is calling it now, so it is done soon
+        util::futex_wait(calls_done_, seen);
+        continue;
+      }
+      auto left = deadline - clock::now();
+      if (left.count() <= 0) {
+        std::uint32_t expected = BlockCall::pending;
+        if (call.state.compare_exchange_strong(expected, BlockCall::cancelled)) return false;
+        continue;
+      }
+      wait_while_equal(calls_done_, seen, left);
+    }
+  }
+
+  void AudioManager::free_dropped_calls()
   {
-    auto last = buffer_number();
-    if (last == 0) return;
-    while (last >= (buffer_number() - 1))
-      ;
+    timed_out_calls_.apply([](auto& calls) {
+      calls.erase(std::remove_if(calls.begin(), calls.end(),
+                                 [](auto& call) { return call->state == BlockCall::dropped; }),
+                  calls.end());
+    });
   }
 
   void AudioManager::send_midi_event(core::midi::AnyMidiEvent evt) noexcept
   {
-    midi_bufs.outer().emplace_back(std::move(evt));
+    midi_bufs.outer_locked([&](core::midi::MidiBuffer& buf) { buf.push(evt); });
   }
 
   float AudioManager::cpu_time() noexcept
@@ -53,10 +135,48 @@ namespace otto::services {
   void AudioManager::pre_process_tasks() noexcept
   {
     _buffer_number++;
+    if (block_waiters_ > 0) util::futex_wake_all(_buffer_number);
+    _buffer_pool.end_block();
+    profiler_.begin_block();
     auto running = this->running() && Application::current().running();
-    if (running) {
+    if (!running) return;
+    if (!realtime_setup_done_ && realtime_config_.enabled) realtime_setup();
+    {
+      auto scope = profiler_.scope(action_queue_stage_);
       action_queue_.pop_call_all();
     }
+    if (resource_usage_countdown_-- == 0) {
+      auto usage = util::thread_resource_usage::get();
+      profiler_.record_resource_usage(usage.page_faults, usage.involuntary_switches);
+      resource_usage_countdown_ = _samplerate / std::max(1u, _buffer_size.load());
+    }
+  }
+
+  void AudioManager::realtime_setup() noexcept
+  {
+    realtime_setup_done_ = true;
+    auto& cfg = realtime_config_;
+    if (cfg.flush_denormals && !util::flush_denormals()) {
+      LOGW("Flushing denormals to zero is not supported on this platform");
+    }
+    if (cfg.cpu >= 0 && !util::pin_current_thread(cfg.cpu)) {
+      LOGW("Could not pin the audio thread to cpu {}", cfg.cpu);
+    }
+    // The pool buffers are written when they are allocated, so only the stack needs to be touched
+    int stack_lock_error = 0;
+    if (cfg.prefault_stack > 0) {
+      if (cfg.lock_memory) {
+        stack_lock_error = util::lock_stack(cfg.prefault_stack);
+      } else {
+        util::prefault_stack(cfg.prefault_stack);
+      }
+    }
+    if (stack_lock_error != 0) {
+      LOGW("Could not lock the audio thread stack: {} (errno {})", std::strerror(stack_lock_error),
+           stack_lock_error);
+    }
+    LOGI("Audio thread set up. Denormals flushed: {}, cpu: {}, memory locked: {}", util::denormals_flushed(),
+         cfg.cpu, cfg.lock_memory && memory_lock_error_ == 0 && stack_lock_error == 0);
   }
 
 } // namespace otto::services
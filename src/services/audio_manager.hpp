@@ -1,18 +1,43 @@
 #pragma once
 
+#include <chrono>
+#include <cstdint>
 #include <memory>
+#include <vector>
 
 #include "core/audio/processor.hpp"
+#include "core/audio/profiler.hpp"
 #include "core/service.hpp"
 #include "itc/itc.hpp"
 #include "services/application.hpp"
 #include "services/debug_ui.hpp"
+#include "util/futex.hpp"
 #include "util/locked.hpp"
 #include "util/signals.hpp"
 
 namespace otto::services {
 
   struct AudioManager : core::Service {
+    /// How the audio thread is set up for realtime processing, on the first block after {@ref start()}
+    struct RealtimeConfig {
+      /// Run the realtime setup at all. Enabled by the drivers of actual audio devices
+      bool enabled = false;
+      /// Flush denormals to zero, see {@ref util::flush_denormals}
+      bool flush_denormals = true;
+      /// Lock the memory of the process into RAM, so the audio thread never waits for a page to be swapped in
+      ///
+      /// Opt in. The memory mapped at {@ref start()} is locked with `mlockall(MCL_CURRENT)` on the calling thread.
+      /// Later allocations are not locked, except the buffer pool, the audio workers and the audio thread stack,
+      /// which are locked with `mlock`.
+      bool lock_memory = false;
+      /// Pin the audio thread to this cpu, ideally one isolated with the `isolcpus` kernel parameter. -1 to not
+      /// pin it
+      int cpu = -1;
+      /// Bytes of stack to touch, so the audio thread does not page fault when its stack grows. Also locked, with
+      /// `lock_memory`
+      std::size_t prefault_stack = 256 * 1024;
+    };
+
     /// Fires Events::pre_init and generates midi frequency table.
     ///
     /// @note @ref _buffer_pool is constructed
@@ -20,10 +45,16 @@ namespace otto::services {
     /// AudioBufferPool::set_buffer_size as soon as possible
     AudioManager();
 
-    /// Use this to get audio buffers. There are currently a maximum of 4 avaliable, so make sure to
-    /// release them when you're done with them!
+    /// Use this to get audio buffers. The pool starts out with {@ref AudioBufferPool::number_of_buffers} buffers,
+    /// and is grown by the ui thread when needed. Buffers must be released before the end of the block.
     core::audio::AudioBufferPool& buffer_pool() noexcept;
 
+    /// Timings of the stages of the audio processing
+    core::audio::AudioProfiler& profiler() noexcept;
+
+    /// The realtime setup of the audio thread. Must be changed before {@ref start()}
+    RealtimeConfig& realtime_config() noexcept;
+
     /// Push-only access to the action queue
     ///
     /// This queue is consumed at the start of each buffer.
@@ -60,12 +91,32 @@ namespace otto::services {
       return _buffer_number;
     }
 
-    /// Block at least until the current process call is done
-    void wait_one() const noexcept;
+    /// How long {@ref wait_for_next_block} and {@ref run_at_next_block} wait by default. Much longer than a
+    /// buffer, so they only time out when audio is not being processed.
+    static constexpr std::chrono::milliseconds default_block_timeout{500};
+
+    /// Block until the next buffer starts, so the process call running now, if any, is done
+    ///
+    /// Spins briefly, since buffers are short, and then sleeps until the audio thread wakes it.
+    ///
+    /// \returns `false` if no buffer started within `timeout`, e.g. because audio is stopped
+    bool wait_for_next_block(std::chrono::nanoseconds timeout = default_block_timeout) noexcept;
+
+    /// Call `f` on the audio thread at the start of the next buffer, and block until it returns
+    ///
+    /// `f` is called from the action queue, so it runs after the actions pushed before this call, and
+    /// before the buffer is processed.
+    ///
+    /// \returns `false` if `f` was not called within `timeout`, e.g. because audio is stopped, or if the
+    /// action queue is full. `f` is then never called, and is destroyed on a non-realtime thread, like
+    /// everything else it captured.
+    template<typename F>
+    bool run_at_next_block(F&& f, std::chrono::nanoseconds timeout = default_block_timeout);
 
     /// Start audio processing
     ///
-    /// Sets `running() = true`
+    /// Sets `running() = true`, and locks the memory if {@ref RealtimeConfig::lock_memory} is set, so it is done
+    /// here rather than on the audio thread.
     void start() noexcept;
 
     /// Check if audio should be processed
@@ -92,19 +143,67 @@ namespace otto::services {
   protected:
     /// Must be called by implementations before the actual processing is performed
     ///
-    /// Executes the items in the action queue, and increments the buffer number
+    /// Executes the items in the action queue, increments the buffer number,
+    /// and ends the previous block in the buffer pool and the profiler.
+    ///
+    /// On the first block after {@ref start()}, this also runs the realtime setup from {@ref realtime_config()},
+    /// since it must happen on the audio thread. About once a second, it records the page faults and context
+    /// switches of the audio thread in the profiler.
     void pre_process_tasks() noexcept;
 
-    util::double_buffered<core::midi::shared_vector<core::midi::AnyMidiEvent>> midi_bufs = {{}, {}};
+    /// Messages sent with {@ref send_midi_event} are pushed to the outer buffer. The inner buffer holds the
+    /// messages of the block being processed.
+    util::double_buffered<core::midi::MidiBuffer> midi_bufs = {{}, {}};
     std::atomic_int _samplerate = 48000;
     std::atomic_uint _buffer_size = 256;
-    std::atomic_uint _buffer_number = 0;
+    /// Incremented at the start of each buffer. The audio thread wakes {@ref wait_for_next_block} on it.
+    std::atomic<std::uint32_t> _buffer_number = 0;
     util::audio::Graph _cpu_time;
     itc::ActionQueue action_queue_;
 
   private:
+    /// Spin, and then sleep on a futex, while `word == value`
+    ///
+    /// \returns `false` if `word` did not change within `timeout`
+    static bool wait_while_equal(std::atomic<std::uint32_t>& word,
+                                 std::uint32_t value,
+                                 std::chrono::nanoseconds timeout) noexcept;
+
+    /// Threads in {@ref wait_for_next_block}. The audio thread only makes the wake syscall if there are any
+    std::atomic_int block_waiters_ = 0;
+
+    /// The state of a {@ref run_at_next_block} call. Owned by the calling thread, and pointed to by the queued action
+    struct BlockCall {
+      enum State : std::uint32_t { pending, running, done, cancelled, dropped };
+      virtual ~BlockCall() = default;
+      std::atomic<std::uint32_t> state = pending;
+    };
+
+    /// Wait until the audio thread is done with `call`, or cancel it if it is not started within `timeout`
+    ///
+    /// \returns `false` if the call was cancelled
+    bool wait_for_call(BlockCall& call, std::chrono::nanoseconds timeout) noexcept;
+
+    /// Free the calls in {@ref timed_out_calls_} whose actions the audio thread has dropped
+    void free_dropped_calls();
+
+    /// Incremented by the audio thread after each {@ref run_at_next_block} call, which it wakes the callers on
+    std::atomic<std::uint32_t> calls_done_ = 0;
+    /// Cancelled calls that may still be queued. Freed by {@ref free_dropped_calls}, or with the audio manager
+    util::locked<std::vector<std::unique_ptr<BlockCall>>> timed_out_calls_;
     core::audio::AudioBufferPool _buffer_pool{1};
+    core::audio::AudioProfiler profiler_;
+    int action_queue_stage_ = profiler_.add_stage("action queue");
     std::atomic_bool _running{false};
+
+    /// Set up the calling thread for realtime processing
+    void realtime_setup() noexcept;
+    RealtimeConfig realtime_config_;
+    bool realtime_setup_done_ = false;
+    /// The `errno` of locking the memory in {@ref start()}, 0 on success
+    int memory_lock_error_ = 0;
+    /// Blocks until the next resource usage sample
+    unsigned resource_usage_countdown_ = 0;
   };
 
   // IMPLEMENTATION //
@@ -115,6 +214,35 @@ namespace otto::services {
     return itc::ActionSender(action_queue_, receivers...);
   }
 
+  template<typename F>
+  bool AudioManager::run_at_next_block(F&& f, std::chrono::nanoseconds timeout)
+  {
+    struct Call : BlockCall {
+      Call(F&& f) : f(std::forward<F>(f)) {}
+      std::decay_t<F> f;
+    };
+    free_dropped_calls();
+    auto call = std::make_unique<Call>(std::forward<F>(f));
+    // The action only gets a raw pointer, so it never frees the call, or anything `f` captured, on the audio thread
+    bool pushed = action_queue_.push([this, c = call.get()] {
+      std::uint32_t expected = BlockCall::pending;
+      if (!c->state.compare_exchange_strong(expected, BlockCall::running)) {
+        c->state = BlockCall::dropped;
+        return;
+      }
+      c->f();
+      // The caller may free the call as soon as this is stored
+      c->state = BlockCall::done;
+      calls_done_++;
+      util::futex_wake_all(calls_done_);
+    });
+    if (!pushed) return false;
+    if (wait_for_call(*call, timeout)) return true;
+    // The action is still queued, so the call is freed by a later call, once the audio thread has dropped it
+    timed_out_calls_.apply([&](auto& calls) { calls.push_back(std::move(call)); });
+    return false;
+  }
+
   template<typename... Receivers>
   struct AudioSender : itc::ActionSender<Receivers...> {
     template<typename Tag, typename Type, typename... Mixins>
@@ -1,28 +1,56 @@
 #include "engine_manager.hpp"
 
+#include <algorithm>
+#include <cstring>
+#include <thread>
+
 #include "core/engine/engine_dispatcher.hpp"
 #include "core/engine/engine_dispatcher.inl"
+#include "core/audio/graph.hpp"
 #include "core/ui/vector_graphics.hpp"
 
 #include "engines/fx/wormhole/wormhole.hpp"
 #include "engines/fx/chorus/chorus.hpp"
 #include "engines/synths/OTTOFM/ottofm.hpp"
 #include "engines/synths/goss/goss.hpp"
+#include "engines/synths/stream_sampler/stream_sampler.hpp"
+#include "engines/synths/wavetable/wavetable.hpp"
 
 
 #include "services/application.hpp"
+#include "services/audio_manager.hpp"
 #include "services/clock_manager.hpp"
 
+#include "util/realtime_worker_pool.hpp"
+
 namespace otto::services {
 
   using namespace core;
   using namespace core::engine;
 
+  namespace {
+    void log_setup_errors(const util::realtime_worker_pool& workers)
+    {
+      for (auto& e : workers.setup_errors()) {
+        if (e.cpu < 0) {
+          LOGW("Could not give audio worker {} realtime priority: {}", e.worker, std::strerror(e.error));
+        } else {
+          LOGW("Could not pin audio worker {} to cpu {}: {}", e.worker, e.cpu, std::strerror(e.error));
+        }
+      }
+    }
+  } // namespace
+
   struct DefaultEngineManager final : EngineManager {
     DefaultEngineManager();
 
     void start() override;
     audio::ProcessData<2> process(audio::ProcessData<1> external_in) override;
+    audio::ProcessData<2> process_into(audio::ProcessData<1> external_in,
+                                       const std::array<audio::AudioBufferHandle, 2>& output) override;
+
+    /// Build the audio routing graph, and swap it in at the start of the next buffer
+    void rebuild_graph();
 
   private:
     // using EffectsDispatcher = EngineDispatcher< //
@@ -32,7 +60,9 @@ namespace otto::services {
     using SynthDispatcher = EngineDispatcher< //
       EngineType::synth,
       engines::ottofm::OttofmEngine,
-      engines::goss::GossEngine>;
+      engines::goss::GossEngine,
+      engines::wavetable::WavetableEngine,
+      engines::stream_sampler::StreamSamplerEngine>;
 
     SynthDispatcher synth;
     engines::wormhole::Wormhole effect1;
@@ -45,6 +75,10 @@ namespace otto::services {
     // engines::Sends line_in_send;
     // engines::Master master;
     // engines::Sequencer sequencer;
+
+    /// Runs independent branches of the graph in parallel. `nullptr` when disabled.
+    std::unique_ptr<util::realtime_worker_pool> workers_;
+    audio::SwappableAudioGraph graph_;
   };
 
   std::unique_ptr<EngineManager> EngineManager::create_default()
@@ -188,72 +222,134 @@ namespace otto::services {
     };
 
     state_manager.attach("Engines", load, save);
-  }
 
-  void DefaultEngineManager::start() {}
+#if OTTO_AUDIO_WORKERS
+    util::realtime_worker_pool::config workers_config;
+    // The audio thread takes part in the work as well
+    workers_config.workers = std::clamp(int(std::thread::hardware_concurrency()) - 1, 0, 3);
+    workers_config.avoid_cpu = Application::current().audio_manager->realtime_config().cpu;
+    if (workers_config.workers > 0) {
+      workers_ = std::make_unique<util::realtime_worker_pool>(workers_config);
+      log_setup_errors(*workers_);
+    }
+#endif
 
-  audio::ProcessData<2> DefaultEngineManager::process(audio::ProcessData<1> external_in)
-  {
-    // Main processor function
-    auto midi_in = external_in.midi_only();
-    midi_in.clock = ClockManager::current().step_frames(external_in.nframes);
-    // auto arp_out = arpeggiator->process(midi_in);
-    auto synth_out = synth.process(external_in);
-    auto right_chan = Application::current().audio_manager->buffer_pool().allocate();
+    rebuild_graph();
+  }
 
-    util::copy(synth_out.audio, right_chan.begin());
+  void DefaultEngineManager::start()
+  {
+    if (!workers_) return;
+    // The audio thread may have been pinned, and memory locking enabled, on the command line, after the workers
+    // were started
+    auto& cfg = Application::current().audio_manager->realtime_config();
+    workers_->avoid_cpu(cfg.cpu);
+    log_setup_errors(*workers_);
+    if (cfg.enabled && cfg.lock_memory) {
+      if (int err = workers_->lock_memory(cfg.prefault_stack); err != 0) {
+        LOGW("Could not lock the audio workers into memory: {} (errno {})", std::strerror(err), err);
+      }
+    }
+  }
 
-    auto fx1_bus = Application::current().audio_manager->buffer_pool().allocate();
-    auto fx2_bus = Application::current().audio_manager->buffer_pool().allocate();
+  void DefaultEngineManager::rebuild_graph()
+  {
+    using Buffers = audio::AudioGraph::Buffers;
+    using Data = audio::ProcessData<0>;
+    audio::AudioGraphBuilder b;
+
+    auto synth_bus = b.bus("synth", 1);
+    auto fx1_send = b.bus("fx1 send", 1);
+    auto fx2_send = b.bus("fx2 send", 1);
+    auto fx1_out = b.bus("fx1", 2);
+    auto fx2_out = b.bus("fx2", 2);
+    auto fx1_mix = b.bus("fx1 + dry", 2);
+    auto master = b.bus("master", 2);
+
+    // The synths write their output to the buffer they are given, or return a new one. Goss allocates three
+    // buffers while processing, and while switching engines, both engines run, and the old one gets a copy of
+    // the input.
+    b.node("synth", {}, {synth_bus},
+           [this](Buffers&, Buffers& out, Data& data) {
+             auto res = synth.process(data.with(out[0]));
+             if (res.audio.data() != out[0].data()) util::copy(res.audio, out[0].begin());
+           },
+           {/* in_place = */ false, /* scratch_buffers = */ 7});
+
+    b.node("sends", {synth_bus}, {fx1_send, fx2_send}, [](Buffers& in, Buffers& out, Data&) {
+      for (auto&& [snth, fx1, fx2] : util::zip(in[0], out[0], out[1])) {
+        fx1 = snth * 0.25; // * synth_send.props.to_FX1;
+        fx2 = snth * 0.25; // * synth_send.props.to_FX2;
+      }
+    });
 
-    for (auto&& [snth, fx1, fx2] : util::zip(synth_out.audio, fx1_bus, fx2_bus)) {
-      fx1 = snth * 0.25; // * synth_send.props.to_FX1;
-      fx2 = snth * 0.25; // * synth_send.props.to_FX2;
+    // The effects return new buffers, which are copied after they are done reading the input
+    auto effect_node = [](auto& effect) {
+      return [&effect](Buffers& in, Buffers& out, Data& data) {
+        auto res = effect.audio->process(data.with(in[0]));
+        util::copy(res.audio[0], out[0].begin());
+        util::copy(res.audio[1], out[1].begin());
+      };
+    };
+    b.node("fx1", {fx1_send}, {fx1_out}, effect_node(effect1), {/* in_place = */ true, /* scratch_buffers = */ 2});
+    b.node("fx1 return", {synth_bus, fx1_out}, {fx1_mix}, [](Buffers& in, Buffers& out, Data&) {
+      // The outputs may alias any of the inputs, so read the whole frame before writing
+      for (auto&& [snth, fxL, fxR, l, r] : util::zip(in[0], in[1], in[2], out[0], out[1])) {
+        const float dry = snth;
+        const float wetR = fxR;
+        l = fxL + dry * 0.5; // * synth_send.props.dry * (1 - synth_send.props.dry_pan);
+        r = wetR + dry * 0.5; // * synth_send.props.dry * (1 + synth_send.props.dry_pan);
+      }
+    }, {/* in_place = */ true});
+    b.node("fx2", {fx2_send}, {fx2_out}, effect_node(effect2), {/* in_place = */ true, /* scratch_buffers = */ 2});
+    b.node("fx2 return", {fx1_mix, fx2_out}, {master}, [](Buffers& in, Buffers& out, Data&) {
+      for (auto&& [mixL, mixR, fxL, fxR, l, r] : util::zip(in[0], in[1], in[2], in[3], out[0], out[1])) {
+        const float right = mixR + fxR;
+        l = mixL + fxL;
+        r = right;
+      }
+    }, {/* in_place = */ true});
+
+    b.output(master);
+    // One buffer is used by the external input
+    constexpr int budget = audio::AudioBufferPool::number_of_buffers - 1;
+    std::unique_ptr<audio::AudioGraph> graph;
+    if (workers_) {
+      try {
+        graph = b.compile(budget, audio::AudioGraphBuilder::Schedule::parallel);
+      } catch (audio::AudioGraphBuilder::exception& e) {
+        if (e.data() != audio::AudioGraphBuilder::ErrorCode::too_many_buffers) throw;
+        LOGW("Processing the audio graph serially: {}", e.what());
+      }
     }
-    auto fx1_out = effect1.audio->process(audio::ProcessData<1>(fx1_bus));
-    auto fx2_out = effect2.audio->process(audio::ProcessData<1>(fx2_bus));
+    if (!graph) graph = b.compile(budget);
+    graph->set_profiler(Application::current().audio_manager->profiler());
+    graph_.publish(std::move(graph));
+  }
 
-    // Temporary. Get only synth output for testing
-    for (auto&& [snth, l, r] : util::zip(synth_out.audio, fx1_out.audio[0], fx1_out.audio[1])) {
-      l = r = snth;
-    }
-    return fx1_out;
-    // // Sequencer. Outputs L/R dry output and adds to fx busses.
-    // // auto seq_dry = sequencer.process(midi_in, fx1_bus, fx2_bus);
-    // auto fx1_out = effect1->process(audio::ProcessData<1>(fx1_bus));
-    // auto fx2_out = effect2->process(audio::ProcessData<1>(fx2_bus));
-
-    // Stereo output gathered in fx1_out
-    for (auto&& [snth, fx1L, fx1R, fx2L, fx2R] :
-         util::zip(synth_out.audio, fx1_out.audio[0], fx1_out.audio[1], fx2_out.audio[0], fx2_out.audio[1])) {
-      fx1L += fx2L + snth * 0.5; // * synth_send.props.dry * (1 - synth_send.props.dry_pan);
-      fx1R += fx2R + snth * 0.5; // * synth_send.props.dry * (1 + synth_send.props.dry_pan);
+  audio::ProcessData<2> DefaultEngineManager::process(audio::ProcessData<1> external_in)
+  {
+    external_in.clock = ClockManager::current().step_frames(external_in.nframes);
+    auto* graph = graph_.acquire();
+    if (graph == nullptr) {
+      auto out = Application::current().audio_manager->buffer_pool().allocate_multi_clear<2>();
+      return external_in.with(out);
     }
+    return graph->process(std::move(external_in), Application::current().audio_manager->buffer_pool(),
+                          workers_.get());
+  }
 
-    return fx1_out;
-    // synth_out.audio.release();
-    // fx2_out.audio[0].release();
-    // fx2_out.audio[1].release();
-    // fx1_bus.release();
-    // fx2_bus.release();
-
-
-    // auto smplr_out = sequencer.process(midi_in);
-    // for (auto&& [resL, resR, smplr] : util::zip(fx1_out.audio[0], fx1_out.audio[1], smplr_out.audio)) {
-    //   resL += smplr;
-    //   resR += smplr;
-    // }
-
-
-    // return master.process(std::move(fx1_out));
-    /*
-    auto temp = Application::current().audio_manager->buffer_pool().allocate_multi_clear<2>();
-    for (auto&& [in, tmp] : util::zip(seq_out, temp)) {
-    std::get<0>(tmp) += std::get<0>(in);
-        std::get<1>(tmp) += std::get<0>(in);
-        }
-    return master.process({std::move(temp),external_in.midi,external_in.nframes});
-    */
+  audio::ProcessData<2> DefaultEngineManager::process_into(audio::ProcessData<1> external_in,
+                                                           const std::array<audio::AudioBufferHandle, 2>& output)
+  {
+    external_in.clock = ClockManager::current().step_frames(external_in.nframes);
+    auto* graph = graph_.acquire();
+    if (graph == nullptr) {
+      for (auto& buf : output) std::fill_n(buf.begin(), external_in.nframes, 0.f);
+      return external_in.with(output);
+    }
+    return graph->process(std::move(external_in), Application::current().audio_manager->buffer_pool(),
+                          workers_.get(), &output);
   }
 
 } // namespace otto::services
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <algorithm>
 #include <unordered_map>
 
 #include "core/service.hpp"
@@ -47,6 +48,22 @@ namespace otto::services {
     /// Process the engine audio chain
     virtual core::audio::ProcessData<2> process(core::audio::ProcessData<1> external_in) = 0;
 
+    /// Process the engine audio chain, rendering the output into `output`
+    ///
+    /// Used by audio drivers that can hand out their output buffers, to avoid a copy.
+    /// The default implementation copies the result of {@ref process}.
+    ///
+    /// \returns The processed data, with `output` as the audio
+    virtual core::audio::ProcessData<2> process_into(core::audio::ProcessData<1> external_in,
+                                                     const std::array<core::audio::AudioBufferHandle, 2>& output)
+    {
+      auto res = process(std::move(external_in));
+      for (int c = 0; c < 2; c++) {
+        if (res.audio[c].data() != output[c].data()) std::copy_n(res.audio[c].begin(), res.nframes, output[c].begin());
+      }
+      return res.with(output);
+    }
+
     /// For now, this is the way to get the default EngineManager implementation
     /// 
     /// This is very likely to be changed in the future
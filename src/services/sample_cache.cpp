@@ -0,0 +1,252 @@
+#include "sample_cache.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <tuple>
+
+#include <AudioFile.h>
+
+#include "services/audio_manager.hpp"
+#include "services/log_manager.hpp"
+#include "services/state_manager.hpp"
+#include "util/futex.hpp"
+
+namespace otto::services {
+
+  namespace {
+    /// Resample with a windowed sinc interpolator. Slow, but only done once per sample
+    std::vector<float> resample(const std::vector<float>& in, int from, int to)
+    {
+      if (from == to || in.empty()) return in;
+      constexpr int zero_crossings = 16;
+      // Points of the kernel table per input frame. The kernel is interpolated linearly between them
+      constexpr int table_resolution = 512;
+      const double step = double(from) / to;
+      // When downsampling, the cutoff is lowered to the new nyquist frequency
+      const double cutoff = std::min(1.0, 1.0 / step);
+      const double half_width = zero_crossings / cutoff;
+
+      // One side of the symmetric kernel, with a zero at the end for the interpolation
+      std::vector<double> kernel(std::size_t(std::ceil(half_width * table_resolution)) + 2, 0.0);
+      for (std::size_t i = 0; i < kernel.size() - 1; i++) {
+        double x = double(i) / table_resolution;
+        if (x > half_width) break;
+        double sinc = x == 0 ? 1 : std::sin(M_PI * cutoff * x) / (M_PI * cutoff * x);
+        // Blackman window
+        double w = x / half_width;
+        double window = 0.42 + 0.5 * std::cos(M_PI * w) + 0.08 * std::cos(2 * M_PI * w);
+        kernel[i] = cutoff * sinc * window;
+      }
+
+      std::vector<float> out(std::ceil(in.size() / step));
+      for (std::size_t n = 0; n < out.size(); n++) {
+        double t = n * step;
+        int first = std::max(0, int(std::ceil(t - half_width)));
+        int last = std::min(int(in.size()) - 1, int(std::floor(t + half_width)));
+        double sum = 0;
+        for (int k = first; k <= last; k++) {
+          double pos = std::abs(t - k) * table_resolution;
+          auto i = std::size_t(pos);
+          double frac = pos - i;
+          sum += in[k] * (kernel[i] + frac * (kernel[i + 1] - kernel[i]));
+        }
+        out[n] = sum;
+      }
+      return out;
+    }
+  } // namespace
+
+  // Handle //
+
+  struct SampleCache::Handle::Request {
+    SamplePtr sample;
+    /// 0 while loading, 1 when `sample` is set
+    std::atomic<std::uint32_t> ready = 0;
+
+    void finish(SamplePtr s) noexcept
+    {
+      sample = std::move(s);
+      ready.store(1, std::memory_order_release);
+      util::futex_wake_all(ready);
+    }
+  };
+
+  SampleCache::Handle::Handle(std::shared_ptr<Request> request) noexcept : request_(std::move(request)) {}
+
+  bool SampleCache::Handle::ready() const noexcept
+  {
+    return request_ == nullptr || request_->ready.load(std::memory_order_acquire) == 1;
+  }
+
+  SampleCache::SamplePtr SampleCache::Handle::get() const noexcept
+  {
+    if (!ready() || request_ == nullptr) return nullptr;
+    return request_->sample;
+  }
+
+  SampleCache::SamplePtr SampleCache::Handle::wait() const noexcept
+  {
+    if (request_ == nullptr) return nullptr;
+    while (request_->ready.load(std::memory_order_acquire) == 0) util::futex_wait(request_->ready, 0);
+    return request_->sample;
+  }
+
+  // SampleCache //
+
+  bool SampleCache::Key::operator<(const Key& rhs) const noexcept
+  {
+    return std::tie(path, mtime, samplerate) < std::tie(rhs.path, rhs.mtime, rhs.samplerate);
+  }
+
+  SampleCache::SampleCache(std::size_t budget) : budget_(budget)
+  {
+    thread_ = std::thread([this] { run(); });
+  }
+
+  SampleCache::~SampleCache()
+  {
+    {
+      std::lock_guard lock(mutex_);
+      stop_ = true;
+    }
+    cv_.notify_all();
+    thread_.join();
+    // Nobody will load these, so make sure nobody waits for them
+    for (auto& [key, request] : queue_) request->finish(nullptr);
+  }
+
+  std::unique_ptr<SampleCache> SampleCache::create_default()
+  {
+    auto res = std::make_unique<SampleCache>();
+    auto load = [cache = res.get()](nlohmann::json& j) {
+      if (j.is_object() && j.count("budget_mb")) cache->budget(j["budget_mb"].get<std::size_t>() << 20);
+    };
+    auto save = [cache = res.get()] { return nlohmann::json{{"budget_mb", cache->budget() >> 20}}; };
+    Application::current().state_manager->attach("SampleCache", load, save);
+    return res;
+  }
+
+  SampleCache::Handle SampleCache::load(const fs::path& path)
+  {
+    return load(path, AudioManager::current().samplerate());
+  }
+
+  SampleCache::Handle SampleCache::load(const fs::path& path, int samplerate)
+  {
+    auto request = std::make_shared<Handle::Request>();
+    if (!fs::exists(path)) {
+      LOGW("No such sample: {}", path.string());
+      request->finish(nullptr);
+      return Handle(request);
+    }
+    Key key = {path.string(), fs::last_write_time(path).time_since_epoch().count(), samplerate};
+
+    std::unique_lock lock(mutex_);
+    if (auto found = entries_.find(key); found != entries_.end()) {
+      lru_.splice(lru_.begin(), lru_, found->second.lru);
+      request->finish(found->second.sample);
+      return Handle(request);
+    }
+    if (auto found = pending_.find(key); found != pending_.end()) {
+      if (auto shared = found->second.lock()) return Handle(shared);
+    }
+    pending_[key] = request;
+    queue_.emplace_back(key, request);
+    lock.unlock();
+    cv_.notify_one();
+    return Handle(request);
+  }
+
+  std::size_t SampleCache::budget() const noexcept
+  {
+    std::lock_guard lock(mutex_);
+    return budget_;
+  }
+
+  void SampleCache::budget(std::size_t bytes)
+  {
+    std::lock_guard lock(mutex_);
+    budget_ = bytes;
+    evict();
+  }
+
+  std::size_t SampleCache::memory_usage() const noexcept
+  {
+    std::lock_guard lock(mutex_);
+    return usage_;
+  }
+
+  int SampleCache::size() const noexcept
+  {
+    std::lock_guard lock(mutex_);
+    return entries_.size();
+  }
+
+  SampleCache::SamplePtr SampleCache::decode(const fs::path& path, int samplerate)
+  {
+    AudioFile<float> file;
+    if (!file.load(path.string()) || file.getNumChannels() == 0) {
+      LOGW("Could not load sample {}", path.string());
+      return nullptr;
+    }
+    std::vector<float> mono(file.getNumSamplesPerChannel(), 0.f);
+    for (auto& channel : file.samples) {
+      for (std::size_t i = 0; i < mono.size(); i++) mono[i] += channel[i] / file.getNumChannels();
+    }
+    auto res = std::make_shared<Sample>();
+    res->path = path;
+    res->samplerate = samplerate;
+    res->audio = resample(mono, file.getSampleRate(), samplerate);
+    return res;
+  }
+
+  void SampleCache::run()
+  {
+    std::unique_lock lock(mutex_);
+    while (true) {
+      cv_.wait(lock, [&] { return stop_ || !queue_.empty(); });
+      if (stop_) return;
+      auto [key, request] = std::move(queue_.front());
+      queue_.pop_front();
+
+      lock.unlock();
+      auto sample = decode(key.path, key.samplerate);
+      lock.lock();
+
+      // Only erase the entry of this request, since a newer request for the same sample may have taken its place
+      if (auto found = pending_.find(key); found != pending_.end() && !found->second.owner_before(request) &&
+                                           !request.owner_before(found->second)) {
+        pending_.erase(found);
+      }
+      if (auto found = entries_.find(key); found != entries_.end()) {
+        // Loaded again, after all the handles to an earlier request were dropped before it finished
+        sample = found->second.sample;
+      } else if (sample != nullptr) {
+        std::size_t bytes = sizeof(Sample) + sample->audio.size() * sizeof(float);
+        lru_.push_front(key);
+        entries_[key] = {sample, bytes, lru_.begin()};
+        usage_ += bytes;
+      }
+      // Evicted before the request is finished, so the sample is ready when the loader is done with it.
+      // The new sample is held by `sample`, so it is not evicted itself.
+      evict();
+      request->finish(std::move(sample));
+    }
+  }
+
+  void SampleCache::evict()
+  {
+    for (auto it = lru_.end(); usage_ > budget_ && it != lru_.begin();) {
+      --it;
+      auto entry = entries_.find(*it);
+      // Only the cache holds it
+      if (entry->second.sample.use_count() == 1) {
+        usage_ -= entry->second.bytes;
+        entries_.erase(entry);
+        it = lru_.erase(it);
+      }
+    }
+  }
+
+} // namespace otto::services
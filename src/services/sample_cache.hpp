@@ -0,0 +1,136 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "core/service.hpp"
+#include "services/application.hpp"
+#include "util/filesystem.hpp"
+
+namespace otto::services {
+
+  /// Decoded samples, shared by all engines
+  ///
+  /// WAV files are decoded, mixed down to mono and resampled once, on a loader thread. Engines that load the
+  /// same file share one copy of it. Samples stay cached when they are no longer used, so loading them again
+  /// is instant, until the memory is needed: when the cache uses more than its budget, the least recently
+  /// used samples that no one holds are evicted. Samples that are held are never evicted, so they can push
+  /// the memory usage over the budget.
+  ///
+  /// Samples are identified by their path and modification time, so a file that has changed is loaded again.
+  struct SampleCache : core::Service {
+    /// A decoded sample
+    struct Sample {
+      fs::path path;
+      int samplerate = 0;
+      /// Mono, at `samplerate`
+      std::vector<float> audio;
+    };
+    using SamplePtr = std::shared_ptr<const Sample>;
+
+    /// A sample that is being loaded
+    ///
+    /// Like a `std::shared_future`, but it can be polled without blocking, so the UI can keep drawing
+    /// while a kit loads. The sample is kept in memory as long as a handle to it exists.
+    struct Handle {
+      struct Request;
+
+      Handle() = default;
+
+      /// `true` once the sample has been loaded, or has failed to load
+      bool ready() const noexcept;
+      /// The sample, or `nullptr` if it is not ready, or could not be loaded
+      SamplePtr get() const noexcept;
+      /// Block until the sample is ready
+      SamplePtr wait() const noexcept;
+
+    private:
+      friend SampleCache;
+      explicit Handle(std::shared_ptr<Request> request) noexcept;
+
+      std::shared_ptr<Request> request_;
+    };
+
+    static constexpr std::size_t default_budget = std::size_t(128) << 20;
+
+    explicit SampleCache(std::size_t budget = default_budget);
+    ~SampleCache();
+
+    /// A cache that stores its budget in the state file
+    static std::unique_ptr<SampleCache> create_default();
+
+    static SampleCache& current() noexcept
+    {
+      return *Application::current().sample_cache;
+    }
+
+    /// Load the sample in `path`, resampled to the samplerate of the {@ref AudioManager}
+    Handle load(const fs::path& path);
+
+    /// Load the sample in `path`, resampled to `samplerate`
+    ///
+    /// If the sample is cached, the returned handle is ready right away. If it is already being loaded, the
+    /// handle shares that request. Files that can not be read give a handle to `nullptr`.
+    Handle load(const fs::path& path, int samplerate);
+
+    /// The memory budget, in bytes
+    std::size_t budget() const noexcept;
+
+    /// Set the memory budget, evicting unused samples until it is met
+    void budget(std::size_t bytes);
+
+    /// The memory used by the cached samples, in bytes
+    std::size_t memory_usage() const noexcept;
+
+    /// The number of cached samples, held or not
+    int size() const noexcept;
+
+  private:
+    struct Key {
+      std::string path;
+      std::int64_t mtime;
+      int samplerate;
+
+      bool operator<(const Key& rhs) const noexcept;
+    };
+
+    struct Entry {
+      SamplePtr sample;
+      std::size_t bytes;
+      /// The position of the key in {@ref lru_}
+      std::list<Key>::iterator lru;
+    };
+
+    /// Decode and resample a file. Returns `nullptr` if it can not be read
+    static SamplePtr decode(const fs::path& path, int samplerate);
+
+    void run();
+    /// Evict unused samples, least recently used first, until the budget is met. Requires a lock on `mutex_`
+    void evict();
+
+    mutable std::mutex mutex_;
+    std::condition_variable cv_;
+
+    std::map<Key, Entry> entries_;
+    /// The keys of all entries. Most recently used first
+    std::list<Key> lru_;
+    std::size_t budget_;
+    std::size_t usage_ = 0;
+
+    /// Requests that have not been loaded yet, so a second load of the same sample can share them
+    std::map<Key, std::weak_ptr<Handle::Request>> pending_;
+    std::deque<std::pair<Key, std::shared_ptr<Handle::Request>>> queue_;
+
+    bool stop_ = false;
+    std::thread thread_;
+  };
+
+} // namespace otto::services
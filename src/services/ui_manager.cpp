@@ -1,5 +1,7 @@
 #include "ui_manager.hpp"
 
+#include <algorithm>
+
 #include "core/ui/vector_graphics.hpp"
 #include "services/audio_manager.hpp"
 #include "services/engine_manager.hpp"
@@ -139,12 +141,32 @@ namespace otto::services {
         ctx.font(vg::Fonts::Norm, 12);
         std::string cpu_time = fmt::format("{}%", int(100 * Application::current().audio_manager->cpu_time()));
         ctx.fillText(cpu_time, {290, 230});
+#if OTTO_DEBUG_UI
+        auto stats = Application::current().audio_manager->buffer_pool().statistics();
+        ctx.fillText(fmt::format("bufs {}/{} peak {} alloc/blk {} reserve! {}", stats.in_use, stats.capacity,
+                                 stats.peak_in_use, stats.allocations_last_block, stats.emergency_allocations),
+                     {10, 230});
+        auto stages = Application::current().audio_manager->profiler().statistics();
+        auto slowest = std::max_element(stages.begin(), stages.end(),
+                                        [](auto& a, auto& b) { return a.p99 < b.p99; });
+        if (slowest != stages.end()) {
+          ctx.fillText(fmt::format("p99 {} {}us xruns {}", slowest->name, slowest->p99 / 1000,
+                                   Application::current().audio_manager->profiler().xruns()),
+                       {10, 215});
+        }
+        auto usage = Application::current().audio_manager->profiler().resource_statistics();
+        ctx.fillText(fmt::format("faults/min {:.0f} preempt/min {:.0f}", usage.page_faults_per_minute,
+                                 usage.involuntary_switches_per_minute),
+                     {10, 200});
+#endif
       });
 
       signals.on_draw.emit(ctx);
     });
 
     Controller::current().flush_leds();
+    // Grow the buffer pool here, so the audio thread doesn't have to
+    Application::current().audio_manager->buffer_pool().maintain();
     _frame_count++;
 
     auto now = chrono::clock::now();
@@ -134,6 +134,8 @@ namespace otto::services {
     /// for the new screen
     void display(core::ui::ScreenAndInput screen);
 
+    itc::ActionQueue action_queue_;
+
   private:
     struct EmptyScreen : core::ui::Screen {
       void draw(core::ui::vg::Canvas& ctx) {}
@@ -148,7 +150,6 @@ namespace otto::services {
     unsigned _frame_count = 0;
 
     chrono::time_point last_frame = chrono::clock::now();
-    itc::ActionQueue action_queue_;
   };
 
   template<typename... Receivers>
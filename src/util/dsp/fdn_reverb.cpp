@@ -0,0 +1,179 @@
+#include "fdn_reverb.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace otto::util::dsp {
+
+  namespace {
+    using simd::vfloat;
+
+    /// Mutually prime delays, at 44.1 kHz, spread out so the echoes of the lines do not pile up
+    constexpr std::array<float, FdnReverb::lines> lengths = {709, 887, 1069, 1259, 1433, 1613, 1801, 1973};
+    /// Slow, unrelated rates for the delay modulation of each line, in Hz
+    constexpr std::array<float, FdnReverb::lines> lfo_rates = {0.31, 0.47, 0.19, 0.53, 0.37, 0.23, 0.43, 0.29};
+    /// Depth of the delay modulation, in frames at 44.1 kHz
+    constexpr float lfo_depth = 6;
+
+    /// The signs the input is fed to the lines with, and the two output taps. All three are orthogonal to each
+    /// other, and to the direction the Householder matrix reflects, so left and right are decorrelated.
+    constexpr std::array<float, FdnReverb::lines> input_signs = {1, 1, 1, 1, -1, -1, -1, -1};
+    constexpr std::array<float, FdnReverb::lines> left_taps = {1, -1, 1, -1, 1, -1, 1, -1};
+    constexpr std::array<float, FdnReverb::lines> right_taps = {1, 1, -1, -1, 1, 1, -1, -1};
+
+    /// The sum of `taps[i] * values[i]`, added as a tree instead of one after the other, which is a long
+    /// chain of dependent additions
+    inline float tap_sum(const std::array<float, FdnReverb::lines>& taps, const float* values) noexcept
+    {
+      std::array<float, FdnReverb::lines> sums;
+      for (int i = 0; i < FdnReverb::lines; i++) sums[i] = taps[i] * values[i];
+      for (int width = FdnReverb::lines / 2; width > 0; width /= 2) {
+        for (int i = 0; i < width; i++) sums[i] += sums[i + width];
+      }
+      return sums[0];
+    }
+
+    template<typename Lines>
+    Lines load_lines(const std::array<float, FdnReverb::lines>& values, float scale = 1)
+    {
+      alignas(vfloat::alignment) std::array<float, FdnReverb::lines> scaled;
+      for (int l = 0; l < FdnReverb::lines; l++) scaled[l] = values[l] * scale;
+      Lines res;
+      for (std::size_t v = 0; v < res.size(); v++) res[v] = vfloat::load(scaled.data() + v * vfloat::size);
+      return res;
+    }
+  } // namespace
+
+  FdnReverb::FdnReverb(float samplerate) : samplerate_(samplerate)
+  {
+    const float scale = samplerate / 44100.f;
+    length_ = load_lines<Lines>(lengths, scale);
+    lfo_rate_ = load_lines<Lines>(lfo_rates, 2.f / samplerate);
+    for (int l = 0; l < lines; l++) delay_[l] = lengths[l] * scale;
+    for (int v = 0; v < vectors; v++) {
+      lfo_phase_[v] = vfloat{0};
+      lowpass_[v] = vfloat{0};
+    }
+
+    // Room for the longest line at its longest, and the frame after it for the interpolation
+    const int max_delay = std::ceil((lengths.back() + lfo_depth) * scale) + 2;
+    int frames = 1;
+    while (frames < max_delay) frames *= 2;
+    mask_ = frames - 1;
+    buffer_.resize(frames * vectors, vfloat{0});
+
+    // The taps of a chunk are all older than the chunk as long as it is no longer than the shortest line
+    chunk_frames_ = std::clamp(int((lengths.front() - lfo_depth) * scale) - 1, 1, 256);
+    taps_.resize(chunk_frames_ * vectors);
+
+    decay(1.5f);
+    gain_ = target_gain_;
+  }
+
+  void FdnReverb::decay(float seconds) noexcept
+  {
+    // Each pass through a line of `n` frames loses `60 * n / (seconds * samplerate)` dB
+    const float frames = std::max(seconds, 0.01f) * samplerate_;
+    alignas(vfloat::alignment) std::array<float, lines> gains;
+    for (int l = 0; l < lines; l++) {
+      gains[l] = std::pow(10.f, -3.f * lengths[l] * samplerate_ / 44100.f / frames);
+    }
+    for (int v = 0; v < vectors; v++) target_gain_[v] = vfloat::load(gains.data() + v * vfloat::size);
+  }
+
+  void FdnReverb::damping(float damping) noexcept
+  {
+    damping_ = std::clamp(damping, 0.f, 0.99f);
+  }
+
+  void FdnReverb::clear() noexcept
+  {
+    std::fill(buffer_.begin(), buffer_.end(), vfloat{0});
+    for (auto& lp : lowpass_) lp = vfloat{0};
+  }
+
+  void FdnReverb::process(const float* in, float* left, float* right, int nframes) noexcept
+  {
+    if (nframes <= 0) return;
+
+    // The parameters at the end of the block, and their steps per frame
+    const vfloat depth{lfo_depth * samplerate_ / 44100.f};
+    alignas(vfloat::alignment) std::array<float, lines> delay_end;
+    Lines gain_step;
+    for (int v = 0; v < vectors; v++) {
+      lfo_phase_[v] = simd::wrap_phase(lfo_phase_[v] + lfo_rate_[v] * vfloat{float(nframes)});
+      (length_[v] + depth * simd::sinP9(lfo_phase_[v])).store(delay_end.data() + v * vfloat::size);
+      gain_step[v] = (target_gain_[v] - gain_[v]) * vfloat{1.f / nframes};
+    }
+    std::array<float, lines> delay_step;
+    for (int l = 0; l < lines; l++) delay_step[l] = (delay_end[l] - delay_[l]) / nframes;
+    const float damping_step = (damping_ - damping_current_) / nframes;
+
+    // Scaled so the input and output are about as loud as each other
+    const float scale = 1.f / std::sqrt(float(lines));
+    const Lines input_signs_v = load_lines<Lines>(input_signs, scale);
+
+    float* buffer = reinterpret_cast<float*>(buffer_.data());
+    float* taps = reinterpret_cast<float*>(taps_.data());
+    // The state is copied out of the members, since writing to the buffers could otherwise change them
+    Lines lowpass = lowpass_;
+    Lines gain = gain_;
+    float damping_current = damping_current_;
+    int position = position_;
+    const int mask = mask_;
+
+    for (int first = 0; first < nframes; first += chunk_frames_) {
+      const int n = std::min(chunk_frames_, nframes - first);
+
+      // Read the taps of the chunk, one line at a time. The delays are fractional while they are modulated, so
+      // the taps are interpolated
+      for (int l = 0; l < lines; l++) {
+        float delay = delay_[l];
+        for (int f = 0; f < n; f++) {
+          delay += delay_step[l];
+          const int whole = int(delay);
+          const float frac = delay - whole;
+          const int a = (position + f - whole) & mask;
+          const float tap_a = buffer[a * lines + l];
+          const float tap_b = buffer[((a - 1) & mask) * lines + l];
+          taps[f * lines + l] = tap_a + frac * (tap_b - tap_a);
+        }
+        delay_[l] = delay;
+      }
+
+      for (int f = 0; f < n; f++) {
+        damping_current += damping_step;
+        const vfloat damping{damping_current};
+        Lines feedback;
+        vfloat total{0};
+        for (int v = 0; v < vectors; v++) {
+          const vfloat y = taps_[f * vectors + v];
+          // A one pole lowpass per line, so the highs lose more on every pass
+          lowpass[v] = y + damping * (lowpass[v] - y);
+          gain[v] = gain[v] + gain_step[v];
+          feedback[v] = lowpass[v] * gain[v];
+          total = total + feedback[v];
+        }
+
+        // The Householder matrix `I - 2/N * 11^T`: lossless, and every line feeds every other line
+        const vfloat reflection{simd::sum(total) * (2.f / lines)};
+        const vfloat input{in[first + f]};
+        vfloat* frame = buffer_.data() + ((position + f) & mask) * vectors;
+        for (int v = 0; v < vectors; v++) frame[v] = feedback[v] - reflection + input * input_signs_v[v];
+      }
+      position = (position + n) & mask;
+
+      // The outputs are sums of the taps, after the input has been read, so `in` may be an output
+      for (int f = 0; f < n; f++) {
+        const float* t = taps + f * lines;
+        left[first + f] = tap_sum(left_taps, t) * scale;
+        right[first + f] = tap_sum(right_taps, t) * scale;
+      }
+    }
+    lowpass_ = lowpass;
+    gain_ = gain;
+    damping_current_ = damping_current;
+    position_ = position;
+  }
+
+} // namespace otto::util::dsp
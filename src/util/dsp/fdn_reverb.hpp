@@ -0,0 +1,72 @@
+#pragma once
+
+#include <array>
+#include <vector>
+
+#include "util/simd.hpp"
+
+namespace otto::util::dsp {
+
+  /// A stereo reverb made of 8 modulated delay lines, fed back into each other through a Householder matrix
+  ///
+  /// Each line is a lane of {@ref simd::vfloat}, so the damping, feedback gains and mixing of all the lines
+  /// are computed together, one frame at a time. The lines are interleaved in one buffer, so the feedback of a
+  /// frame is written with aligned stores. Blocks are split into chunks shorter than the shortest line, so the
+  /// taps of a whole chunk can be read before any of its feedback is written.
+  ///
+  /// Parameters are updated once per block: {@ref process} ramps the feedback gains, the damping and the
+  /// modulated delay lengths from their values at the start of the block to their values at the end.
+  struct FdnReverb {
+    static constexpr int lines = 8;
+
+    explicit FdnReverb(float samplerate);
+
+    /// The time it takes the tail to fall by 60 dB, in seconds
+    void decay(float seconds) noexcept;
+
+    /// How much faster high frequencies decay than low ones, in `[0, 1)`
+    void damping(float damping) noexcept;
+
+    /// Reverberate `nframes` frames of `in` into `left` and `right`
+    ///
+    /// Only the reverb is written, not the dry signal. `in` may be the same buffer as `left` or `right`.
+    void process(const float* in, float* left, float* right, int nframes) noexcept;
+
+    /// Silence the tail
+    void clear() noexcept;
+
+  private:
+    static_assert(lines % simd::vfloat::size == 0);
+    static constexpr int vectors = lines / simd::vfloat::size;
+    using Lines = std::array<simd::vfloat, vectors>;
+
+    float samplerate_;
+    float damping_ = 0;
+
+    /// The lines, interleaved. Line `l` of frame `i` is float `i * lines + l`
+    std::vector<simd::vfloat> buffer_;
+    /// The number of frames in the buffer, minus one. It is a power of two
+    int mask_ = 0;
+    /// The frame that is written next
+    int position_ = 0;
+    /// The most frames that are read from the lines before writing to them
+    int chunk_frames_ = 0;
+    /// The interpolated taps of a chunk, interleaved like {@ref buffer_}
+    std::vector<simd::vfloat> taps_;
+
+    /// The delay of each line, in frames, without modulation
+    Lines length_;
+    /// The modulated delays at the end of the last block
+    std::array<float, lines> delay_;
+    Lines lfo_phase_;
+    /// The change in phase of the delay modulation, per frame
+    Lines lfo_rate_;
+    /// The feedback gains at the end of the last block, and the gains for the current decay
+    Lines gain_;
+    Lines target_gain_;
+    /// The state of the damping filters
+    Lines lowpass_;
+    float damping_current_ = 0;
+  };
+
+} // namespace otto::util::dsp
@@ -1,9 +1,200 @@
 #include "sample.hpp"
 
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+
 #include "util/assert.hpp"
+#include "util/simd.hpp"
 
 namespace otto::dsp {
 
+  namespace {
+    using util::simd::vfloat;
+    constexpr int lanes = vfloat::size;
+
+    /// Half the width of the sinc kernel, in frames
+    constexpr int sinc_half_width = 8;
+    /// Table entries per frame
+    constexpr int table_resolution = 512;
+
+    /// `sin(pi x) / (pi x)`, and a Blackman window that is `sinc_half_width` frames wide,
+    /// for `x` in `[0, sinc_half_width]`
+    struct SincTables {
+      SincTables() noexcept
+      {
+        for (std::size_t i = 0; i < sinc.size(); i++) {
+          double x = double(i) / table_resolution;
+          sinc[i] = i == 0 ? 1 : std::sin(M_PI * x) / (M_PI * x);
+          double w = std::min(x / sinc_half_width, 1.0);
+          window[i] = 0.42 + 0.5 * std::cos(M_PI * w) + 0.08 * std::cos(2 * M_PI * w);
+        }
+      }
+
+      /// Read `table` at every lane of `x`, with linear interpolation
+      static vfloat lookup(const float* table, vfloat x) noexcept
+      {
+        alignas(vfloat::alignment) std::array<std::int32_t, lanes> index;
+        vfloat t = x * vfloat{float(table_resolution)};
+        vfloat ti = floor(t);
+        ti.store_truncated(index.data());
+        vfloat y0 = util::simd::gather(table, index.data());
+        return y0 + (t - ti) * (util::simd::gather(table + 1, index.data()) - y0);
+      }
+
+      /// One entry more than needed, so the last one can be interpolated
+      std::array<float, sinc_half_width * table_resolution + 2> sinc;
+      std::array<float, sinc_half_width * table_resolution + 2> window;
+    };
+
+    /// Built when the program starts, so the audio thread never has to
+    const SincTables sinc_tables;
+
+    /// The frames each lane of a {@ref vfloat} is interpolated from
+    template<int N>
+    struct alignas(vfloat::alignment) Frames {
+      vfloat operator[](int t) const noexcept
+      {
+        return vfloat::load(at[t]);
+      }
+
+      float at[N][lanes];
+    };
+
+    struct Linear {
+      static constexpr int taps = 2;
+
+      static vfloat interpolate(const Frames<taps>& y, vfloat frac, float) noexcept
+      {
+        vfloat y0 = y[0];
+        return y0 + frac * (y[1] - y0);
+      }
+    };
+
+    struct Hermite {
+      static constexpr int taps = 4;
+
+      static vfloat interpolate(const Frames<taps>& y, vfloat frac, float) noexcept
+      {
+        const vfloat half{0.5f};
+        vfloat ym1 = y[0], y0 = y[1], y1 = y[2], y2 = y[3];
+        vfloat c1 = half * (y1 - ym1);
+        vfloat c2 = ym1 - vfloat{2.5f} * y0 + vfloat{2.f} * y1 - half * y2;
+        vfloat c3 = half * (y2 - ym1) + vfloat{1.5f} * (y0 - y1);
+        return ((c3 * frac + c2) * frac + c1) * frac + y0;
+      }
+    };
+
+    struct Sinc {
+      static constexpr int taps = 2 * sinc_half_width;
+
+      /// \param cutoff The cutoff frequency, relative to the nyquist frequency of the sample
+      static vfloat interpolate(const Frames<taps>& y, vfloat frac, float cutoff) noexcept
+      {
+        const vfloat zero{0.f};
+        const vfloat vcutoff{cutoff};
+        vfloat res{0.f};
+        vfloat sum{0.f};
+        for (int t = 0; t < taps; t++) {
+          // The distance from the position to frame `t`
+          vfloat d = frac + vfloat{float(sinc_half_width - 1 - t)};
+          vfloat x = max(d, zero - d);
+          // Every lane is at a different distance, so the kernel is read from the tables with a gather
+          vfloat weight = SincTables::lookup(sinc_tables.sinc.data(), vcutoff * x) *
+                          SincTables::lookup(sinc_tables.window.data(), x);
+          sum = sum + weight;
+          res = res + weight * y[t];
+        }
+        // The truncated kernel does not quite sum to 1, which would make the gain ripple with the position
+        alignas(vfloat::alignment) std::array<float, lanes> sums;
+        sum.store(sums.data());
+        for (auto& s : sums) s = 1.f / s;
+        return res * vfloat::load(sums.data());
+      }
+    };
+
+    /// The part of a {@ref Sample} that is played
+    struct Region {
+      const float* data;
+      int start;
+      int end;
+      bool loop;
+      /// The fade in gain is `(position - fade_in_from) * fade_in_slope + fade_in_offset`, limited to 1.
+      /// Without a fade, the slope is 0 and the offset is 1, so the gain is always 1.
+      float fade_in_from;
+      float fade_in_slope;
+      float fade_in_offset;
+      /// The fade out gain is `(fade_out_to - position) * fade_out_slope + fade_out_offset`, limited to 1
+      float fade_out_to;
+      float fade_out_slope;
+      float fade_out_offset;
+    };
+
+    /// Read frame `i`, wrapping around the region if it loops, or 0 outside of it
+    float read_wrapped(const Region& r, int i) noexcept
+    {
+      if (i >= r.start && i < r.end) return r.data[i];
+      if (!r.loop) return 0.f;
+      int length = r.end - r.start;
+      return r.data[r.start + ((i - r.start) % length + length) % length];
+    }
+
+    /// Render `nframes` frames starting at `position`, which all lie between the start and end points
+    ///
+    /// Frames are rendered {@ref vfloat::size} at a time. When all frames a block is interpolated from lie
+    /// inside the region, they are read without any checks. Only the few blocks at the edges read
+    /// through {@ref read_wrapped}.
+    template<typename Kernel>
+    void render_frames(const Region& r, double position, double stride, float* out, int nframes) noexcept
+    {
+      constexpr int before = Kernel::taps / 2 - 1;
+      constexpr int after = Kernel::taps / 2;
+      const float cutoff = std::min(1.0, 1.0 / std::abs(stride));
+
+      alignas(vfloat::alignment) std::array<float, lanes> ramp, offsets, block;
+      for (int l = 0; l < lanes; l++) ramp[l] = l;
+      const vfloat vramp = vfloat::load(ramp.data());
+      const vfloat vstride{float(stride)};
+      const vfloat one{1.f};
+      Frames<Kernel::taps> frames;
+
+      for (int f = 0; f < nframes; f += lanes) {
+        const int count = std::min(lanes, nframes - f);
+        const double first = position + f * stride;
+        const int base = std::floor(first);
+        // Relative to `base`, so the fractions keep their precision far into long samples
+        vfloat rel = vfloat{float(first - base)} + vramp * vstride;
+        vfloat offset = floor(rel);
+        vfloat frac = rel - offset;
+        offset.store(offsets.data());
+
+        auto gather = [&](auto&& read) {
+          for (int l = 0; l < lanes; l++) {
+            // Lanes past `count` repeat the last frame, so they never read outside of the data
+            int idx = base + int(offsets[std::min(l, count - 1)]) - before;
+            for (int t = 0; t < Kernel::taps; t++) frames.at[t][l] = read(idx + t);
+          }
+        };
+        int lowest = base + int(std::min(offsets[0], offsets[count - 1])) - before;
+        int highest = base + int(std::max(offsets[0], offsets[count - 1])) + after;
+        if (lowest >= r.start && highest < r.end) {
+          gather([&](int i) { return r.data[i]; });
+        } else {
+          gather([&](int i) { return read_wrapped(r, i); });
+        }
+        vfloat res = Kernel::interpolate(frames, frac, cutoff);
+
+        vfloat fade_in = vfloat{base - r.fade_in_from} + rel;
+        vfloat fade_out = vfloat{r.fade_out_to - base} - rel;
+        res = res * min(one, fade_in * vfloat{r.fade_in_slope} + vfloat{r.fade_in_offset});
+        res = res * min(one, fade_out * vfloat{r.fade_out_slope} + vfloat{r.fade_out_offset});
+        res.store(block.data());
+        std::copy_n(block.data(), count, out + f);
+      }
+    }
+  } // namespace
+
   Sample::Sample(gsl::span<float> audio_data, float speed_modifier) noexcept
     : audio_data_(audio_data), end_point_(audio_data_.size()), speed_modifier(speed_modifier)
   {}
@@ -31,6 +222,66 @@ namespace otto::dsp {
     return {*this, end_point()};
   }
 
+  Sample::Playhead Sample::playhead() const noexcept
+  {
+    float stride = playback_speed_ * speed_modifier;
+    if (stride < 0) {
+      return {double(end_point() - 1)};
+    }
+    return {double(start_point())};
+  }
+
+  int Sample::render(gsl::span<float> out, Playhead& playhead, Interpolation interpolation) const noexcept
+  {
+    const double stride = playback_speed_ * speed_modifier;
+    const int length = end_point_ - start_point_;
+    const int nframes = out.size();
+    // In reverse, the iterator fades towards the frames before the start point and end point
+    const int shift = stride < 0 ? 1 : 0;
+    const Region region = {
+      audio_data_.data(),
+      start_point_,
+      end_point_,
+      loop,
+      float(start_point_ - shift),
+      fade_in_time_ > 0 ? 1.f / fade_in_time_ : 0.f,
+      fade_in_time_ > 0 ? 0.f : 1.f,
+      float(end_point_ - shift),
+      fade_out_time_ > 0 ? 1.f / fade_out_time_ : 0.f,
+      fade_out_time_ > 0 ? 0.f : 1.f,
+    };
+    if (length <= 0) playhead.done = true;
+
+    double& position = playhead.position;
+    int f = 0;
+    while (f < nframes && !playhead.done) {
+      if (position < start_point_ || position >= end_point_) {
+        if (!loop) {
+          playhead.done = true;
+          break;
+        }
+        position -= std::floor((position - start_point_) / length) * length;
+        // Rounding can leave it right on the end point
+        if (position >= end_point_) position = start_point_;
+      }
+      // The frames until playback passes the end point, or the start point in reverse
+      double left = nframes;
+      if (stride > 0) left = std::ceil((end_point_ - position) / stride);
+      if (stride < 0) left = std::floor((position - start_point_) / -stride) + 1;
+      int n = std::min<double>(nframes - f, left);
+
+      switch (interpolation) {
+        case Interpolation::linear: render_frames<Linear>(region, position, stride, out.data() + f, n); break;
+        case Interpolation::hermite: render_frames<Hermite>(region, position, stride, out.data() + f, n); break;
+        case Interpolation::sinc: render_frames<Sinc>(region, position, stride, out.data() + f, n); break;
+      }
+      f += n;
+      position += n * stride;
+    }
+    std::fill(out.begin() + f, out.end(), 0.f);
+    return f;
+  }
+
   int Sample::start_point() const noexcept
   {
     return start_point_;
@@ -12,6 +12,25 @@ namespace otto::dsp {
   struct Sample {
     struct iterator;
 
+    /// How {@ref render} reads between the frames of the audio data
+    enum struct Interpolation {
+      /// Two frames. Cheap, but rolls off the highs, and aliases when the sample is sped up
+      linear,
+      /// Four frames, 3rd order Hermite. Much less roll-off for a little more work
+      hermite,
+      /// Sixteen frames, Blackman windowed sinc. The cutoff follows the playback speed, so samples that are
+      /// sped up do not alias
+      sinc,
+    };
+
+    /// The position of a voice playing a sample with {@ref render}
+    struct Playhead {
+      /// The position in the audio data, in frames
+      double position = 0;
+      /// Set when playback has passed the end point. Never set when looping
+      bool done = false;
+    };
+
     explicit Sample(gsl::span<float> audio_data, float speed_modifier = 1.f) noexcept;
     Sample() = default;
 
@@ -20,6 +39,23 @@ namespace otto::dsp {
     iterator begin() const noexcept;
     iterator end() const noexcept;
 
+    /// A playhead at the start point, or at the end point when playing in reverse
+    Playhead playhead() const noexcept;
+
+    /// Render the next `out.size()` frames, moving `playhead` along
+    ///
+    /// Plays the audio between the start and end points like {@ref iterator} does, with the same fades,
+    /// backwards if the playback speed is negative, and wrapping around if {@ref loop} is set. Unlike the
+    /// iterator, it reads between frames with `interpolation`. Frames after the end point are 0.
+    ///
+    /// The block is split where playback wraps or ends, so the frames in between are rendered without per-frame
+    /// bounds checks, {@ref util::simd::vfloat::size} frames at a time. `out` can be an
+    /// {@ref core::audio::AudioBufferHandle}.
+    ///
+    /// \returns The number of frames that were played before the end point was reached
+    int render(gsl::span<float> out, Playhead& playhead, Interpolation interpolation = Interpolation::linear) const
+      noexcept;
+
     /// Index where playback should start
     int start_point() const noexcept;
     /// Index one past where playback should end
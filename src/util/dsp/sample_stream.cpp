@@ -0,0 +1,455 @@
+#include "sample_stream.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "services/log_manager.hpp"
+#include "util/futex.hpp"
+
+namespace otto::util::dsp {
+
+  namespace {
+    std::uint32_t read_u16(const std::uint8_t* p) noexcept
+    {
+      return p[0] | (p[1] << 8);
+    }
+
+    std::uint32_t read_u32(const std::uint8_t* p) noexcept
+    {
+      return p[0] | (p[1] << 8) | (p[2] << 16) | (std::uint32_t(p[3]) << 24);
+    }
+
+    /// Mix `channels` interleaved channels down to mono, decoding each sample with `decode`
+    template<typename Decode>
+    void mix_down(const std::uint8_t* p, int channels, int bytes, gsl::span<float> out, Decode decode) noexcept
+    {
+      const float scale = 1.f / channels;
+      for (auto& f : out) {
+        float sum = 0;
+        for (int c = 0; c < channels; c++, p += bytes) sum += decode(p);
+        f = sum * scale;
+      }
+    }
+  } // namespace
+
+  // WavFile //
+
+  namespace {
+    /// Bytes read per `pread` in {@ref WavFile::read}. On the stack, so reading allocates nothing.
+    constexpr std::size_t read_chunk_bytes = 16 * 1024;
+
+    /// `pread` until `bytes` bytes are read, the end of the file is reached, or an error occurs
+    ///
+    /// \returns The number of bytes read
+    std::size_t pread_all(int fd, std::uint8_t* out, std::size_t bytes, std::int64_t offset) noexcept
+    {
+      std::size_t done = 0;
+      while (done < bytes) {
+        auto n = ::pread(fd, out + done, bytes - done, offset + std::int64_t(done));
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        done += n;
+      }
+      return done;
+    }
+  } // namespace
+
+  WavFile::WavFile(const fs::path& path)
+  {
+    fd_ = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd_ < 0) throw exception(ErrorCode::open_failed, "Could not open {}", path.string());
+
+    auto fail = [&](ErrorCode ec, const char* what) {
+      ::close(fd_);
+      fd_ = -1;
+      return exception(ec, "{}: {}", path.string(), what);
+    };
+
+    struct stat st;
+    if (::fstat(fd_, &st) != 0) throw fail(ErrorCode::open_failed, "Could not stat the file");
+    const std::int64_t file_size = st.st_size;
+
+    std::uint8_t header[12];
+    if (pread_all(fd_, header, 12, 0) < 12 || std::memcmp(header, "RIFF", 4) != 0 ||
+        std::memcmp(header + 8, "WAVE", 4) != 0) {
+      throw fail(ErrorCode::invalid_file, "Not a WAV file");
+    }
+    bool has_format = false;
+    for (std::int64_t chunk = 12; file_size - chunk >= 8;) {
+      std::uint8_t chunk_header[8];
+      if (pread_all(fd_, chunk_header, 8, chunk) < 8) break;
+      std::int64_t chunk_size = read_u32(chunk_header + 4);
+      const std::int64_t body = chunk + 8;
+      const std::int64_t available = std::min(chunk_size, file_size - body);
+      if (std::memcmp(chunk_header, "fmt ", 4) == 0 && available >= 16) {
+        std::uint8_t fmt[26] = {};
+        pread_all(fd_, fmt, std::min<std::int64_t>(available, sizeof(fmt)), body);
+        int tag = read_u16(fmt);
+        // WAVE_FORMAT_EXTENSIBLE keeps the actual format in the first two bytes of the sub format GUID
+        if (tag == 0xFFFE && available >= 26) tag = read_u16(fmt + 24);
+        channels_ = read_u16(fmt + 2);
+        samplerate_ = read_u32(fmt + 4);
+        block_align_ = read_u16(fmt + 12);
+        int bits = read_u16(fmt + 14);
+        if (tag == 1 && bits == 8) format_ = Format::pcm8;
+        else if (tag == 1 && bits == 16) format_ = Format::pcm16;
+        else if (tag == 1 && bits == 24) format_ = Format::pcm24;
+        else if (tag == 1 && bits == 32) format_ = Format::pcm32;
+        else if (tag == 3 && bits == 32) format_ = Format::float32;
+        else throw fail(ErrorCode::unsupported_format, "Unsupported sample format");
+        if (channels_ == 0 || block_align_ != channels_ * (bits / 8)) {
+          throw fail(ErrorCode::invalid_file, "Invalid format chunk");
+        }
+        if (channels_ > max_channels) throw fail(ErrorCode::unsupported_format, "Too many channels");
+        has_format = true;
+      } else if (std::memcmp(chunk_header, "data", 4) == 0) {
+        if (!has_format) throw fail(ErrorCode::invalid_file, "Data before format chunk");
+        data_offset_ = body;
+        size_ = available / block_align_;
+        // The frames after the head are read front to back, by the streaming thread
+        ::posix_fadvise(fd_, data_offset_, 0, POSIX_FADV_SEQUENTIAL);
+        return;
+      }
+      // Chunks are padded to an even size
+      chunk = body + std::min(chunk_size + (chunk_size & 1), file_size - body);
+    }
+    throw fail(ErrorCode::invalid_file, "No data chunk");
+  }
+
+  WavFile::~WavFile()
+  {
+    if (fd_ >= 0) ::close(fd_);
+  }
+
+  int WavFile::channels() const noexcept
+  {
+    return channels_;
+  }
+
+  int WavFile::samplerate() const noexcept
+  {
+    return samplerate_;
+  }
+
+  int WavFile::size() const noexcept
+  {
+    return size_;
+  }
+
+  void WavFile::read(int first, gsl::span<float> out) const noexcept
+  {
+    std::uint8_t buffer[read_chunk_bytes];
+    const std::size_t frames_per_read = read_chunk_bytes / block_align_;
+    for (std::size_t done = 0; done < std::size_t(out.size());) {
+      auto frames = std::min<std::size_t>(frames_per_read, out.size() - done);
+      auto offset = data_offset_ + (first + std::int64_t(done)) * block_align_;
+      auto got = pread_all(fd_, buffer, frames * block_align_, offset) / block_align_;
+      decode(buffer, out.subspan(done, got));
+      done += got;
+      if (got < frames) {
+        std::fill(out.begin() + done, out.end(), 0.f);
+        return;
+      }
+    }
+  }
+
+  void WavFile::decode(const std::uint8_t* p, gsl::span<float> out) const noexcept
+  {
+    switch (format_) {
+      case Format::pcm8:
+        return mix_down(p, channels_, 1, out, [](const std::uint8_t* s) { return (s[0] - 128) / 128.f; });
+      case Format::pcm16:
+        return mix_down(p, channels_, 2, out,
+                        [](const std::uint8_t* s) { return std::int16_t(read_u16(s)) / 32768.f; });
+      case Format::pcm24:
+        return mix_down(p, channels_, 3, out, [](const std::uint8_t* s) {
+          return std::int32_t((s[0] << 8) | (s[1] << 16) | (std::uint32_t(s[2]) << 24)) / 2147483648.f;
+        });
+      case Format::pcm32:
+        return mix_down(p, channels_, 4, out,
+                        [](const std::uint8_t* s) { return std::int32_t(read_u32(s)) / 2147483648.f; });
+      case Format::float32:
+        return mix_down(p, channels_, 4, out, [](const std::uint8_t* s) {
+          std::uint32_t bits = read_u32(s);
+          float f;
+          std::memcpy(&f, &bits, sizeof(f));
+          return f;
+        });
+    }
+  }
+
+  // StreamedSample //
+
+  StreamedSample::StreamedSample(const fs::path& path)
+    : path_(path), file_(std::make_unique<WavFile>(path)), size_(file_->size()), samplerate_(file_->samplerate())
+  {
+    auto head = std::make_shared<std::vector<float>>(std::min(size_, head_frames));
+    file_->read(0, *head);
+    head_ = std::move(head);
+  }
+
+  StreamedSample::StreamedSample(const fs::path& path,
+                                 std::shared_ptr<const std::vector<float>> audio,
+                                 int samplerate)
+    : path_(path), head_(std::move(audio)), size_(head_->size()), samplerate_(samplerate)
+  {}
+
+  const WavFile& StreamedSample::file() const noexcept
+  {
+    return *file_;
+  }
+
+  const fs::path& StreamedSample::path() const noexcept
+  {
+    return path_;
+  }
+
+  int StreamedSample::size() const noexcept
+  {
+    return size_;
+  }
+
+  int StreamedSample::samplerate() const noexcept
+  {
+    return samplerate_;
+  }
+
+  gsl::span<const float> StreamedSample::head() const noexcept
+  {
+    return *head_;
+  }
+
+  // SampleStreamer //
+
+  SampleStreamer::SampleStreamer(int streams, int samplerate, int ring_frames)
+    : lookahead_frames_(std::ceil(samplerate * lookahead_seconds))
+  {
+    int capacity = 1;
+    while (capacity < ring_frames) capacity <<= 1;
+    streams_.reserve(streams);
+    for (int i = 0; i < streams; i++) streams_.push_back(std::make_unique<Stream>(*this, capacity));
+    thread_ = std::thread([this] { run(); });
+  }
+
+  SampleStreamer::~SampleStreamer()
+  {
+    stop_ = true;
+    wake();
+    thread_.join();
+  }
+
+  SampleStreamer::Stream& SampleStreamer::stream(int idx) noexcept
+  {
+    return *streams_[idx];
+  }
+
+  int SampleStreamer::size() const noexcept
+  {
+    return streams_.size();
+  }
+
+  int SampleStreamer::underruns() const noexcept
+  {
+    return underruns_.load(std::memory_order_relaxed);
+  }
+
+  void SampleStreamer::wake() noexcept
+  {
+    wake_.fetch_add(1, std::memory_order_release);
+    util::futex_wake_all(wake_);
+  }
+
+  void SampleStreamer::run()
+  {
+    using namespace std::chrono_literals;
+    int reported = 0;
+    while (!stop_) {
+      auto wake = wake_.load(std::memory_order_acquire);
+      for (auto& stream : streams_) fill(*stream);
+      if (int underruns = this->underruns(); underruns != reported) {
+        LOGW("Sample streaming fell behind in {} blocks", underruns - reported);
+        reported = underruns;
+      }
+      // Much shorter than the lookahead, so the rings never drain between two rounds
+      util::futex_wait_for(wake_, wake, 10ms);
+    }
+  }
+
+  void SampleStreamer::fill(Stream& s)
+  {
+    auto generation = s.generation_.load(std::memory_order_acquire);
+    const auto* sample = s.request_sample_.load(std::memory_order_relaxed);
+    if (sample == nullptr) return;
+    const std::uint64_t head = sample->head().size();
+    if (std::uint64_t(sample->size()) <= head) return;
+    const std::uint64_t length = sample->size() - head;
+    const std::uint64_t capacity = s.ring_.size();
+
+    if (generation != s.fill_generation_) {
+      s.fill_generation_ = generation;
+      s.fill_position_ = 0;
+    }
+    auto consumed_packed = s.consumed_.load(std::memory_order_acquire);
+    std::uint64_t consumed =
+      Stream::generation_of(consumed_packed) == generation ? Stream::position_of(consumed_packed) : 0;
+    // After an underrun, the audio thread has skipped ahead
+    s.fill_position_ = std::max(s.fill_position_, consumed);
+
+    float speed = s.request_speed_.load(std::memory_order_relaxed);
+    std::uint64_t lookahead = std::min<std::uint64_t>(std::max(lookahead_frames_ * speed, 1024.f), capacity);
+    std::uint64_t target = consumed + lookahead;
+    if (!s.request_loop_.load(std::memory_order_relaxed)) target = std::min(target, length);
+
+    while (s.fill_position_ < target) {
+      std::uint64_t offset = s.fill_position_ % length;
+      std::uint64_t ring_idx = s.fill_position_ & s.mask_;
+      auto n = std::min({target - s.fill_position_, length - offset, capacity - ring_idx});
+      sample->file().read(head + offset, gsl::span<float>(s.ring_.data() + ring_idx, n));
+      s.fill_position_ += n;
+      s.written_.store(Stream::pack(generation, s.fill_position_), std::memory_order_release);
+      // The voice has moved on to another sample
+      if (s.generation_.load(std::memory_order_relaxed) != generation) return;
+    }
+  }
+
+  // SampleStreamer::Stream //
+
+  SampleStreamer::Stream::Stream(SampleStreamer& streamer, int ring_frames)
+    : streamer_(streamer), ring_(ring_frames, 0.f), mask_(ring_frames - 1)
+  {}
+
+  std::uint64_t SampleStreamer::Stream::pack(std::uint32_t generation, std::uint64_t position) noexcept
+  {
+    return (std::uint64_t(generation & 0xFFFFFF) << 40) | position;
+  }
+
+  std::uint32_t SampleStreamer::Stream::generation_of(std::uint64_t packed) noexcept
+  {
+    return packed >> 40;
+  }
+
+  std::uint64_t SampleStreamer::Stream::position_of(std::uint64_t packed) noexcept
+  {
+    return packed & ((std::uint64_t(1) << 40) - 1);
+  }
+
+  void SampleStreamer::Stream::start(const StreamedSample& sample, float speed, bool loop) noexcept
+  {
+    sample_ = &sample;
+    speed_ = std::max(speed, 0.f);
+    loop_ = loop;
+    done_ = sample.size() == 0;
+    position_ = 0;
+    lap_ = 0;
+    play_generation_ = (play_generation_ + 1) & 0xFFFFFF;
+
+    request_sample_.store(&sample, std::memory_order_relaxed);
+    request_speed_.store(speed_, std::memory_order_relaxed);
+    request_loop_.store(loop, std::memory_order_relaxed);
+    consumed_.store(pack(play_generation_, 0), std::memory_order_relaxed);
+    generation_.store(play_generation_, std::memory_order_release);
+    if (sample.size() > int(sample.head().size())) streamer_.wake();
+  }
+
+  void SampleStreamer::Stream::speed(float speed) noexcept
+  {
+    speed_ = std::max(speed, 0.f);
+    request_speed_.store(speed_, std::memory_order_relaxed);
+  }
+
+  void SampleStreamer::Stream::stop() noexcept
+  {
+    if (sample_ == nullptr) return;
+    done_ = true;
+    sample_ = nullptr;
+    play_generation_ = (play_generation_ + 1) & 0xFFFFFF;
+    request_sample_.store(nullptr, std::memory_order_relaxed);
+    generation_.store(play_generation_, std::memory_order_release);
+  }
+
+  bool SampleStreamer::Stream::done() const noexcept
+  {
+    return done_;
+  }
+
+  bool SampleStreamer::Stream::ready(int nframes) const noexcept
+  {
+    if (done_ || nframes <= 0) return true;
+    const int size = sample_->size();
+    const int head_size = sample_->head().size();
+    const std::uint64_t length = size - head_size;
+    auto written = written_.load(std::memory_order_acquire);
+    const std::uint64_t available = generation_of(written) == play_generation_ ? position_of(written) : 0;
+    // The last frame read, including the one after it that is interpolated towards
+    double last = position_ + (nframes - 1) * speed_ + 1;
+    std::uint64_t lap = lap_;
+    if (last >= size) {
+      if (!loop_) return length <= available;
+      lap += std::uint64_t(last / size);
+      last = std::fmod(last, size);
+    }
+    const int idx = last;
+    if (idx < head_size) return lap * length <= available;
+    return lap * length + (idx - head_size) < available;
+  }
+
+  void SampleStreamer::Stream::read(gsl::span<float> out) noexcept
+  {
+    auto frame = out.begin();
+    if (!done_) {
+      const int size = sample_->size();
+      const auto head = sample_->head();
+      const int head_size = head.size();
+      const std::uint64_t length = size - head_size;
+      auto written = written_.load(std::memory_order_acquire);
+      const std::uint64_t available = generation_of(written) == play_generation_ ? position_of(written) : 0;
+      bool missing = false;
+
+      auto read_frame = [&](int idx, std::uint64_t lap) {
+        if (idx < head_size) return head[idx];
+        std::uint64_t pos = lap * length + (idx - head_size);
+        if (pos >= available) {
+          missing = true;
+          return 0.f;
+        }
+        return ring_[pos & mask_];
+      };
+
+      for (; frame != out.end(); ++frame) {
+        int idx = int(position_);
+        float frac = position_ - idx;
+        float s0 = read_frame(idx, lap_);
+        float s1 = 0;
+        if (idx + 1 < size)
+          s1 = read_frame(idx + 1, lap_);
+        else if (loop_)
+          s1 = read_frame(0, lap_ + 1);
+        *frame = s0 + frac * (s1 - s0);
+
+        position_ += speed_;
+        if (position_ >= size) {
+          if (!loop_) {
+            done_ = true;
+            ++frame;
+            break;
+          }
+          for (; position_ >= size; lap_++) position_ -= size;
+        }
+      }
+
+      int idx = int(position_);
+      std::uint64_t needed = lap_ * length + std::max(0, idx - head_size);
+      consumed_.store(pack(play_generation_, needed), std::memory_order_release);
+      if (missing) streamer_.underruns_.fetch_add(1, std::memory_order_relaxed);
+    }
+    std::fill(frame, out.end(), 0.f);
+  }
+
+} // namespace otto::util::dsp
@@ -0,0 +1,213 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include <gsl/span>
+
+#include "util/exception.hpp"
+#include "util/filesystem.hpp"
+
+namespace otto::util::dsp {
+
+  /// A WAV file, read with `pread`
+  ///
+  /// Reads PCM files with 8, 16, 24 or 32 bit samples, and 32 bit float files, with up to
+  /// {@ref max_channels} channels. Only the header is read when the file is opened, so opening a file is cheap,
+  /// no matter how long it is. The file is not mapped, so its frames only take up memory in the page cache,
+  /// and are never locked into RAM, even if the process memory is.
+  struct WavFile {
+    enum struct ErrorCode { open_failed, invalid_file, unsupported_format };
+    using exception = util::as_exception<ErrorCode>;
+
+    static constexpr int max_channels = 64;
+
+    /// \throws {@ref exception} if the file can not be opened, or is not a WAV file we can read
+    explicit WavFile(const fs::path& path);
+    ~WavFile();
+
+    WavFile(const WavFile&) = delete;
+    WavFile& operator=(const WavFile&) = delete;
+
+    int channels() const noexcept;
+    int samplerate() const noexcept;
+    /// Number of frames
+    int size() const noexcept;
+
+    /// Read frames `[first, first + out.size())`, mixed down to mono
+    ///
+    /// Reads from the disk, so never call this on the audio thread. Frames that can not be read are 0.
+    /// Can be called from multiple threads at once.
+    void read(int first, gsl::span<float> out) const noexcept;
+
+  private:
+    enum struct Format { pcm8, pcm16, pcm24, pcm32, float32 };
+
+    /// Decode `out.size()` frames from `bytes`, mixed down to mono
+    void decode(const std::uint8_t* bytes, gsl::span<float> out) const noexcept;
+
+    int fd_ = -1;
+    /// Offset of the first frame in the file
+    std::int64_t data_offset_ = 0;
+    /// Bytes per frame
+    int block_align_ = 0;
+    Format format_ = Format::pcm16;
+    int channels_ = 0;
+    int samplerate_ = 0;
+    int size_ = 0;
+  };
+
+  /// A sample that is streamed from disk, except for its first {@ref head_frames} frames
+  ///
+  /// A sample can also be held in memory entirely, in which case nothing is streamed. Its frames are shared,
+  /// so they can come from a cache that other engines load the same file from.
+  struct StreamedSample {
+    /// Frames that are read into memory when the sample is opened. Playback starts from these, which gives
+    /// the {@ref SampleStreamer} time to start filling the ring buffer of the voice.
+    static constexpr int head_frames = 1 << 15;
+
+    /// \throws {@ref WavFile::exception}
+    explicit StreamedSample(const fs::path& path);
+
+    /// A sample that is entirely in memory
+    ///
+    /// \param audio Mono frames at `samplerate`
+    StreamedSample(const fs::path& path, std::shared_ptr<const std::vector<float>> audio, int samplerate);
+
+    /// The file the frames after the head are streamed from. Only valid if `size() > head().size()`
+    const WavFile& file() const noexcept;
+    const fs::path& path() const noexcept;
+    /// Number of frames
+    int size() const noexcept;
+    int samplerate() const noexcept;
+    /// The frames in memory. At most {@ref head_frames}, unless the whole sample is in memory
+    gsl::span<const float> head() const noexcept;
+
+  private:
+    fs::path path_;
+    /// `nullptr` if the sample is in memory
+    std::unique_ptr<WavFile> file_;
+    std::shared_ptr<const std::vector<float>> head_;
+    int size_ = 0;
+    int samplerate_ = 0;
+  };
+
+  /// Streams {@ref StreamedSample}s from disk for a fixed number of voices
+  ///
+  /// Each voice plays from its own {@ref Stream}. The first frames of a sample are read from its preloaded
+  /// head, the rest from a ring buffer that a background thread keeps filled ahead of the playback position.
+  /// The lookahead grows with the playback speed. If the thread still falls behind, the missing frames are
+  /// played as silence and counted in {@ref underruns()} - the audio thread never waits for the disk.
+  struct SampleStreamer {
+    struct Stream;
+
+    /// How far ahead of the playback position the rings are filled, at normal speed
+    static constexpr float lookahead_seconds = 0.25f;
+
+    /// \param streams The number of voices
+    /// \param samplerate The output samplerate. Used to size the lookahead.
+    /// \param ring_frames The capacity of each ring buffer. Rounded up to a power of two. Limits the
+    ///        lookahead at high speeds.
+    SampleStreamer(int streams, int samplerate, int ring_frames = 1 << 16);
+    ~SampleStreamer();
+
+    SampleStreamer(const SampleStreamer&) = delete;
+    SampleStreamer& operator=(const SampleStreamer&) = delete;
+
+    Stream& stream(int idx) noexcept;
+    int size() const noexcept;
+
+    /// The number of blocks, in all streams, that were missing frames because the disk was too slow
+    int underruns() const noexcept;
+
+  private:
+    /// Wake the prefetch thread, so it starts filling a new stream right away
+    void wake() noexcept;
+    void run();
+    void fill(Stream& stream);
+
+    std::vector<std::unique_ptr<Stream>> streams_;
+    int lookahead_frames_;
+    std::atomic<int> underruns_ = 0;
+    std::atomic<std::uint32_t> wake_ = 0;
+    std::atomic<bool> stop_ = false;
+    std::thread thread_;
+  };
+
+  /// The playback of one voice. See {@ref SampleStreamer}
+  ///
+  /// All the member functions are called from the audio thread. Only forward playback is streamed.
+  struct SampleStreamer::Stream {
+    Stream(SampleStreamer& streamer, int ring_frames);
+
+    /// Start playing `sample` from its first frame
+    ///
+    /// `sample` must outlive the {@ref SampleStreamer}, or at least stay alive until another sample is
+    /// started on this stream.
+    ///
+    /// \param speed Frames of the sample per output frame
+    /// \param loop Start over from the first frame after the last one, instead of stopping
+    void start(const StreamedSample& sample, float speed, bool loop) noexcept;
+
+    /// Change the playback speed, without restarting
+    void speed(float speed) noexcept;
+
+    /// Stop playing. Nothing more will be streamed for this stream until it is started again
+    void stop() noexcept;
+
+    /// `true` after {@ref stop()}, or when a sample that does not loop has played to the end
+    bool done() const noexcept;
+
+    /// `true` if the frames needed to render the next `nframes` frames have been streamed, so {@ref read}
+    /// would not underrun
+    bool ready(int nframes) const noexcept;
+
+    /// Render the next `out.size()` frames, with linear interpolation
+    ///
+    /// Frames after the end of the sample, and frames that have not been streamed in time, are 0.
+    void read(gsl::span<float> out) noexcept;
+
+  private:
+    friend SampleStreamer;
+
+    /// The generation of the stream, and a position in it, packed so both can be published in one store.
+    /// A position is the number of frames after the head, counting every lap of a loop.
+    static std::uint64_t pack(std::uint32_t generation, std::uint64_t position) noexcept;
+    static std::uint32_t generation_of(std::uint64_t packed) noexcept;
+    static std::uint64_t position_of(std::uint64_t packed) noexcept;
+
+    SampleStreamer& streamer_;
+    std::vector<float> ring_;
+    std::uint64_t mask_;
+
+    // Written by the audio thread. The other fields are stored before the generation is bumped.
+    std::atomic<const StreamedSample*> request_sample_ = nullptr;
+    std::atomic<float> request_speed_ = 1;
+    std::atomic<bool> request_loop_ = false;
+    std::atomic<std::uint32_t> generation_ = 0;
+    /// The first frame of the ring that is still needed
+    std::atomic<std::uint64_t> consumed_ = 0;
+
+    // Written by the prefetch thread
+    /// One past the last frame written to the ring
+    std::atomic<std::uint64_t> written_ = 0;
+
+    // Only used by the audio thread
+    const StreamedSample* sample_ = nullptr;
+    std::uint32_t play_generation_ = 0;
+    float speed_ = 1;
+    bool loop_ = false;
+    bool done_ = true;
+    /// Position in the sample, and how many times it has looped
+    double position_ = 0;
+    std::uint64_t lap_ = 0;
+
+    // Only used by the prefetch thread
+    std::uint32_t fill_generation_ = 0;
+    std::uint64_t fill_position_ = 0;
+  };
+
+} // namespace otto::util::dsp
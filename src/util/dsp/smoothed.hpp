@@ -0,0 +1,107 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <type_traits>
+
+namespace otto::util::dsp {
+
+  /// A parameter that ramps to new values, instead of jumping to them
+  ///
+  /// Meant to be set from the action handlers of audio processors, and read in their process function, either
+  /// with {@ref next()} for every frame, or with {@ref skip()} once per control block for parameters that are
+  /// expensive to apply, like filter frequencies. Prop changes are coalesced to at most one per block (see
+  /// {@ref itc::ActionSender::push_latest}), so with a ramp of one block, a fast encoder sweep becomes one
+  /// continuous ramp.
+  ///
+  /// Exponential ramps move by a constant ratio per frame, which sounds even for frequencies and gains. They
+  /// need the start and target values to be positive, and are linear otherwise.
+  template<typename T = float>
+  struct Smoothed {
+    static_assert(std::is_floating_point_v<T>);
+
+    enum struct Ramp { linear, exponential };
+
+    /// \param ramp_frames The length of the ramp to a new value. Usually the buffer size
+    Smoothed(T value = 0, int ramp_frames = 256, Ramp ramp = Ramp::linear) noexcept
+      : current_(value), target_(value), ramp_frames_(std::max(1, ramp_frames)), ramp_(ramp)
+    {}
+
+    /// Set the length of the ramps started after this call
+    void set_ramp_frames(int frames) noexcept
+    {
+      ramp_frames_ = std::max(1, frames);
+    }
+
+    /// Start a ramp from the current value to `target`
+    void set(T target) noexcept
+    {
+      target_ = target;
+      remaining_ = ramp_frames_;
+      if (ramp_ == Ramp::exponential && current_ > 0 && target > 0) {
+        exponential_ = true;
+        step_ = std::pow(target / current_, T(1) / ramp_frames_);
+      } else {
+        exponential_ = false;
+        step_ = (target - current_) / ramp_frames_;
+      }
+    }
+
+    /// Set the value, without a ramp
+    void jump(T value) noexcept
+    {
+      current_ = target_ = value;
+      remaining_ = 0;
+    }
+
+    /// Advance one frame
+    ///
+    /// \returns the new value
+    T next() noexcept
+    {
+      if (remaining_ == 0) return current_;
+      if (--remaining_ == 0) return current_ = target_;
+      return current_ = exponential_ ? current_ * step_ : current_ + step_;
+    }
+
+    /// Advance `frames` frames at once
+    ///
+    /// \returns the new value
+    T skip(int frames) noexcept
+    {
+      if (frames >= remaining_) {
+        remaining_ = 0;
+        return current_ = target_;
+      }
+      remaining_ -= frames;
+      return current_ = exponential_ ? current_ * std::pow(step_, T(frames)) : current_ + step_ * frames;
+    }
+
+    /// `true` until the target is reached
+    bool is_ramping() const noexcept
+    {
+      return remaining_ > 0;
+    }
+
+    T current() const noexcept
+    {
+      return current_;
+    }
+
+    T target() const noexcept
+    {
+      return target_;
+    }
+
+  private:
+    T current_;
+    T target_;
+    /// Added to, or multiplied with, the value every frame
+    T step_ = 0;
+    int remaining_ = 0;
+    int ramp_frames_;
+    Ramp ramp_;
+    bool exponential_ = false;
+  };
+
+} // namespace otto::util::dsp
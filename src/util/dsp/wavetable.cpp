@@ -0,0 +1,245 @@
+#include "wavetable.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <complex>
+#include <cstring>
+#include <fstream>
+
+#include <AudioFile.h>
+
+#include "services/log_manager.hpp"
+
+namespace otto::util::dsp {
+
+  namespace {
+    using Spectrum = std::vector<std::complex<double>>;
+
+    /// In place inverse FFT, without scaling. `x.size()` must be a power of two
+    void inverse_fft(Spectrum& x)
+    {
+      int n = x.size();
+      for (int i = 1, j = 0; i < n; i++) {
+        int bit = n >> 1;
+        for (; j & bit; bit >>= 1) j ^= bit;
+        j ^= bit;
+        if (i < j) std::swap(x[i], x[j]);
+      }
+      for (int len = 2; len <= n; len <<= 1) {
+        std::complex<double> step = std::polar(1.0, 2 * M_PI / len);
+        for (int i = 0; i < n; i += len) {
+          std::complex<double> w = 1;
+          for (int j = 0; j < len / 2; j++) {
+            auto u = x[i + j];
+            auto v = x[i + j + len / 2] * w;
+            x[i + j] = u + v;
+            x[i + j + len / 2] = u - v;
+            w *= step;
+          }
+        }
+      }
+    }
+
+    struct CacheHeader {
+      std::array<char, 4> magic = {'O', 'T', 'W', 'T'};
+      std::uint32_t version = 1;
+      std::uint32_t table_size = WavetablePyramid::table_size;
+      std::uint32_t levels = WavetablePyramid::levels;
+      std::uint32_t stride = WavetablePyramid::stride;
+      std::uint32_t size = 0;
+      std::uint64_t key = 0;
+
+      bool operator==(const CacheHeader& rhs) const noexcept
+      {
+        return magic == rhs.magic && version == rhs.version && table_size == rhs.table_size &&
+               levels == rhs.levels && stride == rhs.stride && size == rhs.size && key == rhs.key;
+      }
+    };
+
+    /// FNV-1a
+    void hash_bytes(std::uint64_t& hash, const void* data, std::size_t size)
+    {
+      auto* bytes = static_cast<const unsigned char*>(data);
+      for (std::size_t i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3;
+      }
+    }
+  } // namespace
+
+  // WavetablePyramid //
+
+  void WavetablePyramid::add(gsl::span<const float> cycle)
+  {
+    int n = cycle.size();
+    // The nyquist bin of the cycle is left out, since its phase is unknown
+    int harmonics = std::min<int>((n + 1) / 2, table_size / 2);
+
+    // Only the harmonics that fit are needed, so a plain DFT is fine, and works for cycles of any length
+    Spectrum harmonic(harmonics);
+    for (int h = 1; h < harmonics; h++) {
+      std::complex<double> sum = 0;
+      for (int k = 0; k < n; k++) sum += double(cycle[k]) * std::polar(1.0, -2 * M_PI * h * k / n);
+      harmonic[h] = sum / double(n);
+    }
+
+    data_.resize(data_.size() + levels * stride, 0.f);
+    float* tables = data_.data() + size_ * levels * stride;
+    Spectrum bins(table_size);
+    for (int level = 0; level < levels; level++) {
+      std::fill(bins.begin(), bins.end(), 0);
+      int limit = std::min(harmonics - 1, (table_size / 2) >> level);
+      for (int h = 1; h <= limit; h++) {
+        bins[h] = harmonic[h];
+        bins[table_size - h] = std::conj(harmonic[h]);
+      }
+      inverse_fft(bins);
+      float* table = tables + level * stride;
+      for (int i = 0; i < table_size; i++) table[i] = bins[i].real();
+      table[table_size] = table[0];
+    }
+
+    float peak = 0;
+    for (int i = 0; i < table_size; i++) peak = std::max(peak, std::abs(tables[i]));
+    if (peak > 0) {
+      for (int i = 0; i < levels * stride; i++) tables[i] /= peak;
+    }
+    size_++;
+  }
+
+  int WavetablePyramid::level_for(float increment) noexcept
+  {
+    int level = 0;
+    while (level < levels - 1 && ((table_size / 2) >> level) * increment > 0.5f) level++;
+    return level;
+  }
+
+  bool WavetablePyramid::save_cache(const fs::path& file, std::uint64_t key) const
+  {
+    CacheHeader header;
+    header.size = size_;
+    header.key = key;
+    std::ofstream out(file.c_str(), std::ios::binary | std::ios::trunc);
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.write(reinterpret_cast<const char*>(data_.data()), data_.size() * sizeof(float));
+    return out.good();
+  }
+
+  bool WavetablePyramid::load_cache(const fs::path& file, std::uint64_t key)
+  {
+    std::ifstream in(file.c_str(), std::ios::binary);
+    if (!in) return false;
+    CacheHeader header;
+    in.read(reinterpret_cast<char*>(&header), sizeof(header));
+    CacheHeader expected;
+    expected.size = header.size;
+    expected.key = key;
+    if (!in || !(header == expected)) return false;
+    std::vector<float> data(std::size_t(header.size) * levels * stride);
+    in.read(reinterpret_cast<char*>(data.data()), data.size() * sizeof(float));
+    if (!in || in.peek() != std::ifstream::traits_type::eof()) return false;
+    data_ = std::move(data);
+    size_ = header.size;
+    return true;
+  }
+
+  WavetablePyramid load_wavetables(const fs::path& dir, const fs::path& cache_file)
+  {
+    std::vector<fs::path> files;
+    if (fs::exists(dir)) {
+      for (auto&& de : fs::directory_iterator(dir)) {
+        if (de.is_regular_file() && de.path().extension() == ".wav") files.push_back(de.path());
+      }
+    }
+    std::sort(files.begin(), files.end());
+
+    // The cache is valid as long as the same files are there, with the same sizes and modification times
+    std::uint64_t key = 0xcbf29ce484222325;
+    for (auto& file : files) {
+      auto name = file.filename().string();
+      auto size = fs::file_size(file);
+      auto mtime = fs::last_write_time(file).time_since_epoch().count();
+      hash_bytes(key, name.data(), name.size());
+      hash_bytes(key, &size, sizeof(size));
+      hash_bytes(key, &mtime, sizeof(mtime));
+    }
+
+    WavetablePyramid res;
+    if (res.load_cache(cache_file, key)) {
+      DLOGI("Loaded {} wavetables from {}", res.size(), cache_file.string());
+      return res;
+    }
+    for (auto& file : files) {
+      AudioFile<float> audio_file;
+      if (!audio_file.load(file.string()) || audio_file.getNumSamplesPerChannel() == 0) {
+        LOGW("Could not load wavetable {}", file.string());
+        continue;
+      }
+      res.add(audio_file.samples[0]);
+    }
+    LOGI("Built {} wavetables from {}", res.size(), dir.string());
+    if (!res.save_cache(cache_file, key)) LOGW("Could not write the wavetable cache {}", cache_file.string());
+    return res;
+  }
+
+  // Rendering //
+
+  float render_wavetable(const float* a,
+                         const float* b,
+                         float morph,
+                         float morph_step,
+                         float phase,
+                         float increment,
+                         float* out,
+                         int nframes) noexcept
+  {
+    using simd::vfloat;
+    constexpr int lanes = vfloat::size;
+    constexpr int table_size = WavetablePyramid::table_size;
+
+    alignas(vfloat::alignment) std::array<float, lanes> ramp;
+    for (int i = 0; i < lanes; i++) ramp[i] = i;
+    const vfloat vramp = vfloat::load(ramp.data());
+    const vfloat vsize{float(table_size)};
+    const vfloat vlast{float(table_size - 1)};
+    const vfloat zero{0.f};
+    const vfloat one{1.f};
+
+    // Each lane reads from its own position in the tables
+    alignas(vfloat::alignment) std::array<std::int32_t, lanes> index;
+    int f = 0;
+    for (; f + lanes <= nframes; f += lanes) {
+      vfloat x = vfloat{phase} + vramp * vfloat{increment};
+      vfloat pos = (x - floor(x)) * vsize;
+      // The tables are followed by their first frame, so the last index still has a frame after it
+      vfloat ipos = min(floor(pos), vlast);
+      vfloat frac = pos - ipos;
+      ipos.store_truncated(index.data());
+      vfloat va = simd::gather(a, index.data());
+      va = va + frac * (simd::gather(a + 1, index.data()) - va);
+      vfloat vb = simd::gather(b, index.data());
+      vb = vb + frac * (simd::gather(b + 1, index.data()) - vb);
+      vfloat m = min(max(vfloat{morph} + vramp * vfloat{morph_step}, zero), one);
+      (va + m * (vb - va)).store(out + f);
+
+      phase += lanes * increment;
+      phase -= std::floor(phase);
+      morph += lanes * morph_step;
+    }
+    for (; f < nframes; f++) {
+      float pos = phase * table_size;
+      int i = std::min(int(pos), table_size - 1);
+      float frac = pos - i;
+      float va = a[i] + frac * (a[i + 1] - a[i]);
+      float vb = b[i] + frac * (b[i + 1] - b[i]);
+      float m = std::clamp(morph, 0.f, 1.f);
+      out[f] = va + m * (vb - va);
+      phase += increment;
+      phase -= std::floor(phase);
+      morph += morph_step;
+    }
+    return phase;
+  }
+
+} // namespace otto::util::dsp
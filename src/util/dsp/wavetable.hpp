@@ -0,0 +1,91 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <gsl/span>
+
+#include "util/filesystem.hpp"
+#include "util/simd.hpp"
+
+namespace otto::util::dsp {
+
+  /// A set of single cycle waveforms, each stored as a pyramid of band-limited tables
+  ///
+  /// Level 0 of a waveform has all the harmonics that fit in {@ref table_size}, and each level above it has
+  /// half as many, so there is one table per octave. Reading each note from the lowest level whose harmonics
+  /// are all below the nyquist frequency never aliases, and costs no more than any other table read. All the
+  /// filtering is done once, when a waveform is added.
+  struct WavetablePyramid {
+    /// Frames in one cycle of a table
+    static constexpr int table_size = 2048;
+    /// Level `l` has the harmonics up to `table_size / 2 >> l`
+    static constexpr int levels = 11;
+    /// Floats from the start of one table to the next. Each table is followed by a copy of its first frame,
+    /// so interpolating reads never have to wrap.
+    static constexpr int stride = int(simd::padded_size(table_size + 1));
+
+    /// Add a waveform from one cycle of audio, of any length
+    ///
+    /// The waveform is normalized to a peak of 1, and its DC offset is removed.
+    void add(gsl::span<const float> cycle);
+
+    /// Number of waveforms
+    int size() const noexcept
+    {
+      return size_;
+    }
+
+    /// The table of waveform `idx` at `level`
+    const float* table(int idx, int level) const noexcept
+    {
+      return data_.data() + (idx * levels + level) * stride;
+    }
+
+    /// The lowest level that does not alias when read with `increment` cycles per frame
+    static int level_for(float increment) noexcept;
+
+    /// Write the tables to a binary cache file
+    ///
+    /// \param key Identifies the source of the waveforms, see {@ref load_cache}
+    /// \returns `false` if the file could not be written
+    bool save_cache(const fs::path& file, std::uint64_t key) const;
+
+    /// Read the tables from a file written by {@ref save_cache}
+    ///
+    /// \returns `false`, and leaves this unchanged, if the file is missing or damaged, or was written with
+    /// another `key` or table layout
+    bool load_cache(const fs::path& file, std::uint64_t key);
+
+  private:
+    std::vector<float> data_;
+    int size_ = 0;
+  };
+
+  /// Load the `.wav` files in `dir`, in order of their names, as one waveform each
+  ///
+  /// The first time, the pyramids are built and written to `cache_file`. After that, they are read from it,
+  /// until a file in `dir` is added, removed or changed. Files that can not be loaded are skipped.
+  WavetablePyramid load_wavetables(const fs::path& dir, const fs::path& cache_file);
+
+  /// Render `nframes` frames of a wavetable oscillator into `out`
+  ///
+  /// Reads the tables `a` and `b` from a {@ref WavetablePyramid} with linear interpolation, and mixes them by
+  /// `morph`, which moves by `morph_step` every frame. The morph is clamped to `[0, 1]` in every frame, so it
+  /// never extrapolates past the tables. Phases, interpolation and mixing are computed for
+  /// {@ref simd::vfloat::size} frames at a time.
+  ///
+  /// \param phase The phase of the first frame, in `[0, 1)`
+  /// \param increment Cycles per frame
+  /// \param out Must be aligned to {@ref simd::vfloat::alignment}
+  /// \returns The phase after the last frame
+  float render_wavetable(const float* a,
+                         const float* b,
+                         float morph,
+                         float morph_step,
+                         float phase,
+                         float increment,
+                         float* out,
+                         int nframes) noexcept;
+
+} // namespace otto::util::dsp
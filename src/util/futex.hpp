@@ -0,0 +1,115 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+#if defined(__linux__)
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+#else
+#include <algorithm>
+#include <condition_variable>
+#include <mutex>
+#endif
+
+namespace otto::util {
+
+  /// Block the calling thread while `word == expected`, until woken by {@ref futex_wake_all}
+  ///
+  /// Like all futex waits, this may return spuriously, so always call it in a loop that checks the condition.
+  ///
+  /// On linux, this is the `FUTEX_WAIT` syscall. On other platforms it is emulated with a condition variable.
+  inline void futex_wait(std::atomic<std::uint32_t>& word, std::uint32_t expected) noexcept;
+
+  /// Like {@ref futex_wait}, but returns after at most about `timeout`
+  inline void futex_wait_for(std::atomic<std::uint32_t>& word,
+                             std::uint32_t expected,
+                             std::chrono::nanoseconds timeout) noexcept;
+
+  /// Wake all threads blocked in {@ref futex_wait} on `word`
+  inline void futex_wake_all(std::atomic<std::uint32_t>& word) noexcept;
+
+  /// Hint to the CPU that the calling thread is spinning
+  inline void cpu_relax() noexcept
+  {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__arm__) || defined(__aarch64__)
+    asm volatile("yield");
+#endif
+  }
+
+  // IMPLEMENTATION //
+
+  static_assert(sizeof(std::atomic<std::uint32_t>) == sizeof(std::uint32_t));
+
+#if defined(__linux__)
+
+  inline void futex_wait(std::atomic<std::uint32_t>& word, std::uint32_t expected) noexcept
+  {
+    ::syscall(SYS_futex, reinterpret_cast<std::uint32_t*>(&word), FUTEX_WAIT_PRIVATE, expected, nullptr, nullptr, 0);
+  }
+
+  inline void futex_wait_for(std::atomic<std::uint32_t>& word,
+                             std::uint32_t expected,
+                             std::chrono::nanoseconds timeout) noexcept
+  {
+    if (timeout.count() <= 0) return;
+    ::timespec ts;
+    ts.tv_sec = timeout.count() / 1'000'000'000;
+    ts.tv_nsec = timeout.count() % 1'000'000'000;
+    ::syscall(SYS_futex, reinterpret_cast<std::uint32_t*>(&word), FUTEX_WAIT_PRIVATE, expected, &ts, nullptr, 0);
+  }
+
+  inline void futex_wake_all(std::atomic<std::uint32_t>& word) noexcept
+  {
+    ::syscall(SYS_futex, reinterpret_cast<std::uint32_t*>(&word), FUTEX_WAKE_PRIVATE, INT32_MAX, nullptr, nullptr, 0);
+  }
+
+#else
+
+  namespace detail {
+    struct futex_emulation {
+      std::mutex mutex;
+      std::condition_variable cv;
+
+      static futex_emulation& get() noexcept
+      {
+        static futex_emulation instance;
+        return instance;
+      }
+    };
+  } // namespace detail
+
+  inline void futex_wait(std::atomic<std::uint32_t>& word, std::uint32_t expected) noexcept
+  {
+    auto& fe = detail::futex_emulation::get();
+    std::unique_lock lock(fe.mutex);
+    if (word.load() != expected) return;
+    fe.cv.wait_for(lock, std::chrono::milliseconds(1));
+  }
+
+  inline void futex_wait_for(std::atomic<std::uint32_t>& word,
+                             std::uint32_t expected,
+                             std::chrono::nanoseconds timeout) noexcept
+  {
+    if (timeout.count() <= 0) return;
+    auto& fe = detail::futex_emulation::get();
+    std::unique_lock lock(fe.mutex);
+    if (word.load() != expected) return;
+    fe.cv.wait_for(lock, std::min<std::chrono::nanoseconds>(timeout, std::chrono::milliseconds(1)));
+  }
+
+  inline void futex_wake_all(std::atomic<std::uint32_t>&) noexcept
+  {
+    auto& fe = detail::futex_emulation::get();
+    std::lock_guard lock(fe.mutex);
+    fe.cv.notify_all();
+  }
+
+#endif
+
+} // namespace otto::util
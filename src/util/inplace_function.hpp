@@ -0,0 +1,105 @@
+#pragma once
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace otto::util {
+
+  template<typename Signature, std::size_t Capacity = 48>
+  struct inplace_function;
+
+  /// A move-only `std::function` alternative with fixed size inline storage
+  ///
+  /// The callable is always stored inside the object itself, so constructing, moving and calling an
+  /// `inplace_function` never allocates. Callables that do not fit in `Capacity` bytes are rejected at
+  /// compile time.
+  ///
+  /// @tparam Capacity The number of bytes avaliable for the stored callable
+  template<typename Ret, typename... Args, std::size_t Capacity>
+  struct inplace_function<Ret(Args...), Capacity> {
+    static constexpr std::size_t capacity = Capacity;
+    static constexpr std::size_t alignment = alignof(std::max_align_t);
+
+    inplace_function() noexcept = default;
+
+    template<typename Callable,
+             typename = std::enable_if_t<!std::is_same_v<std::decay_t<Callable>, inplace_function> &&
+                                         std::is_invocable_r_v<Ret, std::decay_t<Callable>&, Args...>>>
+    inplace_function(Callable&& c) noexcept
+    {
+      using C = std::decay_t<Callable>;
+      static_assert(sizeof(C) <= Capacity, "The callable is too large for the inplace_function storage");
+      static_assert(alignof(C) <= alignment, "The callable is overaligned for the inplace_function storage");
+      static_assert(std::is_nothrow_move_constructible_v<C>, "The callable must be nothrow move constructible");
+      ::new (&storage_) C(std::forward<Callable>(c));
+      invoke_ = [](void* s, Args... args) -> Ret { return (*static_cast<C*>(s))(std::forward<Args>(args)...); };
+      manage_ = [](void* dst, void* src) noexcept {
+        auto* from = static_cast<C*>(src);
+        if (dst != nullptr) ::new (dst) C(std::move(*from));
+        from->~C();
+      };
+    }
+
+    inplace_function(inplace_function&& rhs) noexcept
+    {
+      move_from(rhs);
+    }
+
+    inplace_function& operator=(inplace_function&& rhs) noexcept
+    {
+      if (this != &rhs) {
+        reset();
+        move_from(rhs);
+      }
+      return *this;
+    }
+
+    inplace_function(const inplace_function&) = delete;
+    inplace_function& operator=(const inplace_function&) = delete;
+
+    ~inplace_function() noexcept
+    {
+      reset();
+    }
+
+    /// Destroy the stored callable, if any
+    void reset() noexcept
+    {
+      if (manage_ != nullptr) manage_(nullptr, &storage_);
+      invoke_ = nullptr;
+      manage_ = nullptr;
+    }
+
+    Ret operator()(Args... args)
+    {
+      return invoke_(&storage_, std::forward<Args>(args)...);
+    }
+
+    explicit operator bool() const noexcept
+    {
+      return invoke_ != nullptr;
+    }
+
+  private:
+    void move_from(inplace_function& rhs) noexcept
+    {
+      if (rhs.manage_ == nullptr) return;
+      rhs.manage_(&storage_, &rhs.storage_);
+      invoke_ = rhs.invoke_;
+      manage_ = rhs.manage_;
+      rhs.invoke_ = nullptr;
+      rhs.manage_ = nullptr;
+    }
+
+    using invoke_ptr = Ret (*)(void*, Args...);
+    /// Move-constructs the callable in `src` into `dst` (if not null), and destroys the one in `src`
+    using manage_ptr = void (*)(void* dst, void* src) noexcept;
+
+    std::aligned_storage_t<Capacity, alignment> storage_;
+    invoke_ptr invoke_ = nullptr;
+    manage_ptr manage_ = nullptr;
+  };
+
+} // namespace otto::util
@@ -202,8 +202,8 @@ namespace otto::util {
     constexpr tl::expected<void, error> pop_back() noexcept
     {
       if (empty()) return tl::unexpected(error::empty);
-      data()[_size].~T();
       _size--;
+      data()[_size].~T();
       return {};
     }
 
@@ -0,0 +1,127 @@
+#include "realtime.hpp"
+
+#include <cerrno>
+
+#if defined(__SSE__)
+#include <xmmintrin.h>
+#endif
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#endif
+
+namespace otto::util {
+
+  namespace {
+#if defined(__SSE__)
+    /// Flush to zero (bit 15) and denormals are zero (bit 6)
+    constexpr unsigned mxcsr_ftz_daz = 0x8040;
+#elif defined(__aarch64__) || defined(__arm__)
+    /// The FZ bit of FPCR and FPSCR
+    constexpr unsigned arm_fz = 1u << 24;
+#endif
+  } // namespace
+
+  bool flush_denormals() noexcept
+  {
+#if defined(__SSE__)
+    _mm_setcsr(_mm_getcsr() | mxcsr_ftz_daz);
+    return true;
+#elif defined(__aarch64__)
+    std::uint64_t fpcr;
+    asm volatile("mrs %0, fpcr" : "=r"(fpcr));
+    asm volatile("msr fpcr, %0" : : "r"(fpcr | arm_fz));
+    return true;
+#elif defined(__arm__) && defined(__ARM_FP)
+    std::uint32_t fpscr;
+    asm volatile("vmrs %0, fpscr" : "=r"(fpscr));
+    asm volatile("vmsr fpscr, %0" : : "r"(fpscr | arm_fz));
+    return true;
+#else
+    return false;
+#endif
+  }
+
+  bool denormals_flushed() noexcept
+  {
+#if defined(__SSE__)
+    return (_mm_getcsr() & mxcsr_ftz_daz) == mxcsr_ftz_daz;
+#elif defined(__aarch64__)
+    std::uint64_t fpcr;
+    asm volatile("mrs %0, fpcr" : "=r"(fpcr));
+    return fpcr & arm_fz;
+#elif defined(__arm__) && defined(__ARM_FP)
+    std::uint32_t fpscr;
+    asm volatile("vmrs %0, fpscr" : "=r"(fpscr));
+    return fpscr & arm_fz;
+#else
+    return false;
+#endif
+  }
+
+  bool pin_current_thread(int cpu) noexcept
+  {
+#if defined(__linux__)
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(cpu, &cpus);
+    return pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus) == 0;
+#else
+    return false;
+#endif
+  }
+
+  int lock_memory() noexcept
+  {
+#if defined(__linux__)
+    return mlockall(MCL_CURRENT) == 0 ? 0 : errno;
+#else
+    return ENOSYS;
+#endif
+  }
+
+  int lock_range(const void* data, std::size_t bytes) noexcept
+  {
+#if defined(__linux__)
+    return mlock(data, bytes) == 0 ? 0 : errno;
+#else
+    return ENOSYS;
+#endif
+  }
+
+  [[gnu::noinline]] void prefault_stack(std::size_t bytes) noexcept
+  {
+    // Touch one byte per page, from the top of the frame downwards
+    constexpr std::size_t page = 4096;
+    volatile char* stack = static_cast<volatile char*>(__builtin_alloca(bytes));
+    for (std::size_t i = bytes; i >= page; i -= page) stack[i - 1] = 0;
+    stack[0] = 0;
+  }
+
+  [[gnu::noinline]] int lock_stack(std::size_t bytes) noexcept
+  {
+    // The pages are touched first, so mlock does not have to fault them in
+    volatile char* stack = static_cast<volatile char*>(__builtin_alloca(bytes));
+    constexpr std::size_t page = 4096;
+    for (std::size_t i = bytes; i >= page; i -= page) stack[i - 1] = 0;
+    stack[0] = 0;
+    return lock_range(const_cast<char*>(stack), bytes);
+  }
+
+  thread_resource_usage thread_resource_usage::get() noexcept
+  {
+    thread_resource_usage res;
+#if defined(__linux__)
+    rusage usage;
+    if (getrusage(RUSAGE_THREAD, &usage) == 0) {
+      res.page_faults = usage.ru_minflt + usage.ru_majflt;
+      res.involuntary_switches = usage.ru_nivcsw;
+    }
+#endif
+    return res;
+  }
+
+} // namespace otto::util
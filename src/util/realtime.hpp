@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace otto::util {
+
+  /// Set the flush-to-zero and denormals-are-zero modes of the calling thread's floating point unit
+  ///
+  /// Denormal floats, like the tail of a decaying reverb or comb filter, are many times slower to compute with
+  /// on most CPUs. With these modes set, they are treated as zero instead. On x86 this sets the FTZ and DAZ
+  /// bits of MXCSR, on ARM the FZ bit of FPCR/FPSCR. Does nothing on other platforms.
+  ///
+  /// \returns `false` if the platform is not supported
+  bool flush_denormals() noexcept;
+
+  /// Check whether denormals are flushed to zero on the calling thread
+  bool denormals_flushed() noexcept;
+
+  /// Pin the calling thread to `cpu`
+  ///
+  /// \returns `false` on failure, or if the platform is not supported
+  bool pin_current_thread(int cpu) noexcept;
+
+  /// Lock the pages the process has mapped now into memory, with `mlockall(MCL_CURRENT)`
+  ///
+  /// Faults in the whole process image, so call it at startup, not on the audio thread. Memory mapped later is
+  /// not locked, so things the audio thread needs that are allocated later are locked with {@ref lock_range}.
+  /// This usually requires the `CAP_IPC_LOCK` capability, or a large enough `RLIMIT_MEMLOCK`.
+  ///
+  /// \returns 0, or the `errno` of the failure. `ENOSYS` if the platform is not supported
+  int lock_memory() noexcept;
+
+  /// Lock `bytes` of memory starting at `data` with `mlock`
+  ///
+  /// \returns 0, or the `errno` of the failure. `ENOSYS` if the platform is not supported
+  int lock_range(const void* data, std::size_t bytes) noexcept;
+
+  /// Touch `bytes` of stack below the calling function, so they are mapped before they are needed
+  void prefault_stack(std::size_t bytes) noexcept;
+
+  /// Like {@ref prefault_stack}, but also lock the touched stack into memory
+  ///
+  /// \returns 0, or the `errno` of the failure. `ENOSYS` if the platform is not supported
+  int lock_stack(std::size_t bytes) noexcept;
+
+  /// Counters from `getrusage` for the calling thread
+  struct thread_resource_usage {
+    /// Minor and major page faults
+    std::uint64_t page_faults = 0;
+    /// Involuntary context switches, i.e. the thread was preempted
+    std::uint64_t involuntary_switches = 0;
+
+    /// Get the counters of the calling thread. All zeros if the platform is not supported.
+    static thread_resource_usage get() noexcept;
+  };
+
+} // namespace otto::util
@@ -0,0 +1,180 @@
+#include "realtime_worker_pool.hpp"
+
+#include <algorithm>
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include "util/futex.hpp"
+#include "util/realtime.hpp"
+
+namespace otto::util {
+
+  namespace {
+    constexpr std::uint64_t index_mask = 0xFFFF;
+
+    int core_count() noexcept
+    {
+      return std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    /// \returns 0, or the error code
+    int make_realtime(std::thread& thread, int priority) noexcept
+    {
+#if defined(__linux__)
+      if (priority <= 0) return 0;
+      sched_param param = {};
+      param.sched_priority = priority;
+      return pthread_setschedparam(thread.native_handle(), SCHED_FIFO, &param);
+#else
+      return 0;
+#endif
+    }
+
+    /// \returns 0, or the error code
+    int pin(std::thread& thread, int cpu) noexcept
+    {
+#if defined(__linux__)
+      if (cpu < 0) return 0;
+      cpu_set_t cpus;
+      CPU_ZERO(&cpus);
+      CPU_SET(cpu, &cpus);
+      return pthread_setaffinity_np(thread.native_handle(), sizeof(cpus), &cpus);
+#else
+      return 0;
+#endif
+    }
+  } // namespace
+
+  realtime_worker_pool::realtime_worker_pool(config cfg) : config_(cfg)
+  {
+    workers_.reserve(cfg.workers);
+    for (int i = 0; i < cfg.workers; i++) {
+      workers_.emplace_back([this, i] { worker_main(i); });
+      if (int err = make_realtime(workers_.back(), cfg.priority); err != 0) setup_errors_.push_back({i, -1, err});
+      int cpu = worker_cpu(cfg, i, core_count());
+      if (int err = pin(workers_.back(), cpu); err != 0) setup_errors_.push_back({i, cpu, err});
+    }
+  }
+
+  void realtime_worker_pool::avoid_cpu(int cpu)
+  {
+    if (config_.first_cpu < 0 || cpu == config_.avoid_cpu) return;
+    config_.avoid_cpu = cpu;
+    setup_errors_.clear();
+    for (int i = 0; i < int(workers_.size()); i++) {
+      int target = worker_cpu(config_, i, core_count());
+      if (int err = pin(workers_[i], target); err != 0) setup_errors_.push_back({i, target, err});
+    }
+  }
+
+  int realtime_worker_pool::lock_memory(std::size_t stack_bytes) noexcept
+  {
+    int res = lock_range(this, sizeof(*this));
+#if defined(__linux__)
+    for (auto& thread : workers_) {
+      pthread_attr_t attr;
+      if (int err = pthread_getattr_np(thread.native_handle(), &attr); err != 0) {
+        if (res == 0) res = err;
+        continue;
+      }
+      void* stack = nullptr;
+      std::size_t size = 0;
+      pthread_attr_getstack(&attr, &stack, &size);
+      pthread_attr_destroy(&attr);
+      // The stack grows down from the end of the mapping
+      auto bytes = std::min(stack_bytes, size);
+      if (int err = lock_range(static_cast<char*>(stack) + size - bytes, bytes); err != 0 && res == 0) res = err;
+    }
+#endif
+    return res;
+  }
+
+  int realtime_worker_pool::worker_cpu(const config& cfg, int worker, int cores) noexcept
+  {
+    if (cfg.first_cpu < 0) return -1;
+    const bool avoid = cfg.avoid_cpu >= 0 && cfg.avoid_cpu < cores;
+    const int usable = cores - (avoid ? 1 : 0);
+    // Only the avoided core is left, so the scheduler may as well place the worker
+    if (usable <= 0) return -1;
+    int cpu = cfg.first_cpu % cores;
+    for (int n = worker % usable;; cpu = (cpu + 1) % cores) {
+      if (avoid && cpu == cfg.avoid_cpu) continue;
+      if (n-- == 0) return cpu;
+    }
+  }
+
+  realtime_worker_pool::~realtime_worker_pool() noexcept
+  {
+    stop_ = true;
+    wake_.fetch_add(1);
+    futex_wake_all(wake_);
+    for (auto& t : workers_) t.join();
+  }
+
+  void realtime_worker_pool::run_impl(int count, task_fn fn, void* ctx) noexcept
+  {
+    fn_ = fn;
+    ctx_ = ctx;
+    generation_++;
+    remaining_.store(count, std::memory_order_relaxed);
+    next_task_.store(std::uint64_t(generation_) << 32 | std::uint64_t(count) << 16, std::memory_order_release);
+
+    wake_.fetch_add(1);
+    if (sleeping_workers_.load() > 0) futex_wake_all(wake_);
+
+    execute_tasks();
+
+    // Join
+    for (std::uint32_t r; (r = remaining_.load()) != 0;) {
+      wait_while_equal(remaining_, r, sleeping_callers_);
+    }
+  }
+
+  void realtime_worker_pool::execute_tasks() noexcept
+  {
+    auto cur = next_task_.load(std::memory_order_acquire);
+    while ((cur & index_mask) < ((cur >> 16) & index_mask)) {
+      if (!next_task_.compare_exchange_weak(cur, cur + 1, std::memory_order_acq_rel)) continue;
+      // The task is claimed, so the job can not be finished, and fn_ and ctx_ still belong to it
+      fn_(ctx_, cur & index_mask);
+      if (remaining_.fetch_sub(1) == 1 && sleeping_callers_.load() > 0) {
+        futex_wake_all(remaining_);
+      }
+      cur = next_task_.load(std::memory_order_acquire);
+    }
+  }
+
+  void realtime_worker_pool::wait_while_equal(std::atomic<std::uint32_t>& word,
+                                              std::uint32_t value,
+                                              std::atomic<int>& sleepers) noexcept
+  {
+    for (int i = 0; i < config_.spin_iterations; i++) {
+      if (word.load(std::memory_order_acquire) != value) return;
+      cpu_relax();
+    }
+    sleepers.fetch_add(1);
+    futex_wait(word, value);
+    sleepers.fetch_sub(1);
+  }
+
+  void realtime_worker_pool::worker_main(int index) noexcept
+  {
+    loguru::set_thread_name(fmt::format("audio worker {}", index).c_str());
+    // The FPU modes are per thread, so the workers need the same as the audio thread
+    flush_denormals();
+    // Not loaded from wake_, since a job could have been started before this thread got to run
+    std::uint32_t seen = 0;
+    while (true) {
+      wait_while_equal(wake_, seen, sleeping_workers_);
+      auto now = wake_.load(std::memory_order_acquire);
+      if (now == seen) continue;
+      seen = now;
+      if (stop_) return;
+      execute_tasks();
+    }
+  }
+
+} // namespace otto::util
@@ -0,0 +1,142 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace otto::util {
+
+  /// A small pool of realtime threads, for splitting the work of an audio block across cores
+  ///
+  /// {@ref run} hands a number of tasks to the workers, takes part in executing them on the calling thread,
+  /// and returns when they are all done. It never allocates or locks, so it can be called from the audio thread.
+  ///
+  /// Between calls, the workers spin for a short while, since the next call is usually right around the corner,
+  /// and then go to sleep on a futex. The calling thread waits for the last task the same way.
+  ///
+  /// With zero workers, {@ref run} simply executes all tasks on the calling thread.
+  struct realtime_worker_pool {
+    struct config {
+      /// Number of worker threads. The calling thread is not included.
+      int workers = 0;
+      /// `SCHED_FIFO` priority of the workers. 0 leaves them at normal priority
+      int priority = 80;
+      /// Pin each worker to its own core, starting at this core. -1 to not pin workers
+      int first_cpu = 1;
+      /// The core the calling thread is pinned to, which no worker is pinned to. -1 if it is not pinned
+      int avoid_cpu = -1;
+      /// Number of times to check for work before going to sleep
+      int spin_iterations = 20000;
+    };
+
+    /// A worker that could not be given its priority, or pinned to its core
+    struct setup_error {
+      int worker = 0;
+      /// The core it should have been pinned to, or -1 if setting the priority failed
+      int cpu = -1;
+      /// The `errno` value of the failed call
+      int error = 0;
+    };
+
+    realtime_worker_pool(config cfg);
+
+    realtime_worker_pool(const realtime_worker_pool&) = delete;
+    realtime_worker_pool& operator=(const realtime_worker_pool&) = delete;
+
+    /// Stops and joins the workers
+    ~realtime_worker_pool() noexcept;
+
+    /// The number of worker threads, not including the calling thread
+    int worker_count() const noexcept
+    {
+      return workers_.size();
+    }
+
+    /// Pin the workers again, keeping them off `cpu`
+    ///
+    /// For when the calling thread is pinned after the pool was created. Does nothing if workers are not pinned.
+    /// Replaces the {@ref setup_errors} with the failures to pin the workers again.
+    void avoid_cpu(int cpu);
+
+    /// Lock the pool, and the top `stack_bytes` of the stack of each worker, into memory with `mlock`
+    ///
+    /// Faults the pages in, so call it at startup, not from the calling thread of {@ref run}.
+    ///
+    /// \returns 0, or the `errno` of the first failure
+    int lock_memory(std::size_t stack_bytes) noexcept;
+
+    /// The failures of the constructor, or of the last call to {@ref avoid_cpu}
+    ///
+    /// The pool does not log them itself, so its owner can report them however it reports errors.
+    const std::vector<setup_error>& setup_errors() const noexcept
+    {
+      return setup_errors_;
+    }
+
+    /// The core worker number `worker` is pinned to, out of `cores` cores. -1 if it is not pinned.
+    ///
+    /// Counts up from `cfg.first_cpu`, skipping `cfg.avoid_cpu`, and wraps around to core 0.
+    static int worker_cpu(const config& cfg, int worker, int cores) noexcept;
+
+    /// Call `f(i)` for each `i` in `[0, count)`, in parallel
+    ///
+    /// Blocks until all calls have returned. Must not be called concurrently from multiple threads.
+    ///
+    /// \requires `count <= max_tasks`
+    template<typename F>
+    void run(int count, F&& f) noexcept;
+
+    /// The maximum number of tasks per call to {@ref run}
+    static constexpr int max_tasks = 0xFFFF;
+
+  private:
+    using task_fn = void (*)(void* ctx, int index) noexcept;
+
+    void run_impl(int count, task_fn fn, void* ctx) noexcept;
+    void worker_main(int index) noexcept;
+    /// Claim and execute tasks of the current job until there are none left
+    void execute_tasks() noexcept;
+    /// Wait until `word != value`. Spins before sleeping.
+    void wait_while_equal(std::atomic<std::uint32_t>& word, std::uint32_t value, std::atomic<int>& sleepers) noexcept;
+
+    config config_;
+    std::vector<std::thread> workers_;
+    std::vector<setup_error> setup_errors_;
+
+    /// The current job. Written by the calling thread before the job is published.
+    task_fn fn_ = nullptr;
+    void* ctx_ = nullptr;
+    std::uint32_t generation_ = 0;
+
+    /// `generation << 32 | count << 16 | next index`. Tasks are claimed by incrementing this, so a worker that is
+    /// late to the previous job can never claim a task of the next one.
+    alignas(64) std::atomic<std::uint64_t> next_task_ = 0;
+    /// Incremented for each job, and when stopping. Workers wait on this.
+    alignas(64) std::atomic<std::uint32_t> wake_ = 0;
+    std::atomic<int> sleeping_workers_ = 0;
+    /// The number of tasks of the current job that have not finished. The calling thread waits on this.
+    alignas(64) std::atomic<std::uint32_t> remaining_ = 0;
+    std::atomic<int> sleeping_callers_ = 0;
+    std::atomic<bool> stop_ = false;
+  };
+
+  // IMPLEMENTATION //
+
+  template<typename F>
+  void realtime_worker_pool::run(int count, F&& f) noexcept
+  {
+    using Fn = std::remove_reference_t<F>;
+    static_assert(std::is_nothrow_invocable_v<Fn&, int>, "Tasks must be noexcept");
+    if (count <= 0) return;
+    if (workers_.empty() || count == 1) {
+      for (int i = 0; i < count; i++) f(i);
+      return;
+    }
+    run_impl(
+      count, [](void* ctx, int index) noexcept { (*static_cast<Fn*>(ctx))(index); },
+      const_cast<void*>(static_cast<const void*>(&f)));
+  }
+
+} // namespace otto::util
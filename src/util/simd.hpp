@@ -0,0 +1,350 @@
+#pragma once
+
+/// \file
+/// A minimal portable SIMD float vector.
+///
+/// The instruction set is chosen at compile time from the target flags:
+///  - AVX2 (`-mavx2`, or `-march=native` with `OTTO_NATIVE_ARCH`): 8 lanes
+///  - SSE2 (all x86_64 targets): 4 lanes
+///  - NEON (32 bit arm with `-mfpu=neon`, which the rpi-proto-1 board sets, and all aarch64 targets): 4 lanes
+///  - Otherwise a plain array of 4 floats, which compilers are generally able to vectorize.
+///
+/// All loads and stores must be aligned to {@ref vfloat::alignment}.
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define OTTO_SIMD_AVX2 1
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define OTTO_SIMD_SSE2 1
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define OTTO_SIMD_NEON 1
+#endif
+
+namespace otto::util::simd {
+
+#if defined(OTTO_SIMD_AVX2)
+
+  struct vfloat {
+    static constexpr std::size_t size = 8;
+    static constexpr std::size_t alignment = 32;
+
+    vfloat() = default;
+    vfloat(__m256 v) noexcept : v(v) {}
+    explicit vfloat(float f) noexcept : v(_mm256_set1_ps(f)) {}
+
+    static vfloat load(const float* ptr) noexcept
+    {
+      return _mm256_load_ps(ptr);
+    }
+
+    void store(float* ptr) const noexcept
+    {
+      _mm256_store_ps(ptr, v);
+    }
+
+    /// Store the lanes rounded towards zero. `ptr` must be aligned to {@ref alignment}
+    void store_truncated(std::int32_t* ptr) const noexcept
+    {
+      _mm256_store_si256(reinterpret_cast<__m256i*>(ptr), _mm256_cvttps_epi32(v));
+    }
+
+    friend vfloat operator+(vfloat a, vfloat b) noexcept
+    {
+      return _mm256_add_ps(a.v, b.v);
+    }
+    friend vfloat operator-(vfloat a, vfloat b) noexcept
+    {
+      return _mm256_sub_ps(a.v, b.v);
+    }
+    friend vfloat operator*(vfloat a, vfloat b) noexcept
+    {
+      return _mm256_mul_ps(a.v, b.v);
+    }
+
+    friend vfloat min(vfloat a, vfloat b) noexcept
+    {
+      return _mm256_min_ps(a.v, b.v);
+    }
+    friend vfloat max(vfloat a, vfloat b) noexcept
+    {
+      return _mm256_max_ps(a.v, b.v);
+    }
+
+    friend vfloat floor(vfloat a) noexcept
+    {
+      return _mm256_floor_ps(a.v);
+    }
+
+    __m256 v;
+  };
+
+#elif defined(OTTO_SIMD_SSE2)
+
+  struct vfloat {
+    static constexpr std::size_t size = 4;
+    static constexpr std::size_t alignment = 16;
+
+    vfloat() = default;
+    vfloat(__m128 v) noexcept : v(v) {}
+    explicit vfloat(float f) noexcept : v(_mm_set1_ps(f)) {}
+
+    static vfloat load(const float* ptr) noexcept
+    {
+      return _mm_load_ps(ptr);
+    }
+
+    void store(float* ptr) const noexcept
+    {
+      _mm_store_ps(ptr, v);
+    }
+
+    /// Store the lanes rounded towards zero. `ptr` must be aligned to {@ref alignment}
+    void store_truncated(std::int32_t* ptr) const noexcept
+    {
+      _mm_store_si128(reinterpret_cast<__m128i*>(ptr), _mm_cvttps_epi32(v));
+    }
+
+    friend vfloat operator+(vfloat a, vfloat b) noexcept
+    {
+      return _mm_add_ps(a.v, b.v);
+    }
+    friend vfloat operator-(vfloat a, vfloat b) noexcept
+    {
+      return _mm_sub_ps(a.v, b.v);
+    }
+    friend vfloat operator*(vfloat a, vfloat b) noexcept
+    {
+      return _mm_mul_ps(a.v, b.v);
+    }
+
+    friend vfloat min(vfloat a, vfloat b) noexcept
+    {
+      return _mm_min_ps(a.v, b.v);
+    }
+    friend vfloat max(vfloat a, vfloat b) noexcept
+    {
+      return _mm_max_ps(a.v, b.v);
+    }
+
+    /// SSE2 has no floor instruction, so truncate and correct for negative values
+    friend vfloat floor(vfloat a) noexcept
+    {
+      __m128 t = _mm_cvtepi32_ps(_mm_cvttps_epi32(a.v));
+      return _mm_sub_ps(t, _mm_and_ps(_mm_cmpgt_ps(t, a.v), _mm_set1_ps(1.f)));
+    }
+
+    __m128 v;
+  };
+
+#elif defined(OTTO_SIMD_NEON)
+
+  struct vfloat {
+    static constexpr std::size_t size = 4;
+    static constexpr std::size_t alignment = 16;
+
+    vfloat() = default;
+    vfloat(float32x4_t v) noexcept : v(v) {}
+    explicit vfloat(float f) noexcept : v(vdupq_n_f32(f)) {}
+
+    static vfloat load(const float* ptr) noexcept
+    {
+      return vld1q_f32(ptr);
+    }
+
+    void store(float* ptr) const noexcept
+    {
+      vst1q_f32(ptr, v);
+    }
+
+    /// Store the lanes rounded towards zero. `ptr` must be aligned to {@ref alignment}
+    void store_truncated(std::int32_t* ptr) const noexcept
+    {
+      vst1q_s32(ptr, vcvtq_s32_f32(v));
+    }
+
+    friend vfloat operator+(vfloat a, vfloat b) noexcept
+    {
+      return vaddq_f32(a.v, b.v);
+    }
+    friend vfloat operator-(vfloat a, vfloat b) noexcept
+    {
+      return vsubq_f32(a.v, b.v);
+    }
+    friend vfloat operator*(vfloat a, vfloat b) noexcept
+    {
+      return vmulq_f32(a.v, b.v);
+    }
+
+    friend vfloat min(vfloat a, vfloat b) noexcept
+    {
+      return vminq_f32(a.v, b.v);
+    }
+    friend vfloat max(vfloat a, vfloat b) noexcept
+    {
+      return vmaxq_f32(a.v, b.v);
+    }
+
+    /// ARMv7 NEON has no floor instruction, so truncate and correct for negative values
+    friend vfloat floor(vfloat a) noexcept
+    {
+      float32x4_t t = vcvtq_f32_s32(vcvtq_s32_f32(a.v));
+      uint32x4_t gt = vcgtq_f32(t, a.v);
+      return vsubq_f32(t, vreinterpretq_f32_u32(vandq_u32(gt, vreinterpretq_u32_f32(vdupq_n_f32(1.f)))));
+    }
+
+    float32x4_t v;
+  };
+
+#else
+
+  struct vfloat {
+    static constexpr std::size_t size = 4;
+    static constexpr std::size_t alignment = 16;
+
+    vfloat() = default;
+    explicit vfloat(float f) noexcept : v{f, f, f, f} {}
+
+    static vfloat load(const float* ptr) noexcept
+    {
+      vfloat res;
+      for (std::size_t i = 0; i < size; i++) res.v[i] = ptr[i];
+      return res;
+    }
+
+    void store(float* ptr) const noexcept
+    {
+      for (std::size_t i = 0; i < size; i++) ptr[i] = v[i];
+    }
+
+    /// Store the lanes rounded towards zero. `ptr` must be aligned to {@ref alignment}
+    void store_truncated(std::int32_t* ptr) const noexcept
+    {
+      for (std::size_t i = 0; i < size; i++) ptr[i] = std::int32_t(v[i]);
+    }
+
+    friend vfloat operator+(vfloat a, vfloat b) noexcept
+    {
+      for (std::size_t i = 0; i < size; i++) a.v[i] += b.v[i];
+      return a;
+    }
+    friend vfloat operator-(vfloat a, vfloat b) noexcept
+    {
+      for (std::size_t i = 0; i < size; i++) a.v[i] -= b.v[i];
+      return a;
+    }
+    friend vfloat operator*(vfloat a, vfloat b) noexcept
+    {
+      for (std::size_t i = 0; i < size; i++) a.v[i] *= b.v[i];
+      return a;
+    }
+
+    friend vfloat min(vfloat a, vfloat b) noexcept
+    {
+      for (std::size_t i = 0; i < size; i++) a.v[i] = std::min(a.v[i], b.v[i]);
+      return a;
+    }
+    friend vfloat max(vfloat a, vfloat b) noexcept
+    {
+      for (std::size_t i = 0; i < size; i++) a.v[i] = std::max(a.v[i], b.v[i]);
+      return a;
+    }
+
+    friend vfloat floor(vfloat a) noexcept
+    {
+      for (std::size_t i = 0; i < size; i++) a.v[i] = std::floor(a.v[i]);
+      return a;
+    }
+
+    alignas(alignment) std::array<float, size> v;
+  };
+
+#endif
+
+  /// The number of lanes needed to hold `n` values, rounded up to a whole number of vectors
+  constexpr std::size_t padded_size(std::size_t n) noexcept
+  {
+    return (n + vfloat::size - 1) / vfloat::size * vfloat::size;
+  }
+
+  /// Load `base[index[i]]` into lane `i`, for {@ref vfloat::size} indices aligned to {@ref vfloat::alignment}
+  ///
+  /// AVX2 has a gather instruction for this. SSE2 and NEON do not, so there the lanes are loaded one by one.
+  inline vfloat gather(const float* base, const std::int32_t* index) noexcept
+  {
+#if defined(OTTO_SIMD_AVX2)
+    return _mm256_i32gather_ps(base, _mm256_load_si256(reinterpret_cast<const __m256i*>(index)), sizeof(float));
+#else
+    alignas(vfloat::alignment) std::array<float, vfloat::size> lanes;
+    for (std::size_t i = 0; i < vfloat::size; i++) lanes[i] = base[index[i]];
+    return vfloat::load(lanes.data());
+#endif
+  }
+
+  /// Wrap a phase into the range `[-1, 1)`
+  inline vfloat wrap_phase(vfloat x) noexcept
+  {
+    const vfloat half{0.5f};
+    const vfloat one{1.f};
+    const vfloat two{2.f};
+    return x - two * floor((x + one) * half);
+  }
+
+  /// Vectorized version of `gam::scl::sinP9`
+  ///
+  /// 9th order polynomial approximation of `sin(pi * x)` for `x` in `[-1, 1]`
+  inline vfloat sinP9(vfloat x) noexcept
+  {
+    const vfloat c1{3.1415191f};
+    const vfloat c3{-5.1662729f};
+    const vfloat c5{2.5422065f};
+    const vfloat c7{-0.5811243f};
+    const vfloat c9{0.0636716f};
+    vfloat xx = x * x;
+    return x * (c1 + xx * (c3 + xx * (c5 + xx * (c7 + xx * c9))));
+  }
+
+  /// The sum of the lanes of `v`
+  inline float sum(vfloat v) noexcept
+  {
+    alignas(vfloat::alignment) std::array<float, vfloat::size> lanes;
+    v.store(lanes.data());
+    float res = 0;
+    for (float f : lanes) res += f;
+    return res;
+  }
+
+  /// Interleave two channels into `out`, as `l0 r0 l1 r1 ...`
+  ///
+  /// Unlike {@ref vfloat::load}, this does not require aligned pointers, since it is used on buffers
+  /// owned by the audio drivers.
+  inline void interleave(const float* l, const float* r, float* out, std::size_t n) noexcept
+  {
+    std::size_t i = 0;
+#if defined(OTTO_SIMD_AVX2) || defined(OTTO_SIMD_SSE2)
+    for (; i + 4 <= n; i += 4) {
+      __m128 a = _mm_loadu_ps(l + i);
+      __m128 b = _mm_loadu_ps(r + i);
+      _mm_storeu_ps(out + 2 * i, _mm_unpacklo_ps(a, b));
+      _mm_storeu_ps(out + 2 * i + 4, _mm_unpackhi_ps(a, b));
+    }
+#elif defined(OTTO_SIMD_NEON)
+    for (; i + 4 <= n; i += 4) {
+      float32x4x2_t v = {{vld1q_f32(l + i), vld1q_f32(r + i)}};
+      vst2q_f32(out + 2 * i, v);
+    }
+#endif
+    for (; i < n; i++) {
+      out[2 * i] = l[i];
+      out[2 * i + 1] = r[i];
+    }
+  }
+
+} // namespace otto::util::simd
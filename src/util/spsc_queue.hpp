@@ -0,0 +1,162 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <new>
+#include <optional>
+#include <type_traits>
+#include <utility>
+
+namespace otto::util {
+
+  /// A bounded, wait-free, single-producer/single-consumer queue
+  ///
+  /// All storage is inline, so pushing and popping never allocates. When the queue is full, pushes
+  /// fail and are counted in {@ref overflow_count()}. The number of elements in the queue after each
+  /// push is tracked in {@ref high_water_mark()}.
+  ///
+  /// Exactly one thread may push and exactly one thread may pop at any given time.
+  ///
+  /// @tparam Capacity must be a power of two
+  template<typename T, std::size_t Capacity>
+  struct spsc_queue {
+    static_assert(Capacity > 0 && (Capacity & (Capacity - 1)) == 0, "spsc_queue capacity must be a power of two");
+
+    using value_type = T;
+    static constexpr std::size_t capacity = Capacity;
+
+    spsc_queue() noexcept = default;
+    spsc_queue(const spsc_queue&) = delete;
+    spsc_queue& operator=(const spsc_queue&) = delete;
+
+    ~spsc_queue() noexcept
+    {
+      consume_all([](T&) {});
+    }
+
+    /// Construct an element at the back of the queue
+    ///
+    /// Producer only.
+    ///
+    /// @return `false` if the queue was full, in which case nothing was constructed
+    template<typename... Args>
+    bool try_emplace(Args&&... args) noexcept(std::is_nothrow_constructible_v<T, Args...>)
+    {
+      auto head = head_.load(std::memory_order_relaxed);
+      auto tail = tail_.load(std::memory_order_acquire);
+      if (head - tail >= Capacity) {
+        overflow_count_.fetch_add(1, std::memory_order_relaxed);
+        return false;
+      }
+      ::new (slot(head)) T(std::forward<Args>(args)...);
+      head_.store(head + 1, std::memory_order_release);
+      auto size = head + 1 - tail;
+      if (size > high_water_mark_.load(std::memory_order_relaxed)) {
+        high_water_mark_.store(size, std::memory_order_relaxed);
+      }
+      return true;
+    }
+
+    /// Push an element to the back of the queue
+    ///
+    /// Producer only.
+    bool try_push(const T& v) noexcept(std::is_nothrow_copy_constructible_v<T>)
+    {
+      return try_emplace(v);
+    }
+
+    /// Push an element to the back of the queue
+    ///
+    /// Producer only.
+    bool try_push(T&& v) noexcept(std::is_nothrow_move_constructible_v<T>)
+    {
+      return try_emplace(std::move(v));
+    }
+
+    /// Pop the front element off the queue
+    ///
+    /// Consumer only.
+    ///
+    /// @return `std::nullopt` if the queue was empty
+    std::optional<T> try_pop() noexcept(std::is_nothrow_move_constructible_v<T>)
+    {
+      auto tail = tail_.load(std::memory_order_relaxed);
+      if (tail == head_.load(std::memory_order_acquire)) return std::nullopt;
+      T* ptr = slot(tail);
+      std::optional<T> res = std::move(*ptr);
+      ptr->~T();
+      tail_.store(tail + 1, std::memory_order_release);
+      return res;
+    }
+
+    /// Call `f` with each element currently in the queue, and pop them
+    ///
+    /// Elements pushed while this is running are left for the next call, so the amount of work is
+    /// bounded by the queue size when the call started.
+    ///
+    /// Consumer only.
+    ///
+    /// @return the number of elements consumed
+    template<typename F>
+    std::size_t consume_all(F&& f) noexcept(std::is_nothrow_invocable_v<F&, T&>)
+    {
+      auto tail = tail_.load(std::memory_order_relaxed);
+      auto head = head_.load(std::memory_order_acquire);
+      for (auto i = tail; i != head; i++) {
+        T* ptr = slot(i);
+        f(*ptr);
+        ptr->~T();
+        tail_.store(i + 1, std::memory_order_release);
+      }
+      return head - tail;
+    }
+
+    /// The number of elements in the queue.
+    ///
+    /// This is only a snapshot when called from a thread that is neither the producer nor the consumer.
+    std::size_t size() const noexcept
+    {
+      return head_.load(std::memory_order_acquire) - tail_.load(std::memory_order_acquire);
+    }
+
+    bool empty() const noexcept
+    {
+      return size() == 0;
+    }
+
+    /// The number of pushes that failed because the queue was full
+    std::size_t overflow_count() const noexcept
+    {
+      return overflow_count_.load(std::memory_order_relaxed);
+    }
+
+    /// The largest number of elements that have been in the queue at once
+    std::size_t high_water_mark() const noexcept
+    {
+      return high_water_mark_.load(std::memory_order_relaxed);
+    }
+
+    /// Reset the overflow count and high water mark
+    void reset_statistics() noexcept
+    {
+      overflow_count_.store(0, std::memory_order_relaxed);
+      high_water_mark_.store(0, std::memory_order_relaxed);
+    }
+
+  private:
+    T* slot(std::size_t index) noexcept
+    {
+      return std::launder(reinterpret_cast<T*>(&storage_[index & (Capacity - 1)]));
+    }
+
+    static constexpr std::size_t cache_line = 64;
+
+    alignas(cache_line) std::atomic<std::size_t> head_ = 0;
+    alignas(cache_line) std::atomic<std::size_t> tail_ = 0;
+    alignas(cache_line) std::atomic<std::size_t> overflow_count_ = 0;
+    std::atomic<std::size_t> high_water_mark_ = 0;
+    alignas(cache_line) std::array<std::aligned_storage_t<sizeof(T), alignof(T)>, Capacity> storage_;
+  };
+
+} // namespace otto::util
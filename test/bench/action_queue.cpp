@@ -0,0 +1,30 @@
+#include "testing.t.hpp"
+
+#include "itc/action_queue.hpp"
+
+namespace otto::itc {
+
+  TEST_CASE ("ActionQueue throughput", "[benchmarks][itc]") {
+    using float_action = Action<struct bench_float_action_tag, float>;
+    struct FloatAR {
+      void action(float_action, float f)
+      {
+        value += f;
+      }
+      float value = 0;
+    } ar;
+
+    ActionQueue q;
+    // From a single prop change up to a full queue, like when a preset is loaded
+    for (int burst : {1, 64, int(ActionQueue::capacity)}) {
+      BENCHMARK (fmt::format("ActionQueue: push/pop {} actions", burst)) {
+        for (int i = 0; i < burst; i++) {
+          q.push(ar, float_action::data(i));
+        }
+        q.pop_call_all();
+        return ar.value;
+      };
+    }
+  }
+
+} // namespace otto::itc
@@ -0,0 +1,27 @@
+#include "testing.t.hpp"
+
+#include "core/audio/audio_buffer_pool.hpp"
+
+namespace otto::core::audio {
+
+  TEST_CASE ("AudioBufferPool allocation", "[benchmarks][audio]") {
+    AudioBufferPool pool{256};
+
+    BENCHMARK ("allocate + release") {
+      return pool.allocate().data();
+    };
+
+    BENCHMARK ("allocate_clear + release") {
+      return pool.allocate_clear().data();
+    };
+
+    BENCHMARK ("allocate_multi<2> + release") {
+      return pool.allocate_multi<2>()[0].data();
+    };
+
+    BENCHMARK ("allocate_multi<8> + release") {
+      return pool.allocate_multi<8>()[7].data();
+    };
+  }
+
+} // namespace otto::core::audio
@@ -0,0 +1,21 @@
+#include "testing.t.hpp"
+
+#include "dummy_services.hpp"
+
+namespace otto::services::test {
+
+  TEST_CASE ("EngineManager::process", "[benchmarks][services]") {
+    auto app = make_dummy_application_default_engines();
+
+    app.engine_manager->start();
+    app.audio_manager->start();
+
+    for (int bs : {16, 64, 256, 1024}) {
+      DummyAudioManager::current().set_bs_sr(bs, 44100);
+      BENCHMARK (fmt::format("AudioManager::process, bs = {}", bs)) {
+        return DummyAudioManager::current().process();
+      };
+    }
+  }
+
+} // namespace otto::services::test
@@ -0,0 +1,106 @@
+#include "testing.t.hpp"
+
+#include "dummy_services.hpp"
+
+#include "engines/fx/chorus/chorus.hpp"
+#include "engines/fx/wormhole/wormhole.hpp"
+#include "engines/synths/OTTOFM/ottofm.hpp"
+#include "engines/synths/goss/goss.hpp"
+#include "engines/synths/stream_sampler/stream_sampler.hpp"
+#include "engines/synths/wavetable/wavetable.hpp"
+
+namespace otto::services::test {
+
+  using namespace otto::engines;
+  using core::voices::PlayMode;
+
+  /// Benchmark a synth with 1, 3 and 6 held keys in each play mode
+  template<typename Engine>
+  void benchmark_synth()
+  {
+    for (PlayMode pm : PlayMode::_values()) {
+      for (int keys : {1, 3, 6}) {
+        auto engine = std::make_unique<Engine>();
+        auto& audio = *engine->audio;
+        DummyAudioManager::current().run_actions();
+        itc::call_receiver(audio, core::voices::play_mode_tag::action::data(pm));
+
+        auto& pool = AudioManager::current().buffer_pool();
+        core::midi::MidiBuffer notes;
+        // A chord of stacked fourths, so no two keys are the same note in interval mode
+        for (int i = 0; i < keys; i++) notes.push(core::midi::NoteOnEvent(48 + 5 * i));
+        audio.process({pool.allocate_clear(), notes});
+
+        BENCHMARK (fmt::format("{}::process, {}, {} keys", Engine::name, pm._to_string(), keys)) {
+          return audio.process({pool.allocate_clear()});
+        };
+      }
+    }
+  }
+
+  template<typename Engine>
+  void benchmark_fx()
+  {
+    for (int bs : {64, 256, 1024}) {
+      DummyAudioManager::current().set_bs_sr(bs, 44100);
+      auto engine = std::make_unique<Engine>();
+      auto& audio = *engine->audio;
+      DummyAudioManager::current().run_actions();
+
+      auto& pool = AudioManager::current().buffer_pool();
+      auto in = pool.allocate();
+      for (auto& f : in) f = Random::get(-1.f, 1.f);
+
+      BENCHMARK (fmt::format("{}::process, bs = {}", std::string(Engine::name), bs)) {
+        return audio.process({in});
+      };
+    }
+    DummyAudioManager::current().set_bs_sr(256, 44100);
+  }
+
+  /// Benchmark the feedback delay network of the Wormhole against its classic reverb, with and without shimmer
+  void benchmark_wormhole()
+  {
+    for (bool classic : {true, false}) {
+      for (float shimmer : {0.f, 0.5f}) {
+        for (int bs : {64, 128, 256, 512}) {
+          DummyAudioManager::current().set_bs_sr(bs, 44100);
+          auto engine = std::make_unique<wormhole::Wormhole>();
+          engine->props.classic.set(classic);
+          engine->props.shimmer.set(shimmer);
+          auto& audio = *engine->audio;
+          DummyAudioManager::current().run_actions();
+
+          auto& pool = AudioManager::current().buffer_pool();
+          auto in = pool.allocate();
+          for (auto& f : in) f = Random::get(-1.f, 1.f);
+
+          BENCHMARK (fmt::format("Wormhole::process, {}, shimmer = {}, bs = {}", classic ? "classic" : "FDN", shimmer,
+                                 bs)) {
+            return audio.process({in});
+          };
+        }
+      }
+    }
+    DummyAudioManager::current().set_bs_sr(256, 44100);
+  }
+
+  TEST_CASE ("Synth engines", "[benchmarks][engines]") {
+    auto app = make_dummy_application();
+    app.audio_manager->start();
+
+    benchmark_synth<ottofm::OttofmEngine>();
+    benchmark_synth<goss::GossEngine>();
+    benchmark_synth<wavetable::WavetableEngine>();
+    benchmark_synth<stream_sampler::StreamSamplerEngine>();
+  }
+
+  TEST_CASE ("Effect engines", "[benchmarks][engines]") {
+    auto app = make_dummy_application();
+    app.audio_manager->start();
+
+    benchmark_wormhole();
+    benchmark_fx<chorus::Chorus>();
+  }
+
+} // namespace otto::services::test
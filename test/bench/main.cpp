@@ -0,0 +1,24 @@
+#define CATCH_CONFIG_RUNNER
+#include "testing.t.hpp"
+
+#include "core/audio/midi.hpp"
+
+/// Runs the benchmarks, reporting to CSV unless another reporter is requested with `-r`.
+///
+/// ```sh
+/// bench -o benchmarks.csv
+/// bench "[engines]" -r console
+/// ```
+int main(int argc, char* argv[])
+{
+  using namespace otto;
+  core::midi::generateFreqTable();
+
+  Catch::Session session;
+  session.configData().reporterName = "benchmarks.csv";
+  int result = session.applyCommandLine(argc, argv);
+  if (result != 0) return result;
+
+  result = session.run();
+  return (result < 0xff ? result : 0xff);
+}
@@ -0,0 +1,43 @@
+#include "testing.t.hpp"
+
+#include "util/dsp/sample.hpp"
+
+namespace otto::dsp {
+
+  TEST_CASE ("Sample playback", "[benchmarks][dsp]") {
+    // 10 seconds of noise
+    std::vector<float> data(441000);
+    for (auto& f : data) f = Random::get(-1.f, 1.f);
+    Sample sample{data};
+    sample.fade_in_time(1000);
+    sample.fade_out_time(1000);
+    sample.loop = true;
+
+    std::vector<float> out(256);
+
+    for (float speed : {1.f, 0.7f, -1.5f}) {
+      sample.playback_speed(speed);
+
+      BENCHMARK (fmt::format("Sample::iterator, 256 frames at speed {}", speed)) {
+        auto iter = sample.begin();
+        for (auto& f : out) {
+          f = *iter;
+          ++iter;
+        }
+        return out[0];
+      };
+
+      using Interpolation = Sample::Interpolation;
+      for (auto [interpolation, name] : {std::pair{Interpolation::linear, "linear"},
+                                         std::pair{Interpolation::hermite, "hermite"},
+                                         std::pair{Interpolation::sinc, "sinc"}}) {
+        auto playhead = sample.playhead();
+        BENCHMARK (fmt::format("Sample::render, 256 frames at speed {}, {}", speed, name)) {
+          sample.render(out, playhead, interpolation);
+          return out[0];
+        };
+      }
+    }
+  }
+
+} // namespace otto::dsp
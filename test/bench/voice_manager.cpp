@@ -0,0 +1,78 @@
+#include "testing.t.hpp"
+
+#include "core/voices/voice_manager.hpp"
+
+namespace otto::core::voices {
+
+  namespace {
+    /// Does no dsp, so only the voice allocation is measured
+    struct BenchVoice : VoiceBase<BenchVoice> {
+      float operator()() noexcept
+      {
+        return 0;
+      }
+    };
+
+    /// Dense MIDI: chords, glissandi and the sustain pedal, as played in a busy block
+    std::vector<midi::AnyMidiEvent> dense_midi()
+    {
+      std::vector<midi::AnyMidiEvent> res;
+      auto chord = [&](int root) {
+        for (int i : {0, 4, 7, 11, 14, 17}) res.push_back(midi::NoteOnEvent(root + i));
+      };
+      auto chord_off = [&](int root) {
+        for (int i : {0, 4, 7, 11, 14, 17}) res.push_back(midi::NoteOffEvent(root + i));
+      };
+      // Overlapping chords
+      chord(36);
+      chord(43);
+      chord_off(36);
+      chord(48);
+      chord_off(43);
+      chord_off(48);
+      // A glissando up and down, with every key overlapping the next
+      for (int k = 30; k < 100; k++) {
+        res.push_back(midi::NoteOnEvent(k + 1));
+        res.push_back(midi::NoteOffEvent(k));
+      }
+      for (int k = 100; k > 30; k--) {
+        res.push_back(midi::NoteOnEvent(k - 1));
+        res.push_back(midi::NoteOffEvent(k));
+      }
+      res.push_back(midi::NoteOffEvent(30));
+      // Chords and a glissando held with the sustain pedal
+      res.push_back(midi::ControlChangeEvent(0x40, 127));
+      for (int root = 24; root < 84; root += 5) {
+        chord(root);
+        chord_off(root);
+      }
+      for (int k = 40; k < 90; k++) {
+        res.push_back(midi::NoteOnEvent(k));
+        res.push_back(midi::NoteOffEvent(k));
+      }
+      res.push_back(midi::ControlChangeEvent(0x40, 0));
+      return res;
+    }
+
+    template<int N>
+    void benchmark_voice_manager()
+    {
+      auto events = dense_midi();
+      for (PlayMode pm : PlayMode::_values()) {
+        VoiceManager<BenchVoice, N> vm;
+        itc::call_receiver(vm, play_mode_tag::action::data(pm));
+        BENCHMARK (fmt::format("VoiceManager<{}>::handle_midi, {}, {} events", N, pm._to_string(), events.size())) {
+          for (auto& e : events) vm.handle_midi(e);
+          return vm.sounding_voice_count();
+        };
+      }
+    }
+  } // namespace
+
+  TEST_CASE ("VoiceManager allocation", "[benchmarks][voices]") {
+    benchmark_voice_manager<16>();
+    benchmark_voice_manager<32>();
+    benchmark_voice_manager<64>();
+  }
+
+} // namespace otto::core::voices
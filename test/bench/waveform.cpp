@@ -0,0 +1,51 @@
+#include "testing.t.hpp"
+
+#include <AudioFile.h>
+
+#include "core/audio/waveform.hpp"
+
+namespace otto::core::audio {
+
+  TEST_CASE ("Waveform views", "[benchmarks][audio]") {
+    // 10 seconds of noise
+    std::vector<float> data(441000);
+    for (auto& f : data) f = Random::get(-1.f, 1.f);
+
+    BENCHMARK ("Waveform construction, 10 s") {
+      Waveform wf{data, 200};
+      wf.wait();
+      return wf.view(200, 0, data.size()).size();
+    };
+
+    Waveform wf{data, 200};
+    wf.wait();
+    auto view = wf.view(200, 0, data.size());
+    // From the whole file down to a single buffer
+    for (int length : {int(data.size()), 44100, 4410, 256}) {
+      BENCHMARK (fmt::format("Waveform::view, 200 points of {} samples", length)) {
+        return wf.view(view, 0, length).size();
+      };
+    }
+
+    // The first time a file is opened, its peaks are built and cached. After that, they are loaded
+    auto file = fs::path("/tmp/otto_waveform_bench.wav");
+    AudioFile<float> audio;
+    audio.setAudioBufferSize(1, data.size());
+    audio.samples[0] = data;
+    audio.save(file.string());
+    BENCHMARK ("Waveform of a 10 s file, built") {
+      fs::remove("/tmp/otto_waveform_bench.wav.peaks");
+      Waveform wf{file, 200};
+      wf.wait();
+      return wf.size();
+    };
+    BENCHMARK ("Waveform of a 10 s file, cached") {
+      Waveform wf{file, 200};
+      wf.wait();
+      return wf.size();
+    };
+    fs::remove(file);
+    fs::remove("/tmp/otto_waveform_bench.wav.peaks");
+  }
+
+} // namespace otto::core::audio
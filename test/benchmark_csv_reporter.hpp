@@ -2,11 +2,71 @@
 
 //#include "testing.t.hpp"
 
+#include <ctime>
+#include <fstream>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <sys/utsname.h>
+
+#ifndef OTTO_GIT_REVISION
+#define OTTO_GIT_REVISION "unknown"
+#endif
+
+#ifndef OTTO_BUILD_TYPE
+#define OTTO_BUILD_TYPE "unknown"
+#endif
+
 namespace Catch {
 
+  /// Key/value pairs describing the machine and build the benchmarks ran on
+  inline std::vector<std::pair<std::string, std::string>> machine_metadata()
+  {
+    std::vector<std::pair<std::string, std::string>> res;
+
+    std::time_t now = std::time(nullptr);
+    char date[32];
+    std::strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%SZ", std::gmtime(&now));
+    res.emplace_back("date", date);
+    res.emplace_back("revision", OTTO_GIT_REVISION);
+    res.emplace_back("build_type", OTTO_BUILD_TYPE);
+#if defined(__clang__)
+    res.emplace_back("compiler", "clang " __clang_version__);
+#elif defined(__GNUC__)
+    res.emplace_back("compiler", "gcc " __VERSION__);
+#endif
+
+    utsname uts;
+    if (uname(&uts) == 0) {
+      res.emplace_back("os", fmt::format("{} {}", uts.sysname, uts.release));
+      res.emplace_back("arch", uts.machine);
+    }
+
+    // x86 has "model name" per core, the Raspberry Pi has a single "Model" line
+    std::ifstream cpuinfo("/proc/cpuinfo");
+    for (std::string line; std::getline(cpuinfo, line);) {
+      if (line.rfind("model name", 0) == 0 || line.rfind("Model", 0) == 0) {
+        auto value = line.substr(line.find(':') + 1);
+        res.emplace_back("cpu", value.substr(value.find_first_not_of(' ')));
+        break;
+      }
+    }
+    res.emplace_back("cores", std::to_string(std::thread::hardware_concurrency()));
+    return res;
+  }
+
+  /// Reports only benchmarks, as CSV.
+  ///
+  /// The file starts with the {@ref machine_metadata} as `# key: value` comment lines, so runs from different
+  /// machines and releases can be diffed. Times are in nanoseconds.
   struct BenchmarkCSVReporter : StreamingReporterBase<BenchmarkCSVReporter> {
-    BenchmarkCSVReporter(ReporterConfig const& _config) : StreamingReporterBase(_config) {
-      stream << "Name, Iterations, Mean (ns), StdDev (ns)\n";
+    BenchmarkCSVReporter(ReporterConfig const& _config) : StreamingReporterBase(_config)
+    {
+      for (auto& [key, value] : machine_metadata()) {
+        stream << fmt::format("# {}: {}\n", key, value);
+      }
+      stream << "test_case,name,samples,iterations,mean_ns,mean_low_ns,mean_high_ns,stddev_ns\n";
     }
 
     static std::string getDescription()
@@ -30,7 +90,11 @@ namespace Catch {
     }
     void benchmarkEnded(BenchmarkStats<> const& stats) override
     {
-      stream << fmt::format("\"{}\", {}, {}, {}\n", stats.info.name, stats.info.iterations, stats.mean.point.count(), stats.standardDeviation.point.count());
+      stream << fmt::format("\"{}\",\"{}\",{},{},{:.3f},{:.3f},{:.3f},{:.3f}\n", currentTestCaseInfo->name,
+                            stats.info.name, stats.info.samples, stats.info.iterations, stats.mean.point.count(),
+                            stats.mean.lower_bound.count(), stats.mean.upper_bound.count(),
+                            stats.standardDeviation.point.count());
+      stream.flush();
     }
     void benchmarkFailed(std::string const& str) override
     {
@@ -0,0 +1,145 @@
+#include "testing.t.hpp"
+
+#include <cstdint>
+#include <set>
+#include <thread>
+
+#include "core/audio/audio_buffer_pool.hpp"
+
+namespace otto::core::audio {
+
+  TEST_CASE ("AudioBufferPool", "[audio]") {
+    AudioBufferPool pool{100, 4};
+
+    SECTION ("Buffers are aligned and distinct") {
+      auto bufs = pool.allocate_multi<4>();
+      std::set<float*> ptrs;
+      for (auto& b : bufs) {
+        REQUIRE(b.size() == 100);
+        REQUIRE(reinterpret_cast<std::uintptr_t>(b.data()) % AudioBufferPool::alignment == 0);
+        ptrs.insert(b.data());
+      }
+      REQUIRE(ptrs.size() == 4);
+      REQUIRE(pool.in_use() == 4);
+    }
+
+    SECTION ("The last handle returns the buffer to the pool") {
+      float* ptr;
+      {
+        auto a = pool.allocate();
+        ptr = a.data();
+        auto b = a;
+        REQUIRE(a.reference_count() == 2);
+        a.release();
+        REQUIRE(b.reference_count() == 1);
+        REQUIRE(pool.in_use() == 1);
+      }
+      REQUIRE(pool.in_use() == 0);
+      // The free list is LIFO
+      REQUIRE(pool.allocate().data() == ptr);
+    }
+
+    SECTION ("Assignment releases the previous buffer") {
+      auto a = pool.allocate();
+      auto b = pool.allocate();
+      auto c = pool.allocate();
+      b = a;
+      REQUIRE(a.reference_count() == 2);
+      REQUIRE(pool.in_use() == 2);
+      c = std::move(a);
+      REQUIRE(c.reference_count() == 2);
+      REQUIRE(pool.in_use() == 1);
+      auto& b_ref = b;
+      b = b_ref;
+      REQUIRE(b.reference_count() == 2);
+      c = std::move(b);
+      REQUIRE(c.reference_count() == 1);
+      REQUIRE(pool.in_use() == 1);
+    }
+
+    SECTION ("Slices keep the buffer alive") {
+      auto s = pool.allocate().slice(10, 20);
+      REQUIRE(s.size() == 20);
+      REQUIRE(s.reference_count() == 1);
+      REQUIRE(pool.in_use() == 1);
+      s.release();
+      REQUIRE(pool.in_use() == 0);
+    }
+
+    SECTION ("maintain grows the pool when usage gets close to the capacity") {
+      pool.maintain();
+      REQUIRE(pool.capacity() == 4);
+      {
+        auto bufs = pool.allocate_multi<2>();
+      }
+      pool.maintain();
+      REQUIRE(pool.capacity() >= 2 + AudioBufferPool::growth_headroom);
+      REQUIRE(pool.statistics().emergency_allocations == 0);
+    }
+
+    SECTION ("Running out takes buffers from the emergency reserve, which maintain refills") {
+      REQUIRE(pool.statistics().reserve_left == AudioBufferPool::emergency_reserve);
+      {
+        auto bufs = pool.allocate_multi<6>();
+        auto stats = pool.statistics();
+        // The buffers from the reserve join the pool
+        REQUIRE(stats.capacity == 6);
+        REQUIRE(stats.in_use == 6);
+        REQUIRE(stats.emergency_allocations == 2);
+        REQUIRE(stats.reserve_left == AudioBufferPool::emergency_reserve - 2);
+        std::set<float*> ptrs;
+        for (auto& b : bufs) {
+          REQUIRE(reinterpret_cast<std::uintptr_t>(b.data()) % AudioBufferPool::alignment == 0);
+          ptrs.insert(b.data());
+        }
+        REQUIRE(ptrs.size() == 6);
+      }
+      REQUIRE(pool.in_use() == 0);
+      pool.maintain();
+      auto stats = pool.statistics();
+      REQUIRE(stats.reserve_left == AudioBufferPool::emergency_reserve);
+      REQUIRE(stats.capacity >= 6 + AudioBufferPool::growth_headroom);
+    }
+
+    SECTION ("Statistics per block") {
+      {
+        auto bufs = pool.allocate_multi<3>();
+      }
+      pool.allocate();
+      pool.end_block();
+      auto stats = pool.statistics();
+      REQUIRE(stats.allocations_last_block == 4);
+      REQUIRE(stats.peak_in_use == 3);
+      pool.end_block();
+      stats = pool.statistics();
+      REQUIRE(stats.allocations_last_block == 0);
+      REQUIRE(stats.peak_allocations_per_block == 4);
+    }
+
+    SECTION ("set_buffer_size reallocates the buffers") {
+      pool.set_buffer_size(33);
+      auto b = pool.allocate();
+      REQUIRE(b.size() == 33);
+      REQUIRE(reinterpret_cast<std::uintptr_t>(b.data()) % AudioBufferPool::alignment == 0);
+      REQUIRE(pool.capacity() == 4);
+    }
+
+    SECTION ("Buffers can be allocated from multiple threads at once") {
+      auto worker = [&] {
+        for (int i = 0; i < 10000; i++) {
+          auto a = pool.allocate();
+          auto b = pool.allocate();
+          a[0] = 1;
+          b = a;
+        }
+      };
+      std::thread t1{worker};
+      std::thread t2{worker};
+      t1.join();
+      t2.join();
+      REQUIRE(pool.in_use() == 0);
+      REQUIRE(pool.statistics().peak_in_use <= 4);
+    }
+  }
+
+} // namespace otto::core::audio
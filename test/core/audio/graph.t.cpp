@@ -0,0 +1,316 @@
+#include "testing.t.hpp"
+
+#include "core/audio/graph.hpp"
+
+namespace otto::core::audio {
+
+  using Buffers = AudioGraph::Buffers;
+  using Data = ProcessData<0>;
+  using ErrorCode = AudioGraphBuilder::ErrorCode;
+
+  namespace {
+    /// A node process function that fills all outputs with `value`
+    AudioGraph::ProcessFunc fill(float value)
+    {
+      return [value](Buffers&, Buffers& out, Data&) {
+        for (auto& buf : out) std::fill(buf.begin(), buf.end(), value);
+      };
+    }
+
+    /// A node process function that writes the sum of all inputs to all outputs
+    AudioGraph::ProcessFunc sum()
+    {
+      return [](Buffers& in, Buffers& out, Data& data) {
+        for (int i = 0; i < data.nframes; i++) {
+          float s = 0;
+          for (auto& buf : in) s += buf[i];
+          for (auto& buf : out) buf[i] = s;
+        }
+      };
+    }
+
+    ErrorCode compile_error(const AudioGraphBuilder& b, int budget = 8)
+    {
+      try {
+        b.compile(budget);
+      } catch (AudioGraphBuilder::exception& e) {
+        return e.data();
+      }
+      FAIL("The graph compiled");
+      return {};
+    }
+  } // namespace
+
+  TEST_CASE ("AudioGraph", "[audio]") {
+    AudioBufferPool pool{16};
+    std::array<float, 16> in_storage = {};
+    std::atomic_int in_refs = 0;
+    AudioBufferHandle in_buf = {in_storage.data(), in_storage.size(), in_refs};
+
+    SECTION ("Nodes run after their inputs, and otherwise in declaration order") {
+      AudioGraphBuilder b;
+      auto a = b.bus("a", 1);
+      auto c = b.bus("c", 1);
+      auto out = b.bus("out", 2);
+      b.node("last", {a, c}, {out}, sum());
+      b.node("c", {a}, {c}, sum());
+      b.node("a", {}, {a}, fill(1));
+      b.output(out);
+      auto g = b.compile(8);
+      REQUIRE(g->node_order() == std::vector<std::string>{"a", "c", "last"});
+      auto res = g->process(ProcessData<1>(in_buf), pool);
+      REQUIRE(res.audio[0][0] == 2);
+      REQUIRE(res.audio[1][15] == 2);
+    }
+
+    SECTION ("Busses that are not alive at the same time share buffers") {
+      AudioGraphBuilder b;
+      // A chain of 6 mono stages, each only reading the previous one
+      auto prev = b.bus("0", 1);
+      b.node("0", {}, {prev}, fill(1));
+      for (int i = 1; i < 6; i++) {
+        auto next = b.bus(std::to_string(i), 1);
+        b.node(std::to_string(i), {prev}, {next}, sum());
+        prev = next;
+      }
+      auto out = b.bus("out", 2);
+      b.node("out", {prev}, {out}, sum());
+      b.output(out);
+      auto g = b.compile(8);
+      REQUIRE(g->slot_count() == 3);
+
+      SECTION ("In place nodes can reuse the buffers of their inputs") {
+        AudioGraphBuilder b2;
+        auto a = b2.bus("a", 2);
+        auto out2 = b2.bus("out", 2);
+        b2.node("a", {}, {a}, fill(1));
+        b2.node("out", {a}, {out2}, sum(), {true, 0});
+        b2.output(out2);
+        REQUIRE(b2.compile(8)->slot_count() == 2);
+      }
+
+      SECTION ("In place outputs may alias inputs that are read later in the same frame") {
+        AudioGraphBuilder b2;
+        auto dry = b2.bus("dry", 1);
+        auto wet = b2.bus("wet", 2);
+        auto out2 = b2.bus("out", 2);
+        b2.node("dry", {}, {dry}, fill(1));
+        b2.node("wet", {}, {wet}, [](Buffers&, Buffers& out, Data&) {
+          std::fill(out[0].begin(), out[0].end(), 2.f);
+          std::fill(out[1].begin(), out[1].end(), 3.f);
+        });
+        bool aliased = false;
+        b2.node("mix", {dry, wet}, {out2}, [&aliased](Buffers& in, Buffers& out, Data&) {
+          aliased = out[0].data() == in[0].data();
+          for (auto&& [d, wL, wR, l, r] : util::zip(in[0], in[1], in[2], out[0], out[1])) {
+            const float s = d;
+            l = wL + s * 0.5;
+            r = wR + s * 0.5;
+          }
+        }, {true, 0});
+        b2.output(out2);
+        auto res = b2.compile(8)->process(ProcessData<1>(in_buf), pool);
+        // The left output shares its buffer with the dry input, which the right channel reads after
+        REQUIRE(aliased);
+        REQUIRE(res.audio[0][7] == 2.5);
+        REQUIRE(res.audio[1][7] == 3.5);
+      }
+    }
+
+    SECTION ("Processing holds only the output buffers afterwards") {
+      AudioGraphBuilder b;
+      auto a = b.bus("a", 2);
+      auto c = b.bus("c", 2);
+      auto out = b.bus("out", 2);
+      b.node("a", {b.input()}, {a}, sum());
+      b.node("c", {a}, {c}, sum());
+      b.node("out", {a, c}, {out}, sum());
+      b.output(out);
+      auto g = b.compile(8);
+      in_storage.fill(0.5);
+      auto res = g->process(ProcessData<1>(in_buf), pool);
+      // a = 0.5, c = 0.5 + 0.5, out = 0.5 + 0.5 + 1 + 1
+      REQUIRE(res.audio[0][3] == 3);
+      // Everything but the output is released, so the pool can hand out the rest
+      auto rest = pool.allocate_multi<AudioBufferPool::number_of_buffers - 2>();
+      REQUIRE(rest[0].data() != res.audio[0].data());
+    }
+
+    SECTION ("The output can be rendered into external buffers") {
+      AudioGraphBuilder b;
+      auto a = b.bus("a", 2);
+      auto out = b.bus("out", 2);
+      b.node("a", {}, {a}, fill(1));
+      b.node("out", {a}, {out}, sum());
+      b.output(out);
+      auto g = b.compile(8);
+      alignas(64) std::array<std::array<float, 16>, 2> device = {};
+      std::atomic_int device_refs = 0;
+      std::array<AudioBufferHandle, 2> device_bufs = {AudioBufferHandle{device[0].data(), 16, device_refs},
+                                                      AudioBufferHandle{device[1].data(), 16, device_refs}};
+      auto res = g->process(ProcessData<1>(in_buf), pool, nullptr, &device_bufs);
+      REQUIRE(res.audio[0].data() == device[0].data());
+      REQUIRE(res.audio[1].data() == device[1].data());
+      REQUIRE(device[0][15] == 2);
+      REQUIRE(device[1][0] == 2);
+      REQUIRE(pool.in_use() == 0);
+    }
+
+    SECTION ("Scratch buffers count towards the budget") {
+      AudioGraphBuilder b;
+      auto out = b.bus("out", 2);
+      b.node("out", {}, {out}, fill(0), {false, 3});
+      b.output(out);
+      REQUIRE(b.compile(5)->peak_buffer_usage() == 5);
+      REQUIRE(compile_error(b, 4) == ErrorCode::too_many_buffers);
+    }
+
+    SECTION ("Invalid graphs are rejected") {
+      AudioGraphBuilder b;
+      auto a = b.bus("a", 1);
+      auto out = b.bus("out", 2);
+
+      SECTION ("Cycles") {
+        b.node("a", {out}, {a}, sum());
+        b.node("out", {a}, {out}, sum());
+        b.output(out);
+        REQUIRE(compile_error(b) == ErrorCode::cycle);
+      }
+
+      SECTION ("Reading a bus nobody writes") {
+        b.node("out", {a}, {out}, sum());
+        b.output(out);
+        REQUIRE(compile_error(b) == ErrorCode::no_producer);
+      }
+
+      SECTION ("Writing a bus twice") {
+        b.node("a1", {}, {a}, fill(1));
+        b.node("a2", {}, {a}, fill(1));
+        b.node("out", {a}, {out}, sum());
+        b.output(out);
+        REQUIRE(compile_error(b) == ErrorCode::multiple_producers);
+      }
+
+      SECTION ("Mono output") {
+        b.node("a", {}, {a}, fill(1));
+        b.output(a);
+        REQUIRE(compile_error(b) == ErrorCode::invalid_output);
+      }
+    }
+  }
+
+  TEST_CASE ("AudioGraph parallel schedule", "[audio]") {
+    AudioBufferPool pool{16};
+    std::array<float, 16> in_storage = {};
+    std::atomic_int in_refs = 0;
+    AudioBufferHandle in_buf = {in_storage.data(), in_storage.size(), in_refs};
+
+    // input -> a -> {b, c} -> out
+    AudioGraphBuilder builder;
+    auto a = builder.bus("a", 1);
+    auto b = builder.bus("b", 1);
+    auto c = builder.bus("c", 2);
+    auto out = builder.bus("out", 2);
+    builder.node("a", {builder.input()}, {a}, sum());
+    builder.node("b", {a}, {b}, sum(), {true, 0});
+    builder.node("c", {a}, {c}, sum(), {true, 0});
+    builder.node("out", {b, c}, {out}, sum(), {true, 0});
+    builder.output(out);
+
+    auto serial = builder.compile(8);
+    auto parallel = builder.compile(8, AudioGraphBuilder::Schedule::parallel);
+    REQUIRE(serial->stage_count() == 4);
+    REQUIRE(parallel->stage_count() == 3);
+    // In the serial schedule, c can reuse the buffer of a. In parallel, b and c both read it while they run.
+    REQUIRE(serial->slot_count() == 3);
+    REQUIRE(parallel->slot_count() == 4);
+
+    util::realtime_worker_pool::config cfg;
+    cfg.workers = 1;
+    cfg.priority = 0;
+    cfg.first_cpu = -1;
+    util::realtime_worker_pool workers{cfg};
+
+    in_storage.fill(1);
+    for (int i = 0; i < 100; i++) {
+      auto res = parallel->process(ProcessData<1>(in_buf), pool, &workers);
+      REQUIRE(res.audio[0][0] == 3);
+      REQUIRE(res.audio[1][15] == 3);
+    }
+  }
+
+  TEST_CASE ("AudioGraph benchmarks", "[.benchmarks]") {
+    // Stand-in for an effect: a cascade of one pole filters
+    struct Branch {
+      std::array<float, 64> state = {};
+      void operator()(Buffers& in, Buffers& out, Data& data)
+      {
+        for (int i = 0; i < data.nframes; i++) {
+          float x = in[0][i];
+          for (auto& s : state) x = s = s + 0.1f * (x - s);
+          out[0][i] = out[1][i] = x;
+        }
+      }
+    };
+
+    AudioGraphBuilder builder;
+    auto send = builder.bus("send", 1);
+    auto fx1 = builder.bus("fx1", 2);
+    auto fx2 = builder.bus("fx2", 2);
+    auto out = builder.bus("out", 2);
+    builder.node("send", {builder.input()}, {send}, sum());
+    builder.node("fx1", {send}, {fx1}, Branch());
+    builder.node("fx2", {send}, {fx2}, Branch());
+    builder.node("out", {fx1, fx2}, {out}, sum(), {true, 0});
+    builder.output(out);
+    auto serial = builder.compile(16);
+    auto parallel = builder.compile(16, AudioGraphBuilder::Schedule::parallel);
+
+    util::realtime_worker_pool::config cfg;
+    cfg.workers = 1;
+    cfg.priority = 0;
+    cfg.first_cpu = -1;
+    util::realtime_worker_pool workers{cfg};
+
+    for (int bs : {64, 128, 256}) {
+      AudioBufferPool pool{std::size_t(bs)};
+      std::vector<float> in_storage(bs, 0.5f);
+      std::atomic_int in_refs = 0;
+      AudioBufferHandle in_buf = {in_storage.data(), in_storage.size(), in_refs};
+
+      BENCHMARK (fmt::format("Serial, bs = {}", bs)) {
+        return serial->process(ProcessData<1>(in_buf), pool).audio[0][0];
+      };
+      BENCHMARK (fmt::format("Parallel, 1 worker, bs = {}", bs)) {
+        return parallel->process(ProcessData<1>(in_buf), pool, &workers).audio[0][0];
+      };
+    }
+  }
+
+  TEST_CASE ("SwappableAudioGraph", "[audio]") {
+    auto make_graph = [](float value) {
+      AudioGraphBuilder b;
+      auto out = b.bus("out", 2);
+      b.node("out", {}, {out}, fill(value));
+      b.output(out);
+      return b.compile(8);
+    };
+
+    SwappableAudioGraph sg;
+    REQUIRE(sg.acquire() == nullptr);
+
+    auto g1 = make_graph(1);
+    auto* g1_ptr = g1.get();
+    sg.publish(std::move(g1));
+    REQUIRE(sg.acquire() == g1_ptr);
+    REQUIRE(sg.acquire() == g1_ptr);
+
+    // Graphs that are replaced before the audio thread picks them up are never used
+    sg.publish(make_graph(2));
+    auto g3 = make_graph(3);
+    auto* g3_ptr = g3.get();
+    sg.publish(std::move(g3));
+    REQUIRE(sg.acquire() == g3_ptr);
+  }
+
+} // namespace otto::core::audio
@@ -0,0 +1,176 @@
+#include "testing.t.hpp"
+
+#include <vector>
+
+#include "core/audio/midi_buffer.hpp"
+
+namespace otto::core::midi {
+
+  using Bytes = std::vector<std::uint8_t>;
+
+  TEST_CASE ("MidiMessage", "[audio][midi]") {
+    SECTION ("Types and typed views") {
+      auto msg = [](Bytes b) { return MidiMessage::from_bytes(b); };
+      REQUIRE(msg({0x93, 60, 100}).type() == MessageType::NoteOn);
+      REQUIRE(msg({0x93, 60, 100}).channel() == 3);
+      REQUIRE(msg({0x93, 60, 0}).type() == MessageType::NoteOff);
+      REQUIRE(msg({0xA0, 60, 20}).pressure() == 20);
+      REQUIRE(msg({0xD0, 20}).pressure() == 20);
+      REQUIRE(msg({0xC5, 7}).program() == 7);
+      REQUIRE(msg({0xE0, 0, 64}).value14() == 8192);
+      REQUIRE(msg({0xF8}).type() == MessageType::Clock);
+      REQUIRE(msg({0xF8}).is_realtime());
+      REQUIRE(msg({0xF2, 1, 1}).type() == MessageType::SongPosition);
+      REQUIRE(msg({0xF9}).type() == MessageType::Invalid);
+    }
+
+    SECTION ("Incomplete messages are not packed") {
+      REQUIRE(MidiMessage::from_bytes(Bytes{0x90, 60}).status == 0);
+      REQUIRE(MidiMessage::from_bytes(Bytes{0xC0, 1, 2}).status == 0);
+      REQUIRE(MidiMessage::from_bytes(Bytes{60}).status == 0);
+      REQUIRE(MidiMessage::from_bytes(Bytes{0xF0, 1, 0xF7}).status == 0);
+    }
+
+    SECTION ("Events survive a round trip") {
+      auto round_trip = [](AnyMidiEvent evt) { return MidiMessage::from_event(evt).to_event(); };
+
+      auto on = round_trip(NoteOnEvent(60, 100 / 127.f, 2, 17));
+      REQUIRE(std::holds_alternative<NoteOnEvent>(on));
+      REQUIRE(std::get<NoteOnEvent>(on).key == 60);
+      REQUIRE(std::get<NoteOnEvent>(on).velocity == 100);
+      REQUIRE(std::get<NoteOnEvent>(on).channel == 2);
+      REQUIRE(event_time(on) == 17);
+
+      REQUIRE(std::holds_alternative<NoteOffEvent>(round_trip(NoteOffEvent(60))));
+
+      ControlChangeEvent cc = {7, 99};
+      cc.type = MidiEvent::Type::ControlChange;
+      cc.channel = 1;
+      cc.time = 3;
+      auto cc2 = round_trip(cc);
+      REQUIRE(std::get<ControlChangeEvent>(cc2).controler == 7);
+      REQUIRE(std::get<ControlChangeEvent>(cc2).value == 99);
+      REQUIRE(std::get<ControlChangeEvent>(cc2).channel == 1);
+
+      PitchBendEvent pb = {12345};
+      pb.type = MidiEvent::Type::PitchBend;
+      pb.channel = 0;
+      pb.time = 0;
+      REQUIRE(std::get<PitchBendEvent>(round_trip(pb)).value == 12345);
+    }
+  }
+
+  TEST_CASE ("MidiBuffer", "[audio][midi]") {
+    MidiBuffer buf;
+
+    SECTION ("Messages are stored in order, and their bytes can be read back") {
+      Bytes on = {0x90, 60, 100};
+      Bytes sysex = {0xF0, 0x7E, 0x01, 0x02, 0xF7};
+      Bytes clock = {0xF8};
+      REQUIRE(buf.push(on, 1));
+      REQUIRE(buf.push(sysex, 2));
+      REQUIRE(buf.push(clock, 3));
+      REQUIRE(buf.size() == 3);
+      REQUIRE(buf[1].type() == MessageType::SysEx);
+      std::vector<Bytes> res;
+      for (auto& msg : buf) {
+        auto bytes = buf.bytes(msg);
+        res.emplace_back(bytes.begin(), bytes.end());
+      }
+      REQUIRE(res == std::vector<Bytes>{on, sysex, clock});
+      REQUIRE(buf[2].frame == 3);
+    }
+
+    SECTION ("Messages that do not fit are dropped and counted") {
+      for (std::size_t i = 0; i < MidiBuffer::capacity; i++) REQUIRE(buf.push(NoteOnEvent(60)));
+      REQUIRE(!buf.push(NoteOnEvent(60)));
+      REQUIRE(buf.dropped() == 1);
+      buf.clear();
+      REQUIRE(buf.empty());
+      REQUIRE(buf.dropped() == 1);
+
+      Bytes sysex(MidiBuffer::sysex_capacity / 2, 0x10);
+      sysex.front() = 0xF0;
+      sysex.back() = 0xF7;
+      REQUIRE(buf.push(sysex, 0));
+      REQUIRE(buf.push(sysex, 0));
+      REQUIRE(!buf.push(sysex, 0));
+      REQUIRE(buf.dropped() == 2);
+    }
+
+    SECTION ("A default reference is empty, and can not be pushed to") {
+      MidiBufferRef ref;
+      REQUIRE(ref.empty());
+      REQUIRE(ref.begin() == ref.end());
+      REQUIRE(!ref.push(NoteOnEvent(60)));
+      ref = buf;
+      REQUIRE(ref.push(NoteOnEvent(60)));
+      REQUIRE(buf.size() == 1);
+    }
+  }
+
+  TEST_CASE ("MidiParser", "[audio][midi]") {
+    MidiParser parser;
+    std::vector<Bytes> res;
+    auto parse = [&](Bytes bytes) {
+      parser.parse(bytes, [&](gsl::span<const std::uint8_t> msg) { res.emplace_back(msg.begin(), msg.end()); });
+    };
+
+    SECTION ("Running status") {
+      parse({0x90, 60, 100, 62, 100, 64, 0, 0xC0, 5, 6});
+      REQUIRE(res == std::vector<Bytes>{{0x90, 60, 100}, {0x90, 62, 100}, {0x90, 64, 0}, {0xC0, 5}, {0xC0, 6}});
+      REQUIRE(parser.dropped() == 0);
+    }
+
+    SECTION ("Messages split over several chunks") {
+      parse({0xB0});
+      parse({1});
+      REQUIRE(res.empty());
+      parse({2, 3});
+      parse({4});
+      REQUIRE(res == std::vector<Bytes>{{0xB0, 1, 2}, {0xB0, 3, 4}});
+    }
+
+    SECTION ("Realtime messages inside other messages") {
+      parse({0x90, 60, 0xF8, 100, 0xF0, 1, 0xFA, 2, 0xF7});
+      REQUIRE(res == std::vector<Bytes>{{0xF8}, {0x90, 60, 100}, {0xFA}, {0xF0, 1, 2, 0xF7}});
+    }
+
+    SECTION ("Sysex over several chunks") {
+      parse({0xF0, 1, 2});
+      parse({3, 4});
+      REQUIRE(res.empty());
+      parse({5, 0xF7, 0x80, 60, 0});
+      REQUIRE(res == std::vector<Bytes>{{0xF0, 1, 2, 3, 4, 5, 0xF7}, {0x80, 60, 0}});
+    }
+
+    SECTION ("System common messages cancel running status") {
+      parse({0x90, 60, 100, 0xF2, 1, 2, 61, 100});
+      REQUIRE(res == std::vector<Bytes>{{0x90, 60, 100}, {0xF2, 1, 2}});
+      REQUIRE(parser.dropped() == 2);
+    }
+
+    SECTION ("An interrupted sysex is dropped") {
+      parse({0xF0, 1, 2, 0x90, 60, 100});
+      REQUIRE(res == std::vector<Bytes>{{0x90, 60, 100}});
+      REQUIRE(parser.dropped() == 1);
+    }
+
+    SECTION ("Too long sysex messages are dropped") {
+      Bytes sysex(MidiParser::max_sysex_size + 10, 0x10);
+      sysex.front() = 0xF0;
+      sysex.back() = 0xF7;
+      parse(sysex);
+      parse({0xF8});
+      REQUIRE(res == std::vector<Bytes>{{0xF8}});
+      REQUIRE(parser.dropped() == 1);
+    }
+
+    SECTION ("Stray data bytes are dropped") {
+      parse({60, 100, 0x90, 60, 100});
+      REQUIRE(res == std::vector<Bytes>{{0x90, 60, 100}});
+      REQUIRE(parser.dropped() == 2);
+    }
+  }
+
+} // namespace otto::core::midi
@@ -0,0 +1,74 @@
+#include "testing.t.hpp"
+
+#include "core/audio/midi_file.hpp"
+
+namespace otto::core::midi {
+
+  using ErrorCode = MidiFile::ErrorCode;
+
+  namespace {
+    std::vector<std::uint8_t> track(std::vector<std::uint8_t> events)
+    {
+      std::vector<std::uint8_t> res = {'M', 'T', 'r', 'k', 0, 0, 0, std::uint8_t(events.size())};
+      res.insert(res.end(), events.begin(), events.end());
+      return res;
+    }
+
+    ErrorCode parse_error(const std::vector<std::uint8_t>& data)
+    {
+      try {
+        MidiFile::parse(data);
+      } catch (MidiFile::exception& e) {
+        return e.data();
+      }
+      FAIL("The file parsed");
+      return {};
+    }
+  } // namespace
+
+  TEST_CASE ("MidiFile", "[midi]") {
+    // Format 1, two tracks, 96 ticks per quarter note
+    std::vector<std::uint8_t> file = {'M', 'T', 'h', 'd', 0, 0, 0, 6, 0, 1, 0, 2, 0, 96};
+    // Tempo map: 120 bpm, then 60 bpm from tick 192
+    auto tempo = track({0x00, 0xFF, 0x51, 0x03, 0x07, 0xA1, 0x20, //
+                        0x81, 0x40, 0xFF, 0x51, 0x03, 0x0F, 0x42, 0x40, //
+                        0x00, 0xFF, 0x2F, 0x00});
+    // Note on at 0, note off using running status at 96, sysex, note at 288, a program change and the end at 384
+    auto notes = track({0x00, 0x90, 60, 100,           //
+                        0x60, 60, 0,                    //
+                        0x00, 0xF0, 0x02, 0x01, 0xF7,   //
+                        0x81, 0x40, 0x91, 62, 90,       //
+                        0x00, 0xC0, 0x05,               //
+                        0x60, 0xFF, 0x2F, 0x00});
+    file.insert(file.end(), tempo.begin(), tempo.end());
+    file.insert(file.end(), notes.begin(), notes.end());
+
+    SECTION ("Messages are merged and timed using the tempo map") {
+      auto mf = MidiFile::parse(file);
+      REQUIRE(mf.messages.size() == 3);
+      REQUIRE(mf.messages[0].time == Approx(0));
+      REQUIRE(mf.messages[0].bytes == std::array<std::uint8_t, 3>{0x90, 60, 100});
+      REQUIRE(mf.messages[1].time == Approx(0.5));
+      REQUIRE(mf.messages[1].bytes == std::array<std::uint8_t, 3>{0x90, 60, 0});
+      // 192 ticks at 120 bpm, then 96 at 60 bpm
+      REQUIRE(mf.messages[2].time == Approx(2.0));
+      REQUIRE(mf.messages[2].bytes == std::array<std::uint8_t, 3>{0x91, 62, 90});
+      REQUIRE(mf.duration == Approx(3.0));
+    }
+
+    SECTION ("Invalid files are rejected") {
+      REQUIRE(parse_error({'R', 'I', 'F', 'F', 0, 0, 0, 6, 0, 1, 0, 2, 0, 96}) == ErrorCode::invalid_header);
+      auto format2 = file;
+      format2[9] = 2;
+      REQUIRE(parse_error(format2) == ErrorCode::unsupported_format);
+      auto truncated = file;
+      truncated.resize(truncated.size() - 3);
+      REQUIRE(parse_error(truncated) == ErrorCode::truncated);
+      auto no_status = std::vector<std::uint8_t>(file.begin(), file.begin() + 14);
+      auto bad = track({0x00, 60, 100});
+      no_status.insert(no_status.end(), bad.begin(), bad.end());
+      REQUIRE(parse_error(no_status) == ErrorCode::missing_status);
+    }
+  }
+
+} // namespace otto::core::midi
@@ -0,0 +1,116 @@
+#include "testing.t.hpp"
+
+#include <thread>
+
+#include "core/audio/midi_input.hpp"
+
+namespace otto::core::midi {
+
+  TEST_CASE ("MidiInputQueue", "[audio][midi]") {
+    MidiInputQueue q;
+    std::vector<MidiMessage> events;
+    auto collect = [&](MidiMessage msg) { events.push_back(msg); };
+    constexpr int sr = 48000;
+    constexpr std::int64_t ms = 1'000'000;
+
+    SECTION ("Messages are drained at their frame offset") {
+      std::vector<std::uint8_t> on = {0x90, 60, 100};
+      std::vector<std::uint8_t> off = {0x80, 60, 0};
+      REQUIRE(q.push(on, 1000 * ms + 1 * ms));
+      REQUIRE(q.push(off, 1000 * ms + 2 * ms));
+      REQUIRE(q.drain(1000 * ms, sr, 256, collect) == 2);
+      REQUIRE(events.size() == 2);
+      REQUIRE(events[0].type() == MessageType::NoteOn);
+      REQUIRE(events[0].key() == 60);
+      REQUIRE(events[0].frame == 48);
+      REQUIRE(events[1].type() == MessageType::NoteOff);
+      REQUIRE(events[1].frame == 96);
+      REQUIRE(q.drain(1000 * ms, sr, 256, collect) == 0);
+    }
+
+    SECTION ("Frame offsets are clamped to the block and never decrease") {
+      std::vector<std::uint8_t> cc = {0xB0, 1, 64};
+      q.push(cc, 10 * ms);
+      q.push(cc, 5 * ms);
+      q.push(cc, 100 * ms);
+      q.push(cc, 12 * ms);
+      q.drain(10 * ms, sr, 256, collect);
+      REQUIRE(events.size() == 4);
+      REQUIRE(events[0].frame == 0);
+      REQUIRE(events[1].frame == 0);
+      REQUIRE(events[2].frame == 255);
+      REQUIRE(events[3].frame == 255);
+    }
+
+    SECTION ("System and two byte channel messages are passed on") {
+      std::vector<std::uint8_t> program_change = {0xC0, 5};
+      std::vector<std::uint8_t> clock = {0xF8};
+      std::vector<std::uint8_t> song_position = {0xF2, 0, 1};
+      for (auto* msg : {&program_change, &clock, &song_position}) REQUIRE(q.push(*msg, 0));
+      q.drain(0, sr, 256, collect);
+      REQUIRE(events.size() == 3);
+      REQUIRE(events[0].type() == MessageType::ProgramChange);
+      REQUIRE(events[0].program() == 5);
+      REQUIRE(events[1].type() == MessageType::Clock);
+      REQUIRE(events[2].type() == MessageType::SongPosition);
+      REQUIRE(events[2].value14() == 128);
+    }
+
+    SECTION ("Messages split over several pushes are joined") {
+      std::vector<std::uint8_t> first = {0x90, 60};
+      std::vector<std::uint8_t> second = {100, 62, 100};
+      REQUIRE(q.push(first, 0));
+      REQUIRE(q.push(second, 0));
+      q.drain(0, sr, 256, collect);
+      REQUIRE(events.size() == 2);
+      REQUIRE(events[0].key() == 60);
+      REQUIRE(events[1].key() == 62);
+    }
+
+    SECTION ("Sysex and stray data bytes are dropped") {
+      std::vector<std::uint8_t> sysex = {0xF0, 0x7E, 0x7F, 0xF7};
+      std::vector<std::uint8_t> data_only = {60, 100, 0};
+      REQUIRE(!q.push(sysex, 0));
+      REQUIRE(!q.push(data_only, 0));
+      auto stats = q.statistics();
+      REQUIRE(stats.dropped == 2);
+      REQUIRE(stats.received == 0);
+      REQUIRE(q.drain(0, sr, 256, collect) == 0);
+    }
+
+    SECTION ("Messages pushed to a full queue are counted as overflowed") {
+      std::vector<std::uint8_t> on = {0x90, 60, 100};
+      for (std::size_t i = 0; i < MidiInputQueue::capacity; i++) REQUIRE(q.push(on, 0));
+      REQUIRE(!q.push(on, 0));
+      REQUIRE(!q.push(on, 0));
+      auto stats = q.statistics();
+      REQUIRE(stats.received == MidiInputQueue::capacity);
+      REQUIRE(stats.overflowed == 2);
+      REQUIRE(stats.high_water_mark == MidiInputQueue::capacity);
+      REQUIRE(q.drain(0, sr, 256, collect) == MidiInputQueue::capacity);
+      REQUIRE(q.push(on, 0));
+    }
+
+    SECTION ("All messages arrive in order when pushed from another thread") {
+      constexpr int count = 100000;
+      std::thread producer([&] {
+        for (int i = 0; i < count;) {
+          std::vector<std::uint8_t> cc = {0xB0, std::uint8_t(i % 128), std::uint8_t((i / 128) % 128)};
+          if (q.push(cc, i)) i++;
+        }
+      });
+      int received = 0;
+      bool in_order = true;
+      while (received < count) {
+        q.drain(0, sr, 256, [&](MidiMessage msg) {
+          in_order &= msg.controller() == received % 128 && msg.value() == (received / 128) % 128;
+          received++;
+        });
+      }
+      producer.join();
+      REQUIRE(in_order);
+      REQUIRE(received == count);
+    }
+  }
+
+} // namespace otto::core::midi
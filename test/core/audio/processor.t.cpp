@@ -0,0 +1,61 @@
+#include "testing.t.hpp"
+
+#include <utility>
+#include <variant>
+#include <vector>
+
+#include "core/audio/processor.hpp"
+
+namespace otto::core::audio {
+
+  TEST_CASE ("split_at_midi_events", "[audio]") {
+    std::array<float, 64> storage = {};
+    std::atomic_int ref_count = 0;
+    AudioBufferHandle buf = {storage.data(), storage.size(), ref_count};
+
+    // A record of the calls, in order. Events are recorded as their key, blocks as {idx, length}
+    std::vector<std::variant<int, std::pair<int, int>>> calls;
+    midi::MidiBuffer midi_buf;
+    auto split = [&](std::vector<midi::AnyMidiEvent> events) {
+      calls.clear();
+      midi_buf.clear();
+      for (auto& evt : events) midi_buf.push(evt);
+      ProcessData<1> data{buf, midi_buf};
+      split_at_midi_events(
+        data, [&](const midi::AnyMidiEvent& evt) { calls.push_back(std::get<midi::NoteOnEvent>(evt).key); },
+        [&](int idx, int length) { calls.push_back(std::pair(idx, length)); });
+    };
+    using B = std::pair<int, int>;
+
+    SECTION ("Without events, the whole block is processed at once") {
+      split({});
+      REQUIRE(calls.size() == 1);
+      REQUIRE(calls[0] == decltype(calls)::value_type(B{0, 64}));
+    }
+
+    SECTION ("Blocks are split at each event") {
+      split({midi::NoteOnEvent(1, 1, 0, 0), midi::NoteOnEvent(2, 1, 0, 10), midi::NoteOnEvent(3, 1, 0, 10),
+             midi::NoteOnEvent(4, 1, 0, 40)});
+      decltype(calls) expected = {1, B{0, 10}, 2, 3, B{10, 30}, 4, B{40, 24}};
+      REQUIRE(calls == expected);
+    }
+
+    SECTION ("Events are not reordered, and are clamped to the block") {
+      split({midi::NoteOnEvent(1, 1, 0, 20), midi::NoteOnEvent(2, 1, 0, 5), midi::NoteOnEvent(3, 1, 0, 100)});
+      decltype(calls) expected = {B{0, 20}, 1, 2, B{20, 43}, 3, B{63, 1}};
+      REQUIRE(calls == expected);
+    }
+
+    SECTION ("Handlers that take a MidiMessage get the packed message") {
+      midi_buf.push(midi::NoteOnEvent(1, 1, 0, 10));
+      ProcessData<1> data{buf, midi_buf};
+      std::vector<midi::MidiMessage> msgs;
+      split_at_midi_events(
+        data, [&](const midi::MidiMessage& msg) { msgs.push_back(msg); }, [](int, int) {});
+      REQUIRE(msgs.size() == 1);
+      REQUIRE(msgs[0].key() == 1);
+      REQUIRE(msgs[0].frame == 10);
+    }
+  }
+
+} // namespace otto::core::audio
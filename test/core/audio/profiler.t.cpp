@@ -0,0 +1,108 @@
+#include "testing.t.hpp"
+
+#include <sstream>
+#include <thread>
+
+#include "core/audio/profiler.hpp"
+
+namespace otto::core::audio {
+
+  using namespace std::chrono_literals;
+
+  TEST_CASE ("AudioProfiler", "[audio]") {
+    AudioProfiler profiler;
+    int a = profiler.add_stage("a");
+    int b = profiler.add_stage("b");
+    REQUIRE(profiler.add_stage("a") == a);
+
+    auto block = [&](auto a_time, auto b_time) {
+      profiler.begin_block();
+      profiler.record(a, a_time);
+      profiler.record(b, b_time);
+      profiler.end_block();
+    };
+
+    SECTION ("Percentiles are within the bucket precision") {
+      for (int i = 0; i < 98; i++) block(10us, 1us);
+      block(100us, 1us);
+      block(1ms, 1us);
+      auto stats = profiler.statistics();
+      REQUIRE(stats.size() == 2);
+      REQUIRE(stats[0].name == "a");
+      REQUIRE(stats[0].blocks == 100);
+      REQUIRE(stats[0].p50 >= 10000);
+      REQUIRE(stats[0].p50 <= 12500);
+      REQUIRE(stats[0].p99 >= 100000);
+      REQUIRE(stats[0].p99 <= 125000);
+      REQUIRE(stats[0].max == 1000000);
+      REQUIRE(stats[1].max == 1000);
+    }
+
+    SECTION ("Stages that did not run are not counted") {
+      profiler.begin_block();
+      profiler.record(a, 1us);
+      profiler.end_block();
+      auto stats = profiler.statistics();
+      REQUIRE(stats[0].blocks == 1);
+      REQUIRE(stats[1].blocks == 0);
+    }
+
+    SECTION ("Xruns are attributed to the slowest stage of the block before") {
+      block(10us, 1us);
+      block(1us, 10us);
+      profiler.report_xrun();
+      auto stats = profiler.statistics();
+      REQUIRE(stats[0].xruns == 0);
+      REQUIRE(stats[1].xruns == 1);
+      REQUIRE(profiler.xruns() == 1);
+
+      SECTION ("reset clears everything at the next block") {
+        profiler.reset();
+        profiler.begin_block();
+        stats = profiler.statistics();
+        REQUIRE(stats[1].xruns == 0);
+        REQUIRE(stats[1].blocks == 0);
+      }
+    }
+
+    SECTION ("Scopes record the time they are alive") {
+      profiler.begin_block();
+      {
+        auto scope = profiler.scope(a);
+        std::this_thread::sleep_for(1ms);
+      }
+      profiler.end_block();
+      REQUIRE(profiler.statistics()[0].max >= 1000000);
+    }
+
+    SECTION ("Resource usage is counted from the first sample") {
+      profiler.record_resource_usage(100, 10);
+      REQUIRE(profiler.resource_statistics().page_faults == 0);
+      profiler.record_resource_usage(103, 11);
+      auto usage = profiler.resource_statistics();
+      REQUIRE(usage.page_faults == 3);
+      REQUIRE(usage.involuntary_switches == 1);
+      REQUIRE(usage.page_faults_per_minute > 0);
+
+      profiler.reset();
+      profiler.begin_block();
+      REQUIRE(profiler.resource_statistics().page_faults == 0);
+      profiler.record_resource_usage(200, 20);
+      profiler.record_resource_usage(200, 20);
+      REQUIRE(profiler.resource_statistics().page_faults == 0);
+      REQUIRE(profiler.resource_statistics().page_faults_per_minute == 0);
+    }
+
+    SECTION ("CSV output") {
+      block(10us, 1us);
+      std::stringstream ss;
+      profiler.write_csv(ss);
+      std::string line;
+      std::getline(ss, line);
+      REQUIRE(line == "stage,blocks,p50_us,p99_us,max_us,xruns");
+      std::getline(ss, line);
+      REQUIRE(line.rfind("\"a\",1,", 0) == 0);
+    }
+  }
+
+} // namespace otto::core::audio
@@ -0,0 +1,72 @@
+#include "testing.t.hpp"
+
+#include <numeric>
+
+#include "core/audio/reblocker.hpp"
+
+namespace otto::core::audio {
+
+  TEST_CASE ("Reblocker", "[audio]") {
+    constexpr int bs = 64;
+    Reblocker rb{bs, 4 * bs};
+    // Each block outputs a ramp continuing from the previous one, and records its input
+    float next = 0;
+    std::vector<float> seen_input;
+    auto block = [&](float* l, float* r, const float* in) {
+      for (int i = 0; i < bs; i++) {
+        l[i] = next;
+        r[i] = -next;
+        next++;
+      }
+      if (in) seen_input.insert(seen_input.end(), in, in + bs);
+    };
+
+    auto run = [&](std::vector<int> sizes, bool with_input) {
+      std::vector<float> out_l;
+      std::vector<float> out_r;
+      float in_counter = 0;
+      for (int n : sizes) {
+        std::vector<float> l(n), r(n), in(n);
+        std::iota(in.begin(), in.end(), in_counter);
+        in_counter += n;
+        rb.process(l.data(), r.data(), with_input ? in.data() : nullptr, n, block);
+        out_l.insert(out_l.end(), l.begin(), l.end());
+        out_r.insert(out_r.end(), r.begin(), r.end());
+      }
+      return std::pair(out_l, out_r);
+    };
+
+    SECTION ("Matching callbacks are processed directly") {
+      int calls = 0;
+      float buf[2][bs];
+      rb.process(buf[0], buf[1], nullptr, bs, [&](float* l, float* r, const float*) {
+        REQUIRE(l == buf[0]);
+        REQUIRE(r == buf[1]);
+        calls++;
+      });
+      REQUIRE(calls == 1);
+    }
+
+    SECTION ("Output is continuous across callbacks of varying size") {
+      auto [l, r] = run({64, 30, 100, 128, 1, 200, 61}, false);
+      REQUIRE(l.size() == 584);
+      for (int i = 0; i < int(l.size()); i++) {
+        REQUIRE(l[i] == i);
+        REQUIRE(r[i] == -i);
+      }
+      REQUIRE(!rb.input_delayed());
+    }
+
+    SECTION ("Input is delayed by a block once re-blocking is needed") {
+      run({64, 128}, true);
+      REQUIRE(!rb.input_delayed());
+      REQUIRE(seen_input.size() == 192);
+      run({30, 100, 11, 200}, true);
+      REQUIRE(rb.input_delayed());
+      // The second run starts counting the input at 0 again, after a block of silence
+      for (int i = 0; i < bs; i++) REQUIRE(seen_input[192 + i] == 0);
+      for (int i = bs; i < int(seen_input.size()) - 192; i++) REQUIRE(seen_input[192 + i] == i - bs);
+    }
+  }
+
+} // namespace otto::core::audio
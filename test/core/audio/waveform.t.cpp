@@ -10,11 +10,115 @@ namespace otto::test {
 
   using namespace core::audio;
 
+  namespace {
+    /// The peak of `frames`, the slow way
+    Peak brute_force_peak(const std::vector<float>& frames, int first, int last)
+    {
+      auto [min, max] = std::minmax_element(frames.begin() + first, frames.begin() + last);
+      return {*min, *max};
+    }
+  } // namespace
+
+  TEST_CASE ("Waveform peaks", "[audio][waveform]") {
+    // 100 bins of 1024 frames, so the points of a view of the whole waveform line up with the bins
+    constexpr int length = 100 * 1024;
+    std::vector<float> data(length);
+    for (auto& f : data) f = Random::get(-1.f, 1.f);
+
+    SECTION ("Views show the min and max of the frames of each point") {
+      Waveform wf = {data, 100};
+      wf.wait();
+      REQUIRE(wf.ready());
+      REQUIRE(wf.frames_ready() == length);
+
+      auto view = wf.view(100, 0, length);
+      REQUIRE(view.size() == 100);
+      for (int i = 0; i < 100; i++) {
+        auto expected = brute_force_peak(data, i * 1024, (i + 1) * 1024);
+        REQUIRE(view[i].min == expected.min);
+        REQUIRE(view[i].max == expected.max);
+      }
+
+      // Closer than a bin, the frames are read directly
+      wf.view(view, 5000, 5000 + 300);
+      for (int i = 0; i < 100; i++) {
+        auto expected = brute_force_peak(data, 5000 + i * 3, 5000 + (i + 1) * 3);
+        REQUIRE(view[i].min == expected.min);
+        REQUIRE(view[i].max == expected.max);
+      }
+    }
+
+    SECTION ("Files are cached next to them") {
+      auto file = fs::path("/tmp/otto_waveform_test.wav");
+      auto cache = fs::path("/tmp/otto_waveform_test.wav.peaks");
+      auto write = [&] {
+        AudioFile<float> audio;
+        audio.setAudioBufferSize(1, length);
+        audio.samples[0] = data;
+        audio.save(file.string());
+      };
+      write();
+      fs::remove(cache);
+
+      auto view_of_file = [&] {
+        Waveform wf = {file, 100};
+        wf.wait();
+        auto view = wf.view(100, 0, length);
+        return std::vector<Peak>(view.begin(), view.end());
+      };
+      auto built = view_of_file();
+      REQUIRE(fs::exists(cache));
+      for (int i = 0; i < 100; i++) {
+        auto expected = brute_force_peak(data, i * 1024, (i + 1) * 1024);
+        REQUIRE(built[i].min == approx(expected.min).margin(1e-4));
+        REQUIRE(built[i].max == approx(expected.max).margin(1e-4));
+      }
+
+      auto cached = view_of_file();
+      for (int i = 0; i < 100; i++) {
+        REQUIRE(cached[i].min == built[i].min);
+        REQUIRE(cached[i].max == built[i].max);
+      }
+
+      // A file with new contents, but the same size, is not read from the cache
+      for (auto& f : data) f *= 0.5f;
+      write();
+      auto changed = view_of_file();
+      for (int i = 0; i < 100; i++) REQUIRE(changed[i].max == approx(built[i].max * 0.5f).margin(1e-4));
+
+      fs::remove(file);
+      fs::remove(cache);
+    }
+
+    SECTION ("Waveforms share a worker, and can be destroyed before they are built") {
+      std::vector<std::unique_ptr<Waveform>> waveforms;
+      for (int i = 0; i < 4; i++) waveforms.push_back(std::make_unique<Waveform>(data, 100));
+      // Queued, or being built
+      waveforms[1] = nullptr;
+      waveforms[2] = nullptr;
+      waveforms[0]->wait();
+      waveforms[3]->wait();
+      REQUIRE(waveforms[3]->ready());
+      auto view = waveforms[3]->view(100, 0, length);
+      auto expected = brute_force_peak(data, 0, 1024);
+      REQUIRE(view[0].max == expected.max);
+    }
+
+    SECTION ("Files that can not be read give empty waveforms") {
+      Waveform wf = {fs::path("/tmp/otto_waveform_missing.wav"), 100};
+      REQUIRE(wf.ready());
+      REQUIRE(wf.size() == 0);
+      auto view = wf.view(10, 0, 100);
+      REQUIRE(view[0].max == 0);
+    }
+  }
+
   TEST_CASE ("Waveform", "[.][graphics][waveform]") {
     AudioFile<float> file;
     file.load("data/samples/test.wav");
 
     Waveform wf = {{file.samples[0].data(), file.getNumSamplesPerChannel()}, 300};
+    wf.wait();
 
     using namespace core::ui::vg;
 
@@ -47,20 +151,24 @@ namespace otto::test {
       timeline.step(1);
       wf.view(view, start, start + length);
 
-      float y_bot = height - 70;
+      float y_mid = height / 2;
       float x_start = 10;
-      float x = x_start;
-      float y_scale = 40;
-      auto iter = view.begin();
+      float y_scale = 80;
       ctx.group([&] {
+        // Along the maxima, and back along the minima
         ctx.beginPath();
-        ctx.moveTo(x, y_bot - *iter * y_scale);
-        for (; iter < view.end(); iter++) {
-          ctx.lineTo(x, y_bot - *iter * y_scale);
+        float x = x_start;
+        ctx.moveTo(x, y_mid - view[0].max * y_scale);
+        for (auto& peak : view) {
+          ctx.lineTo(x, y_mid - peak.max * y_scale);
           x += 1;
         }
-        ctx.lineTo(x, y_bot);
-        ctx.lineTo(x_start, y_bot);
+        for (auto iter = view.end(); iter != view.begin();) {
+          --iter;
+          x -= 1;
+          ctx.lineTo(x, y_mid - iter->min * y_scale);
+        }
+        ctx.closePath();
         ctx.fill(DefaultColors::White);
       });
     });
@@ -1,9 +1,127 @@
 #include "core/engine/engine_dispatcher.hpp"
 #include "testing.t.hpp"
 
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+#include "dummy_services.hpp"
+
 namespace otto::test {
   using namespace otto::core::engine;
 
+  namespace {
+    /// Number of {@ref ConstEngine}s destroyed
+    int destroyed_engines = 0;
+
+    struct EmptyScreen : core::ui::Screen {
+      void draw(core::ui::vg::Canvas&) override {}
+    };
+
+    /// An effect engine that outputs `Value`
+    template<int Value>
+    struct ConstEngine : EffectEngine<ConstEngine<Value>> {
+      static constexpr util::string_ref name = Value == 1 ? "One" : "Two";
+
+      struct Audio {
+        core::audio::ProcessData<2> process(core::audio::ProcessData<1> data) noexcept
+        {
+          auto out = services::AudioManager::current().buffer_pool().allocate_multi<2>();
+          for (auto& buf : out) std::fill(buf.begin(), buf.end(), float(Value));
+          return data.with(out);
+        }
+      };
+
+      ~ConstEngine()
+      {
+        destroyed_engines++;
+      }
+
+      core::ui::ScreenAndInput screen() override
+      {
+        return {screen_, *this};
+      }
+
+      std::unique_ptr<Audio> audio = std::make_unique<Audio>();
+      EmptyScreen screen_;
+      struct Props {
+        DECL_REFLECTION_EMPTY(Props);
+      } props;
+    };
+  } // namespace
+
+  TEST_CASE ("EngineDispatcher switches engines with a crossfade", "[engines]") {
+    using namespace std::chrono_literals;
+    using Dispatcher = EngineDispatcher<EngineType::effect, ConstEngine<1>, ConstEngine<2>>;
+    auto app = services::test::make_dummy_application();
+    auto& audio = services::test::DummyAudioManager::current();
+    auto& ui = services::test::DummyUIManager::current();
+    destroyed_engines = 0;
+
+    auto dispatcher = std::make_unique<Dispatcher>();
+    ui.register_screen_selector(services::ScreenEnum::fx1, [&] { return dispatcher->current().screen(); });
+    ui.display(services::ScreenEnum::fx1);
+    auto& first_screen = ui.current_screen();
+    audio.start();
+
+    // Act as both the audio and the UI thread
+    std::vector<float> output;
+    auto run_block = [&] {
+      ui.run_actions();
+      audio.run_actions();
+      auto in = audio.buffer_pool().allocate_clear();
+      auto res = dispatcher->process(core::audio::ProcessData<1>(in));
+      output.insert(output.end(), res.audio[0].begin(), res.audio[0].end());
+    };
+    auto run_until = [&](auto&& done) {
+      auto deadline = std::chrono::steady_clock::now() + 5s;
+      while (!done() && std::chrono::steady_clock::now() < deadline) {
+        run_block();
+        std::this_thread::sleep_for(100us);
+      }
+      return done();
+    };
+
+    run_block();
+    REQUIRE(output.back() == 1);
+    dispatcher->encoder({core::input::Encoder::blue, 1});
+
+    SECTION ("The new engine becomes current once it is constructed, and is faded in") {
+      REQUIRE(run_until([&] { return output.back() == 2; }));
+      REQUIRE(dispatcher->current().name() == "Two");
+      // The fade is continuous, and takes crossfade_ms. It is equal power, so it peaks above both engines
+      auto first = std::find_if(output.begin(), output.end(), [](float f) { return f != 1; });
+      auto last = std::find_if(first, output.end(), [](float f) { return std::abs(f - 2) < 1e-4; });
+      REQUIRE(std::adjacent_find(first, last, [](float a, float b) { return std::abs(b - a) > 0.01; }) == last);
+      REQUIRE(std::all_of(first, last, [](float f) { return f > 1 && f < 2.3; }));
+      int fade_frames = audio.samplerate() * Dispatcher::crossfade_ms / 1000;
+      REQUIRE(std::abs(int(last - first) - fade_frames) <= 1);
+    }
+
+    SECTION ("The old engine is destroyed after the UI has moved to the new screen") {
+      REQUIRE(run_until([&] { return output.back() == 2; }));
+      // The worker waits for the UI thread, so nothing is destroyed while only audio is processed
+      for (int i = 0; i < 10; i++) {
+        audio.run_actions();
+        std::this_thread::sleep_for(1ms);
+      }
+      REQUIRE(destroyed_engines == 0);
+      REQUIRE(&ui.current_screen() == &first_screen);
+      REQUIRE(run_until([&] { return destroyed_engines == 1; }));
+      REQUIRE(&ui.current_screen() == &dispatcher->current().screen().screen());
+      REQUIRE(output.back() == 2);
+    }
+
+    SECTION ("Switching back constructs a new engine, and destroys both old ones") {
+      REQUIRE(run_until([&] { return dispatcher->current().name() == "Two"; }));
+      dispatcher->encoder({core::input::Encoder::blue, -1});
+      REQUIRE(run_until([&] { return destroyed_engines == 2 && output.back() == 1; }));
+      REQUIRE(dispatcher->current().name() == "One");
+    }
+
+    dispatcher.reset();
+  }
+
 #if false
   namespace testfxengine1 {
     struct Audio;
@@ -0,0 +1,135 @@
+#include "core/voices/note_stack.hpp"
+#include "testing.t.hpp"
+
+namespace otto::core::voices {
+
+  TEST_CASE ("NoteStack") {
+    NoteStack<8> stack;
+
+    SECTION ("push_back fills up to capacity") {
+      for (int i = 0; i < 8; i++) REQUIRE(stack.push_back({.key = i, .note = i, .voice = i}) >= 0);
+      REQUIRE(stack.size() == 8);
+      REQUIRE(!stack.has_room(1));
+      REQUIRE(stack.push_back({.key = 9, .note = 9, .voice = 0}) == -1);
+    }
+
+    SECTION ("steal_oldest takes voices in the order they were pushed") {
+      stack.push_back({.key = 1, .voice = 4});
+      stack.push_back({.key = 2, .voice = 5});
+      stack.push_back({.key = 3, .voice = 6});
+      REQUIRE(stack.steal_oldest() == 4);
+      REQUIRE(stack.steal_oldest() == 5);
+      REQUIRE(stack.steal_oldest() == 6);
+      REQUIRE(stack.steal_oldest() == -1);
+    }
+
+    SECTION ("return_voice gives voices to the newest entry without one") {
+      stack.push_back({.key = 1, .voice = 0});
+      stack.push_back({.key = 2, .voice = 1});
+      stack.push_back({.key = 3, .voice = 2});
+      stack.steal_oldest();
+      stack.steal_oldest();
+      int idx = stack.return_voice(7);
+      REQUIRE(stack[idx].key == 2);
+      idx = stack.return_voice(8);
+      REQUIRE(stack[idx].key == 1);
+      REQUIRE(stack.return_voice(9) == -1);
+    }
+
+    SECTION ("remove_key removes all entries of the key, newest first") {
+      stack.push_back({.key = 1, .note = 1, .voice = 0});
+      stack.push_back({.key = 2, .note = 2, .voice = 1});
+      stack.push_back({.key = 2, .note = 14, .voice = 2});
+      stack.push_back({.key = 3, .note = 3, .voice = 3});
+      std::vector<int> notes;
+      stack.remove_key(2, [&](NoteStackEntry& e) { notes.push_back(e.note); });
+      REQUIRE_THAT(notes, Catch::Equals(std::vector{14, 2}));
+      REQUIRE(stack.size() == 2);
+      // Removing it again does nothing
+      stack.remove_key(2, [&](NoteStackEntry& e) { FAIL("Key was already removed"); });
+      REQUIRE(stack.size() == 2);
+      REQUIRE(stack[stack.back()].key == 3);
+    }
+
+    SECTION ("Voices removed with a key return to the entries that lost theirs") {
+      // Like mono mode: each key has three entries, and only the newest key has voices
+      for (int key = 1; key <= 2; key++) {
+        for (int i = 0; i < 3; i++) {
+          int v = key == 1 ? i : stack.steal_oldest();
+          stack.push_back({.key = key, .note = key * 10 + i, .voice = v});
+        }
+      }
+      std::vector<int> returned_to;
+      stack.remove_key(2, [&](NoteStackEntry& e) {
+        int idx = stack.return_voice(e.voice);
+        returned_to.push_back(stack[idx].note * 100 + stack[idx].voice);
+      });
+      REQUIRE_THAT(returned_to, Catch::Equals(std::vector{1202, 1101, 1000}));
+      REQUIRE(stack.steal_oldest() == 0);
+    }
+
+    SECTION ("Removed entries are reused") {
+      for (int n = 0; n < 100; n++) {
+        stack.push_back({.key = n % 128, .voice = 0});
+        stack.remove_key(n % 128, [](auto&) {});
+      }
+      REQUIRE(stack.empty());
+      for (int i = 0; i < 8; i++) REQUIRE(stack.push_back({.key = i, .voice = i}) >= 0);
+    }
+
+    SECTION ("remove_released removes all keys with released entries, oldest first") {
+      stack.push_back({.key = 1, .voice = 0});
+      stack.push_back({.key = 2, .voice = 1});
+      stack.push_back({.key = 2, .voice = 2});
+      stack.push_back({.key = 3, .voice = 3});
+      stack.push_back({.key = 4, .voice = 4});
+      stack.mark_release(2);
+      stack.mark_release(4);
+      std::vector<int> removed;
+      stack.remove_released([&](int key) {
+        removed.push_back(key);
+        stack.remove_key(key, [](auto&) {});
+      });
+      REQUIRE_THAT(removed, Catch::Equals(std::vector{2, 4}));
+      REQUIRE(stack.size() == 2);
+    }
+  }
+
+  TEST_CASE ("FreeVoices") {
+    FreeVoices<4> free;
+
+    SECTION ("Starts with all voices, in index order") {
+      REQUIRE(free.size() == 4);
+      for (int i = 0; i < 4; i++) REQUIRE(free.pop_front() == i);
+      REQUIRE(free.empty());
+      REQUIRE(free.pop_front() == -1);
+    }
+
+    SECTION ("Voices are reused in the order they were freed") {
+      for (int i = 0; i < 4; i++) free.pop_front();
+      free.push_back(2);
+      free.push_back(0);
+      free.push_back(3);
+      REQUIRE(free.pop_front() == 2);
+      REQUIRE(free.pop_front() == 0);
+      REQUIRE(free.pop_front() == 3);
+    }
+
+    SECTION ("remove takes a voice from the middle") {
+      free.remove(1);
+      free.remove(1);
+      REQUIRE(!free.contains(1));
+      REQUIRE(free.size() == 3);
+      REQUIRE(free.pop_front() == 0);
+      REQUIRE(free.pop_front() == 2);
+      REQUIRE(free.pop_front() == 3);
+    }
+
+    SECTION ("push_back of a free voice does nothing") {
+      free.push_back(0);
+      REQUIRE(free.size() == 4);
+      REQUIRE(free.pop_front() == 0);
+    }
+  }
+
+} // namespace otto::core::voices
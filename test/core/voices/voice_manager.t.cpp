@@ -346,6 +346,95 @@ namespace otto::core::voices {
       }
     }
 
+    SECTION ("Sustain pedal") {
+      auto pedal = [&](bool down) { vmgr.handle_midi(midi::ControlChangeEvent{0x40, down ? 127 : 0}); };
+
+      SECTION ("Released keys keep playing while the pedal is down") {
+        pedal(true);
+        vmgr.handle_midi(midi::NoteOnEvent{50});
+        vmgr.handle_midi(midi::NoteOffEvent{50});
+        REQUIRE_THAT(test::sort(view::transform(triggered_voices, MEMBER_CALLER(midi_note))),
+                     Catch::Equals(std::vector{50}));
+        pedal(false);
+        REQUIRE(util::count(triggered_voices) == 0);
+      }
+
+      SECTION ("Keys that are still held are not released with the pedal") {
+        pedal(true);
+        vmgr.handle_midi(midi::NoteOnEvent{50});
+        vmgr.handle_midi(midi::NoteOnEvent{60});
+        vmgr.handle_midi(midi::NoteOffEvent{50});
+        pedal(false);
+        REQUIRE_THAT(test::sort(view::transform(triggered_voices, MEMBER_CALLER(midi_note))),
+                     Catch::Equals(std::vector{60}));
+      }
+
+      SECTION ("Releases all voices of a key in interval mode") {
+        voices_props.play_mode = +PlayMode::interval;
+        voices_props.interval = 7;
+        queue.pop_call_all();
+
+        pedal(true);
+        vmgr.handle_midi(midi::NoteOnEvent{50});
+        vmgr.handle_midi(midi::NoteOffEvent{50});
+        REQUIRE(util::count(triggered_voices) == 2);
+        pedal(false);
+        REQUIRE(util::count(triggered_voices) == 0);
+      }
+
+      SECTION ("Releases the main and sub voices in mono mode") {
+        voices_props.play_mode = +PlayMode::mono;
+        voices_props.sub = 0.5f;
+        queue.pop_call_all();
+
+        pedal(true);
+        vmgr.handle_midi(midi::NoteOnEvent{50});
+        vmgr.handle_midi(midi::NoteOnEvent{60});
+        vmgr.handle_midi(midi::NoteOffEvent{60});
+        vmgr.handle_midi(midi::NoteOffEvent{50});
+        REQUIRE_THAT(test::sort(view::transform(triggered_voices, MEMBER_CALLER(midi_note))),
+                     Catch::Equals(std::vector{48, 48, 60}));
+        pedal(false);
+        REQUIRE(util::count(triggered_voices) == 0);
+      }
+
+      SECTION ("Pressing a sustained key again keeps it after the pedal is released") {
+        pedal(true);
+        vmgr.handle_midi(midi::NoteOnEvent{50});
+        vmgr.handle_midi(midi::NoteOffEvent{50});
+        vmgr.handle_midi(midi::NoteOnEvent{50});
+        pedal(false);
+        REQUIRE_THAT(test::sort(view::transform(triggered_voices, MEMBER_CALLER(midi_note))),
+                     Catch::Equals(std::vector{50}));
+      }
+    }
+
+    SECTION ("More than 12 voices") {
+      VoiceManager<Voice, 16> big = {shared_int};
+      auto big_triggered = view::filter(big.voices(), [](Voice& v) { return v.is_triggered(); });
+
+      SECTION ("Poly mode uses all voices") {
+        itc::call_receiver(big, rand_tag::action::data(0.5f));
+        for (int i = 0; i < 16; i++) big.handle_midi(midi::NoteOnEvent{40 + i});
+        REQUIRE(util::count(big_triggered) == 16);
+        big.handle_midi(midi::NoteOnEvent{80});
+        REQUIRE(util::count(big_triggered) == 16);
+        for (int i = 0; i < 16; i++) big.handle_midi(midi::NoteOffEvent{40 + i});
+        big.handle_midi(midi::NoteOffEvent{80});
+        REQUIRE(util::count(big_triggered) == 0);
+      }
+
+      SECTION ("Unison mode detunes all voices") {
+        itc::call_receiver(big, play_mode_tag::action::data(PlayMode::unison));
+        itc::call_receiver(big, detune_tag::action::data(0.5f));
+        big.handle_midi(midi::NoteOnEvent{50});
+        REQUIRE(util::count(big_triggered) == VoiceManager<Voice, 16>::UnisonAllocator::num_voices_used);
+        std::set<float> freqs;
+        for (auto& v : big_triggered) freqs.insert(v.frequency());
+        REQUIRE(freqs.size() == VoiceManager<Voice, 16>::UnisonAllocator::num_voices_used);
+      }
+    }
+
     SECTION ("Portamento") {
       voices_props.play_mode = +PlayMode::mono;
       queue.pop_call_all();
@@ -540,6 +629,66 @@ namespace otto::core::voices {
         auto res2 = vmgr.process(ProcessData<1>{buf});
         REQUIRE(util::all_of(res2.audio, util::does_equal(4)));
       }
+
+      SECTION ("voices that are not sounding are not rendered") {
+        struct SVoice : voices::VoiceBase<SVoice> {
+          float operator()() noexcept
+          {
+            calls++;
+            return 1.f;
+          }
+
+          bool is_sounding() noexcept
+          {
+            return is_triggered();
+          }
+
+          int calls = 0;
+        };
+
+        VoiceManager<SVoice, 4> vmgr;
+        auto buf = services::AudioManager::current().buffer_pool().allocate_clear();
+
+        REQUIRE(vmgr.sounding_voice_count() == 0);
+        auto res = vmgr.process(ProcessData<1>{buf});
+        REQUIRE(util::all_of(res.audio, util::does_equal(0)));
+        REQUIRE(vmgr() == 0.f);
+        for (auto& v : vmgr.voices()) REQUIRE(v.calls == 0);
+
+        vmgr.handle_midi(midi::NoteOnEvent(60));
+        REQUIRE(vmgr.sounding_voice_count() == 1);
+        auto res2 = vmgr.process(ProcessData<1>{buf});
+        REQUIRE(util::all_of(res2.audio, util::does_equal(1 * vmgr.normal_volume)));
+        REQUIRE(util::count_if(vmgr.voices(), [](SVoice& v) { return v.calls > 0; }) == 1);
+
+        vmgr.handle_midi(midi::NoteOffEvent(60));
+        REQUIRE(vmgr.sounding_voice_count() == 0);
+      }
+
+      SECTION ("midi events are applied at their frame") {
+        struct SVoice : voices::VoiceBase<SVoice> {
+          float operator()() noexcept
+          {
+            return 1.f;
+          }
+
+          bool is_sounding() noexcept
+          {
+            return is_triggered();
+          }
+        };
+
+        VoiceManager<SVoice, 4> vmgr;
+        auto buf = services::AudioManager::current().buffer_pool().allocate_clear();
+        REQUIRE(buf.size() > 20);
+
+        std::vector<midi::AnyMidiEvent> events = {midi::NoteOnEvent(60, 1, 0, 10), midi::NoteOffEvent(60, 1, 0, 20)};
+        auto res = vmgr.process(ProcessData<1>{buf, {std::move(events)}});
+        for (int i = 0; i < res.nframes; i++) {
+          INFO("Frame " << i);
+          REQUIRE(res.audio[i] == (i >= 10 && i < 20 ? vmgr.normal_volume : 0.f));
+        }
+      }
     }
   }
 } // namespace otto::core::voices
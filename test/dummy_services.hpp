@@ -6,6 +6,7 @@
 #include "services/engine_manager.hpp"
 #include "services/log_manager.hpp"
 #include "services/preset_manager.hpp"
+#include "services/sample_cache.hpp"
 #include "services/state_manager.hpp"
 #include "services/ui_manager.hpp"
 
@@ -85,6 +86,12 @@ namespace otto::services::test {
       UIManager::display({screen, input});
     }
 
+    /// Call the actions queued for the UI thread, without drawing a frame
+    void run_actions()
+    {
+      action_queue_.pop_call_all();
+    }
+
     static DummyUIManager& current()
     {
       return dynamic_cast<DummyUIManager&>(UIManager::current());
@@ -140,20 +147,22 @@ namespace otto::services::test {
       midi_bufs.swap();
 
       auto in_buf = Application::current().audio_manager->buffer_pool().allocate_clear();
-      // steal the inner midi buffer
       auto out = Application::current().engine_manager->process(
-        {in_buf, {std::move(midi_bufs.inner())}, core::clock::ClockRange()});
+        {in_buf, midi_bufs.inner(), core::clock::ClockRange()});
 
       // process_audio_output(out);
 
       LOGW_IF(out.nframes != nframes, "Frames went missing!");
 
-      // return the midi buffer
-      midi_bufs.inner() = out.midi.move_vector_out();
-
       return out;
     }
 
+    /// Call the actions queued for the audio thread, without processing any audio
+    void run_actions()
+    {
+      pre_process_tasks();
+    }
+
     void set_bs_sr(int buffer_size, int sample_rate)
     {
       _buffer_size = buffer_size;
@@ -171,8 +180,8 @@ namespace otto::services::test {
   {
     return {
       std::make_unique<LogManager>,        std::make_unique<DummyStateManager>,  std::make_unique<DummyPresetManager>,
-      std::make_unique<DummyAudioManager>, ClockManager::create_default,         std::make_unique<DummyUIManager>,
-      std::make_unique<DummyController>,   std::make_unique<DummyEngineManager>,
+      std::make_unique<DummyAudioManager>, ClockManager::create_default,         std::make_unique<SampleCache>,
+      std::make_unique<DummyUIManager>,    std::make_unique<DummyController>,    std::make_unique<DummyEngineManager>,
     };
   }
 
@@ -180,8 +189,8 @@ namespace otto::services::test {
   {
     return {
       std::make_unique<LogManager>,        std::make_unique<DummyStateManager>, std::make_unique<DummyPresetManager>,
-      std::make_unique<DummyAudioManager>, ClockManager::create_default,        std::make_unique<DummyUIManager>,
-      std::make_unique<DummyController>,   EngineManager::create_default,
+      std::make_unique<DummyAudioManager>, ClockManager::create_default,        std::make_unique<SampleCache>,
+      std::make_unique<DummyUIManager>,    std::make_unique<DummyController>,   EngineManager::create_default,
     };
   }
 } // namespace otto::services::test
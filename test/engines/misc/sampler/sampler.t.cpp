@@ -99,7 +99,7 @@ namespace otto::engines::sampler {
     Sndr sndr{{audio_queue, audio}, {ui_queue, main_screen, env_screen}};
     Props props{sndr};
 
-    int ref_count = 0;
+    std::atomic_int ref_count = 0;
     auto the_buffer = util::generate_array<10>([](auto i) { return float(i); });
     core::audio::AudioBufferHandle buffer = {the_buffer.data(), the_buffer.size(), ref_count};
 
@@ -0,0 +1,235 @@
+#include "testing.t.hpp"
+
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <queue>
+#include <thread>
+
+#include "itc/action_queue.hpp"
+#include "util/inplace_function.hpp"
+#include "util/spin_lock.hpp"
+#include "util/spsc_queue.hpp"
+
+namespace otto::itc {
+
+  TEST_CASE ("inplace_function") {
+    SECTION ("Calls the stored callable") {
+      int i = 0;
+      util::inplace_function<void()> f = [&i] { i++; };
+      f();
+      f();
+      REQUIRE(i == 2);
+    }
+
+    SECTION ("Returns values and takes arguments") {
+      util::inplace_function<int(int, int)> f = [](int a, int b) { return a * b; };
+      REQUIRE(f(3, 4) == 12);
+    }
+
+    SECTION ("Is empty by default and after being moved from") {
+      util::inplace_function<void()> f;
+      REQUIRE(!f);
+      f = [] {};
+      REQUIRE(f);
+      auto f2 = std::move(f);
+      REQUIRE(!f);
+      REQUIRE(f2);
+    }
+
+    SECTION ("Destroys the stored callable exactly once") {
+      auto counter = std::make_shared<int>(0);
+      {
+        util::inplace_function<void()> f = [counter] {};
+        REQUIRE(counter.use_count() == 2);
+        auto f2 = std::move(f);
+        REQUIRE(counter.use_count() == 2);
+      }
+      REQUIRE(counter.use_count() == 1);
+    }
+  }
+
+  TEST_CASE ("spsc_queue") {
+    util::spsc_queue<int, 8> q;
+
+    SECTION ("Is FIFO ordered") {
+      for (int i = 0; i < 5; i++) REQUIRE(q.try_push(i));
+      for (int i = 0; i < 5; i++) REQUIRE(q.try_pop() == i);
+      REQUIRE(q.try_pop() == std::nullopt);
+    }
+
+    SECTION ("Counts overflows when full") {
+      for (int i = 0; i < 8; i++) REQUIRE(q.try_push(i));
+      REQUIRE(!q.try_push(8));
+      REQUIRE(!q.try_push(9));
+      REQUIRE(q.size() == 8);
+      REQUIRE(q.overflow_count() == 2);
+    }
+
+    SECTION ("Tracks the high water mark") {
+      for (int i = 0; i < 5; i++) q.try_push(i);
+      q.consume_all([](int) {});
+      q.try_push(1);
+      REQUIRE(q.size() == 1);
+      REQUIRE(q.high_water_mark() == 5);
+      q.reset_statistics();
+      REQUIRE(q.high_water_mark() == 0);
+    }
+
+    SECTION ("Wraps around the end of the storage") {
+      int expected = 0;
+      int next = 0;
+      for (int round = 0; round < 10; round++) {
+        for (int i = 0; i < 5; i++) q.try_push(next++);
+        q.consume_all([&](int v) { REQUIRE(v == expected++); });
+      }
+      REQUIRE(expected == 50);
+    }
+
+    SECTION ("consume_all does not consume elements pushed during the call") {
+      q.try_push(1);
+      q.try_push(2);
+      auto n = q.consume_all([&](int v) { q.try_push(v * 10); });
+      REQUIRE(n == 2);
+      REQUIRE(q.size() == 2);
+    }
+  }
+
+  TEST_CASE ("ActionQueue stress test", "[itc][slow]") {
+    ActionQueue aq;
+    constexpr int count = 200000;
+    // Only touched by the consumer
+    int last_received = -1;
+    bool in_order = true;
+
+    std::thread producer([&] {
+      for (int i = 0; i < count; i++) {
+        while (!aq.push([&last_received, &in_order, i] {
+          in_order = in_order && (i == last_received + 1);
+          last_received = i;
+        }))
+          std::this_thread::yield();
+      }
+    });
+
+    while (last_received < count - 1) {
+      if (aq.pop_call_all() == 0) std::this_thread::yield();
+    }
+    producer.join();
+
+    REQUIRE(in_order);
+    REQUIRE(last_received == count - 1);
+    REQUIRE(aq.size() == 0);
+    REQUIRE(aq.high_water_mark() <= ActionQueue::capacity);
+  }
+
+  TEST_CASE ("ActionQueue overflow", "[itc]") {
+    ActionQueue aq;
+    int calls = 0;
+    for (std::size_t i = 0; i < ActionQueue::capacity; i++) {
+      REQUIRE(aq.push([&calls] { calls++; }));
+    }
+    REQUIRE(!aq.push([&calls] { calls++; }));
+    REQUIRE(aq.overflow_count() == 1);
+    REQUIRE(aq.high_water_mark() == ActionQueue::capacity);
+    aq.pop_call_all();
+    REQUIRE(calls == ActionQueue::capacity);
+  }
+
+  namespace {
+    /// The previous `std::function`/`std::deque` based queue, kept for comparison
+    struct LockedFunctionQueue {
+      void push(const std::function<void()>& f)
+      {
+        lock_.lock();
+        queue_.push(f);
+        lock_.unlock();
+      }
+
+      void pop_call_all()
+      {
+        lock_.lock();
+        while (queue_.size() > 0) {
+          queue_.front()();
+          queue_.pop();
+        }
+        lock_.unlock();
+      }
+
+      util::spin_lock lock_;
+      std::queue<std::function<void()>, std::deque<std::function<void()>>> queue_;
+    };
+  } // namespace
+
+  TEST_CASE ("ActionQueue benchmarks", "[.benchmarks]") {
+    using float_action = Action<struct bench_float_action_tag, float>;
+    struct FloatAR {
+      void action(float_action, float f)
+      {
+        value += f;
+      }
+      float value = 0;
+    } ar;
+
+    // A typical burst of prop changes between two audio buffers
+    constexpr int burst = 64;
+
+    BENCHMARK ("std::function + std::deque + spin_lock: push/pop 64 actions") {
+      static LockedFunctionQueue q;
+      for (int i = 0; i < burst; i++) {
+        q.push([&ar, data = float_action::data(i)] { call_receiver(ar, data); });
+      }
+      q.pop_call_all();
+      return ar.value;
+    };
+
+    BENCHMARK ("ActionQueue: push/pop 64 actions") {
+      static ActionQueue q;
+      for (int i = 0; i < burst; i++) {
+        q.push(ar, float_action::data(i));
+      }
+      q.pop_call_all();
+      return ar.value;
+    };
+
+    BENCHMARK_ADVANCED("std::function + std::deque + spin_lock: concurrent push/pop")(Catch::Benchmark::Chronometer meter)
+    {
+      LockedFunctionQueue q;
+      meter.measure([&] {
+        std::atomic_bool done = false;
+        std::thread producer([&] {
+          for (int i = 0; i < 10000; i++) q.push([&ar, data = float_action::data(i)] { call_receiver(ar, data); });
+          done = true;
+        });
+        while (!done) {
+          q.pop_call_all();
+          std::this_thread::yield();
+        }
+        producer.join();
+        q.pop_call_all();
+      });
+    };
+
+    BENCHMARK_ADVANCED("ActionQueue: concurrent push/pop")(Catch::Benchmark::Chronometer meter)
+    {
+      ActionQueue q;
+      meter.measure([&] {
+        std::atomic_bool done = false;
+        std::thread producer([&] {
+          for (int i = 0; i < 10000; i++) {
+            while (!q.push([&ar, data = float_action::data(i)] { call_receiver(ar, data); }))
+              std::this_thread::yield();
+          }
+          done = true;
+        });
+        while (!done) {
+          q.pop_call_all();
+          std::this_thread::yield();
+        }
+        producer.join();
+        q.pop_call_all();
+      });
+    };
+  }
+
+} // namespace otto::itc
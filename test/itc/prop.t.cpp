@@ -53,5 +53,68 @@ namespace otto::engines::test_engine {
       REQUIRE(props.int_prop == 20);
       REQUIRE(props.int_prop_w_limits == 30);
     }
+
+    SECTION ("Changes are coalesced until the queue is run") {
+      queue.pop_call_all();
+      for (int i = 0; i < 100; i++) props.float_prop = i;
+      props.int_prop = 5;
+      props.float_prop = 1000;
+      REQUIRE(queue.size() == 2);
+      queue.pop_call_all();
+      REQUIRE(par.float_prop == 1000);
+      REQUIRE(par.int_prop == 5);
+
+      props.float_prop = 2000;
+      REQUIRE(queue.size() == 1);
+      queue.pop_call_all();
+      REQUIRE(par.float_prop == 2000);
+    }
+
+    SECTION ("A change pushed to a full queue is sent with the next change") {
+      queue.pop_call_all();
+      while (queue.push([] {}))
+        ;
+      props.float_prop = 1;
+      queue.pop_call_all();
+      REQUIRE(par.float_prop == 10);
+      props.float_prop = 2;
+      queue.pop_call_all();
+      REQUIRE(par.float_prop == 2);
+    }
+  }
+
+  struct FloatAR {
+    void action(Action<struct joined_float_tag, float>, float v)
+    {
+      value = v;
+    }
+    float value = 0;
+  };
+
+  TEST_CASE ("itc::Prop coalescing with several queues") {
+    ActionQueue queue1;
+    ActionQueue queue2;
+    FloatAR far1;
+    FloatAR far2;
+    using JSndr = JoinedActionSender<ActionSender<FloatAR>, ActionSender<FloatAR>>;
+    JSndr sndr = {{queue1, far1}, {queue2, far2}};
+    JSndr::Prop<struct joined_float_tag, float> prop = {sndr, 1};
+
+    queue1.pop_call_all();
+    queue2.pop_call_all();
+    prop = 2;
+    prop = 3;
+    REQUIRE(queue1.size() == 1);
+    REQUIRE(queue2.size() == 1);
+    queue1.pop_call_all();
+    REQUIRE(far1.value == 3);
+    // Each queue is coalesced on its own
+    prop = 4;
+    REQUIRE(queue1.size() == 1);
+    REQUIRE(queue2.size() == 1);
+    queue1.pop_call_all();
+    queue2.pop_call_all();
+    REQUIRE(far1.value == 4);
+    REQUIRE(far2.value == 4);
   }
 } // namespace otto::engines::test_engine
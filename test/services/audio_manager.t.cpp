@@ -0,0 +1,66 @@
+#include "testing.t.hpp"
+
+#include <atomic>
+#include <thread>
+
+#include "dummy_services.hpp"
+
+namespace otto::services {
+
+  using namespace std::chrono_literals;
+
+  TEST_CASE ("AudioManager block waits", "[services][audio]") {
+    auto app = services::test::make_dummy_application();
+    auto& audio = test::DummyAudioManager::current();
+
+    SECTION ("Waits time out while audio is stopped") {
+      REQUIRE(!audio.wait_for_next_block(5ms));
+      int calls = 0;
+      REQUIRE(!audio.run_at_next_block([&] { calls++; }, 5ms));
+      // A call that timed out is never made
+      audio.start();
+      audio.run_actions();
+      REQUIRE(calls == 0);
+    }
+
+    SECTION ("A call that timed out is not freed on the audio thread") {
+      auto captured = std::make_shared<int>(0);
+      REQUIRE(!audio.run_at_next_block([captured] { (*captured)++; }, 5ms));
+      REQUIRE(captured.use_count() == 2);
+      audio.start();
+      long use_count_on_audio_thread = 0;
+      std::thread audio_thread([&] {
+        audio.run_actions();
+        use_count_on_audio_thread = captured.use_count();
+      });
+      audio_thread.join();
+      REQUIRE(use_count_on_audio_thread == 2);
+      REQUIRE(*captured == 0);
+      // The next call frees it
+      REQUIRE(!audio.run_at_next_block([] {}, 1ms));
+      REQUIRE(captured.use_count() == 1);
+    }
+
+    SECTION ("Waits return at the start of the next block") {
+      audio.start();
+      std::atomic_bool stop = false;
+      std::thread audio_thread([&] {
+        while (!stop) {
+          audio.run_actions();
+          std::this_thread::sleep_for(1ms);
+        }
+      });
+      for (int i = 0; i < 20; i++) {
+        auto number = audio.buffer_number();
+        REQUIRE(audio.wait_for_next_block());
+        REQUIRE(audio.buffer_number() > number);
+        std::thread::id id;
+        REQUIRE(audio.run_at_next_block([&] { id = std::this_thread::get_id(); }));
+        REQUIRE(id == audio_thread.get_id());
+      }
+      stop = true;
+      audio_thread.join();
+    }
+  }
+
+} // namespace otto::services
@@ -0,0 +1,97 @@
+#include "testing.t.hpp"
+
+#include <cmath>
+
+#include <AudioFile.h>
+
+#include "services/sample_cache.hpp"
+
+namespace otto::services {
+
+  namespace {
+    /// Write a stereo file with a sine in the left channel, and silence in the right
+    void write_sine(const fs::path& file, float freq, int samplerate, int frames)
+    {
+      AudioFile<float> audio;
+      audio.setAudioBufferSize(2, frames);
+      audio.setSampleRate(samplerate);
+      for (int i = 0; i < frames; i++) audio.samples[0][i] = std::sin(2 * M_PI * freq * i / samplerate);
+      audio.save(file.string());
+    }
+  } // namespace
+
+  TEST_CASE ("SampleCache", "[services]") {
+    auto file_a = fs::path("/tmp/otto_sample_cache_a.wav");
+    auto file_b = fs::path("/tmp/otto_sample_cache_b.wav");
+    write_sine(file_a, 441, 44100, 44100);
+    write_sine(file_b, 441, 44100, 44100);
+    // A sample of 44100 frames, and its header
+    constexpr std::size_t sample_bytes = sizeof(SampleCache::Sample) + 44100 * sizeof(float);
+
+    SampleCache cache;
+
+    SECTION ("Samples are decoded and mixed down") {
+      auto handle = cache.load(file_a, 44100);
+      auto sample = handle.wait();
+      REQUIRE(handle.ready());
+      REQUIRE(sample != nullptr);
+      REQUIRE(sample->audio.size() == 44100);
+      for (int i = 0; i < 44100; i += 97) {
+        REQUIRE(sample->audio[i] == Approx(0.5 * std::sin(2 * M_PI * 441 * i / 44100)).margin(1e-4));
+      }
+      REQUIRE(cache.memory_usage() == sample_bytes);
+    }
+
+    SECTION ("Loading a sample twice shares it") {
+      auto first = cache.load(file_a, 44100);
+      auto second = cache.load(file_a, 44100);
+      REQUIRE(first.wait() == second.wait());
+      // And once it is cached, it is ready right away
+      auto third = cache.load(file_a, 44100);
+      REQUIRE(third.ready());
+      REQUIRE(third.get() == first.get());
+      REQUIRE(cache.size() == 1);
+    }
+
+    SECTION ("Samples are resampled") {
+      auto sample = cache.load(file_a, 48000).wait();
+      REQUIRE(sample->samplerate == 48000);
+      REQUIRE(sample->audio.size() == 48000);
+      // Away from the edges, the sine has the same frequency and amplitude
+      for (int i = 1000; i < 47000; i += 101) {
+        REQUIRE(sample->audio[i] == Approx(0.5 * std::sin(2 * M_PI * 441 * i / 48000)).margin(1e-3));
+      }
+    }
+
+    SECTION ("Unused samples are evicted when the budget is exceeded") {
+      cache.budget(sample_bytes * 3 / 2);
+      auto a = cache.load(file_a, 44100).wait();
+      auto b = cache.load(file_b, 44100).wait();
+      // Both are held, so they stay, even though that takes the cache over budget
+      REQUIRE(cache.size() == 2);
+      REQUIRE(cache.memory_usage() == 2 * sample_bytes);
+
+      // b is the only sample that is not held, so it is evicted to make room
+      b = nullptr;
+      auto c = cache.load(file_b, 48000).wait();
+      REQUIRE(cache.size() == 2);
+      REQUIRE(cache.load(file_a, 44100).ready());
+
+      a = nullptr;
+      c = nullptr;
+      cache.budget(0);
+      REQUIRE(cache.size() == 0);
+      REQUIRE(cache.memory_usage() == 0);
+    }
+
+    SECTION ("Files that can not be loaded give empty handles") {
+      auto handle = cache.load("/tmp/otto_sample_cache_missing.wav", 44100);
+      REQUIRE(handle.ready());
+      REQUIRE(handle.get() == nullptr);
+    }
+
+    fs::remove(file_a);
+    fs::remove(file_b);
+  }
+
+} // namespace otto::services
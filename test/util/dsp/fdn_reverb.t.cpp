@@ -0,0 +1,107 @@
+#include "testing.t.hpp"
+
+#include <cmath>
+
+#include "util/dsp/fdn_reverb.hpp"
+
+namespace otto::util::dsp {
+
+  namespace {
+    /// The RMS level of both channels of frames `[first, last)`, in dB
+    float level(const std::vector<float>& l, const std::vector<float>& r, int first, int last)
+    {
+      double sum = 0;
+      for (int i = first; i < last; i++) sum += l[i] * l[i] + r[i] * r[i];
+      return 10 * std::log10(sum / (2 * (last - first)));
+    }
+
+    /// The response to an impulse, processed in blocks of `bs` frames
+    std::pair<std::vector<float>, std::vector<float>> impulse_response(FdnReverb& reverb, int frames, int bs = 256)
+    {
+      std::vector<float> in(frames, 0.f);
+      in[0] = 1;
+      std::vector<float> l(frames), r(frames);
+      for (int i = 0; i < frames; i += bs) {
+        reverb.process(in.data() + i, l.data() + i, r.data() + i, std::min(bs, frames - i));
+      }
+      return {l, r};
+    }
+  } // namespace
+
+  TEST_CASE ("dsp::FdnReverb", "[dsp]") {
+    constexpr int sr = 44100;
+    FdnReverb reverb{sr};
+
+    SECTION ("The tail falls by 60 dB in the decay time") {
+      reverb.decay(1);
+      reverb.damping(0);
+      // One block for the parameters to reach their targets
+      reverb.process(std::vector<float>(256).data(), std::vector<float>(256).data(), std::vector<float>(256).data(),
+                     256);
+      auto [l, r] = impulse_response(reverb, 2 * sr);
+      float start = level(l, r, sr / 10, sr / 5);
+      float end = level(l, r, sr / 10 + sr, sr / 5 + sr);
+      REQUIRE(start - end == Approx(60).margin(6));
+    }
+
+    SECTION ("Damping makes the tail darker") {
+      reverb.damping(0);
+      auto [l, r] = impulse_response(reverb, sr);
+      FdnReverb damped{sr};
+      damped.damping(0.7);
+      damped.process(std::vector<float>(256).data(), std::vector<float>(256).data(), std::vector<float>(256).data(),
+                     256);
+      auto [dl, dr] = impulse_response(damped, sr);
+
+      // The energy of the first difference is mostly high frequencies
+      auto highs = [](const std::vector<float>& x) {
+        double sum = 0;
+        for (std::size_t i = sr / 2; i < x.size(); i++) sum += std::pow(x[i] - x[i - 1], 2);
+        return sum;
+      };
+      REQUIRE(highs(dl) < 0.2 * highs(l));
+    }
+
+    SECTION ("The channels are decorrelated") {
+      auto [l, r] = impulse_response(reverb, sr);
+      double lr = 0, ll = 0, rr = 0;
+      for (int i = 0; i < sr; i++) {
+        lr += l[i] * r[i];
+        ll += l[i] * l[i];
+        rr += r[i] * r[i];
+      }
+      REQUIRE(ll > 0);
+      REQUIRE(rr > 0);
+      REQUIRE(std::abs(lr) / std::sqrt(ll * rr) < 0.3);
+    }
+
+    SECTION ("Long decays stay stable, at any block size") {
+      reverb.decay(30);
+      reverb.damping(0);
+      float peak = 0;
+      std::vector<float> in(512), l(512), r(512);
+      for (int block = 0; block < 2000; block++) {
+        int bs = 1 + (block * 37) % 512;
+        for (int i = 0; i < bs; i++) in[i] = Random::get(-1.f, 1.f);
+        reverb.process(in.data(), l.data(), r.data(), bs);
+        for (int i = 0; i < bs; i++) {
+          REQUIRE(std::isfinite(l[i]));
+          peak = std::max({peak, std::abs(l[i]), std::abs(r[i])});
+        }
+      }
+      REQUIRE(peak < 10);
+    }
+
+    SECTION ("clear silences the tail") {
+      auto [l, r] = impulse_response(reverb, 4096);
+      reverb.clear();
+      std::vector<float> in(256, 0.f), out_l(256), out_r(256);
+      reverb.process(in.data(), out_l.data(), out_r.data(), 256);
+      for (int i = 0; i < 256; i++) {
+        REQUIRE(out_l[i] == 0);
+        REQUIRE(out_r[i] == 0);
+      }
+    }
+  }
+
+} // namespace otto::util::dsp
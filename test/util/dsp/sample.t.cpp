@@ -266,4 +266,116 @@ namespace otto::dsp {
       }
     }
   }
+
+  namespace {
+    /// Render a whole sample in blocks of an odd size, so blocks end in the middle of a vector
+    std::vector<float> render_all(const Sample& sample, Sample::Interpolation interpolation, int max_frames = 1000)
+    {
+      std::vector<float> res;
+      std::vector<float> block(37);
+      auto playhead = sample.playhead();
+      while (!playhead.done && int(res.size()) < max_frames) {
+        int n = sample.render(block, playhead, interpolation);
+        res.insert(res.end(), block.begin(), block.begin() + n);
+      }
+      return res;
+    }
+  } // namespace
+
+  TEST_CASE ("Sample::render") {
+    std::vector<float> data;
+    std::generate_n(std::back_inserter(data), 100, [i = 0]() mutable { return i++; });
+
+    Sample sample = Sample{data};
+    sample.start_point(10);
+    sample.end_point(90);
+    sample.fade_in_time(10);
+    sample.fade_out_time(15);
+
+    using Interpolation = Sample::Interpolation;
+    auto interpolation = GENERATE(Interpolation::linear, Interpolation::hermite, Interpolation::sinc);
+
+    SECTION ("At speed 1, the output is the same as the iterator's") {
+      REQUIRE_THAT(render_all(sample, interpolation), Catch::Approx(view::to_vec(sample)).margin(1e-4));
+    }
+
+    SECTION ("At speed 1 in reverse, the output is the same as the iterator's") {
+      sample.playback_speed(-1);
+      REQUIRE_THAT(render_all(sample, interpolation), Catch::Approx(view::to_vec(sample)).margin(1e-4));
+    }
+
+    SECTION ("Frames after the end point are 0") {
+      std::vector<float> out(100, 1.f);
+      auto playhead = sample.playhead();
+      REQUIRE(sample.render(out, playhead, interpolation) == 80);
+      REQUIRE(playhead.done);
+      for (int i = 80; i < 100; i++) REQUIRE(out[i] == 0);
+      REQUIRE(sample.render(out, playhead, interpolation) == 0);
+      REQUIRE(out[0] == 0);
+    }
+
+    SECTION ("Looping wraps around the start and end points") {
+      sample.fade_in_time(0);
+      sample.fade_out_time(0);
+      sample.loop = true;
+      auto out = render_all(sample, interpolation, 250);
+      REQUIRE(out.size() >= 250);
+      for (int i = 0; i < 250; i++) REQUIRE(out[i] == approx(10 + i % 80).margin(1e-4));
+
+      sample.playback_speed(-1);
+      out = render_all(sample, interpolation, 250);
+      for (int i = 0; i < 250; i++) REQUIRE(out[i] == approx(89 - i % 80).margin(1e-4));
+    }
+
+    SECTION ("Positions between frames are interpolated") {
+      sample.fade_in_time(0);
+      sample.fade_out_time(0);
+      sample.playback_speed(0.5);
+      auto out = render_all(sample, interpolation);
+      REQUIRE(out.size() == 160);
+      // The ramp is reproduced exactly, away from the edges, where the sinc kernel is cut off
+      for (int i = 20; i < 140; i++) REQUIRE(out[i] == approx(10 + i * 0.5f).margin(0.02));
+    }
+  }
+
+  TEST_CASE ("Sample::render accuracy") {
+    /// The largest error when playing a sine with a period of `period` frames at `speed`
+    auto max_error = [](double period, float speed, Sample::Interpolation interpolation) {
+      std::vector<float> data(20000);
+      for (int i = 0; i < int(data.size()); i++) data[i] = std::sin(2 * M_PI * i / period);
+      Sample sample = Sample{data};
+      sample.playback_speed(speed);
+
+      std::vector<float> out(4096);
+      auto playhead = sample.playhead();
+      double start = playhead.position;
+      sample.render(out, playhead, interpolation);
+      float res = 0;
+      // The first frames are interpolated with the silence before the sample
+      for (int i = 16; i < int(out.size()); i++) {
+        res = std::max<float>(res, std::abs(out[i] - std::sin(2 * M_PI * (start + i * speed) / period)));
+      }
+      return res;
+    };
+
+    SECTION ("Low frequencies") {
+      // 441 Hz at 44.1 kHz, which is far below the cutoff at all these speeds
+      auto speed = GENERATE(0.75f, 1.5f, -1.3f);
+      float linear = max_error(100, speed, Sample::Interpolation::linear);
+      float hermite = max_error(100, speed, Sample::Interpolation::hermite);
+      float sinc = max_error(100, speed, Sample::Interpolation::sinc);
+      REQUIRE(linear < 1e-3);
+      REQUIRE(hermite < linear);
+      REQUIRE(sinc < 1e-4);
+    }
+
+    SECTION ("High frequencies") {
+      // 11 kHz at 44.1 kHz, played slower, where only the sinc kernel stays accurate
+      float linear = max_error(4, 0.75f, Sample::Interpolation::linear);
+      float hermite = max_error(4, 0.75f, Sample::Interpolation::hermite);
+      float sinc = max_error(4, 0.75f, Sample::Interpolation::sinc);
+      REQUIRE(hermite < linear);
+      REQUIRE(sinc < hermite / 10);
+    }
+  }
 } // namespace otto::dsp
@@ -0,0 +1,231 @@
+#include "testing.t.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <thread>
+
+#if defined(__linux__)
+#include <sys/mman.h>
+#endif
+
+#include "util/dsp/sample_stream.hpp"
+
+namespace otto::util::dsp {
+
+  using namespace std::chrono_literals;
+
+  namespace {
+    /// Write a 16 bit WAV file. `frames` holds `channels` interleaved channels
+    void write_wav(const fs::path& file, const std::vector<std::int16_t>& frames, int channels, int samplerate = 44100)
+    {
+      std::ofstream out(file.c_str(), std::ios::binary | std::ios::trunc);
+      auto u32 = [&](std::uint32_t v) { out.write(reinterpret_cast<const char*>(&v), 4); };
+      auto u16 = [&](std::uint16_t v) { out.write(reinterpret_cast<const char*>(&v), 2); };
+      std::uint32_t data_size = frames.size() * 2;
+      out.write("RIFF", 4);
+      u32(4 + 8 + 16 + 8 + 8 + data_size);
+      out.write("WAVE", 4);
+      // An unknown chunk, which should be skipped
+      out.write("LIST", 4);
+      u32(0);
+      out.write("fmt ", 4);
+      u32(16);
+      u16(1);
+      u16(channels);
+      u32(samplerate);
+      u32(samplerate * channels * 2);
+      u16(channels * 2);
+      u16(16);
+      out.write("data", 4);
+      u32(data_size);
+      out.write(reinterpret_cast<const char*>(frames.data()), data_size);
+    }
+
+    /// The value of frame `i` of the test files
+    std::int16_t ramp(int i)
+    {
+      return (i % 20000) - 10000;
+    }
+
+    /// Wait until the prefetch thread has streamed the frames for the next `nframes` frames of `stream`
+    void wait_until_ready(SampleStreamer::Stream& stream, int nframes)
+    {
+      // Only a safeguard against hanging. The assertions do not depend on the timing
+      auto deadline = std::chrono::steady_clock::now() + 10s;
+      while (!stream.ready(nframes) && std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(100us);
+      }
+      REQUIRE(stream.ready(nframes));
+    }
+
+    /// The `VmLck` of the process, in kB. 0 if it is not known
+    long locked_kb()
+    {
+      std::ifstream status("/proc/self/status");
+      for (std::string line; std::getline(status, line);) {
+        if (line.rfind("VmLck:", 0) == 0) return std::stol(line.substr(6));
+      }
+      return 0;
+    }
+
+    void read_blocks(SampleStreamer::Stream& stream, int nframes, std::vector<float>& out)
+    {
+      std::vector<float> block(512);
+      for (int i = 0; i < nframes; i += block.size()) {
+        wait_until_ready(stream, block.size());
+        stream.read(block);
+        out.insert(out.end(), block.begin(), block.end());
+      }
+    }
+  } // namespace
+
+  TEST_CASE ("WavFile", "[dsp]") {
+    auto file = fs::path("/tmp/otto_wav_file_test.wav");
+    std::vector<std::int16_t> frames;
+    for (int i = 0; i < 1000; i++) {
+      frames.push_back(ramp(i));
+      frames.push_back(-ramp(i) / 2);
+    }
+    write_wav(file, frames, 2, 48000);
+
+    WavFile wav(file);
+    REQUIRE(wav.channels() == 2);
+    REQUIRE(wav.samplerate() == 48000);
+    REQUIRE(wav.size() == 1000);
+
+    std::vector<float> out(10);
+    wav.read(500, out);
+    for (int i = 0; i < 10; i++) {
+      REQUIRE(out[i] == Approx((ramp(500 + i) + -ramp(500 + i) / 2) / 2 / 32768.f).margin(1e-4));
+    }
+    fs::remove(file);
+
+    REQUIRE_THROWS_AS(WavFile("/tmp/otto_wav_file_missing.wav"), WavFile::exception);
+  }
+
+  TEST_CASE ("SampleStreamer", "[dsp]") {
+    auto file = fs::path("/tmp/otto_sample_stream_test.wav");
+    constexpr int length = StreamedSample::head_frames + 50000;
+    std::vector<std::int16_t> frames(length);
+    for (int i = 0; i < length; i++) frames[i] = ramp(i);
+    write_wav(file, frames, 1);
+
+    StreamedSample sample(file);
+    REQUIRE(sample.size() == length);
+    REQUIRE(sample.head().size() == StreamedSample::head_frames);
+
+    SECTION ("Plays the whole sample, past the head") {
+      SampleStreamer streamer(1, 44100);
+      auto& stream = streamer.stream(0);
+      stream.start(sample, 1, false);
+      std::vector<float> out;
+      read_blocks(stream, length + 1000, out);
+      REQUIRE(stream.done());
+      REQUIRE(streamer.underruns() == 0);
+      for (int i = 0; i < length; i++) {
+        REQUIRE(out[i] == Approx(ramp(i) / 32768.f).margin(1e-5));
+      }
+      REQUIRE(out[length + 10] == 0);
+    }
+
+    SECTION ("Interpolates at other speeds, and loops") {
+      SampleStreamer streamer(2, 44100);
+      auto& stream = streamer.stream(1);
+      stream.start(sample, 1.5f, true);
+      std::vector<float> out;
+      read_blocks(stream, length, out);
+      REQUIRE(!stream.done());
+      REQUIRE(streamer.underruns() == 0);
+      for (int i = 0; i < int(out.size()); i++) {
+        double pos = std::fmod(i * 1.5, length);
+        int idx = pos;
+        float expected = ramp(idx) / 32768.f;
+        // The interpolation between the last and first frames, and the jumps in the ramp, are skipped
+        if (pos == idx) REQUIRE(out[i] == Approx(expected).margin(1e-5));
+      }
+    }
+
+    SECTION ("Underruns are played as silence, and counted") {
+      // A ring this small can not hold a block of this many frames
+      SampleStreamer streamer(1, 44100, 4096);
+      auto& stream = streamer.stream(0);
+      stream.start(sample, 1, false);
+      std::vector<float> block(StreamedSample::head_frames + 8192);
+      // The ring is filled as far as it goes, but that is not far enough
+      wait_until_ready(stream, StreamedSample::head_frames + 101);
+      REQUIRE(!stream.ready(block.size()));
+      stream.read(block);
+      REQUIRE(streamer.underruns() == 1);
+      REQUIRE(block.back() == 0);
+      REQUIRE(block[StreamedSample::head_frames + 100] != 0);
+    }
+
+    SECTION ("Samples in memory are played without streaming") {
+      auto audio = std::make_shared<std::vector<float>>(length);
+      for (int i = 0; i < length; i++) (*audio)[i] = ramp(i) / 32768.f;
+      StreamedSample in_memory(file, audio, 44100);
+      REQUIRE(in_memory.size() == length);
+      REQUIRE(in_memory.head().size() == length);
+      // A ring this small would underrun if the sample was streamed
+      SampleStreamer streamer(1, 44100, 4096);
+      auto& stream = streamer.stream(0);
+      stream.start(in_memory, 1, false);
+      std::vector<float> block(length);
+      stream.read(block);
+      REQUIRE(streamer.underruns() == 0);
+      REQUIRE(block[length - 1] == Approx(ramp(length - 1) / 32768.f).margin(1e-5));
+    }
+
+    fs::remove(file);
+  }
+
+  TEST_CASE ("SampleStreamer with locked memory", "[dsp]") {
+    // Much bigger than the ring. If the file was mapped, all of it would be locked into memory when it is opened
+    auto file = fs::path("/tmp/otto_sample_stream_locked_test.wav");
+    constexpr int length = 16 << 20;
+    {
+      std::vector<std::int16_t> frames(length);
+      for (int i = 0; i < length; i++) frames[i] = ramp(i);
+      write_wav(file, frames, 1);
+    }
+
+    // The worst case, where everything mapped from now on is locked as well. Without the privileges for that,
+    // the file is still streamed, but the locked memory can not be checked.
+    struct Lock {
+      bool locked = false;
+#if defined(__linux__)
+      Lock() : locked(mlockall(MCL_CURRENT | MCL_FUTURE) == 0) {}
+      // Unlocked even if an assertion fails, so other tests are not affected
+      ~Lock()
+      {
+        if (locked) munlockall();
+      }
+#endif
+    } lock;
+    const bool locked = lock.locked;
+    long locked_before = locked_kb();
+    {
+      StreamedSample sample(file);
+      REQUIRE(sample.size() == length);
+      constexpr int ring_frames = 4096;
+      SampleStreamer streamer(1, 44100, ring_frames);
+      auto& stream = streamer.stream(0);
+      stream.start(sample, 1, false);
+      std::vector<float> out;
+      read_blocks(stream, StreamedSample::head_frames + 8 * ring_frames, out);
+      REQUIRE(streamer.underruns() == 0);
+      for (int i = 0; i < int(out.size()); i++) {
+        REQUIRE(out[i] == Approx(ramp(i) / 32768.f).margin(1e-5));
+      }
+      if (locked) {
+        // The streamer thread stack and the ring are locked, but nowhere near the whole file
+        long file_kb = long(length) * 2 / 1024;
+        REQUIRE(locked_kb() - locked_before < file_kb / 2);
+      }
+    }
+    fs::remove(file);
+  }
+
+} // namespace otto::util::dsp
@@ -0,0 +1,64 @@
+#include "testing.t.hpp"
+
+#include "util/dsp/smoothed.hpp"
+
+namespace otto::util::dsp {
+
+  TEST_CASE ("dsp::Smoothed", "[dsp]") {
+    SECTION ("Linear ramps reach the target in the ramp length") {
+      Smoothed<> s = {0, 4};
+      s.set(1);
+      REQUIRE(s.is_ramping());
+      REQUIRE(s.next() == Approx(0.25));
+      REQUIRE(s.next() == Approx(0.5));
+      REQUIRE(s.next() == Approx(0.75));
+      REQUIRE(s.next() == 1);
+      REQUIRE(!s.is_ramping());
+      REQUIRE(s.next() == 1);
+    }
+
+    SECTION ("A new target starts a new ramp from the current value") {
+      Smoothed<> s = {0, 4};
+      s.set(1);
+      s.next();
+      s.next();
+      s.set(0);
+      REQUIRE(s.next() == Approx(0.375));
+      s.skip(10);
+      REQUIRE(s.current() == 0);
+    }
+
+    SECTION ("Exponential ramps move by a constant ratio") {
+      Smoothed<> s = {100, 4, Smoothed<>::Ramp::exponential};
+      s.set(1600);
+      REQUIRE(s.next() == Approx(200));
+      REQUIRE(s.next() == Approx(400));
+      REQUIRE(s.skip(1) == Approx(800));
+      REQUIRE(s.next() == 1600);
+    }
+
+    SECTION ("Exponential ramps through zero are linear") {
+      Smoothed<> s = {0, 2, Smoothed<>::Ramp::exponential};
+      s.set(1);
+      REQUIRE(s.next() == Approx(0.5));
+    }
+
+    SECTION ("skip matches calling next") {
+      Smoothed<> a = {0, 64};
+      Smoothed<> b = {0, 64};
+      a.set(1);
+      b.set(1);
+      for (int i = 0; i < 16; i++) a.next();
+      REQUIRE(b.skip(16) == Approx(a.current()));
+    }
+
+    SECTION ("jump sets the value without a ramp") {
+      Smoothed<> s = {0, 64};
+      s.set(1);
+      s.jump(0.5);
+      REQUIRE(!s.is_ramping());
+      REQUIRE(s.next() == 0.5);
+    }
+  }
+
+} // namespace otto::util::dsp
@@ -0,0 +1,121 @@
+#include "testing.t.hpp"
+
+#include <array>
+#include <cmath>
+#include <complex>
+
+#include "util/dsp/wavetable.hpp"
+
+namespace otto::util::dsp {
+
+  namespace {
+    /// Magnitude of harmonic `h` of the table
+    float harmonic(const float* table, int h)
+    {
+      constexpr int n = WavetablePyramid::table_size;
+      std::complex<double> sum = 0;
+      for (int k = 0; k < n; k++) sum += double(table[k]) * std::polar(1.0, -2 * M_PI * h * k / n);
+      return std::abs(sum) / n;
+    }
+
+    std::vector<float> saw(int length)
+    {
+      std::vector<float> res(length);
+      for (int i = 0; i < length; i++) res[i] = 2.f * i / length - 1.f;
+      return res;
+    }
+  } // namespace
+
+  TEST_CASE ("WavetablePyramid", "[dsp]") {
+    WavetablePyramid pyramid;
+    pyramid.add(saw(256));
+    pyramid.add(saw(3000));
+    REQUIRE(pyramid.size() == 2);
+
+    SECTION ("Each level has half the harmonics of the one below") {
+      for (int level : {3, 5, 8}) {
+        int limit = (WavetablePyramid::table_size / 2) >> level;
+        const float* table = pyramid.table(1, level);
+        REQUIRE(harmonic(table, limit) > 0.001);
+        REQUIRE(harmonic(table, limit + 1) < 1e-5);
+        REQUIRE(harmonic(table, 2 * limit) < 1e-5);
+      }
+    }
+
+    SECTION ("Tables are normalized, and followed by their first frame") {
+      for (int idx = 0; idx < pyramid.size(); idx++) {
+        const float* table = pyramid.table(idx, 0);
+        float peak = 0;
+        for (int i = 0; i < WavetablePyramid::table_size; i++) peak = std::max(peak, std::abs(table[i]));
+        REQUIRE(peak == Approx(1));
+        REQUIRE(table[WavetablePyramid::table_size] == table[0]);
+      }
+    }
+
+    SECTION ("The chosen level does not alias") {
+      REQUIRE(WavetablePyramid::level_for(1.f / 2048) == 0);
+      for (float freq : {55.f, 440.f, 3520.f, 12000.f}) {
+        float increment = freq / 48000.f;
+        int level = WavetablePyramid::level_for(increment);
+        int limit = (WavetablePyramid::table_size / 2) >> level;
+        REQUIRE(limit * freq <= 24000);
+        // And the level below would have aliased
+        if (level > 0) REQUIRE(2 * limit * freq > 24000);
+      }
+    }
+
+    SECTION ("Cache files") {
+      auto file = fs::path("/tmp/otto_wavetable_test.cache");
+      REQUIRE(pyramid.save_cache(file, 42));
+
+      WavetablePyramid loaded;
+      REQUIRE(!loaded.load_cache(file, 43));
+      REQUIRE(loaded.size() == 0);
+      REQUIRE(loaded.load_cache(file, 42));
+      REQUIRE(loaded.size() == 2);
+      for (int level = 0; level < WavetablePyramid::levels; level++) {
+        REQUIRE(std::equal(pyramid.table(1, level), pyramid.table(1, level) + WavetablePyramid::stride,
+                           loaded.table(1, level)));
+      }
+      fs::remove(file);
+    }
+
+    SECTION ("The vectorized kernel matches a plain interpolated read") {
+      const float* a = pyramid.table(0, 2);
+      const float* b = pyramid.table(1, 2);
+      constexpr int nframes = 67;
+      alignas(simd::vfloat::alignment) std::array<float, nframes> out;
+      float increment = 0.013f;
+      float phase = render_wavetable(a, b, 0.2f, 0.01f, 0.9f, increment, out.data(), nframes);
+
+      double ref_phase = 0.9;
+      for (int f = 0; f < nframes; f++) {
+        double pos = ref_phase * WavetablePyramid::table_size;
+        int i = int(pos);
+        float frac = pos - i;
+        float va = a[i] + frac * (a[i + 1] - a[i]);
+        float vb = b[i] + frac * (b[i + 1] - b[i]);
+        float morph = 0.2f + f * 0.01f;
+        REQUIRE(out[f] == Approx(va + morph * (vb - va)).margin(1e-3));
+        ref_phase = std::fmod(ref_phase + increment, 1.0);
+      }
+      REQUIRE(phase == Approx(ref_phase).margin(1e-4));
+    }
+
+    SECTION ("A fast morph stays within the tables' peak") {
+      const float* a = pyramid.table(0, 0);
+      const float* b = pyramid.table(1, 0);
+      constexpr int nframes = 67;
+      alignas(simd::vfloat::alignment) std::array<float, nframes> out;
+      // Without clamping, the morph would go well outside `[0, 1]` and extrapolate past both tables
+      for (float step : {0.08f, -0.08f}) {
+        render_wavetable(a, b, step > 0 ? -1.f : 2.f, step, 0.3f, 0.011f, out.data(), nframes);
+        for (int f = 0; f < nframes; f++) {
+          INFO("Step " << step << ", frame " << f);
+          REQUIRE(std::abs(out[f]) <= 1.f + 1e-4f);
+        }
+      }
+    }
+  }
+
+} // namespace otto::util::dsp
@@ -0,0 +1,39 @@
+#include "testing.t.hpp"
+
+#include <thread>
+
+#include "util/futex.hpp"
+
+namespace otto::util {
+
+  using namespace std::chrono_literals;
+
+  TEST_CASE ("futex", "[util]") {
+    std::atomic<std::uint32_t> word = 0;
+
+    SECTION ("A timed wait returns after the timeout") {
+      auto start = std::chrono::steady_clock::now();
+      futex_wait_for(word, 0, 5ms);
+      REQUIRE(std::chrono::steady_clock::now() - start >= 4ms);
+    }
+
+    SECTION ("A timed wait returns at once if the word is not the expected value") {
+      auto start = std::chrono::steady_clock::now();
+      futex_wait_for(word, 1, 1s);
+      REQUIRE(std::chrono::steady_clock::now() - start < 500ms);
+    }
+
+    SECTION ("A timed wait is woken") {
+      std::thread waker([&] {
+        std::this_thread::sleep_for(5ms);
+        word = 1;
+        futex_wake_all(word);
+      });
+      auto start = std::chrono::steady_clock::now();
+      while (word == 0) futex_wait_for(word, 0, 10s);
+      REQUIRE(std::chrono::steady_clock::now() - start < 5s);
+      waker.join();
+    }
+  }
+
+} // namespace otto::util
@@ -0,0 +1,61 @@
+#include "testing.t.hpp"
+
+#include <cerrno>
+#include <memory>
+#include <thread>
+
+#if defined(__linux__)
+#include <sys/mman.h>
+#endif
+
+#include "util/realtime.hpp"
+
+namespace otto::util {
+
+  TEST_CASE ("flush_denormals", "[util]") {
+    // The FPU modes are per thread, so this doesn't leak into other tests.
+    // Catch assertions are not thread safe, so the results are checked after the thread is done.
+    bool kept_before = false;
+    bool supported = false;
+    bool flushed = false;
+    bool flushed_to_zero = false;
+    std::thread([&] {
+      volatile float denormal = 1e-39f;
+      kept_before = denormal * 1.f != 0.f;
+      supported = flush_denormals();
+      if (!supported) return;
+      flushed = denormals_flushed();
+      flushed_to_zero = denormal * 1.f == 0.f;
+    }).join();
+    REQUIRE(kept_before);
+    if (!supported) return;
+    REQUIRE(flushed);
+    REQUIRE(flushed_to_zero);
+  }
+
+  TEST_CASE ("lock_range", "[util]") {
+#if defined(__linux__)
+    // Small enough for the default memlock limit, so this works without CAP_IPC_LOCK
+    constexpr std::size_t size = 8192;
+    auto mem = std::make_unique<char[]>(size);
+    REQUIRE(lock_range(mem.get(), size) == 0);
+    munlock(mem.get(), size);
+    // The error is returned, not just a flag
+    REQUIRE(lock_range(reinterpret_cast<void*>(4096), 4096) == ENOMEM);
+#else
+    REQUIRE(lock_range(nullptr, 0) == ENOSYS);
+#endif
+  }
+
+  TEST_CASE ("thread_resource_usage", "[util]") {
+#if defined(__linux__)
+    auto before = thread_resource_usage::get();
+    constexpr std::size_t size = 16 << 20;
+    auto mem = std::make_unique<char[]>(size);
+    for (std::size_t i = 0; i < size; i += 4096) mem[i] = 1;
+    auto after = thread_resource_usage::get();
+    REQUIRE(after.page_faults > before.page_faults);
+#endif
+  }
+
+} // namespace otto::util
@@ -0,0 +1,89 @@
+#include "testing.t.hpp"
+
+#include <array>
+#include <atomic>
+#include <set>
+#include <thread>
+
+#include "util/realtime_worker_pool.hpp"
+
+namespace otto::util {
+
+  namespace {
+    realtime_worker_pool::config test_config(int workers)
+    {
+      realtime_worker_pool::config cfg;
+      cfg.workers = workers;
+      // Tests run without realtime privileges
+      cfg.priority = 0;
+      cfg.first_cpu = -1;
+      return cfg;
+    }
+  } // namespace
+
+  TEST_CASE ("realtime_worker_pool", "[util]") {
+    SECTION ("Without workers, tasks run on the calling thread in order") {
+      realtime_worker_pool pool{test_config(0)};
+      std::vector<int> calls;
+      pool.run(4, [&](int i) noexcept { calls.push_back(i); });
+      REQUIRE(calls == std::vector<int>{0, 1, 2, 3});
+    }
+
+    SECTION ("Each task runs exactly once per call") {
+      realtime_worker_pool pool{test_config(3)};
+      REQUIRE(pool.worker_count() == 3);
+      std::array<std::atomic_int, 16> counts = {};
+      for (int round = 0; round < 1000; round++) {
+        pool.run(counts.size(), [&](int i) noexcept { counts[i]++; });
+        // run has returned, so all tasks must be done
+        for (auto& c : counts) REQUIRE(c == round + 1);
+      }
+    }
+
+    SECTION ("Tasks are spread over multiple threads") {
+      realtime_worker_pool pool{test_config(1)};
+      std::array<std::thread::id, 2> ids;
+      std::atomic_int arrived = 0;
+      // Each task waits for the other, so they must run at the same time
+      pool.run(2, [&](int i) noexcept {
+        ids[i] = std::this_thread::get_id();
+        arrived++;
+        while (arrived < 2) std::this_thread::yield();
+      });
+      REQUIRE(ids[0] != ids[1]);
+    }
+
+    SECTION ("Workers that have gone to sleep are woken up") {
+      auto cfg = test_config(2);
+      cfg.spin_iterations = 1;
+      realtime_worker_pool pool{cfg};
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+      std::atomic_int sum = 0;
+      pool.run(8, [&](int i) noexcept { sum += i; });
+      REQUIRE(sum == 28);
+    }
+
+    SECTION ("Workers are pinned to their own cores, but never to the core of the calling thread") {
+      realtime_worker_pool::config cfg;
+      cfg.first_cpu = 1;
+      auto cpus = [&](int workers, int cores) {
+        std::vector<int> res;
+        for (int i = 0; i < workers; i++) res.push_back(realtime_worker_pool::worker_cpu(cfg, i, cores));
+        return res;
+      };
+      REQUIRE(cpus(3, 4) == std::vector<int>{1, 2, 3});
+      cfg.avoid_cpu = 2;
+      REQUIRE(cpus(3, 4) == std::vector<int>{1, 3, 0});
+      cfg.avoid_cpu = 1;
+      REQUIRE(cpus(3, 4) == std::vector<int>{2, 3, 0});
+      // More workers than cores share them
+      REQUIRE(cpus(4, 2) == std::vector<int>{0, 0, 0, 0});
+      // Only the avoided core is left
+      cfg.avoid_cpu = 0;
+      REQUIRE(cpus(1, 1) == std::vector<int>{-1});
+      cfg.first_cpu = -1;
+      REQUIRE(cpus(2, 4) == std::vector<int>{-1, -1});
+    }
+  }
+
+} // namespace otto::util
@@ -0,0 +1,21 @@
+#include "testing.t.hpp"
+
+#include "util/simd.hpp"
+
+namespace otto::util::simd {
+
+  TEST_CASE ("simd::interleave", "[util]") {
+    // An odd length with unaligned pointers exercises both the vector loop and the tail
+    std::vector<float> l(37), r(37), out(2 * 37 + 1);
+    for (int i = 0; i < 37; i++) {
+      l[i] = i;
+      r[i] = -i;
+    }
+    interleave(l.data() + 1, r.data() + 1, out.data() + 1, 36);
+    for (int i = 0; i < 36; i++) {
+      REQUIRE(out[1 + 2 * i] == i + 1);
+      REQUIRE(out[2 + 2 * i] == -(i + 1));
+    }
+  }
+
+} // namespace otto::util::simd